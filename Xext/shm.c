@@ -106,6 +106,11 @@ static void SShmCompletionEvent(xShmCompletionEvent *from,
 
 static Bool ShmDestroyPixmap(PixmapPtr pPixmap);
 
+#ifdef SHM_FD_PASSING
+static void ShmCacheMapping(ShmDescPtr shmdesc);
+static void ShmFlushMappings(Bool all);
+#endif
+
 static unsigned char ShmReqCode;
 int ShmCompletionCode;
 int BadShmSegCode;
@@ -232,6 +237,9 @@ ShmResetProc(ExtensionEntry * extEntry)
 
     for (i = 0; i < screenInfo.numScreens; i++)
         ShmRegisterFuncs(screenInfo.screens[i], NULL);
+#ifdef SHM_FD_PASSING
+    ShmFlushMappings(TRUE);
+#endif
 }
 
 void
@@ -435,9 +443,13 @@ ShmDetachSegment(void *value, /* must conform to DeleteType */
         return TRUE;
 #if SHM_FD_PASSING
     if (shmdesc->is_fd) {
-        if (shmdesc->busfault)
+        /* a segment the client truncated isn't worth keeping */
+        if (shmdesc->busfault) {
             busfault_unregister(shmdesc->busfault);
-        munmap(shmdesc->addr, shmdesc->size);
+            ShmCacheMapping(shmdesc);
+        }
+        else
+            munmap(shmdesc->addr, shmdesc->size);
     } else
 #endif
         shmdt(shmdesc->addr);
@@ -1133,6 +1145,141 @@ ShmBusfaultNotify(void *context)
     FreeResource (shmdesc->resource, RT_NONE);
 }
 
+/*
+ * Read-only mappings of fd segments are kept for a little while after the
+ * last detach, so a client attaching the same memfd again doesn't have to
+ * map it and fault its pages in all over again.  The fd is new each time,
+ * so mappings are found by the device and inode of the file; holding the
+ * mapping keeps the file, and so the inode number, from being reused.
+ *
+ * Writable mappings aren't kept: reusing one would skip the checks mmap
+ * makes against the new fd's access mode and seals, and holding one would
+ * stop the client from sealing the file against writes.
+ */
+#define SHM_MAP_CACHE_SIZE      8
+#define SHM_MAP_CACHE_BYTES     (64 << 20)
+#define SHM_MAP_CACHE_AGE       2000    /* milliseconds */
+
+/* Segments at least this big are worth backing with huge pages */
+#define SHM_HUGE_PAGE_SIZE      (2 << 20)
+
+typedef struct _ShmMapping {
+    char *addr;
+    unsigned long size;
+    dev_t dev;
+    ino_t ino;
+    CARD32 time;
+} ShmMappingRec;
+
+static ShmMappingRec ShmMapCache[SHM_MAP_CACHE_SIZE];
+static int ShmMapCacheCount;
+static unsigned long ShmMapCacheBytes;
+static OsTimerPtr ShmMapCacheTimer;
+
+static void
+ShmUncacheMapping(int i, Bool unmap)
+{
+    if (unmap)
+        munmap(ShmMapCache[i].addr, ShmMapCache[i].size);
+    ShmMapCacheBytes -= ShmMapCache[i].size;
+    ShmMapCache[i] = ShmMapCache[--ShmMapCacheCount];
+}
+
+static void
+ShmFlushMappings(Bool all)
+{
+    CARD32 now = GetTimeInMillis();
+    int i;
+
+    for (i = ShmMapCacheCount; i--;)
+        if (all || now - ShmMapCache[i].time >= SHM_MAP_CACHE_AGE)
+            ShmUncacheMapping(i, TRUE);
+    if (!ShmMapCacheCount)
+        TimerCancel(ShmMapCacheTimer);
+}
+
+static CARD32
+ShmExpireMappings(OsTimerPtr timer, CARD32 now, void *arg)
+{
+    ShmFlushMappings(FALSE);
+    return ShmMapCacheCount ? SHM_MAP_CACHE_AGE : 0;
+}
+
+static void
+ShmCacheMapping(ShmDescPtr shmdesc)
+{
+    if (shmdesc->writable || shmdesc->size > SHM_MAP_CACHE_BYTES) {
+        munmap(shmdesc->addr, shmdesc->size);
+        return;
+    }
+
+    while (ShmMapCacheCount == SHM_MAP_CACHE_SIZE ||
+           ShmMapCacheBytes + shmdesc->size > SHM_MAP_CACHE_BYTES) {
+        int i, oldest = 0;
+
+        for (i = 1; i < ShmMapCacheCount; i++)
+            if ((INT32) (ShmMapCache[i].time - ShmMapCache[oldest].time) < 0)
+                oldest = i;
+        ShmUncacheMapping(oldest, TRUE);
+    }
+
+    if (!ShmMapCacheCount) {
+        ShmMapCacheTimer = TimerSet(ShmMapCacheTimer, 0, SHM_MAP_CACHE_AGE,
+                                    ShmExpireMappings, NULL);
+        if (!ShmMapCacheTimer) {
+            munmap(shmdesc->addr, shmdesc->size);
+            return;
+        }
+    }
+
+    ShmMapCache[ShmMapCacheCount] = (ShmMappingRec) {
+        .addr = shmdesc->addr,
+        .size = shmdesc->size,
+        .dev = shmdesc->dev,
+        .ino = shmdesc->ino,
+        .time = GetTimeInMillis(),
+    };
+    ShmMapCacheCount++;
+    ShmMapCacheBytes += shmdesc->size;
+}
+
+/*
+ * Map the file behind 'fd', reusing a cached mapping of it for a read-only
+ * attachment if there is one of the same size and the fd can be read
+ */
+static char *
+ShmMapFd(int fd, struct stat *statb, Bool writable)
+{
+    char *addr;
+    int i, flags;
+
+    if (!writable && (flags = fcntl(fd, F_GETFL)) != -1 &&
+        (flags & O_ACCMODE) != O_WRONLY) {
+        for (i = 0; i < ShmMapCacheCount; i++) {
+            if (ShmMapCache[i].dev == statb->st_dev &&
+                ShmMapCache[i].ino == statb->st_ino &&
+                ShmMapCache[i].size == (unsigned long) statb->st_size) {
+                addr = ShmMapCache[i].addr;
+                ShmUncacheMapping(i, FALSE);
+                return addr;
+            }
+        }
+    }
+
+    addr = mmap(NULL, statb->st_size,
+                writable ? PROT_READ|PROT_WRITE : PROT_READ,
+                MAP_SHARED,
+                fd, 0);
+#ifdef MADV_HUGEPAGE
+    /* MAP_HUGETLB only works on hugetlbfs, but shmem can use
+     * transparent huge pages if it's asked to
+     */
+    if (addr != ((char *) -1) && statb->st_size >= SHM_HUGE_PAGE_SIZE)
+        (void) madvise(addr, statb->st_size, MADV_HUGEPAGE);
+#endif
+    return addr;
+}
+
 static int
 ProcShmAttachFd(ClientPtr client)
 {
@@ -1163,10 +1310,7 @@ ProcShmAttachFd(ClientPtr client)
         return BadAlloc;
     }
     shmdesc->is_fd = TRUE;
-    shmdesc->addr = mmap(NULL, statb.st_size,
-                         stuff->readOnly ? PROT_READ : PROT_READ|PROT_WRITE,
-                         MAP_SHARED,
-                         fd, 0);
+    shmdesc->addr = ShmMapFd(fd, &statb, !stuff->readOnly);
 
     close(fd);
     if (shmdesc->addr == ((char *) -1)) {
@@ -1178,6 +1322,8 @@ ProcShmAttachFd(ClientPtr client)
     shmdesc->writable = !stuff->readOnly;
     shmdesc->size = statb.st_size;
     shmdesc->resource = stuff->shmseg;
+    shmdesc->dev = statb.st_dev;
+    shmdesc->ino = statb.st_ino;
 
     shmdesc->busfault = busfault_register_mmap(shmdesc->addr, shmdesc->size, ShmBusfaultNotify, shmdesc);
     if (!shmdesc->busfault) {
@@ -1228,6 +1374,7 @@ ProcShmCreateSegment(ClientPtr client)
 {
     int fd;
     ShmDescPtr shmdesc;
+    struct stat statb;
     REQUEST(xShmCreateSegmentReq);
     xShmCreateSegmentReply rep = {
         .type = X_Reply,
@@ -1244,7 +1391,7 @@ ProcShmCreateSegment(ClientPtr client)
     fd = shm_tmpfile();
     if (fd < 0)
         return BadAlloc;
-    if (ftruncate(fd, stuff->size) < 0) {
+    if (ftruncate(fd, stuff->size) < 0 || fstat(fd, &statb) < 0) {
         close(fd);
         return BadAlloc;
     }
@@ -1254,10 +1401,7 @@ ProcShmCreateSegment(ClientPtr client)
         return BadAlloc;
     }
     shmdesc->is_fd = TRUE;
-    shmdesc->addr = mmap(NULL, stuff->size,
-                         stuff->readOnly ? PROT_READ : PROT_READ|PROT_WRITE,
-                         MAP_SHARED,
-                         fd, 0);
+    shmdesc->addr = ShmMapFd(fd, &statb, !stuff->readOnly);
 
     if (shmdesc->addr == ((char *) -1)) {
         close(fd);
@@ -1268,6 +1412,8 @@ ProcShmCreateSegment(ClientPtr client)
     shmdesc->refcnt = 1;
     shmdesc->writable = !stuff->readOnly;
     shmdesc->size = stuff->size;
+    shmdesc->dev = statb.st_dev;
+    shmdesc->ino = statb.st_ino;
 
     shmdesc->busfault = busfault_register_mmap(shmdesc->addr, shmdesc->size, ShmBusfaultNotify, shmdesc);
     if (!shmdesc->busfault) {
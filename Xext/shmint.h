@@ -71,6 +71,8 @@ typedef struct _ShmDesc {
     Bool is_fd;
     struct busfault *busfault;
     XID resource;
+    dev_t dev;                  /* identify the file behind the fd */
+    ino_t ino;
 #endif
 } ShmDescRec, *ShmDescPtr;
 
@@ -18,6 +18,7 @@
 #include "swaprep.h"
 #include "registry.h"
 #include <X11/extensions/XResproto.h>
+#include "xresstats.h"
 #include "pixmapstr.h"
 #include "windowstr.h"
 #include "gcstruct.h"
@@ -984,6 +985,162 @@ ProcXResQueryResourceBytes (ClientPtr client)
     return rc;
 }
 
+/** @brief Implements XResQueryServerStats: reports the named counters
+           collected with CollectServerStatistics(). */
+static int
+ProcXResQueryServerStats(ClientPtr client)
+{
+    xXResQueryServerStatsReply rep;
+    ServerStatisticsPtr stats;
+    xXResServerStat *stat;
+    char *buf, *p;
+    int i, len, bytes = 0;
+
+    REQUEST_SIZE_MATCH(xXResQueryServerStatsReq);
+
+    stats = CollectServerStatistics();
+    if (!stats)
+        return BadAlloc;
+
+    for (i = 0; i < stats->num; i++)
+        bytes += sz_xXResServerStat + pad_to_int32(strlen(stats->stats[i].name));
+
+    buf = calloc(1, bytes + 1);
+    if (!buf) {
+        FreeServerStatistics(stats);
+        return BadAlloc;
+    }
+
+    for (i = 0, p = buf; i < stats->num; i++) {
+        len = strlen(stats->stats[i].name);
+        stat = (xXResServerStat *) p;
+        stat->valueHi = stats->stats[i].value >> 32;
+        stat->valueLo = stats->stats[i].value & 0xffffffff;
+        stat->nameLength = len;
+        if (client->swapped) {
+            swapl(&stat->valueHi);
+            swapl(&stat->valueLo);
+            swaps(&stat->nameLength);
+        }
+        memcpy(p + sz_xXResServerStat, stats->stats[i].name, len);
+        p += sz_xXResServerStat + pad_to_int32(len);
+    }
+
+    rep = (xXResQueryServerStatsReply) {
+        .type = X_Reply,
+        .sequenceNumber = client->sequence,
+        .length = bytes_to_int32(bytes),
+        .numStats = stats->num
+    };
+    FreeServerStatistics(stats);
+
+    if (client->swapped) {
+        swaps(&rep.sequenceNumber);
+        swapl(&rep.length);
+        swapl(&rep.numStats);
+    }
+    WriteToClient(client, sizeof(rep), &rep);
+    if (bytes)
+        WriteToClientRef(client, bytes, buf, free, buf);
+    else
+        free(buf);
+    return Success;
+}
+
+static char *
+FillDispatchStats(char *p, CARD32 id, DispatchStatsPtr stats,
+                  ClientPtr pClient)
+{
+    xXResDispatchStats *entry = (xXResDispatchStats *) p;
+    CARD32 *histogram = (CARD32 *) (p + sz_xXResDispatchStats);
+    int i;
+
+    entry->id = id;
+    entry->requestsHi = stats->requests >> 32;
+    entry->requestsLo = stats->requests & 0xffffffff;
+    entry->timeHi = stats->time >> 32;
+    entry->timeLo = stats->time & 0xffffffff;
+    if (pClient) {
+        entry->priority = pClient->smart_priority;
+        entry->slicesHi = pClient->smart_slices >> 32;
+        entry->slicesLo = pClient->smart_slices & 0xffffffff;
+        entry->expiredHi = pClient->smart_expired >> 32;
+        entry->expiredLo = pClient->smart_expired & 0xffffffff;
+    }
+    for (i = 0; i < DISPATCH_HISTOGRAM_BUCKETS; i++)
+        histogram[i] = stats->histogram[i];
+
+    return p + sz_xXResDispatchStats + DISPATCH_HISTOGRAM_BUCKETS * 4;
+}
+
+/** @brief Implements XResQueryDispatchStats: request counts, dispatch
+           time and latency histograms per client or per major opcode. */
+static int
+ProcXResQueryDispatchStats(ClientPtr client)
+{
+    REQUEST(xXResQueryDispatchStatsReq);
+    xXResQueryDispatchStatsReply rep;
+    const int entrySize = sz_xXResDispatchStats + DISPATCH_HISTOGRAM_BUCKETS * 4;
+    int i, count = 0, bytes;
+    char *buf, *p;
+
+    REQUEST_SIZE_MATCH(xXResQueryDispatchStatsReq);
+
+    if (stuff->what == XResDispatchStatsClients) {
+        for (i = 0; i < currentMaxClients; i++)
+            if (clients[i] && clients[i]->dispatchStats.requests)
+                count++;
+    }
+    else if (stuff->what == XResDispatchStatsRequests) {
+        for (i = 0; i < ARRAY_SIZE(MajorDispatchStats); i++)
+            if (MajorDispatchStats[i].requests)
+                count++;
+    }
+    else {
+        client->errorValue = stuff->what;
+        return BadValue;
+    }
+
+    bytes = count * entrySize;
+    buf = p = calloc(1, bytes + 1);
+    if (!buf)
+        return BadAlloc;
+
+    if (stuff->what == XResDispatchStatsClients) {
+        for (i = 0; i < currentMaxClients; i++)
+            if (clients[i] && clients[i]->dispatchStats.requests)
+                p = FillDispatchStats(p, clients[i]->clientAsMask,
+                                      &clients[i]->dispatchStats, clients[i]);
+    }
+    else {
+        for (i = 0; i < ARRAY_SIZE(MajorDispatchStats); i++)
+            if (MajorDispatchStats[i].requests)
+                p = FillDispatchStats(p, i, &MajorDispatchStats[i], NULL);
+    }
+
+    rep = (xXResQueryDispatchStatsReply) {
+        .type = X_Reply,
+        .sequenceNumber = client->sequence,
+        .length = bytes_to_int32(bytes),
+        .numEntries = count,
+        .numBuckets = DISPATCH_HISTOGRAM_BUCKETS
+    };
+    if (client->swapped) {
+        swaps(&rep.sequenceNumber);
+        swapl(&rep.length);
+        swapl(&rep.numEntries);
+        swapl(&rep.numBuckets);
+        /* every field of the entries is 32 bits wide */
+        SwapLongs((CARD32 *) buf, bytes_to_int32(bytes));
+    }
+    WriteToClient(client, sizeof(rep), &rep);
+    if (bytes)
+        WriteToClientRef(client, bytes, buf, free, buf);
+    else
+        free(buf);
+    return Success;
+}
+
 static int
 ProcResDispatch(ClientPtr client)
 {
@@ -1001,6 +1158,10 @@ ProcResDispatch(ClientPtr client)
         return ProcXResQueryClientIds(client);
     case X_XResQueryResourceBytes:
         return ProcXResQueryResourceBytes(client);
+    case X_XResQueryServerStats:
+        return ProcXResQueryServerStats(client);
+    case X_XResQueryDispatchStats:
+        return ProcXResQueryDispatchStats(client);
     default: break;
     }
 
@@ -1064,6 +1225,16 @@ SProcXResQueryResourceBytes (ClientPtr client)
     return ProcXResQueryResourceBytes(client);
 }
 
+static int
+SProcXResQueryDispatchStats(ClientPtr client)
+{
+    REQUEST(xXResQueryDispatchStatsReq);
+
+    REQUEST_SIZE_MATCH(xXResQueryDispatchStatsReq);
+    swapl(&stuff->what);
+    return ProcXResQueryDispatchStats(client);
+}
+
 static int
 SProcResDispatch (ClientPtr client)
 {
@@ -1083,6 +1254,10 @@ SProcResDispatch (ClientPtr client)
         return SProcXResQueryClientIds(client);
     case X_XResQueryResourceBytes:
         return SProcXResQueryResourceBytes(client);
+    case X_XResQueryServerStats:   /* nothing to swap */
+        return ProcXResQueryServerStats(client);
+    case X_XResQueryDispatchStats:
+        return SProcXResQueryDispatchStats(client);
     default: break;
     }
 
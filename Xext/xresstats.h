@@ -0,0 +1,111 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _XRESSTATS_H_
+#define _XRESSTATS_H_
+
+/*
+ * Server-side additions to X-Resource 1.2 for inspecting the server
+ * itself rather than its clients.  Clients probe for them by issuing the
+ * request; servers without them answer BadRequest.
+ */
+
+#define X_XResQueryServerStats		6
+
+typedef struct {
+    CARD8 reqType;
+    CARD8 XResReqType;
+    CARD16 length;
+} xXResQueryServerStatsReq;
+#define sz_xXResQueryServerStatsReq	4
+
+typedef struct {
+    CARD8 type;
+    CARD8 pad1;
+    CARD16 sequenceNumber;
+    CARD32 length;
+    CARD32 numStats;
+    CARD32 pad2;
+    CARD32 pad3;
+    CARD32 pad4;
+    CARD32 pad5;
+    CARD32 pad6;
+} xXResQueryServerStatsReply;
+#define sz_xXResQueryServerStatsReply	32
+
+/* The reply is followed by numStats of these, each followed by its
+ * name padded to a multiple of 4 bytes */
+typedef struct {
+    CARD32 valueHi;
+    CARD32 valueLo;
+    CARD16 nameLength;
+    CARD16 pad;
+} xXResServerStat;
+#define sz_xXResServerStat		12
+
+#define X_XResQueryDispatchStats	7
+
+/* values for xXResQueryDispatchStatsReq.what */
+#define XResDispatchStatsClients	0
+#define XResDispatchStatsRequests	1
+
+typedef struct {
+    CARD8 reqType;
+    CARD8 XResReqType;
+    CARD16 length;
+    CARD32 what;
+} xXResQueryDispatchStatsReq;
+#define sz_xXResQueryDispatchStatsReq	8
+
+typedef struct {
+    CARD8 type;
+    CARD8 pad1;
+    CARD16 sequenceNumber;
+    CARD32 length;
+    CARD32 numEntries;
+    CARD32 numBuckets;
+    CARD32 pad2;
+    CARD32 pad3;
+    CARD32 pad4;
+    CARD32 pad5;
+} xXResQueryDispatchStatsReply;
+#define sz_xXResQueryDispatchStatsReply	32
+
+/* The reply is followed by numEntries of these, one per client with
+ * requests dispatched or one per major opcode used, each followed by
+ * numBuckets CARD32s of latency histogram.  Bucket 0 counts requests
+ * taking less than a microsecond, bucket n those taking less than
+ * 2^n microseconds; the last bucket holds everything slower. */
+typedef struct {
+    CARD32 id;                  /* client resource base or major opcode */
+    INT32 priority;             /* scheduler priority, clients only */
+    CARD32 requestsHi;
+    CARD32 requestsLo;
+    CARD32 timeHi;              /* microseconds spent dispatching */
+    CARD32 timeLo;
+    CARD32 slicesHi;            /* times scheduled, clients only */
+    CARD32 slicesLo;
+    CARD32 expiredHi;           /* slices used up, clients only */
+    CARD32 expiredLo;
+} xXResDispatchStats;
+#define sz_xXResDispatchStats		40
+
+#endif                          /* _XRESSTATS_H_ */
@@ -61,10 +61,18 @@ compBlockHandler(ScreenPtr pScreen, void *pTimeout)
 
     pScreen->BlockHandler = cs->BlockHandler;
     compScreenUpdate(pScreen);
+    compTrimPixmapPool(pScreen, FALSE);
     (*pScreen->BlockHandler) (pScreen, pTimeout);
 
     /* Next damage will restore the block handler */
     cs->BlockHandler = NULL;
+
+    /* Unless there are pooled pixmaps waiting to be freed */
+    if (cs->numPooledPixmaps) {
+        AdjustWaitForDelay(pTimeout, COMP_PIXMAP_POOL_AGE);
+        cs->BlockHandler = pScreen->BlockHandler;
+        pScreen->BlockHandler = compBlockHandler;
+    }
 }
 
 static void
@@ -309,7 +317,7 @@ compFreeClientWindow(WindowPtr pWin, XID id)
 
     if (pPixmap) {
         compRestoreWindow(pWin, pPixmap);
-        (*pScreen->DestroyPixmap) (pPixmap);
+        compReleasePixmap(pScreen, pPixmap);
     }
 }
 
@@ -526,6 +534,122 @@ compUnredirectOneSubwindow(WindowPtr pParent, WindowPtr pWin)
     return Success;
 }
 
+static size_t
+compPixmapBytes(PixmapPtr pPixmap)
+{
+    return (size_t) pPixmap->drawable.width * pPixmap->drawable.height *
+        pPixmap->drawable.bitsPerPixel / 8;
+}
+
+static void
+compUnpoolPixmap(CompScreenPtr cs, int i)
+{
+    cs->pooledPixmapBytes -= compPixmapBytes(cs->pixmapPool[i].pPixmap);
+    cs->pixmapPool[i] = cs->pixmapPool[--cs->numPooledPixmaps];
+}
+
+/*
+ * Free pooled pixmaps which haven't been reused for a while, or all of
+ * them
+ */
+void
+compTrimPixmapPool(ScreenPtr pScreen, Bool all)
+{
+    CompScreenPtr cs = GetCompScreen(pScreen);
+    CARD32 now = GetTimeInMillis();
+    int i;
+
+    for (i = cs->numPooledPixmaps; i--;) {
+        PixmapPtr pPixmap = cs->pixmapPool[i].pPixmap;
+
+        if (all || now - cs->pixmapPool[i].time >= COMP_PIXMAP_POOL_AGE) {
+            compUnpoolPixmap(cs, i);
+            (*pScreen->DestroyPixmap) (pPixmap);
+        }
+    }
+}
+
+/*
+ * Done with a backing pixmap.  Keep it for another window of the same
+ * size if nothing else holds a reference and it fits in the pool,
+ * freeing the oldest pooled pixmaps to make room.
+ */
+void
+compReleasePixmap(ScreenPtr pScreen, PixmapPtr pPixmap)
+{
+    CompScreenPtr cs = GetCompScreen(pScreen);
+    size_t bytes = compPixmapBytes(pPixmap);
+
+    if (pPixmap->refcnt != 1 || bytes > COMP_PIXMAP_POOL_BYTES) {
+        (*pScreen->DestroyPixmap) (pPixmap);
+        return;
+    }
+
+    while (cs->numPooledPixmaps == COMP_PIXMAP_POOL_SIZE ||
+           cs->pooledPixmapBytes + bytes > COMP_PIXMAP_POOL_BYTES) {
+        PixmapPtr pOldest;
+        int i, oldest = 0;
+
+        for (i = 1; i < cs->numPooledPixmaps; i++)
+            if ((INT32) (cs->pixmapPool[i].time -
+                         cs->pixmapPool[oldest].time) < 0)
+                oldest = i;
+        pOldest = cs->pixmapPool[oldest].pPixmap;
+        compUnpoolPixmap(cs, oldest);
+        (*pScreen->DestroyPixmap) (pOldest);
+    }
+
+    cs->pixmapPool[cs->numPooledPixmaps].pPixmap = pPixmap;
+    cs->pixmapPool[cs->numPooledPixmaps].time = GetTimeInMillis();
+    cs->numPooledPixmaps++;
+    cs->pooledPixmapBytes += bytes;
+
+    /* make sure the block handler is around to age it out */
+    if (!cs->BlockHandler) {
+        cs->BlockHandler = pScreen->BlockHandler;
+        pScreen->BlockHandler = compBlockHandler;
+    }
+}
+
+/*
+ * A pooled pixmap still holds the contents of the window it last backed,
+ * and the copy from the parent in compNewPixmap only covers what the
+ * parent shows, so clear it before handing it to another window.
+ */
+static PixmapPtr
+compTakePooledPixmap(ScreenPtr pScreen, int w, int h, int depth)
+{
+    CompScreenPtr cs = GetCompScreen(pScreen);
+    int i;
+
+    for (i = cs->numPooledPixmaps; i--;) {
+        PixmapPtr pPixmap = cs->pixmapPool[i].pPixmap;
+
+        if (pPixmap->drawable.width == w && pPixmap->drawable.height == h &&
+            pPixmap->drawable.depth == depth) {
+            GCPtr pGC = GetScratchGC(depth, pScreen);
+            xRectangle rect = { 0, 0, w, h };
+            ChangeGCVal val;
+
+            compUnpoolPixmap(cs, i);
+            if (!pGC) {
+                (*pScreen->DestroyPixmap) (pPixmap);
+                break;
+            }
+            pPixmap->drawable.serialNumber = NEXT_SERIAL_NUMBER;
+            val.val = GXclear;
+            ChangeGC(NullClient, pGC, GCFunction, &val);
+            ValidateGC(&pPixmap->drawable, pGC);
+            (*pGC->ops->PolyFillRect) (&pPixmap->drawable, pGC, 1, &rect);
+            FreeScratchGC(pGC);
+            cs->pixmapPoolHits++;
+            return pPixmap;
+        }
+    }
+    cs->pixmapPoolMisses++;
+    return NULL;
+}
+
 static PixmapPtr
 compNewPixmap(WindowPtr pWin, int x, int y, int w, int h)
 {
@@ -533,8 +657,11 @@ compNewPixmap(WindowPtr pWin, int x, int y, int w, int h)
     WindowPtr pParent = pWin->parent;
     PixmapPtr pPixmap;
 
-    pPixmap = (*pScreen->CreatePixmap) (pScreen, w, h, pWin->drawable.depth,
-                                        CREATE_PIXMAP_USAGE_BACKING_PIXMAP);
+    pPixmap = compTakePooledPixmap(pScreen, w, h, pWin->drawable.depth);
+    if (!pPixmap)
+        pPixmap = (*pScreen->CreatePixmap) (pScreen, w, h,
+                                            pWin->drawable.depth,
+                                            CREATE_PIXMAP_USAGE_BACKING_PIXMAP);
 
     if (!pPixmap)
         return 0;
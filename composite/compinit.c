@@ -52,13 +52,33 @@ DevPrivateKeyRec CompScreenPrivateKeyRec;
 DevPrivateKeyRec CompWindowPrivateKeyRec;
 DevPrivateKeyRec CompSubwindowsPrivateKeyRec;
 
+static void
+compReportStatistics(CallbackListPtr *pcbl, void *data, void *call_data)
+{
+    ScreenPtr pScreen = data;
+    CompScreenPtr cs = GetCompScreen(pScreen);
+    ServerStatisticsPtr stats = call_data;
+    char name[64];
+
+    snprintf(name, sizeof(name), "composite.%d.pool.hit", pScreen->myNum);
+    AddServerStatistic(stats, name, cs->pixmapPoolHits);
+    snprintf(name, sizeof(name), "composite.%d.pool.miss", pScreen->myNum);
+    AddServerStatistic(stats, name, cs->pixmapPoolMisses);
+    snprintf(name, sizeof(name), "composite.%d.pool.pixmaps", pScreen->myNum);
+    AddServerStatistic(stats, name, cs->numPooledPixmaps);
+    snprintf(name, sizeof(name), "composite.%d.pool.bytes", pScreen->myNum);
+    AddServerStatistic(stats, name, cs->pooledPixmapBytes);
+}
+
 static Bool
 compCloseScreen(ScreenPtr pScreen)
 {
     CompScreenPtr cs = GetCompScreen(pScreen);
     Bool ret;
 
+    DeleteCallback(&ServerStatisticsCallback, compReportStatistics, pScreen);
     free(cs->alternateVisuals);
+    compTrimPixmapPool(pScreen, TRUE);
 
     pScreen->CloseScreen = cs->CloseScreen;
     pScreen->InstallColormap = cs->InstallColormap;
@@ -395,6 +415,11 @@ compScreenInit(ScreenPtr pScreen)
     cs->numImplicitRedirectExceptions = 0;
     cs->implicitRedirectExceptions = NULL;
 
+    cs->numPooledPixmaps = 0;
+    cs->pooledPixmapBytes = 0;
+    cs->pixmapPoolHits = 0;
+    cs->pixmapPoolMisses = 0;
+
     if (!compAddAlternateVisuals(pScreen, cs)) {
         free(cs);
         return FALSE;
@@ -461,6 +486,8 @@ compScreenInit(ScreenPtr pScreen)
 
     dixSetPrivate(&pScreen->devPrivates, CompScreenPrivateKey, cs);
 
+    AddCallback(&ServerStatisticsCallback, compReportStatistics, pScreen);
+
     RegisterRealChildHeadProc(CompositeRealChildHead);
 
     return TRUE;
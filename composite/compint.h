@@ -124,6 +124,20 @@ typedef struct _CompImplicitRedirectException {
     XID winVisual;
 } CompImplicitRedirectException;
 
+/*
+ * Backing pixmaps freed by unredirecting or resizing windows are kept
+ * for a while, so windows which come back at the same size (popup menus,
+ * tooltips, animations) don't have to allocate new ones.
+ */
+#define COMP_PIXMAP_POOL_SIZE	    16
+#define COMP_PIXMAP_POOL_BYTES	    (64 << 20)
+#define COMP_PIXMAP_POOL_AGE	    1000        /* milliseconds */
+
+typedef struct _CompPooledPixmap {
+    PixmapPtr pPixmap;
+    CARD32 time;
+} CompPooledPixmapRec;
+
 typedef struct _CompScreen {
     PositionWindowProcPtr PositionWindow;
     CopyWindowProcPtr CopyWindow;
@@ -170,6 +184,12 @@ typedef struct _CompScreen {
     GetImageProcPtr GetImage;
     GetSpansProcPtr GetSpans;
     SourceValidateProcPtr SourceValidate;
+
+    CompPooledPixmapRec pixmapPool[COMP_PIXMAP_POOL_SIZE];
+    int numPooledPixmaps;
+    size_t pooledPixmapBytes;
+    unsigned long pixmapPoolHits;
+    unsigned long pixmapPoolMisses;
 } CompScreenRec, *CompScreenPtr;
 
 extern DevPrivateKeyRec CompScreenPrivateKeyRec;
@@ -236,6 +256,12 @@ Bool
 compReallocPixmap(WindowPtr pWin, int x, int y,
                   unsigned int w, unsigned int h, int bw);
 
+void
+ compReleasePixmap(ScreenPtr pScreen, PixmapPtr pPixmap);
+
+void
+ compTrimPixmapPool(ScreenPtr pScreen, Bool all);
+
 /*
  * compinit.c
  */
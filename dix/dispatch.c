@@ -129,9 +129,9 @@ int ProcInitialConnection();
 #include "xkbsrv.h"
 #include "site.h"
 #include "client.h"
+#include "registry.h"
 
 #ifdef XSERVER_DTRACE
-#include "registry.h"
 #include "probes.h"
 #endif
 
@@ -172,6 +172,7 @@ CallbackListPtr ClientStateCallback;
  */
 volatile char dispatchException = 0;
 volatile char isItTimeToYield;
+volatile char dispatchStatsRequested;
 
 #define SAME_SCREENS(a, b) (\
     (a.pScreen == b.pScreen))
@@ -373,6 +374,79 @@ SmartScheduleClient(void)
     return best;
 }
 
+DispatchStatsRec MajorDispatchStats[256];
+
+static inline void
+AddDispatchTime(DispatchStatsPtr stats, CARD64 time)
+{
+    int bucket = 0;
+
+    while (time >> bucket && bucket < DISPATCH_HISTOGRAM_BUCKETS - 1)
+        bucket++;
+
+    stats->requests++;
+    stats->time += time;
+    stats->histogram[bucket]++;
+}
+
+static void
+LogDispatchStatsRec(const char *name, DispatchStatsPtr stats)
+{
+    char histogram[DISPATCH_HISTOGRAM_BUCKETS * 24];
+    int i, len = 0;
+
+    for (i = 0; i < DISPATCH_HISTOGRAM_BUCKETS; i++) {
+        if (!stats->histogram[i])
+            continue;
+        len += snprintf(histogram + len, sizeof(histogram) - len,
+                        " %s%lluus:%u",
+                        i < DISPATCH_HISTOGRAM_BUCKETS - 1 ? "<" : ">=",
+                        i < DISPATCH_HISTOGRAM_BUCKETS - 1 ?
+                        1ULL << i : 1ULL << (i - 1), stats->histogram[i]);
+    }
+    histogram[len] = '\0';
+
+    LogMessage(X_INFO, "    %s: %llu requests, %llu us,%s\n", name,
+               (unsigned long long) stats->requests,
+               (unsigned long long) stats->time, histogram);
+}
+
+void
+LogDispatchStats(void)
+{
+    char name[64];
+    const char *cmd;
+    int i;
+
+    LogMessage(X_INFO, "Dispatch statistics by client:\n");
+    for (i = 0; i < currentMaxClients; i++) {
+        ClientPtr client = clients[i];
+
+        if (!client || !client->dispatchStats.requests)
+            continue;
+        cmd = GetClientCmdName(client);
+        snprintf(name, sizeof(name), "client %d (%s)", i, cmd ? cmd : "?");
+        LogDispatchStatsRec(name, &client->dispatchStats);
+        LogMessage(X_INFO, "        priority %d, %llu slices, %llu expired\n",
+                   client->smart_priority,
+                   (unsigned long long) client->smart_slices,
+                   (unsigned long long) client->smart_expired);
+    }
+
+    LogMessage(X_INFO, "Dispatch statistics by request:\n");
+    for (i = 0; i < ARRAY_SIZE(MajorDispatchStats); i++) {
+        if (!MajorDispatchStats[i].requests)
+            continue;
+#ifdef X_REGISTRY_REQUEST
+        cmd = LookupMajorName(i);
+#else
+        snprintf(name, sizeof(name), "request %d", i);
+        cmd = name;
+#endif
+        LogDispatchStatsRec(cmd, &MajorDispatchStats[i]);
+    }
+}
+
 void
 EnableLimitedSchedulingLatency(void)
 {
@@ -397,6 +471,7 @@ Dispatch(void)
     ClientPtr client;
     HWEventQueuePtr *icheck = checkForInput;
     long start_tick;
+    CARD64 request_start, request_end;
 
     nextFreeClientID = 1;
     nClients = 0;
@@ -410,6 +485,11 @@ Dispatch(void)
             FlushIfCriticalOutputPending();
         }
 
+        if (dispatchStatsRequested) {
+            dispatchStatsRequested = FALSE;
+            LogDispatchStats();
+        }
+
         if (!WaitForSomething(clients_are_ready()))
             continue;
 
@@ -420,10 +500,16 @@ Dispatch(void)
 
         if (!dispatchException && clients_are_ready()) {
             client = SmartScheduleClient();
+            client->smart_slices++;
 
             isItTimeToYield = FALSE;
 
             start_tick = SmartScheduleTime;
+            /*
+             * Each request is timed from the end of the one before, so
+             * reading it and any input processed first count toward it.
+             */
+            request_start = GetTimeInMicros();
             while (!isItTimeToYield) {
                 if (*icheck[0] != *icheck[1])
                     ProcessInputEvents();
@@ -434,6 +520,7 @@ Dispatch(void)
                     /* Penalize clients which consume ticks */
                     if (client->smart_priority > SMART_MIN_PRIORITY)
                         client->smart_priority--;
+                    client->smart_expired++;
                     break;
                 }
 
@@ -470,8 +557,15 @@ Dispatch(void)
                         result =
                             (*client->requestVector[client->majorOp]) (client);
                 }
+                RegionScratchReset();
+                request_end = GetTimeInMicros();
+                AddDispatchTime(&client->dispatchStats,
+                                request_end - request_start);
+                AddDispatchTime(&MajorDispatchStats[client->majorOp],
+                                request_end - request_start);
+                request_start = request_end;
                 if (!SmartScheduleSignalEnable)
-                    SmartScheduleTime = GetTimeInMillis();
+                    SmartScheduleTime = (CARD32) (request_end / 1000);
 
 #ifdef XSERVER_DTRACE
                 if (XSERVER_REQUEST_DONE_ENABLED())
@@ -2058,6 +2152,48 @@ ProcPutImage(ClientPtr client)
     return Success;
 }
 
+static char *imageBufferPending;
+
+static void
+ReleaseImageBuffer(void *closure)
+{
+    if (closure == imageBufferPending)
+        imageBufferPending = NULL;
+    else
+        free(closure);
+}
+
+/*
+ * Hand a filled image buffer over to the output layer and return a buffer
+ * for the next chunk of lines.  Data written at once comes straight back,
+ * and the buffer is reused; only when the output layer keeps it, to free
+ * once the data is on the wire, is the spare used and a new spare needed.
+ * Without a spare the data is written the ordinary way.
+ */
+static char *
+WriteImageToClient(ClientPtr client, int count, char *pBuf, char **spare,
+                   int size, Bool last)
+{
+    char *next;
+
+    if (last) {
+        WriteToClientRef(client, count, pBuf, free, pBuf);
+        return NULL;
+    }
+    if (!*spare && !(*spare = malloc(size))) {
+        WriteToClient(client, count, pBuf);
+        return pBuf;
+    }
+    imageBufferPending = pBuf;
+    WriteToClientRef(client, count, pBuf, ReleaseImageBuffer, pBuf);
+    if (!imageBufferPending)
+        return pBuf;
+    imageBufferPending = NULL;
+    next = *spare;
+    *spare = NULL;
+    return next;
+}
+
 static int
 DoGetImage(ClientPtr client, int format, Drawable drawable,
            int x, int y, int width, int height,
@@ -2071,7 +2207,7 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
     int relx, rely;
     long widthBytesLine, length;
     Mask plane = 0;
-    char *pBuf;
+    char *pBuf, *spare = NULL;
     xGetImageReply xgi;
     RegionPtr pVisibleRegion = NULL;
 
@@ -2218,8 +2354,10 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
             ReformatImage(pBuf, (int) (nlines * widthBytesLine),
                           BitsPerPixel(pDraw->depth), ClientOrder(client));
 
-            WriteToClient(client, (int) (nlines * widthBytesLine), pBuf);
             linesDone += nlines;
+            pBuf = WriteImageToClient(client, (int) (nlines * widthBytesLine),
+                                      pBuf, &spare, length,
+                                      linesDone == height);
         }
     }
     else {                      /* XYPixmap */
@@ -2246,8 +2384,12 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
                     ReformatImage(pBuf, (int) (nlines * widthBytesLine),
                                   1, ClientOrder(client));
 
-                    WriteToClient(client, (int)(nlines * widthBytesLine), pBuf);
                     linesDone += nlines;
+                    pBuf = WriteImageToClient(client,
+                                              (int) (nlines * widthBytesLine),
+                                              pBuf, &spare, length,
+                                              linesDone == height &&
+                                              !(planemask & (plane - 1)));
                 }
             }
         }
@@ -2255,6 +2397,7 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
     if (pVisibleRegion)
         RegionDestroy(pVisibleRegion);
     free(pBuf);
+    free(spare);
     return Success;
 }
 
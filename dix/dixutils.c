@@ -886,6 +886,62 @@ InitCallbackManager(void)
     DeleteCallbackManager();
 }
 
+/*
+ * Server statistics.  CollectServerStatistics() gathers the counters of
+ * the OS layer and of everybody on ServerStatisticsCallback into one
+ * list of named values.
+ */
+
+CallbackListPtr ServerStatisticsCallback;
+
+void
+AddServerStatistic(ServerStatisticsPtr stats, const char *name,
+                   uint64_t value)
+{
+    ServerStatisticRec *stat;
+
+    if (stats->num == stats->size) {
+        int size = stats->size ? stats->size * 2 : 64;
+
+        stat = reallocarray(stats->stats, size, sizeof(ServerStatisticRec));
+        if (!stat)
+            return;
+        stats->stats = stat;
+        stats->size = size;
+    }
+
+    stat = &stats->stats[stats->num];
+    if (!(stat->name = strdup(name)))
+        return;
+    stat->value = value;
+    stats->num++;
+}
+
+ServerStatisticsPtr
+CollectServerStatistics(void)
+{
+    ServerStatisticsPtr stats = calloc(1, sizeof(ServerStatisticsRec));
+
+    if (!stats)
+        return NULL;
+    ReportOsStatistics(stats);
+    CallCallbacks(&ServerStatisticsCallback, stats);
+    return stats;
+}
+
+void
+FreeServerStatistics(ServerStatisticsPtr stats)
+{
+    int i;
+
+    if (!stats)
+        return;
+    for (i = 0; i < stats->num; i++)
+        free(stats->stats[i].name);
+    free(stats->stats);
+    free(stats);
+}
+
 /**
  * Coordinates the global GL context used by modules in the X Server
  * doing rendering with OpenGL.
@@ -86,6 +86,194 @@ PrintPropertys(WindowPtr pWin)
 }
 #endif
 
+/*
+ * Windows collecting lots of properties (the root window and managed
+ * toplevels easily carry a hundred EWMH and toolkit hints) get an
+ * atom-keyed, open-addressed hash table next to their property list.
+ * The list stays authoritative and keeps its order for ListProperties;
+ * the index maps each atom to the first list entry with that name, which
+ * is what a linear search would find and where XACE starts looking for
+ * polyinstantiated properties.
+ */
+
+#define PROP_INDEX_MIN	16      /* build the index at this many properties */
+#define PROP_INDEX_DROP	8       /* and free it again below this many */
+
+typedef struct _PropertyIndex {
+    unsigned int numProps;      /* length of the property list */
+    unsigned int bits;          /* log2 of the number of slots */
+    PropertyPtr *slots;
+} PropertyIndexRec;
+
+#define PropIndexSize(idx)	(1U << (idx)->bits)
+#define PropIndexMask(idx)	(PropIndexSize(idx) - 1)
+
+static inline unsigned int
+PropertyHash(PropertyIndexPtr idx, Atom name)
+{
+    return ((CARD32) name * 2654435761U) >> (32 - idx->bits);
+}
+
+/* Returns the slot holding name, or the empty slot where it would go */
+static PropertyPtr *
+PropertyIndexSlot(PropertyIndexPtr idx, Atom name)
+{
+    unsigned int i = PropertyHash(idx, name);
+
+    while (idx->slots[i] && idx->slots[i]->propertyName != name)
+        i = (i + 1) & PropIndexMask(idx);
+    return &idx->slots[i];
+}
+
+static Bool
+PropertyIndexResize(PropertyIndexPtr idx, unsigned int bits)
+{
+    PropertyPtr *old = idx->slots;
+    unsigned int i, oldSize = old ? PropIndexSize(idx) : 0;
+
+    idx->slots = calloc(1U << bits, sizeof(PropertyPtr));
+    if (!idx->slots) {
+        idx->slots = old;
+        return FALSE;
+    }
+    idx->bits = bits;
+    for (i = 0; i < oldSize; i++)
+        if (old[i])
+            *PropertyIndexSlot(idx, old[i]->propertyName) = old[i];
+    free(old);
+    return TRUE;
+}
+
+static void
+PropertyIndexFree(WindowPtr pWin)
+{
+    PropertyIndexPtr idx = pWin->optional->propIndex;
+
+    if (idx) {
+        free(idx->slots);
+        free(idx);
+        pWin->optional->propIndex = NULL;
+    }
+}
+
+static void
+PropertyIndexBuild(WindowPtr pWin, unsigned int numProps)
+{
+    PropertyIndexPtr idx;
+    PropertyPtr pProp, *slot;
+    unsigned int bits = 5;
+
+    while ((1U << bits) < numProps * 2)
+        bits++;
+
+    /* The index is only an accelerator, failing to build it is harmless */
+    idx = calloc(1, sizeof(PropertyIndexRec));
+    if (!idx)
+        return;
+    if (!PropertyIndexResize(idx, bits)) {
+        free(idx);
+        return;
+    }
+    idx->numProps = numProps;
+    for (pProp = pWin->optional->userProps; pProp; pProp = pProp->next) {
+        slot = PropertyIndexSlot(idx, pProp->propertyName);
+        if (!*slot)
+            *slot = pProp;
+    }
+    pWin->optional->propIndex = idx;
+}
+
+/* pProp has just been linked in at the head of the property list */
+static void
+PropertyIndexInsert(WindowPtr pWin, PropertyPtr pProp)
+{
+    PropertyIndexPtr idx = pWin->optional->propIndex;
+    PropertyPtr other;
+    unsigned int n;
+
+    if (!idx) {
+        for (n = 0, other = pWin->optional->userProps;
+             other && n < PROP_INDEX_MIN; other = other->next)
+            n++;
+        if (n == PROP_INDEX_MIN)
+            PropertyIndexBuild(pWin, n);
+        return;
+    }
+
+    idx->numProps++;
+    if (idx->numProps * 2 > PropIndexSize(idx) &&
+        !PropertyIndexResize(idx, idx->bits + 1)) {
+        PropertyIndexFree(pWin);
+        return;
+    }
+    *PropertyIndexSlot(idx, pProp->propertyName) = pProp;
+}
+
+/* pProp has just been unlinked; its next pointer is still intact */
+static void
+PropertyIndexRemove(WindowPtr pWin, PropertyPtr pProp)
+{
+    PropertyIndexPtr idx = pWin->optional->propIndex;
+    PropertyPtr *slot, other;
+    unsigned int i, j, k, mask;
+
+    if (!idx)
+        return;
+
+    if (--idx->numProps < PROP_INDEX_DROP) {
+        PropertyIndexFree(pWin);
+        return;
+    }
+
+    slot = PropertyIndexSlot(idx, pProp->propertyName);
+    if (*slot != pProp)
+        return;
+
+    /* Hand the slot to a polyinstantiated twin further down the list */
+    for (other = pProp->next; other; other = other->next)
+        if (other->propertyName == pProp->propertyName) {
+            *slot = other;
+            return;
+        }
+
+    /* Backward-shift deletion keeps the probe sequences unbroken */
+    mask = PropIndexMask(idx);
+    i = j = slot - idx->slots;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (!idx->slots[j])
+            break;
+        k = PropertyHash(idx, idx->slots[j]->propertyName);
+        if ((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j)) {
+            idx->slots[i] = idx->slots[j];
+            i = j;
+        }
+    }
+    idx->slots[i] = NULL;
+}
+
+static void
+UnlinkProperty(WindowPtr pWin, PropertyPtr pProp)
+{
+    PropertyPtr prevProp;
+
+    if (pWin->optional->userProps == pProp) {
+        /* Takes care of head */
+        pWin->optional->userProps = pProp->next;
+    }
+    else {
+        /* Need to traverse to find the previous element */
+        prevProp = pWin->optional->userProps;
+        while (prevProp->next != pProp)
+            prevProp = prevProp->next;
+        prevProp->next = pProp->next;
+    }
+
+    PropertyIndexRemove(pWin, pProp);
+    if (!pWin->optional->userProps)
+        CheckWindowOptionalNeed(pWin);
+}
+
 int
 dixLookupProperty(PropertyPtr *result, WindowPtr pWin, Atom propertyName,
                   ClientPtr client, Mask access_mode)
@@ -95,9 +283,12 @@ dixLookupProperty(PropertyPtr *result, WindowPtr pWin, Atom propertyName,
 
     client->errorValue = propertyName;
 
-    for (pProp = wUserProps(pWin); pProp; pProp = pProp->next)
-        if (pProp->propertyName == propertyName)
-            break;
+    if (pWin->optional && pWin->optional->propIndex)
+        pProp = *PropertyIndexSlot(pWin->optional->propIndex, propertyName);
+    else
+        for (pProp = wUserProps(pWin); pProp; pProp = pProp->next)
+            if (pProp->propertyName == propertyName)
+                break;
 
     if (pProp)
         rc = XaceHookPropertyAccess(client, pWin, &pProp, access_mode);
@@ -284,6 +475,7 @@ dixChangeWindowProperty(ClientPtr pClient, WindowPtr pWin, Atom property,
         }
         pProp->next = pWin->optional->userProps;
         pWin->optional->userProps = pProp;
+        PropertyIndexInsert(pWin, pProp);
     }
     else if (rc == Success) {
         /* To append or prepend to a property the request format and type
@@ -357,7 +549,7 @@ dixChangeWindowProperty(ClientPtr pClient, WindowPtr pWin, Atom property,
 int
 DeleteProperty(ClientPtr client, WindowPtr pWin, Atom propName)
 {
-    PropertyPtr pProp, prevProp;
+    PropertyPtr pProp;
     int rc;
 
     rc = dixLookupProperty(&pProp, pWin, propName, client, DixDestroyAccess);
@@ -365,19 +557,7 @@ DeleteProperty(ClientPtr client, WindowPtr pWin, Atom propName)
         return Success;         /* Succeed if property does not exist */
 
     if (rc == Success) {
-        if (pWin->optional->userProps == pProp) {
-            /* Takes care of head */
-            if (!(pWin->optional->userProps = pProp->next))
-                CheckWindowOptionalNeed(pWin);
-        }
-        else {
-            /* Need to traverse to find the previous element */
-            prevProp = pWin->optional->userProps;
-            while (prevProp->next != pProp)
-                prevProp = prevProp->next;
-            prevProp->next = pProp->next;
-        }
-
+        UnlinkProperty(pWin, pProp);
         deliverPropertyNotifyEvent(pWin, PropertyDelete, pProp->propertyName);
         free(pProp->data);
         dixFreeObjectWithPrivates(pProp, PRIVATE_PROPERTY);
@@ -399,8 +579,10 @@ DeleteAllWindowProperties(WindowPtr pWin)
         pProp = pNextProp;
     }
 
-    if (pWin->optional)
+    if (pWin->optional) {
+        PropertyIndexFree(pWin);
         pWin->optional->userProps = NULL;
+    }
 }
 
 static int
@@ -432,7 +614,7 @@ NullPropertyReply(ClientPtr client, ATOM propertyType, int format)
 int
 ProcGetProperty(ClientPtr client)
 {
-    PropertyPtr pProp, prevProp;
+    PropertyPtr pProp;
     unsigned long n, len, ind;
     int rc;
     WindowPtr pWin;
@@ -535,19 +717,7 @@ ProcGetProperty(ClientPtr client)
 
     if (stuff->delete && (reply.bytesAfter == 0)) {
         /* Delete the Property */
-        if (pWin->optional->userProps == pProp) {
-            /* Takes care of head */
-            if (!(pWin->optional->userProps = pProp->next))
-                CheckWindowOptionalNeed(pWin);
-        }
-        else {
-            /* Need to traverse to find the previous element */
-            prevProp = pWin->optional->userProps;
-            while (prevProp->next != pProp)
-                prevProp = prevProp->next;
-            prevProp->next = pProp->next;
-        }
-
+        UnlinkProperty(pWin, pProp);
         free(pProp->data);
         dixFreeObjectWithPrivates(pProp, PRIVATE_PROPERTY);
     }
@@ -270,6 +270,135 @@ RegionDuplicate(RegionPtr pOld)
     return pNew;
 }
 
+/*
+ * Scratch regions hold intermediate results.  Their rectangle storage is
+ * handed back to a small pool when they're done with instead of being
+ * freed, and the next scratch region starts with it, so a chain of
+ * operations within a request finds room already allocated.  The storage
+ * is still malloc'd, as pixman reallocs and frees it like any other.
+ * RegionScratchReset runs after every request and drops storage big
+ * enough to be worth returning.
+ */
+
+#define REGION_SCRATCH_POOL	16      /* buffers kept for scratch regions */
+#define REGION_SCRATCH_RECTS	4096    /* largest buffer kept in a request */
+#define REGION_SCRATCH_IDLE	256     /* largest buffer kept between requests */
+
+static RegDataPtr regionScratchData[REGION_SCRATCH_POOL];
+static int regionScratchCount;
+
+void
+RegionNullScratch(RegionPtr pReg)
+{
+    pReg->extents = RegionEmptyBox;
+    if (regionScratchCount) {
+        pReg->data = regionScratchData[--regionScratchCount];
+        pReg->data->numRects = 0;
+    }
+    else
+        pReg->data = &RegionEmptyData;
+}
+
+void
+RegionUninitScratch(RegionPtr pReg)
+{
+    RegDataPtr data = pReg->data;
+
+    if (data && data->size) {
+        if (data->size <= REGION_SCRATCH_RECTS &&
+            regionScratchCount < REGION_SCRATCH_POOL)
+            regionScratchData[regionScratchCount++] = data;
+        else
+            free(data);
+    }
+    pReg->data = NULL;
+}
+
+void
+RegionScratchReset(void)
+{
+    int i, n = 0;
+
+    for (i = 0; i < regionScratchCount; i++) {
+        if (regionScratchData[i]->size > REGION_SCRATCH_IDLE)
+            free(regionScratchData[i]);
+        else
+            regionScratchData[n++] = regionScratchData[i];
+    }
+    regionScratchCount = n;
+}
+
+/*
+ * newReg = (reg1 & reg2) - reg3, skipping either step when it can't
+ * change anything and otherwise keeping the intersection in a scratch
+ * region.
+ */
+Bool
+RegionIntersectSubtract(RegionPtr newReg,
+                        RegionPtr reg1, RegionPtr reg2, RegionPtr reg3)
+{
+    RegionRec tmp;
+    Bool ret;
+
+    if (!RegionNar(reg3) &&
+        (RegionNil(reg3) ||
+         !EXTENTCHECK(&reg1->extents, &reg3->extents) ||
+         !EXTENTCHECK(&reg2->extents, &reg3->extents)))
+        return RegionIntersect(newReg, reg1, reg2);
+    if (!reg2->data && SUBSUMES(&reg2->extents, &reg1->extents))
+        return RegionSubtract(newReg, reg1, reg3);
+    if (!reg1->data && SUBSUMES(&reg1->extents, &reg2->extents))
+        return RegionSubtract(newReg, reg2, reg3);
+
+    RegionNullScratch(&tmp);
+    ret = RegionIntersect(&tmp, reg1, reg2) &&
+        RegionSubtract(newReg, &tmp, reg3);
+    RegionUninitScratch(&tmp);
+    return ret;
+}
+
+/*
+ * newReg = reg1 & reg2 moved by (dx, dy), leaving reg2 where it is.  A
+ * single box is moved on the stack; anything else is moved in a scratch
+ * region.
+ */
+Bool
+RegionTranslateIntersect(RegionPtr newReg, RegionPtr reg1, RegionPtr reg2,
+                         int dx, int dy)
+{
+    RegionRec tmp;
+    Bool ret;
+
+    if (!dx && !dy)
+        return RegionIntersect(newReg, reg1, reg2);
+
+    if (!reg2->data) {
+        BoxRec box;
+        int x1 = reg2->extents.x1 + dx, y1 = reg2->extents.y1 + dy;
+        int x2 = reg2->extents.x2 + dx, y2 = reg2->extents.y2 + dy;
+
+        /* clip to the coordinate space as RegionTranslate would */
+        box.x1 = max(x1, MINSHORT);
+        box.y1 = max(y1, MINSHORT);
+        box.x2 = min(x2, MAXSHORT);
+        box.y2 = min(y2, MAXSHORT);
+        if (box.x1 >= box.x2 || box.y1 >= box.y2)
+            RegionNull(&tmp);
+        else
+            RegionInit(&tmp, &box, 1);
+        return RegionIntersect(newReg, reg1, &tmp);
+    }
+
+    RegionNullScratch(&tmp);
+    ret = RegionCopy(&tmp, reg2);
+    if (ret) {
+        RegionTranslate(&tmp, dx, dy);
+        ret = RegionIntersect(newReg, reg1, &tmp);
+    }
+    RegionUninitScratch(&tmp);
+    return ret;
+}
+
 void
 RegionPrint(RegionPtr rgn)
 {
@@ -1384,3 +1513,252 @@ RegionFromRects(int nrects, xRectangle *prect, int ctype)
     }
     return pRgn;
 }
+
+/*
+ * RegionSimplify cuts a region down to a box budget by covering it with
+ * fewer, larger boxes.  The result contains the original region and has
+ * the same extents.
+ *
+ * Very fragmented regions are first rounded out to a grid of tiles,
+ * which takes one pass over the boxes.  After that, neighbouring boxes
+ * are merged into their bounding box, cheapest first, where the cost of
+ * a merge is the area it adds.  Boxes are neighbours when they're next
+ * to each other in y-x order, which pairs boxes across a band first and
+ * then the ends of successive bands.  Merged boxes can overlap, and
+ * banding the result may split them again, so the merging is repeated
+ * on the banded result while it's still over budget, aiming for half as
+ * many boxes as the previous try each time.
+ */
+
+#define REGION_SIMPLIFY_TILE	32      /* smallest tile side in pixels */
+#define REGION_SIMPLIFY_TILES	65536   /* most tiles in the grid */
+#define REGION_SIMPLIFY_SPARSE	8       /* boxes per budgeted box to use tiles */
+#define REGION_SIMPLIFY_TRIES	4
+
+typedef struct _regionMerge {
+    int64_t cost;
+    int box;
+    int stamp;
+} RegionMergeRec, *RegionMergePtr;
+
+static int64_t
+RegionBoxArea(BoxPtr box)
+{
+    return (int64_t) (box->x2 - box->x1) * (box->y2 - box->y1);
+}
+
+static int64_t
+RegionMergeCost(BoxPtr a, BoxPtr b)
+{
+    BoxRec u;
+
+    u.x1 = min(a->x1, b->x1);
+    u.y1 = min(a->y1, b->y1);
+    u.x2 = max(a->x2, b->x2);
+    u.y2 = max(a->y2, b->y2);
+    return RegionBoxArea(&u) - RegionBoxArea(a) - RegionBoxArea(b);
+}
+
+static void
+RegionMergePush(RegionMergePtr heap, int *n, RegionMergeRec m)
+{
+    int i = (*n)++;
+
+    while (i && heap[(i - 1) / 2].cost > m.cost) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = m;
+}
+
+static RegionMergeRec
+RegionMergePop(RegionMergePtr heap, int *n)
+{
+    RegionMergeRec top = heap[0], last = heap[--(*n)];
+    int i = 0, c;
+
+    while ((c = 2 * i + 1) < *n) {
+        if (c + 1 < *n && heap[c + 1].cost < heap[c].cost)
+            c++;
+        if (heap[c].cost >= last.cost)
+            break;
+        heap[i] = heap[c];
+        i = c;
+    }
+    heap[i] = last;
+    return top;
+}
+
+/* Round boxes out to the tiles they touch, one box per run of tiles */
+static int
+RegionTileBoxes(BoxPtr boxes, int n, BoxPtr extents)
+{
+    int w = extents->x2 - extents->x1, h = extents->y2 - extents->y1;
+    int tile = REGION_SIMPLIFY_TILE;
+    int tw, th, x, y, i, out;
+    unsigned char *tiles;
+    BoxPtr runs;
+
+    while ((int64_t) ((w + tile - 1) / tile) * ((h + tile - 1) / tile) >
+           REGION_SIMPLIFY_TILES)
+        tile <<= 1;
+    tw = (w + tile - 1) / tile;
+    th = (h + tile - 1) / tile;
+    tiles = calloc(tw * th, 1);
+    runs = xallocarray(n, sizeof(BoxRec));
+    if (!tiles || !runs) {
+        free(tiles);
+        free(runs);
+        return n;
+    }
+
+    for (i = 0; i < n; i++) {
+        int x1 = (boxes[i].x1 - extents->x1) / tile;
+        int x2 = (boxes[i].x2 - extents->x1 + tile - 1) / tile;
+        int y1 = (boxes[i].y1 - extents->y1) / tile;
+        int y2 = (boxes[i].y2 - extents->y1 + tile - 1) / tile;
+
+        for (y = y1; y < y2; y++)
+            memset(tiles + y * tw + x1, 1, x2 - x1);
+    }
+
+    /* tall boxes can make more runs than there were boxes; keep the boxes */
+    out = 0;
+    for (y = 0; y < th && out <= n; y++) {
+        for (x = 0; x < tw; x++) {
+            int x1;
+
+            if (!tiles[y * tw + x])
+                continue;
+            for (x1 = x; x < tw && tiles[y * tw + x]; x++);
+            if (out == n) {
+                out++;
+                break;
+            }
+            runs[out].x1 = extents->x1 + x1 * tile;
+            runs[out].y1 = extents->y1 + y * tile;
+            runs[out].x2 = min(extents->x1 + x * tile, extents->x2);
+            runs[out].y2 = min(extents->y1 + (y + 1) * tile, extents->y2);
+            out++;
+        }
+    }
+    if (out <= n)
+        memcpy(boxes, runs, out * sizeof(BoxRec));
+    else
+        out = n;
+    free(tiles);
+    free(runs);
+    return out;
+}
+
+/* Merge neighbouring boxes, cheapest first, until at most maxBoxes remain */
+static int
+RegionMergeBoxes(BoxPtr boxes, int n, int maxBoxes)
+{
+    int *next, *prev, *stamp;
+    RegionMergePtr heap;
+    int nheap = 0, count = n, i, out;
+
+    next = calloc(n, sizeof(int));
+    prev = calloc(n, sizeof(int));
+    stamp = calloc(n, sizeof(int));
+    heap = xallocarray(n, sizeof(RegionMergeRec) * 3);
+    if (!next || !prev || !stamp || !heap) {
+        count = 0;
+        goto bail;
+    }
+
+    for (i = 0; i < n; i++) {
+        next[i] = i + 1 < n ? i + 1 : -1;
+        prev[i] = i - 1;
+        if (next[i] >= 0)
+            RegionMergePush(heap, &nheap, (RegionMergeRec) {
+                            RegionMergeCost(&boxes[i], &boxes[i + 1]), i, 0});
+    }
+
+    /*
+     * Each merge pushes at most two entries and retires one box, so the
+     * heap never holds more than three entries per box.  Entries whose box
+     * has changed or gone since are skipped.
+     */
+    while (count > maxBoxes && nheap) {
+        RegionMergeRec m = RegionMergePop(heap, &nheap);
+        int a = m.box, b;
+
+        if (stamp[a] != m.stamp || (b = next[a]) < 0)
+            continue;
+
+        boxes[a].x1 = min(boxes[a].x1, boxes[b].x1);
+        boxes[a].y1 = min(boxes[a].y1, boxes[b].y1);
+        boxes[a].x2 = max(boxes[a].x2, boxes[b].x2);
+        boxes[a].y2 = max(boxes[a].y2, boxes[b].y2);
+        next[a] = next[b];
+        if (next[b] >= 0)
+            prev[next[b]] = a;
+        stamp[b] = -1;
+        stamp[a]++;
+        count--;
+
+        if (next[a] >= 0)
+            RegionMergePush(heap, &nheap, (RegionMergeRec) {
+                            RegionMergeCost(&boxes[a], &boxes[next[a]]),
+                            a, stamp[a]});
+        if (prev[a] >= 0) {
+            stamp[prev[a]]++;
+            RegionMergePush(heap, &nheap, (RegionMergeRec) {
+                            RegionMergeCost(&boxes[prev[a]], &boxes[a]),
+                            prev[a], stamp[prev[a]]});
+        }
+    }
+
+    for (i = out = 0; i < n; i++)
+        if (stamp[i] >= 0)
+            boxes[out++] = boxes[i];
+    count = out;
+
+ bail:
+    free(next);
+    free(prev);
+    free(stamp);
+    free(heap);
+    return count;
+}
+
+Bool
+RegionSimplify(RegionPtr pReg, int maxBoxes)
+{
+    BoxRec extents = pReg->extents;
+    RegionRec simple;
+    BoxPtr boxes;
+    int n, try, target = maxBoxes;
+
+    if (RegionNar(pReg) || RegionNumRects(pReg) <= maxBoxes)
+        return TRUE;
+
+    for (try = 0; target > 1 && try < REGION_SIMPLIFY_TRIES;
+         try++, target /= 2) {
+        n = RegionNumRects(pReg);
+        boxes = xallocarray(n, sizeof(BoxRec));
+        if (!boxes)
+            break;
+        memcpy(boxes, RegionRects(pReg), n * sizeof(BoxRec));
+
+        if (try == 0 && n > maxBoxes * REGION_SIMPLIFY_SPARSE)
+            n = RegionTileBoxes(boxes, n, &extents);
+        if (n > target)
+            n = RegionMergeBoxes(boxes, n, target);
+        if (!n || !RegionInitBoxes(&simple, boxes, n)) {
+            free(boxes);
+            break;
+        }
+        free(boxes);
+
+        RegionUninit(pReg);
+        *pReg = simple;
+        if (RegionNumRects(pReg) <= maxBoxes)
+            return TRUE;
+    }
+
+    RegionReset(pReg, &extents);
+    return TRUE;
+}
@@ -105,8 +105,8 @@ Equipment Corporation.
  *      A resource ID is a 32 bit quantity, the upper 2 bits of which are
  *	off-limits for client-visible resources.  The next 8 bits are
  *      used as client ID, and the low 22 bits come from the client.
- *	A resource ID is "hashed" by extracting and xoring subfields
- *      (varying with the size of the hash table).
+ *	Each client's resources are kept in an open-addressed hash table
+ *	keyed on the ID, and on a list per resource type.
  *
  *      It is sometimes necessary for the server to create an ID that looks
  *      like it belongs to a client.  This ID, however,  must not be one
@@ -149,31 +149,62 @@ Equipment Corporation.
 #define TypeNameString(t) LookupResourceName(t)
 #endif
 
-static void RebuildTable(int    /*client */
-    );
-
 #define SERVER_MINID 32
 
-#define INITBUCKETS 64
 #define INITHASHSIZE 6
-#define MAXHASHSIZE 11
+#define MIGRATESLOTS 256        /* old slots moved per AddResource */
 
 typedef struct _Resource {
-    struct _Resource *next;
+    struct _Resource *next;     /* older resource with the same id */
+    struct _Resource *typeNext; /* older resource of the same type */
+    struct _Resource *typePrev;
     XID id;
     RESTYPE type;
     void *value;
 } ResourceRec, *ResourcePtr;
 
+/*
+ * The table holds one slot per id in use, pointing to the newest resource
+ * with that id.  Slots are found by linear probing, and a freed slot is
+ * left as a tombstone so later probes carry on past it.  When the table
+ * gets too full a new one is allocated and the old slots are moved over
+ * a few at a time, with lookups trying both tables until they're done.
+ */
+typedef struct _ResourceSlot {
+    XID id;
+    ResourcePtr res;            /* NULL if never used, or TOMBSTONE */
+} ResourceSlotRec, *ResourceSlotPtr;
+
+#define TOMBSTONE ((ResourcePtr) &tombstone)
+static char tombstone;
+
+typedef struct _ResourceTable {
+    ResourceSlotPtr slots;
+    int hashsize;               /* log(2)(number of slots) */
+    int used;                   /* slots in use or tombstones */
+} ResourceTableRec, *ResourceTablePtr;
+
+/* A walk through the type lists which resources may be freed under */
+typedef struct _ResourceIter {
+    struct _ResourceIter *outer;
+    ResourcePtr next;
+} ResourceIterRec, *ResourceIterPtr;
+
 typedef struct _ClientResource {
-    ResourcePtr *resources;
+    ResourceTableRec table;
+    ResourceTableRec old;       /* being moved into table */
+    int migrated;               /* slots of old already moved */
+    int ids;                    /* distinct ids in the tables */
+    ResourcePtr *types;         /* newest resource of each type */
+    int numTypes;
+    ResourceIterPtr iters;
     int elements;
-    int buckets;
-    int hashsize;               /* log(2)(buckets) */
     XID fakeID;
     XID endFakeID;
 } ClientResourceRec;
 
+#define ClientResourcesInUse(rrec) ((rrec)->table.slots != NULL)
+
 RESTYPE lastResourceType;
 static RESTYPE lastResourceClass;
 RESTYPE TypeMask;
@@ -632,7 +663,7 @@ ResourceClientBits(void)
 Bool
 InitClientResources(ClientPtr client)
 {
-    int i, j;
+    ClientResourceRec *rrec = &clientTable[client->index];
 
     if (client == serverClient) {
         lastResourceType = RT_LASTPREDEF;
@@ -644,24 +675,19 @@ InitClientResources(ClientPtr client)
             return FALSE;
         memcpy(resourceTypes, predefTypes, sizeof(predefTypes));
     }
-    clientTable[i = client->index].resources =
-        malloc(INITBUCKETS * sizeof(ResourcePtr));
-    if (!clientTable[i].resources)
+    memset(rrec, 0, sizeof(*rrec));
+    rrec->table.slots = calloc(1 << INITHASHSIZE, sizeof(ResourceSlotRec));
+    if (!rrec->table.slots)
         return FALSE;
-    clientTable[i].buckets = INITBUCKETS;
-    clientTable[i].elements = 0;
-    clientTable[i].hashsize = INITHASHSIZE;
+    rrec->table.hashsize = INITHASHSIZE;
     /* Many IDs allocated from the server client are visible to clients,
      * so we don't use the SERVER_BIT for them, but we have to start
      * past the magic value constants used in the protocol.  For normal
      * clients, we can start from zero, with SERVER_BIT set.
      */
-    clientTable[i].fakeID = client->clientAsMask |
+    rrec->fakeID = client->clientAsMask |
         (client->index ? SERVER_BIT : SERVER_MINID);
-    clientTable[i].endFakeID = (clientTable[i].fakeID | RESOURCE_ID_MASK) + 1;
-    for (j = 0; j < INITBUCKETS; j++) {
-        clientTable[i].resources[j] = NULL;
-    }
+    rrec->endFakeID = (rrec->fakeID | RESOURCE_ID_MASK) + 1;
     return TRUE;
 }
 
@@ -693,18 +719,185 @@ HashResourceID(XID id, int numBits)
     }
 }
 
+static inline unsigned int
+ResourceSlotIndex(XID id, int hashsize)
+{
+    /* Fibonacci hashing spreads the consecutive ids clients allocate */
+    return (CARD32) (id * 2654435769U) >> (32 - hashsize);
+}
+
+/* The slot holding id, or NULL with *spot set to where it would go */
+static ResourceSlotPtr
+ProbeSlot(ResourceTablePtr table, XID id, ResourceSlotPtr *spot)
+{
+    unsigned int mask, i;
+    ResourceSlotPtr slot;
+
+    *spot = NULL;
+    if (!table->slots)
+        return NULL;
+    mask = (1U << table->hashsize) - 1;
+    for (i = ResourceSlotIndex(id, table->hashsize);; i = (i + 1) & mask) {
+        slot = &table->slots[i];
+        if (!slot->res) {
+            if (!*spot)
+                *spot = slot;
+            return NULL;
+        }
+        if (slot->res == TOMBSTONE) {
+            if (!*spot)
+                *spot = slot;
+        }
+        else if (slot->id == id)
+            return slot;
+    }
+}
+
+/* The caller has checked that id isn't in the table */
+static void
+InsertSlot(ResourceTablePtr table, XID id, ResourcePtr res)
+{
+    ResourceSlotPtr slot;
+
+    ProbeSlot(table, id, &slot);
+    if (!slot->res)
+        table->used++;
+    slot->id = id;
+    slot->res = res;
+}
+
+/* The slot holding the newest resource with this id */
+static ResourceSlotPtr
+LookupSlot(ClientResourceRec *rrec, XID id)
+{
+    ResourceSlotPtr slot, spot;
+
+    slot = ProbeSlot(&rrec->table, id, &spot);
+    if (!slot)
+        slot = ProbeSlot(&rrec->old, id, &spot);
+    return slot;
+}
+
+static inline ResourcePtr
+LookupResourceChain(int cid, XID id)
+{
+    ResourceSlotPtr slot;
+
+    if (cid >= LimitClients || !ClientResourcesInUse(&clientTable[cid]))
+        return NULL;
+    slot = LookupSlot(&clientTable[cid], id);
+    return slot ? slot->res : NULL;
+}
+
+static void
+MigrateSlots(ClientResourceRec *rrec, int count)
+{
+    int size = 1 << rrec->old.hashsize;
+    ResourceSlotPtr slot;
+
+    for (; count > 0 && rrec->migrated < size; count--, rrec->migrated++) {
+        slot = &rrec->old.slots[rrec->migrated];
+        if (slot->res && slot->res != TOMBSTONE) {
+            InsertSlot(&rrec->table, slot->id, slot->res);
+            slot->res = TOMBSTONE;
+        }
+    }
+    if (rrec->migrated == size) {
+        free(rrec->old.slots);
+        rrec->old.slots = NULL;
+    }
+}
+
+/*
+ * Start moving to a table with room for four times the ids in use.  It
+ * has to be big enough to take everything arriving before the old table
+ * is emptied too, which takes one AddResource per MIGRATESLOTS old slots.
+ */
+static Bool
+GrowTable(ClientResourceRec *rrec)
+{
+    int hashsize = INITHASHSIZE;
+    ResourceSlotPtr slots;
+
+    if (rrec->old.slots)
+        MigrateSlots(rrec, INT_MAX);
+
+    while ((1 << hashsize) < 4 * rrec->ids + 4 ||
+           (1 << hashsize) < (1 << rrec->table.hashsize) / 16)
+        hashsize++;
+
+    slots = calloc(1 << hashsize, sizeof(ResourceSlotRec));
+    if (!slots)
+        return FALSE;
+
+    rrec->old = rrec->table;
+    rrec->migrated = 0;
+    rrec->table.slots = slots;
+    rrec->table.hashsize = hashsize;
+    rrec->table.used = 0;
+    return TRUE;
+}
+
+/* Take res out of the table and its type list, without freeing it */
+static void
+UnlinkResource(ClientResourceRec *rrec, ResourcePtr res)
+{
+    ResourceSlotPtr slot = LookupSlot(rrec, res->id);
+    ResourcePtr *prev;
+    ResourceIterPtr iter;
+
+    for (prev = &slot->res; *prev != res; prev = &(*prev)->next);
+    *prev = res->next;
+    if (!slot->res) {
+        slot->res = TOMBSTONE;
+        rrec->ids--;
+    }
+
+    if (res->typePrev)
+        res->typePrev->typeNext = res->typeNext;
+    else
+        rrec->types[res->type & TypeMask] = res->typeNext;
+    if (res->typeNext)
+        res->typeNext->typePrev = res->typePrev;
+
+    for (iter = rrec->iters; iter; iter = iter->outer)
+        if (iter->next == res)
+            iter->next = res->typeNext;
+
+    rrec->elements--;
+}
+
+static inline void
+PushIter(ClientResourceRec *rrec, ResourceIterPtr iter, ResourcePtr first)
+{
+    iter->next = first;
+    iter->outer = rrec->iters;
+    rrec->iters = iter;
+}
+
+static inline ResourcePtr
+NextIter(ResourceIterPtr iter)
+{
+    ResourcePtr res = iter->next;
+
+    if (res)
+        iter->next = res->typeNext;
+    return res;
+}
+
+static inline void
+PopIter(ClientResourceRec *rrec, ResourceIterPtr iter)
+{
+    rrec->iters = iter->outer;
+}
+
 static XID
 AvailableID(int client, XID id, XID maxid, XID goodid)
 {
-    ResourcePtr res;
-
     if ((goodid >= id) && (goodid <= maxid))
         return goodid;
     for (; id <= maxid; id++) {
-        res = clientTable[client].resources[HashResourceID(id, clientTable[client].hashsize)];
-        while (res && (res->id != id))
-            res = res->next;
-        if (!res)
+        if (!LookupSlot(&clientTable[client], id))
             return id;
     }
     return 0;
@@ -714,7 +907,6 @@ void
 GetXIDRange(int client, Bool server, XID *minp, XID *maxp)
 {
     XID id, maxid;
-    ResourcePtr *resp;
     ResourcePtr res;
     int i;
     XID goodid;
@@ -724,9 +916,8 @@ GetXIDRange(int client, Bool server, XID *minp, XID *maxp)
         id |= client ? SERVER_BIT : SERVER_MINID;
     maxid = id | RESOURCE_ID_MASK;
     goodid = 0;
-    for (resp = clientTable[client].resources, i = clientTable[client].buckets;
-         --i >= 0;) {
-        for (res = *resp++; res; res = res->next) {
+    for (i = 0; i < clientTable[client].numTypes; i++) {
+        for (res = clientTable[client].types[i]; res; res = res->typeNext) {
             if ((res->id < id) || (res->id > maxid))
                 continue;
             if (((res->id - id) >= (maxid - res->id)) ?
@@ -813,82 +1004,89 @@ AddResource(XID id, RESTYPE type, void *value)
 {
     int client;
     ClientResourceRec *rrec;
-    ResourcePtr res, *head;
+    ResourceSlotPtr slot, spot, unused;
+    ResourcePtr res;
+    int index = type & TypeMask;
 
 #ifdef XSERVER_DTRACE
     XSERVER_RESOURCE_ALLOC(id, type, value, TypeNameString(type));
 #endif
     client = CLIENT_ID(id);
     rrec = &clientTable[client];
-    if (!rrec->buckets) {
+    if (!ClientResourcesInUse(rrec)) {
         ErrorF("[dix] AddResource(%lx, %x, %lx), client=%d \n",
                (unsigned long) id, type, (unsigned long) value, client);
         FatalError("client not in use\n");
     }
-    if ((rrec->elements >= 4 * rrec->buckets) && (rrec->hashsize < MAXHASHSIZE))
-        RebuildTable(client);
-    head = &rrec->resources[HashResourceID(id, clientTable[client].hashsize)];
-    res = malloc(sizeof(ResourceRec));
-    if (!res) {
-        (*resourceTypes[type & TypeMask].deleteFunc) (value, id);
-        return FALSE;
+    if (rrec->old.slots)
+        MigrateSlots(rrec, MIGRATESLOTS);
+    if (index >= rrec->numTypes) {
+        int numTypes = max(index, (int) lastResourceType) + 1;
+        ResourcePtr *types = reallocarray(rrec->types, numTypes,
+                                          sizeof(ResourcePtr));
+
+        if (!types)
+            goto bail;
+        memset(types + rrec->numTypes, 0,
+               (numTypes - rrec->numTypes) * sizeof(ResourcePtr));
+        rrec->types = types;
+        rrec->numTypes = numTypes;
     }
-    res->next = *head;
+    res = malloc(sizeof(ResourceRec));
+    if (!res)
+        goto bail;
     res->id = id;
     res->type = type;
     res->value = value;
-    *head = res;
-    rrec->elements++;
-    CallResourceStateCallback(ResourceStateAdding, res);
-    return TRUE;
-}
-
-static void
-RebuildTable(int client)
-{
-    int j;
-    ResourcePtr res, next;
-    ResourcePtr **tails, *resources;
-    ResourcePtr **tptr, *rptr;
-
-    /*
-     * For now, preserve insertion order, since some ddx layers depend
-     * on resources being free in the opposite order they are added.
-     */
 
-    j = 2 * clientTable[client].buckets;
-    tails =  xallocarray(j, sizeof(ResourcePtr *));
-    if (!tails)
-        return;
-    resources =  xallocarray(j, sizeof(ResourcePtr));
-    if (!resources) {
-        free(tails);
-        return;
-    }
-    for (rptr = resources, tptr = tails; --j >= 0; rptr++, tptr++) {
-        *rptr = NULL;
-        *tptr = rptr;
+    /* Same ids go on a list in the slot, newest first */
+    slot = ProbeSlot(&rrec->table, id, &spot);
+    if (!slot)
+        slot = ProbeSlot(&rrec->old, id, &unused);
+    if (slot) {
+        res->next = slot->res;
+        slot->res = res;
     }
-    clientTable[client].hashsize++;
-    for (j = clientTable[client].buckets,
-         rptr = clientTable[client].resources; --j >= 0; rptr++) {
-        for (res = *rptr; res; res = next) {
-            next = res->next;
-            res->next = NULL;
-            tptr = &tails[HashResourceID(res->id, clientTable[client].hashsize)];
-            **tptr = res;
-            *tptr = &res->next;
+    else {
+        if (!spot->res &&
+            rrec->table.used + 1 > (3 << rrec->table.hashsize) / 4) {
+            if (GrowTable(rrec))
+                ProbeSlot(&rrec->table, id, &spot);
+            else if (rrec->table.used + 1 == 1 << rrec->table.hashsize) {
+                free(res);
+                goto bail;
+            }
         }
+        if (!spot->res)
+            rrec->table.used++;
+        spot->id = id;
+        spot->res = res;
+        res->next = NULL;
+        rrec->ids++;
     }
-    free(tails);
-    clientTable[client].buckets *= 2;
-    free(clientTable[client].resources);
-    clientTable[client].resources = resources;
+
+    res->typePrev = NULL;
+    res->typeNext = rrec->types[index];
+    if (res->typeNext)
+        res->typeNext->typePrev = res;
+    rrec->types[index] = res;
+
+    rrec->elements++;
+    CallResourceStateCallback(ResourceStateAdding, res);
+    return TRUE;
+
+ bail:
+    (*resourceTypes[index].deleteFunc) (value, id);
+    return FALSE;
 }
 
 static void
 doFreeResource(ResourcePtr res, Bool skip)
 {
+#ifdef XSERVER_DTRACE
+    XSERVER_RESOURCE_FREE(res->id, res->type,
+                          res->value, TypeNameString(res->type));
+#endif
     CallResourceStateCallback(ResourceStateFreeing, res);
 
     if (!skip)
@@ -900,65 +1098,27 @@ doFreeResource(ResourcePtr res, Bool skip)
 void
 FreeResource(XID id, RESTYPE skipDeleteFuncType)
 {
-    int cid;
+    int cid = CLIENT_ID(id);
     ResourcePtr res;
-    ResourcePtr *prev, *head;
-    int *eltptr;
-    int elements;
-
-    if (((cid = CLIENT_ID(id)) < LimitClients) && clientTable[cid].buckets) {
-        head = &clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
-        eltptr = &clientTable[cid].elements;
-
-        prev = head;
-        while ((res = *prev)) {
-            if (res->id == id) {
-                RESTYPE rtype = res->type;
-
-#ifdef XSERVER_DTRACE
-                XSERVER_RESOURCE_FREE(res->id, res->type,
-                                      res->value, TypeNameString(res->type));
-#endif
-                *prev = res->next;
-                elements = --*eltptr;
-
-                doFreeResource(res, rtype == skipDeleteFuncType);
 
-                if (*eltptr != elements)
-                    prev = head;        /* prev may no longer be valid */
-            }
-            else
-                prev = &res->next;
-        }
+    /* Newest first, and again if freeing one added another */
+    while ((res = LookupResourceChain(cid, id))) {
+        UnlinkResource(&clientTable[cid], res);
+        doFreeResource(res, res->type == skipDeleteFuncType);
     }
 }
 
 void
 FreeResourceByType(XID id, RESTYPE type, Bool skipFree)
 {
-    int cid;
+    int cid = CLIENT_ID(id);
     ResourcePtr res;
-    ResourcePtr *prev, *head;
-
-    if (((cid = CLIENT_ID(id)) < LimitClients) && clientTable[cid].buckets) {
-        head = &clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
 
-        prev = head;
-        while ((res = *prev)) {
-            if (res->id == id && res->type == type) {
-#ifdef XSERVER_DTRACE
-                XSERVER_RESOURCE_FREE(res->id, res->type,
-                                      res->value, TypeNameString(res->type));
-#endif
-                *prev = res->next;
-                clientTable[cid].elements--;
-
-                doFreeResource(res, skipFree);
-
-                break;
-            }
-            else
-                prev = &res->next;
+    for (res = LookupResourceChain(cid, id); res; res = res->next) {
+        if (res->type == type) {
+            UnlinkResource(&clientTable[cid], res);
+            doFreeResource(res, skipFree);
+            break;
         }
     }
 }
@@ -972,51 +1132,41 @@ FreeResourceByType(XID id, RESTYPE type, Bool skipFree)
 Bool
 ChangeResourceValue(XID id, RESTYPE rtype, void *value)
 {
-    int cid;
     ResourcePtr res;
 
-    if (((cid = CLIENT_ID(id)) < LimitClients) && clientTable[cid].buckets) {
-        res = clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
-
-        for (; res; res = res->next)
-            if ((res->id == id) && (res->type == rtype)) {
-                res->value = value;
-                return TRUE;
-            }
-    }
+    for (res = LookupResourceChain(CLIENT_ID(id), id); res; res = res->next)
+        if (res->type == rtype) {
+            res->value = value;
+            return TRUE;
+        }
     return FALSE;
 }
 
-/* Note: if func adds or deletes resources, then func can get called
- * more than once for some resources.  If func adds new resources,
- * func might or might not get called for them.  func cannot both
- * add and delete an equal number of resources!
+/* Note: if func adds resources, func might or might not get called for
+ * them.  Resources func deletes are skipped.
  */
 
 void
 FindClientResourcesByType(ClientPtr client,
                           RESTYPE type, FindResType func, void *cdata)
 {
-    ResourcePtr *resources;
-    ResourcePtr this, next;
-    int i, elements;
-    int *eltptr;
+    ClientResourceRec *rrec;
+    ResourceIterRec iter;
+    ResourcePtr this;
+    int i;
 
     if (!client)
         client = serverClient;
 
-    resources = clientTable[client->index].resources;
-    eltptr = &clientTable[client->index].elements;
-    for (i = 0; i < clientTable[client->index].buckets; i++) {
-        for (this = resources[i]; this; this = next) {
-            next = this->next;
-            if (!type || this->type == type) {
-                elements = *eltptr;
+    rrec = &clientTable[client->index];
+    for (i = 0; i < rrec->numTypes; i++) {
+        if (type && i != (type & TypeMask))
+            continue;
+        PushIter(rrec, &iter, rrec->types[i]);
+        while ((this = NextIter(&iter)))
+            if (!type || this->type == type)
                 (*func) (this->value, this->id, cdata);
-                if (*eltptr != elements)
-                    next = resources[i];        /* start over */
-            }
-        }
+        PopIter(rrec, &iter);
     }
 }
 
@@ -1032,24 +1182,20 @@ void FindSubResources(void *resource,
 void
 FindAllClientResources(ClientPtr client, FindAllRes func, void *cdata)
 {
-    ResourcePtr *resources;
-    ResourcePtr this, next;
-    int i, elements;
-    int *eltptr;
+    ClientResourceRec *rrec;
+    ResourceIterRec iter;
+    ResourcePtr this;
+    int i;
 
     if (!client)
         client = serverClient;
 
-    resources = clientTable[client->index].resources;
-    eltptr = &clientTable[client->index].elements;
-    for (i = 0; i < clientTable[client->index].buckets; i++) {
-        for (this = resources[i]; this; this = next) {
-            next = this->next;
-            elements = *eltptr;
+    rrec = &clientTable[client->index];
+    for (i = 0; i < rrec->numTypes; i++) {
+        PushIter(rrec, &iter, rrec->types[i]);
+        while ((this = NextIter(&iter)))
             (*func) (this->value, this->id, this->type, cdata);
-            if (*eltptr != elements)
-                next = resources[i];    /* start over */
-        }
+        PopIter(rrec, &iter);
     }
 }
 
@@ -1058,25 +1204,31 @@ LookupClientResourceComplex(ClientPtr client,
                             RESTYPE type,
                             FindComplexResType func, void *cdata)
 {
-    ResourcePtr *resources;
-    ResourcePtr this, next;
+    ClientResourceRec *rrec;
+    ResourceIterRec iter;
+    ResourcePtr this;
     void *value;
     int i;
 
     if (!client)
         client = serverClient;
 
-    resources = clientTable[client->index].resources;
-    for (i = 0; i < clientTable[client->index].buckets; i++) {
-        for (this = resources[i]; this; this = next) {
-            next = this->next;
+    rrec = &clientTable[client->index];
+    for (i = 0; i < rrec->numTypes; i++) {
+        if (type && i != (type & TypeMask))
+            continue;
+        PushIter(rrec, &iter, rrec->types[i]);
+        while ((this = NextIter(&iter))) {
             if (!type || this->type == type) {
                 /* workaround func freeing the type as DRI1 does */
                 value = this->value;
-                if ((*func) (value, this->id, cdata))
+                if ((*func) (value, this->id, cdata)) {
+                    PopIter(rrec, &iter);
                     return value;
+                }
             }
         }
+        PopIter(rrec, &iter);
     }
     return NULL;
 }
@@ -1084,48 +1236,33 @@ LookupClientResourceComplex(ClientPtr client,
 void
 FreeClientNeverRetainResources(ClientPtr client)
 {
-    ResourcePtr *resources;
+    ClientResourceRec *rrec;
+    ResourceIterRec iter;
     ResourcePtr this;
-    ResourcePtr *prev;
-    int j, elements;
-    int *eltptr;
+    int i;
 
     if (!client)
         return;
 
-    resources = clientTable[client->index].resources;
-    eltptr = &clientTable[client->index].elements;
-    for (j = 0; j < clientTable[client->index].buckets; j++) {
-        prev = &resources[j];
-        while ((this = *prev)) {
-            RESTYPE rtype = this->type;
-
-            if (rtype & RC_NEVERRETAIN) {
-#ifdef XSERVER_DTRACE
-                XSERVER_RESOURCE_FREE(this->id, this->type,
-                                      this->value, TypeNameString(this->type));
-#endif
-                *prev = this->next;
-                clientTable[client->index].elements--;
-                elements = *eltptr;
-
-                doFreeResource(this, FALSE);
-
-                if (*eltptr != elements)
-                    prev = &resources[j];       /* prev may no longer be valid */
-            }
-            else
-                prev = &this->next;
+    rrec = &clientTable[client->index];
+    for (i = 0; i < rrec->numTypes; i++) {
+        PushIter(rrec, &iter, rrec->types[i]);
+        while ((this = NextIter(&iter))) {
+            if (!(this->type & RC_NEVERRETAIN))
+                break;          /* the whole list is one type */
+            UnlinkResource(rrec, this);
+            doFreeResource(this, FALSE);
         }
+        PopIter(rrec, &iter);
     }
 }
 
 void
 FreeClientResources(ClientPtr client)
 {
-    ResourcePtr *resources;
+    ClientResourceRec *rrec;
     ResourcePtr this;
-    int j;
+    int i;
 
     /* This routine shouldn't be called with a null client, but just in
        case ... */
@@ -1135,35 +1272,26 @@ FreeClientResources(ClientPtr client)
 
     HandleSaveSet(client);
 
-    resources = clientTable[client->index].resources;
-    for (j = 0; j < clientTable[client->index].buckets; j++) {
-        /* It may seem silly to update the head of this resource list as
-           we delete the members, since the entire list will be deleted any way,
-           but there are some resource deletion functions "FreeClientPixels" for
-           one which do a LookupID on another resource id (a Colormap id in this
-           case), so the resource list must be kept valid up to the point that
-           it is deleted, so every time we delete a resource, we must update the
-           head, just like in FreeResource. I hope that this doesn't slow down
-           mass deletion appreciably. PRH */
-
-        ResourcePtr *head;
-
-        head = &resources[j];
-
-        for (this = *head; this; this = *head) {
-#ifdef XSERVER_DTRACE
-            XSERVER_RESOURCE_FREE(this->id, this->type,
-                                  this->value, TypeNameString(this->type));
-#endif
-            *head = this->next;
-            clientTable[client->index].elements--;
-
-            doFreeResource(this, FALSE);
+    /* Every resource is taken out of the table before it is freed, as
+       some deletion functions ("FreeClientPixels" for one) look up other
+       resources of the client.  Types registered later go first, so
+       extension resources sharing the id of a core resource are freed
+       before it, newest first within a type. */
+    rrec = &clientTable[client->index];
+    while (rrec->elements) {
+        for (i = rrec->numTypes; --i >= 0;) {
+            while ((this = rrec->types[i])) {
+                UnlinkResource(rrec, this);
+                doFreeResource(this, FALSE);
+            }
         }
     }
-    free(clientTable[client->index].resources);
-    clientTable[client->index].resources = NULL;
-    clientTable[client->index].buckets = 0;
+    free(rrec->table.slots);
+    free(rrec->old.slots);
+    free(rrec->types);
+    rrec->table.slots = rrec->old.slots = NULL;
+    rrec->types = NULL;
+    rrec->numTypes = 0;
 }
 
 void
@@ -1172,7 +1300,7 @@ FreeAllResources(void)
     int i;
 
     for (i = currentMaxClients; --i >= 0;) {
-        if (clientTable[i].buckets)
+        if (ClientResourcesInUse(&clientTable[i]))
             FreeClientResources(clients[i]);
     }
 }
@@ -1206,20 +1334,16 @@ int
 dixLookupResourceByType(void **result, XID id, RESTYPE rtype,
                         ClientPtr client, Mask mode)
 {
-    int cid = CLIENT_ID(id);
-    ResourcePtr res = NULL;
+    int cid;
+    ResourcePtr res;
 
     *result = NULL;
     if ((rtype & TypeMask) > lastResourceType)
         return BadImplementation;
 
-    if ((cid < LimitClients) && clientTable[cid].buckets) {
-        res = clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
-
-        for (; res; res = res->next)
-            if (res->id == id && res->type == rtype)
-                break;
-    }
+    for (res = LookupResourceChain(CLIENT_ID(id), id); res; res = res->next)
+        if (res->type == rtype)
+            break;
     if (!res)
         return resourceTypes[rtype & TypeMask].errorValue;
 
@@ -1241,18 +1365,14 @@ int
 dixLookupResourceByClass(void **result, XID id, RESTYPE rclass,
                          ClientPtr client, Mask mode)
 {
-    int cid = CLIENT_ID(id);
-    ResourcePtr res = NULL;
+    int cid;
+    ResourcePtr res;
 
     *result = NULL;
 
-    if ((cid < LimitClients) && clientTable[cid].buckets) {
-        res = clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
-
-        for (; res; res = res->next)
-            if (res->id == id && (res->type & rclass))
-                break;
-    }
+    for (res = LookupResourceChain(CLIENT_ID(id), id); res; res = res->next)
+        if (res->type & rclass)
+            break;
     if (!res)
         return BadValue;
 
@@ -601,6 +601,8 @@ CreateRootWindow(ScreenPtr pScreen)
     pWin->optional->otherClients = NULL;
     pWin->optional->passiveGrabs = NULL;
     pWin->optional->userProps = NULL;
+    pWin->optional->propIndex = NULL;
+    pWin->optional->childIndex = NULL;
     pWin->optional->backingBitPlanes = ~0L;
     pWin->optional->backingPixel = 0;
     pWin->optional->boundingShape = NULL;
@@ -973,6 +975,7 @@ DisposeWindowOptional(WindowPtr pWin)
 {
     if (!pWin->optional)
         return;
+    WindowIndexFree(pWin);
     /*
      * everything is peachy.  Delete the optional record
      * and clean up
@@ -1098,6 +1101,7 @@ DeleteWindow(void *value, XID wid)
 
     FreeWindowResources(pWin);
     if (pParent) {
+        WindowIndexInvalidate(pParent);
         if (pParent->firstChild == pWin)
             pParent->firstChild = pWin->nextSib;
         if (pParent->lastChild == pWin)
@@ -1702,6 +1706,7 @@ MoveWindowInStack(WindowPtr pWin, WindowPtr pNextSib)
                     pFirstChange = pFirstChange->nextSib;
             }
         }
+        WindowIndexInvalidate(pParent);
         if (pWin->drawable.pScreen->RestackWindow)
             (*pWin->drawable.pScreen->RestackWindow) (pWin, pOldNextSib);
     }
@@ -1743,15 +1748,14 @@ SetWinSize(WindowPtr pWin)
                              pWin->drawable.x, pWin->drawable.y,
                              (int) pWin->drawable.width,
                              (int) pWin->drawable.height);
-    if (wBoundingShape(pWin) || wClipShape(pWin)) {
-        RegionTranslate(&pWin->winSize, -pWin->drawable.x, -pWin->drawable.y);
-        if (wBoundingShape(pWin))
-            RegionIntersect(&pWin->winSize, &pWin->winSize,
-                            wBoundingShape(pWin));
-        if (wClipShape(pWin))
-            RegionIntersect(&pWin->winSize, &pWin->winSize, wClipShape(pWin));
-        RegionTranslate(&pWin->winSize, pWin->drawable.x, pWin->drawable.y);
-    }
+    if (wBoundingShape(pWin))
+        RegionTranslateIntersect(&pWin->winSize, &pWin->winSize,
+                                 wBoundingShape(pWin),
+                                 pWin->drawable.x, pWin->drawable.y);
+    if (wClipShape(pWin))
+        RegionTranslateIntersect(&pWin->winSize, &pWin->winSize,
+                                 wClipShape(pWin),
+                                 pWin->drawable.x, pWin->drawable.y);
 }
 
 void
@@ -1782,12 +1786,9 @@ SetBorderSize(WindowPtr pWin)
                                  (int) (pWin->drawable.width + (bw << 1)),
                                  (int) (pWin->drawable.height + (bw << 1)));
         if (wBoundingShape(pWin)) {
-            RegionTranslate(&pWin->borderSize, -pWin->drawable.x,
-                            -pWin->drawable.y);
-            RegionIntersect(&pWin->borderSize, &pWin->borderSize,
-                            wBoundingShape(pWin));
-            RegionTranslate(&pWin->borderSize, pWin->drawable.x,
-                            pWin->drawable.y);
+            RegionTranslateIntersect(&pWin->borderSize, &pWin->borderSize,
+                                     wBoundingShape(pWin),
+                                     pWin->drawable.x, pWin->drawable.y);
             RegionUnion(&pWin->borderSize, &pWin->borderSize, &pWin->winSize);
         }
     }
@@ -1879,6 +1880,7 @@ ResizeChildrenWinSize(WindowPtr pWin, int dx, int dy, int dw, int dh)
                 DeliverEvents(pSib, &event, 1, NullWindow);
                 pSib->origin.x = cwsx;
                 pSib->origin.y = cwsy;
+                WindowIndexUpdate(pSib);
             }
         }
         pSib->drawable.x = pWin->drawable.x + pSib->origin.x;
@@ -1974,11 +1976,9 @@ MakeBoundingRegion(WindowPtr pWin, BoxPtr pBox)
 {
     RegionPtr pRgn = RegionCreate(pBox, 1);
 
-    if (wBoundingShape(pWin)) {
-        RegionTranslate(pRgn, -pWin->origin.x, -pWin->origin.y);
-        RegionIntersect(pRgn, pRgn, wBoundingShape(pWin));
-        RegionTranslate(pRgn, pWin->origin.x, pWin->origin.y);
-    }
+    if (wBoundingShape(pWin))
+        RegionTranslateIntersect(pRgn, pRgn, wBoundingShape(pWin),
+                                 pWin->origin.x, pWin->origin.y);
     return pRgn;
 }
 
@@ -2548,6 +2548,8 @@ ReparentWindow(WindowPtr pWin, WindowPtr pParent,
     /* take out of sibling chain */
 
     pPriorParent = pPrev = pWin->parent;
+    WindowIndexInvalidate(pPriorParent);
+    WindowIndexInvalidate(pParent);
     if (pPrev->firstChild == pWin)
         pPrev->firstChild = pWin->nextSib;
     if (pPrev->lastChild == pWin)
@@ -2686,6 +2688,7 @@ MapWindow(WindowPtr pWin, ClientPtr client)
                 return Success;
 
         pWin->mapped = TRUE;
+        WindowIndexUpdate(pWin);
         if (SubStrSend(pWin, pParent))
             DeliverMapNotify(pWin);
 
@@ -2754,6 +2757,7 @@ MapSubwindows(WindowPtr pParent, ClientPtr client)
                     continue;
 
             pWin->mapped = TRUE;
+            WindowIndexUpdate(pWin);
             if (parentNotify || StrSend(pWin))
                 DeliverMapNotify(pWin);
 
@@ -2870,6 +2874,7 @@ UnmapWindow(WindowPtr pWin, Bool fromConfigure)
         (*pScreen->MarkWindow) (pLayerWin->parent);
     }
     pWin->mapped = FALSE;
+    WindowIndexUpdate(pWin);
     if (wasRealized)
         UnrealizeTree(pWin, fromConfigure);
     if (wasViewable) {
@@ -2921,6 +2926,7 @@ UnmapSubwindows(WindowPtr pWin)
                 anyMarked = TRUE;
             }
             pChild->mapped = FALSE;
+            WindowIndexUpdate(pChild);
             if (pChild->realized)
                 UnrealizeTree(pChild, FALSE);
         }
@@ -2983,8 +2989,10 @@ HandleSaveSet(ClientPtr client)
                                pParent->drawable.x,
                                pWin->drawable.y - wBorderWidth(pWin) -
                                pParent->drawable.y, client);
-                if (!pWin->realized && pWin->mapped)
+                if (!pWin->realized && pWin->mapped) {
                     pWin->mapped = FALSE;
+                    WindowIndexUpdate(pWin);
+                }
             }
             if (SaveSetShouldMap(client->saveSet[j]))
                 MapWindow(pWin, client);
@@ -3365,6 +3373,8 @@ CheckWindowOptionalNeed(WindowPtr w)
         return;
     if (optional->userProps != NULL)
         return;
+    if (optional->childIndex != NULL)
+        return;
     if (optional->backingBitPlanes != (CARD32)~0L)
         return;
     if (optional->backingPixel != 0)
@@ -3421,6 +3431,8 @@ MakeWindowOptional(WindowPtr pWin)
     optional->otherClients = NULL;
     optional->passiveGrabs = NULL;
     optional->userProps = NULL;
+    optional->propIndex = NULL;
+    optional->childIndex = NULL;
     optional->backingBitPlanes = ~0L;
     optional->backingPixel = 0;
     optional->boundingShape = NULL;
@@ -0,0 +1,387 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Spatial index of the children of a window, for pointer hit testing.
+ *
+ * Finding the window under the pointer walks down the tree, and at every
+ * level checks the children from the top of the stack down until one
+ * contains the point.  With thousands of siblings that walk dominates
+ * pointer motion.  Once a window is seen to have many children, it gets
+ * a uniform grid over its area, each cell listing the mapped children
+ * whose border box touches it, topmost first.  A lookup then only has to
+ * run the exact test on the few children in one cell.
+ *
+ * The grid works in parent relative coordinates, so moving the parent
+ * doesn't touch it.  Children being mapped, unmapped, moved or resized
+ * are moved between cells as it happens; anything that changes the
+ * stacking order or the set of children just marks the index stale, and
+ * it is rebuilt at the next lookup.  Cell coordinates are clamped to the
+ * grid, which keeps every child that contains a point in the point's
+ * cell even when the child or the point lies outside the parent.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include "misc.h"
+#include "windowstr.h"
+#include "regionstr.h"
+#include "input.h"
+
+/* Index a window once a lookup has to step over this many children */
+#define WINDOW_INDEX_MIN_CHILDREN   32
+/* and drop the index again when a rebuild finds fewer than this */
+#define WINDOW_INDEX_DROP_CHILDREN  16
+
+/* Cells are at least 64 pixels, and there are at most 32 in either
+ * direction */
+#define WINDOW_INDEX_MIN_SHIFT      6
+#define WINDOW_INDEX_MAX_CELLS      32
+
+typedef struct {
+    WindowPtr win;
+    int rank;                   /* higher is closer to the top */
+} WindowIndexEntry;
+
+typedef struct {
+    int num;
+    int size;
+    WindowIndexEntry *entries;  /* sorted topmost first */
+} WindowIndexCell;
+
+typedef struct {
+    WindowPtr win;
+    int rank;
+    short x1, y1, x2, y2;       /* cells covered, x2 < x1 when none */
+} WindowIndexChild;
+
+typedef struct _WindowIndex {
+    Bool stale;
+    int shift;
+    int cols, rows;
+    int width, height;          /* of the parent when built */
+    WindowIndexCell *cells;
+    unsigned int bits;
+    WindowIndexChild *children; /* open addressed by window */
+} WindowIndexRec;
+
+static inline WindowIndexPtr
+WindowGetIndex(WindowPtr pWin)
+{
+    return pWin->optional ? pWin->optional->childIndex : NULL;
+}
+
+static Bool
+ChildContainsPoint(WindowPtr pWin, int x, int y)
+{
+    BoxRec box;
+
+    return pWin->mapped &&
+        x >= pWin->drawable.x - wBorderWidth(pWin) &&
+        x < pWin->drawable.x + (int) pWin->drawable.width +
+        wBorderWidth(pWin) &&
+        y >= pWin->drawable.y - wBorderWidth(pWin) &&
+        y < pWin->drawable.y + (int) pWin->drawable.height +
+        wBorderWidth(pWin) &&
+        /* When a window is shaped, a further check
+         * is made to see if the point is inside
+         * borderSize
+         */
+        (!wBoundingShape(pWin) || PointInBorderSize(pWin, x, y)) &&
+        (!wInputShape(pWin) ||
+         RegionContainsPoint(wInputShape(pWin),
+                             x - pWin->drawable.x,
+                             y - pWin->drawable.y, &box)) &&
+        /* In rootless mode windows may be offscreen, even when
+         * they're in X's stack. (E.g. if the native window system
+         * implements some form of virtual desktop system).
+         */
+        !pWin->unhittable;
+}
+
+static inline int
+WindowIndexCol(WindowIndexPtr idx, int x)
+{
+    x >>= idx->shift;
+    return x < 0 ? 0 : x >= idx->cols ? idx->cols - 1 : x;
+}
+
+static inline int
+WindowIndexRow(WindowIndexPtr idx, int y)
+{
+    y >>= idx->shift;
+    return y < 0 ? 0 : y >= idx->rows ? idx->rows - 1 : y;
+}
+
+static WindowIndexChild *
+WindowIndexFind(WindowIndexPtr idx, WindowPtr pWin)
+{
+    unsigned int mask = (1 << idx->bits) - 1;
+    unsigned int i = (uint32_t) (((uintptr_t) pWin >> 4) * 0x9e3779b1U) >>
+        (32 - idx->bits);
+
+    for (;; i = (i + 1) & mask) {
+        if (idx->children[i].win == pWin || !idx->children[i].win)
+            return &idx->children[i];
+    }
+}
+
+static Bool
+WindowIndexCellAdd(WindowIndexCell *cell, WindowPtr pWin, int rank)
+{
+    int i;
+
+    if (cell->num == cell->size) {
+        int size = cell->size ? cell->size * 2 : 4;
+        WindowIndexEntry *entries;
+
+        entries = reallocarray(cell->entries, size, sizeof(*entries));
+        if (!entries)
+            return FALSE;
+        cell->entries = entries;
+        cell->size = size;
+    }
+
+    for (i = cell->num; i > 0 && cell->entries[i - 1].rank < rank; i--)
+        cell->entries[i] = cell->entries[i - 1];
+    cell->entries[i].win = pWin;
+    cell->entries[i].rank = rank;
+    cell->num++;
+    return TRUE;
+}
+
+static void
+WindowIndexCellRemove(WindowIndexCell *cell, WindowPtr pWin)
+{
+    int i;
+
+    for (i = 0; i < cell->num; i++) {
+        if (cell->entries[i].win == pWin) {
+            memmove(&cell->entries[i], &cell->entries[i + 1],
+                    (cell->num - i - 1) * sizeof(WindowIndexEntry));
+            cell->num--;
+            return;
+        }
+    }
+}
+
+static void
+WindowIndexRemoveChild(WindowIndexPtr idx, WindowIndexChild *child)
+{
+    int x, y;
+
+    for (y = child->y1; y <= child->y2; y++)
+        for (x = child->x1; x <= child->x2; x++)
+            WindowIndexCellRemove(&idx->cells[y * idx->cols + x], child->win);
+    child->x1 = child->y1 = 0;
+    child->x2 = child->y2 = -1;
+}
+
+static Bool
+WindowIndexAddChild(WindowIndexPtr idx, WindowIndexChild *child)
+{
+    WindowPtr pWin = child->win;
+    int bw = wBorderWidth(pWin);
+    int x, y;
+
+    if (!pWin->mapped)
+        return TRUE;
+
+    child->x1 = WindowIndexCol(idx, pWin->origin.x - bw);
+    child->y1 = WindowIndexRow(idx, pWin->origin.y - bw);
+    child->x2 = WindowIndexCol(idx, pWin->origin.x +
+                               (int) pWin->drawable.width + bw - 1);
+    child->y2 = WindowIndexRow(idx, pWin->origin.y +
+                               (int) pWin->drawable.height + bw - 1);
+
+    for (y = child->y1; y <= child->y2; y++)
+        for (x = child->x1; x <= child->x2; x++)
+            if (!WindowIndexCellAdd(&idx->cells[y * idx->cols + x],
+                                    pWin, child->rank))
+                return FALSE;
+    return TRUE;
+}
+
+static void
+WindowIndexClear(WindowIndexPtr idx)
+{
+    int i;
+
+    for (i = 0; i < idx->cols * idx->rows; i++)
+        free(idx->cells[i].entries);
+    free(idx->cells);
+    free(idx->children);
+    idx->cells = NULL;
+    idx->children = NULL;
+}
+
+void
+WindowIndexFree(WindowPtr pWin)
+{
+    WindowIndexPtr idx = WindowGetIndex(pWin);
+
+    if (idx) {
+        WindowIndexClear(idx);
+        free(idx);
+        pWin->optional->childIndex = NULL;
+    }
+}
+
+static Bool
+WindowIndexBuild(WindowPtr pParent, int numChildren)
+{
+    WindowIndexPtr idx = WindowGetIndex(pParent);
+    WindowPtr pChild;
+    int span, rank;
+
+    if (!idx) {
+        if (!MakeWindowOptional(pParent))
+            return FALSE;
+        idx = calloc(1, sizeof(WindowIndexRec));
+        if (!idx)
+            return FALSE;
+        pParent->optional->childIndex = idx;
+    }
+    else
+        WindowIndexClear(idx);
+
+    idx->stale = FALSE;
+    idx->width = pParent->drawable.width;
+    idx->height = pParent->drawable.height;
+    span = max(idx->width, idx->height);
+    for (idx->shift = WINDOW_INDEX_MIN_SHIFT;
+         (span >> idx->shift) >= WINDOW_INDEX_MAX_CELLS; idx->shift++);
+    idx->cols = max((idx->width + (1 << idx->shift) - 1) >> idx->shift, 1);
+    idx->rows = max((idx->height + (1 << idx->shift) - 1) >> idx->shift, 1);
+
+    for (idx->bits = 4; (1 << idx->bits) < numChildren * 2; idx->bits++);
+
+    idx->cells = calloc(idx->cols * idx->rows, sizeof(WindowIndexCell));
+    idx->children = calloc(1 << idx->bits, sizeof(WindowIndexChild));
+    if (!idx->cells || !idx->children)
+        goto bail;
+
+    rank = numChildren;
+    for (pChild = pParent->firstChild; pChild; pChild = pChild->nextSib) {
+        WindowIndexChild *child = WindowIndexFind(idx, pChild);
+
+        child->win = pChild;
+        child->rank = --rank;
+        child->x1 = child->y1 = 0;
+        child->x2 = child->y2 = -1;
+        if (!WindowIndexAddChild(idx, child))
+            goto bail;
+    }
+    return TRUE;
+
+ bail:
+    WindowIndexFree(pParent);
+    return FALSE;
+}
+
+/*
+ * The children of pParent were added to, removed or restacked
+ */
+void
+WindowIndexInvalidate(WindowPtr pParent)
+{
+    WindowIndexPtr idx = WindowGetIndex(pParent);
+
+    if (idx)
+        idx->stale = TRUE;
+}
+
+/*
+ * pWin was mapped or unmapped, or its position, size or border width
+ * changed
+ */
+void
+WindowIndexUpdate(WindowPtr pWin)
+{
+    WindowIndexPtr idx;
+    WindowIndexChild *child;
+
+    if (!pWin->parent || !(idx = WindowGetIndex(pWin->parent)) || idx->stale)
+        return;
+
+    child = WindowIndexFind(idx, pWin);
+    if (!child->win) {
+        /* not seen yet, so the set of children has changed */
+        idx->stale = TRUE;
+        return;
+    }
+
+    WindowIndexRemoveChild(idx, child);
+    if (!WindowIndexAddChild(idx, child))
+        idx->stale = TRUE;
+}
+
+/*
+ * The topmost mapped child of pParent which contains the point x, y in
+ * screen coordinates and accepts input there, or NULL if none does.
+ */
+WindowPtr
+ChildWindowAtPoint(WindowPtr pParent, int x, int y)
+{
+    WindowIndexPtr idx = WindowGetIndex(pParent);
+    WindowIndexCell *cell;
+    WindowPtr pWin;
+    int i, n;
+
+    if (idx && (idx->stale || idx->width != pParent->drawable.width ||
+                idx->height != pParent->drawable.height)) {
+        for (n = 0, pWin = pParent->firstChild; pWin; pWin = pWin->nextSib)
+            n++;
+        if (n < WINDOW_INDEX_DROP_CHILDREN || !WindowIndexBuild(pParent, n)) {
+            WindowIndexFree(pParent);
+            idx = NULL;
+        }
+    }
+
+    if (idx) {
+        cell = &idx->cells[WindowIndexRow(idx, y - pParent->drawable.y) *
+                           idx->cols +
+                           WindowIndexCol(idx, x - pParent->drawable.x)];
+        for (i = 0; i < cell->num; i++) {
+            if (ChildContainsPoint(cell->entries[i].win, x, y))
+                return cell->entries[i].win;
+        }
+        return NULL;
+    }
+
+    for (n = 0, pWin = pParent->firstChild; pWin; pWin = pWin->nextSib, n++) {
+        if (ChildContainsPoint(pWin, x, y))
+            break;
+    }
+
+    /* A long walk, index the children for next time */
+    if (n >= WINDOW_INDEX_MIN_CHILDREN) {
+        int total = n;
+        WindowPtr pChild;
+
+        for (pChild = pWin; pChild; pChild = pChild->nextSib)
+            total++;
+        WindowIndexBuild(pParent, total);
+    }
+    return pWin;
+}
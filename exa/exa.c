@@ -718,10 +718,21 @@ ExaBlockHandler(ScreenPtr pScreen, void *pTimeout)
     if (pExaScr->info->flags & EXA_HANDLES_PIXMAPS)
         return;
 
+    /* A defragment pass, once started, goes on a little at a time whenever
+     * the server is about to sleep, until it is done.
+     */
+    if (pExaScr->defragArea) {
+        if (ExaOffscreenDefragment(pScreen, EXA_DEFRAGMENT_BUDGET) ||
+            !pExaScr->defragArea)
+            pExaScr->lastDefragment = GetTimeInMillis();
+        else
+            AdjustWaitForDelay(pTimeout, 0);
+    }
+
     /* Try and keep the offscreen memory area tidy every now and then (at most
      * once per second) when the server has been idle for at least 100ms.
      */
-    if (pExaScr->numOffscreenAvailable > 1) {
+    if (!pExaScr->defragArea && pExaScr->numOffscreenAvailable > 1) {
         CARD32 now = GetTimeInMillis();
 
         pExaScr->nextDefragment = now +
@@ -739,13 +750,14 @@ ExaWakeupHandler(ScreenPtr pScreen, int result)
     (*pScreen->WakeupHandler) (pScreen, result);
     wrap(pExaScr, pScreen, WakeupHandler, ExaWakeupHandler);
 
-    if (result == 0 && pExaScr->numOffscreenAvailable > 1) {
+    if (result == 0 && !pExaScr->defragArea &&
+        pExaScr->numOffscreenAvailable > 1) {
         CARD32 now = GetTimeInMillis();
 
-        if ((int) (now - pExaScr->nextDefragment) > 0) {
-            ExaOffscreenDefragment(pScreen);
+        if ((int) (now - pExaScr->nextDefragment) > 0 &&
+            (ExaOffscreenDefragment(pScreen, EXA_DEFRAGMENT_BUDGET) ||
+             !pExaScr->defragArea))
             pExaScr->lastDefragment = now;
-        }
     }
 }
 
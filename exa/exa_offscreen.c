@@ -22,8 +22,10 @@
 
 /** @file
  * This allocator allocates blocks of memory by maintaining a list of areas.
- * When allocating, the contiguous block of areas with the minimum eviction
- * cost is found and evicted in order to make room for the new allocation.
+ * Free areas are also filed in lists by size class, so that one that fits
+ * is found without walking the areas.  When none fits, the contiguous block
+ * of areas with the minimum eviction cost around the least recently used
+ * areas is found and evicted in order to make room for the new allocation.
  */
 
 #include "exa_priv.h"
@@ -38,6 +40,300 @@
 #define DBG_OFFSCREEN(a)
 #endif
 
+#define ExaOffscreenAreaPriv(a) ((ExaOffscreenAreaPrivPtr) (a))
+
+/* How many free areas of its own size class a request tries */
+#define EXA_FIT_TRIES 8
+
+/* How many removable areas eviction looks around, and how far */
+#define EXA_EVICT_CANDIDATES 8
+#define EXA_EVICT_REACH 16
+
+/* Position of the highest bit set in x, which isn't 0 */
+static int
+exaOffscreenLog2(unsigned int x)
+{
+    int l = 0;
+
+    if (x >= 1 << 16) {
+        x >>= 16;
+        l += 16;
+    }
+    if (x >= 1 << 8) {
+        x >>= 8;
+        l += 8;
+    }
+    if (x >= 1 << 4) {
+        x >>= 4;
+        l += 4;
+    }
+    if (x >= 1 << 2) {
+        x >>= 2;
+        l += 2;
+    }
+    if (x >= 1 << 1)
+        l += 1;
+    return l;
+}
+
+static void
+exaOffscreenSizeClass(unsigned int size, int *fl, int *sl)
+{
+    int l;
+
+    if (size < EXA_OFFSCREEN_SL) {
+        *fl = 0;
+        *sl = size;
+        return;
+    }
+    l = exaOffscreenLog2(size);
+    *fl = l - EXA_OFFSCREEN_SL_SHIFT + 1;
+    *sl = (size >> (l - EXA_OFFSCREEN_SL_SHIFT)) - EXA_OFFSCREEN_SL;
+}
+
+/* The first size class all of whose areas are at least size bytes */
+static void
+exaOffscreenSearchClass(unsigned int size, int *fl, int *sl)
+{
+    if (size >= EXA_OFFSCREEN_SL)
+        size += (1U << (exaOffscreenLog2(size) - EXA_OFFSCREEN_SL_SHIFT)) - 1;
+    exaOffscreenSizeClass(size, fl, sl);
+}
+
+static void
+exaOffscreenFreeInsert(ExaScreenPrivPtr pExaScr, ExaOffscreenArea * area)
+{
+    ExaOffscreenAreaPrivPtr priv = ExaOffscreenAreaPriv(area);
+    int fl, sl;
+
+    exaOffscreenSizeClass(area->size, &fl, &sl);
+    priv->free_prev = NULL;
+    priv->free_next = pExaScr->offScreenFree[fl][sl];
+    if (priv->free_next)
+        priv->free_next->free_prev = priv;
+    pExaScr->offScreenFree[fl][sl] = priv;
+    pExaScr->offScreenFreeSL[fl] |= 1 << sl;
+    pExaScr->offScreenFreeFL |= 1U << fl;
+}
+
+/* Must be called before the size of a free area changes */
+static void
+exaOffscreenFreeRemove(ExaScreenPrivPtr pExaScr, ExaOffscreenArea * area)
+{
+    ExaOffscreenAreaPrivPtr priv = ExaOffscreenAreaPriv(area);
+    int fl, sl;
+
+    exaOffscreenSizeClass(area->size, &fl, &sl);
+    if (priv->free_next)
+        priv->free_next->free_prev = priv->free_prev;
+    if (priv->free_prev)
+        priv->free_prev->free_next = priv->free_next;
+    else {
+        pExaScr->offScreenFree[fl][sl] = priv->free_next;
+        if (!priv->free_next) {
+            pExaScr->offScreenFreeSL[fl] &= ~(1 << sl);
+            if (!pExaScr->offScreenFreeSL[fl])
+                pExaScr->offScreenFreeFL &= ~(1U << fl);
+        }
+    }
+}
+
+/* size plus what aligning the end of the area to align loses */
+static int
+exaOffscreenRealSize(ExaOffscreenArea * area, int size, int align)
+{
+    return size + (area->base_offset + area->size - size) % align;
+}
+
+static ExaOffscreenArea *
+exaOffscreenFindFree(ExaScreenPrivPtr pExaScr, int size, int align)
+{
+    ExaOffscreenAreaPrivPtr priv;
+    unsigned int map;
+    int fl, sl, tries;
+
+    /* An area of the request's own class, if one fits, wastes the least;
+     * don't look through too many of them.
+     */
+    exaOffscreenSizeClass(size, &fl, &sl);
+    for (priv = pExaScr->offScreenFree[fl][sl], tries = EXA_FIT_TRIES;
+         priv && tries; priv = priv->free_next, tries--) {
+        if (exaOffscreenRealSize(&priv->area, size, align) <= priv->area.size)
+            return &priv->area;
+    }
+
+    /* Otherwise any area of the next class large enough whatever the
+     * alignment loss does.
+     */
+    exaOffscreenSearchClass((unsigned int) size + align - 1, &fl, &sl);
+    if (fl >= EXA_OFFSCREEN_FL)
+        return NULL;
+    map = pExaScr->offScreenFreeSL[fl] & (~0U << sl);
+    if (!map) {
+        if (fl + 1 >= EXA_OFFSCREEN_FL)
+            return NULL;
+        map = pExaScr->offScreenFreeFL & (~0U << (fl + 1));
+        if (!map)
+            return NULL;
+        fl = ffs(map) - 1;
+        map = pExaScr->offScreenFreeSL[fl];
+    }
+    sl = ffs(map) - 1;
+    return &pExaScr->offScreenFree[fl][sl]->area;
+}
+
+/*
+ * The heap of removable areas is ordered by last use.  Marking a pixmap used
+ * only bumps its area's last_use, so an area whose key has gone stale is put
+ * back in its place when it comes to the top.
+ */
+static Bool
+exaOffscreenHeapBefore(ExaOffscreenAreaPrivPtr a, ExaOffscreenAreaPrivPtr b)
+{
+    return (int) (a->heap_key - b->heap_key) < 0;
+}
+
+static void
+exaOffscreenHeapSet(ExaScreenPrivPtr pExaScr, int i,
+                    ExaOffscreenAreaPrivPtr priv)
+{
+    pExaScr->offScreenHeap[i] = priv;
+    priv->heap_index = i;
+}
+
+static void
+exaOffscreenHeapUp(ExaScreenPrivPtr pExaScr, int i)
+{
+    ExaOffscreenAreaPrivPtr priv = pExaScr->offScreenHeap[i];
+
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+
+        if (!exaOffscreenHeapBefore(priv, pExaScr->offScreenHeap[parent]))
+            break;
+        exaOffscreenHeapSet(pExaScr, i, pExaScr->offScreenHeap[parent]);
+        i = parent;
+    }
+    exaOffscreenHeapSet(pExaScr, i, priv);
+}
+
+static void
+exaOffscreenHeapDown(ExaScreenPrivPtr pExaScr, int i)
+{
+    ExaOffscreenAreaPrivPtr priv = pExaScr->offScreenHeap[i];
+    int n = pExaScr->offScreenHeapSize;
+
+    for (;;) {
+        int child = 2 * i + 1;
+
+        if (child >= n)
+            break;
+        if (child + 1 < n &&
+            exaOffscreenHeapBefore(pExaScr->offScreenHeap[child + 1],
+                                   pExaScr->offScreenHeap[child]))
+            child++;
+        if (!exaOffscreenHeapBefore(pExaScr->offScreenHeap[child], priv))
+            break;
+        exaOffscreenHeapSet(pExaScr, i, pExaScr->offScreenHeap[child]);
+        i = child;
+    }
+    exaOffscreenHeapSet(pExaScr, i, priv);
+}
+
+/* An area that doesn't make it into the heap is still found by the full
+ * search in exaFindAreaToEvict.
+ */
+static void
+exaOffscreenHeapInsert(ExaScreenPrivPtr pExaScr, ExaOffscreenArea * area)
+{
+    ExaOffscreenAreaPrivPtr priv = ExaOffscreenAreaPriv(area);
+
+    if (pExaScr->offScreenHeapSize == pExaScr->offScreenHeapAlloc) {
+        int n = pExaScr->offScreenHeapAlloc ?
+            pExaScr->offScreenHeapAlloc * 2 : 64;
+        ExaOffscreenAreaPrivPtr *heap =
+            reallocarray(pExaScr->offScreenHeap, n, sizeof(*heap));
+
+        if (!heap)
+            return;
+        pExaScr->offScreenHeap = heap;
+        pExaScr->offScreenHeapAlloc = n;
+    }
+    priv->heap_key = area->last_use;
+    exaOffscreenHeapSet(pExaScr, pExaScr->offScreenHeapSize++, priv);
+    exaOffscreenHeapUp(pExaScr, priv->heap_index);
+}
+
+static void
+exaOffscreenHeapRemove(ExaScreenPrivPtr pExaScr, ExaOffscreenArea * area)
+{
+    ExaOffscreenAreaPrivPtr priv = ExaOffscreenAreaPriv(area);
+    int i = priv->heap_index;
+
+    if (i < 0)
+        return;
+    priv->heap_index = -1;
+    if (i == --pExaScr->offScreenHeapSize)
+        return;
+    exaOffscreenHeapSet(pExaScr, i,
+                        pExaScr->offScreenHeap[pExaScr->offScreenHeapSize]);
+    exaOffscreenHeapUp(pExaScr, i);
+    exaOffscreenHeapDown(pExaScr, pExaScr->offScreenHeap[i]->heap_index);
+}
+
+static ExaOffscreenArea *
+exaOffscreenHeapTop(ExaScreenPrivPtr pExaScr)
+{
+    while (pExaScr->offScreenHeapSize) {
+        ExaOffscreenAreaPrivPtr top = pExaScr->offScreenHeap[0];
+
+        if (top->heap_key == top->area.last_use)
+            return &top->area;
+        top->heap_key = top->area.last_use;
+        exaOffscreenHeapDown(pExaScr, 0);
+    }
+    return NULL;
+}
+
+#if DEBUG_OFFSCREEN
+static void
+exaOffscreenValidateIndex(ExaScreenPrivPtr pExaScr)
+{
+    ExaOffscreenArea *area;
+    ExaOffscreenAreaPrivPtr priv;
+    unsigned nfree = 0;
+    int fl, sl, i;
+
+    for (fl = 0; fl < EXA_OFFSCREEN_FL; fl++) {
+        assert(!(pExaScr->offScreenFreeFL & (1U << fl)) ==
+               !pExaScr->offScreenFreeSL[fl]);
+        for (sl = 0; sl < EXA_OFFSCREEN_SL; sl++) {
+            assert(!(pExaScr->offScreenFreeSL[fl] & (1 << sl)) ==
+                   !pExaScr->offScreenFree[fl][sl]);
+            for (priv = pExaScr->offScreenFree[fl][sl]; priv;
+                 priv = priv->free_next) {
+                int afl, asl;
+
+                assert(priv->area.state == ExaOffscreenAvail);
+                exaOffscreenSizeClass(priv->area.size, &afl, &asl);
+                assert(afl == fl && asl == sl);
+                nfree++;
+            }
+        }
+    }
+    for (area = pExaScr->info->offScreenAreas; area; area = area->next)
+        if (area->state == ExaOffscreenAvail)
+            nfree--;
+    assert(nfree == 0);
+
+    for (i = 0; i < pExaScr->offScreenHeapSize; i++) {
+        priv = pExaScr->offScreenHeap[i];
+        assert(priv->heap_index == i);
+        assert(priv->area.state == ExaOffscreenRemovable);
+    }
+}
+#endif
+
 #if DEBUG_OFFSCREEN
 static void
 ExaOffscreenValidate(ScreenPtr pScreen)
@@ -55,6 +351,7 @@ ExaOffscreenValidate(ScreenPtr pScreen)
         prev = area;
     }
     assert(prev->base_offset + prev->size == pExaScr->info->memorySize);
+    exaOffscreenValidateIndex(pExaScr);
 }
 #else
 #define ExaOffscreenValidate(s)
@@ -87,48 +384,51 @@ exaUpdateEvictionCost(ExaOffscreenArea * area, unsigned offScreenCounter)
     area->eviction_cost = area->size / age;
 }
 
+/*
+ * Finds the block of areas from begin up to stop with at least need bytes
+ * and the lowest eviction cost, if that's less than *best_cost.
+ */
 static ExaOffscreenArea *
-exaFindAreaToEvict(ExaScreenPrivPtr pExaScr, int size, int align)
+exaFindAreaToEvictIn(ExaScreenPrivPtr pExaScr, ExaOffscreenArea * begin,
+                     ExaOffscreenArea * stop, int need, unsigned *best_cost)
 {
-    ExaOffscreenArea *begin, *end, *best;
-    unsigned cost, best_cost;
-    int avail, real_size;
+    ExaOffscreenArea *end, *best;
+    unsigned cost;
+    int avail;
 
-    best_cost = UINT_MAX;
-    begin = end = pExaScr->info->offScreenAreas;
+    end = begin;
     avail = 0;
     cost = 0;
     best = 0;
 
-    while (end != NULL) {
- restart:
-        while (begin != NULL && begin->state == ExaOffscreenLocked)
+    while (begin != stop) {
+        if (begin->state == ExaOffscreenLocked) {
             begin = end = begin->next;
+            avail = 0;
+            cost = 0;
+            continue;
+        }
 
-        if (begin == NULL)
-            break;
-
-        /* adjust size needed to account for alignment loss for this area */
-        real_size = size + (begin->base_offset + begin->size - size) % align;
-
-        while (avail < real_size && end != NULL) {
-            if (end->state == ExaOffscreenLocked) {
-                /* Can't more room here, restart after this locked area */
-                avail = 0;
-                cost = 0;
-                begin = end;
-                goto restart;
-            }
+        while (avail < need && end != stop &&
+               end->state != ExaOffscreenLocked) {
             avail += end->size;
             exaUpdateEvictionCost(end, pExaScr->offScreenCounter);
             cost += end->eviction_cost;
             end = end->next;
         }
 
+        if (avail < need) {
+            if (end == stop)
+                break;
+            /* Can't get more room here, restart after the locked area */
+            begin = end;
+            continue;
+        }
+
         /* Check the cost, update best */
-        if (avail >= real_size && cost < best_cost) {
+        if (cost < *best_cost) {
             best = begin;
-            best_cost = cost;
+            *best_cost = cost;
         }
 
         avail -= begin->size;
@@ -139,6 +439,49 @@ exaFindAreaToEvict(ExaScreenPrivPtr pExaScr, int size, int align)
     return best;
 }
 
+/*
+ * The cheapest blocks to evict are usually around the least recently used
+ * areas, so look there first, and only search all of offscreen memory when
+ * nothing near them is large enough.
+ */
+static ExaOffscreenArea *
+exaFindAreaToEvict(ExaScreenPrivPtr pExaScr, int need)
+{
+    ExaOffscreenArea *candidates[EXA_EVICT_CANDIDATES];
+    ExaOffscreenArea *head = pExaScr->info->offScreenAreas;
+    ExaOffscreenArea *best = NULL, *area;
+    unsigned best_cost = UINT_MAX;
+    int i, j, n;
+
+    for (n = 0; n < EXA_EVICT_CANDIDATES; n++) {
+        candidates[n] = exaOffscreenHeapTop(pExaScr);
+        if (!candidates[n])
+            break;
+        exaOffscreenHeapRemove(pExaScr, candidates[n]);
+    }
+
+    for (i = 0; i < n; i++) {
+        ExaOffscreenArea *begin = candidates[i], *stop = candidates[i]->next;
+
+        for (j = 0; j < EXA_EVICT_REACH && begin != head; j++)
+            begin = begin->prev;
+        for (j = 0; j < EXA_EVICT_REACH && stop; j++)
+            stop = stop->next;
+
+        area = exaFindAreaToEvictIn(pExaScr, begin, stop, need, &best_cost);
+        if (area)
+            best = area;
+    }
+
+    for (i = 0; i < n; i++)
+        exaOffscreenHeapInsert(pExaScr, candidates[i]);
+
+    if (!best)
+        best = exaFindAreaToEvictIn(pExaScr, head, NULL, need, &best_cost);
+
+    return best;
+}
+
 /**
  * exaOffscreenAlloc allocates offscreen memory
  *
@@ -165,7 +508,7 @@ exaOffscreenAlloc(ScreenPtr pScreen, int size, int align,
     ExaOffscreenArea *area;
 
     ExaScreenPriv(pScreen);
-    int real_size = 0, largest_avail = 0;
+    int real_size;
 
 #if DEBUG_OFFSCREEN
     static int number = 0;
@@ -192,24 +535,13 @@ exaOffscreenAlloc(ScreenPtr pScreen, int size, int align,
     }
 
     /* Try to find a free space that'll fit. */
-    for (area = pExaScr->info->offScreenAreas; area; area = area->next) {
-        /* skip allocated areas */
-        if (area->state != ExaOffscreenAvail)
-            continue;
-
-        /* adjust size to match alignment requirement */
-        real_size = size + (area->base_offset + area->size - size) % align;
-
-        /* does it fit? */
-        if (real_size <= area->size)
-            break;
-
-        if (area->size > largest_avail)
-            largest_avail = area->size;
-    }
+    area = exaOffscreenFindFree(pExaScr, size, align);
 
     if (!area) {
-        area = exaFindAreaToEvict(pExaScr, size, align);
+        /* room for the request whatever the alignment loss turns out to be
+         * once the areas are merged
+         */
+        area = exaFindAreaToEvict(pExaScr, size + align - 1);
 
         if (!area) {
             DBG_OFFSCREEN(("Alloc 0x%x -> NOSPACE\n", size));
@@ -218,9 +550,6 @@ exaOffscreenAlloc(ScreenPtr pScreen, int size, int align,
             return NULL;
         }
 
-        /* adjust size needed to account for alignment loss for this area */
-        real_size = size + (area->base_offset + area->size - size) % align;
-
         /*
          * Kick out first area if in use
          */
@@ -229,18 +558,21 @@ exaOffscreenAlloc(ScreenPtr pScreen, int size, int align,
         /*
          * Now get the system to merge the other needed areas together
          */
-        while (area->size < real_size) {
+        while (area->size < exaOffscreenRealSize(area, size, align)) {
             assert(area->next && area->next->state == ExaOffscreenRemovable);
             (void) ExaOffscreenKickOut(pScreen, area->next);
         }
     }
 
+    real_size = exaOffscreenRealSize(area, size, align);
+
     /* save extra space in new area */
     if (real_size < area->size) {
-        ExaOffscreenArea *new_area = malloc(sizeof(ExaOffscreenArea));
+        ExaOffscreenArea *new_area = malloc(sizeof(ExaOffscreenAreaPrivRec));
 
         if (!new_area)
             return NULL;
+        exaOffscreenFreeRemove(pExaScr, area);
         new_area->base_offset = area->base_offset;
 
         new_area->offset = new_area->base_offset;
@@ -259,9 +591,13 @@ exaOffscreenAlloc(ScreenPtr pScreen, int size, int align,
         area->prev = new_area;
         area->base_offset = new_area->base_offset + new_area->size;
         area->size = real_size;
+        ExaOffscreenAreaPriv(new_area)->heap_index = -1;
+        exaOffscreenFreeInsert(pExaScr, new_area);
     }
-    else
+    else {
+        exaOffscreenFreeRemove(pExaScr, area);
         pExaScr->numOffscreenAvailable--;
+    }
 
     /*
      * Mark this area as in use
@@ -276,6 +612,8 @@ exaOffscreenAlloc(ScreenPtr pScreen, int size, int align,
     area->offset = (area->base_offset + align - 1);
     area->offset -= area->offset % align;
     area->align = align;
+    if (!locked)
+        exaOffscreenHeapInsert(pExaScr, area);
 
     ExaOffscreenValidate(pScreen);
 
@@ -388,6 +726,9 @@ ExaOffscreenMerge(ExaScreenPrivPtr pExaScr, ExaOffscreenArea * area)
 {
     ExaOffscreenArea *next = area->next;
 
+    exaOffscreenFreeRemove(pExaScr, area);
+    exaOffscreenFreeRemove(pExaScr, next);
+
     /* account for space */
     area->size += next->size;
     /* frob pointer */
@@ -396,8 +737,11 @@ ExaOffscreenMerge(ExaScreenPrivPtr pExaScr, ExaOffscreenArea * area)
         area->next->prev = area;
     else
         pExaScr->info->offScreenAreas->prev = area;
+    if (pExaScr->defragArea == next)
+        pExaScr->defragArea = area;
     free(next);
 
+    exaOffscreenFreeInsert(pExaScr, area);
     pExaScr->numOffscreenAvailable--;
 }
 
@@ -425,6 +769,7 @@ exaOffscreenFree(ScreenPtr pScreen, ExaOffscreenArea * area)
                    area->base_offset, area->offset));
     ExaOffscreenValidate(pScreen);
 
+    exaOffscreenHeapRemove(pExaScr, area);
     area->state = ExaOffscreenAvail;
     area->save = NULL;
     area->last_use = 0;
@@ -438,6 +783,7 @@ exaOffscreenFree(ScreenPtr pScreen, ExaOffscreenArea * area)
         prev = area->prev;
 
     pExaScr->numOffscreenAvailable++;
+    exaOffscreenFreeInsert(pExaScr, area);
 
     /* link with next area if free */
     if (next && next->state == ExaOffscreenAvail)
@@ -470,26 +816,43 @@ ExaOffscreenMarkUsed(PixmapPtr pPixmap)
  * Defragment offscreen memory by compacting allocated areas at the end of it,
  * leaving the total amount of memory available as a single area at the
  * beginning (when there are no pinned allocations).
+ *
+ * A pass stops once budget milliseconds have gone by moving pixmaps, and the
+ * next call carries on from there; a budget of 0 finishes the pass.
+ *
+ * @return TRUE if the pass is complete.  FALSE with no pass left to carry on
+ * with means it was abandoned.
  */
-_X_HIDDEN ExaOffscreenArea *
-ExaOffscreenDefragment(ScreenPtr pScreen)
+_X_HIDDEN Bool
+ExaOffscreenDefragment(ScreenPtr pScreen, CARD32 budget)
 {
     ExaScreenPriv(pScreen);
-    ExaOffscreenArea *area, *largest_available = NULL;
-    int largest_size = 0;
+    ExaOffscreenArea *area;
     PixmapPtr pDstPix;
     ExaPixmapPrivPtr pExaDstPix;
+    CARD32 start = GetTimeInMillis();
+
+    if (!pExaScr->info->offScreenAreas || pExaScr->swappedOut) {
+        pExaScr->defragArea = NULL;
+        return TRUE;
+    }
 
     pDstPix = (*pScreen->CreatePixmap) (pScreen, 0, 0, 0, 0);
 
-    if (!pDstPix)
-        return NULL;
+    /* Give up on the pass rather than have the caller retry it at once */
+    if (!pDstPix) {
+        pExaScr->defragArea = NULL;
+        return FALSE;
+    }
 
     pExaDstPix = ExaGetPixmapPriv(pDstPix);
     pExaDstPix->use_gpu_copy = TRUE;
 
-    for (area = pExaScr->info->offScreenAreas->prev;
-         area != pExaScr->info->offScreenAreas;) {
+    area = pExaScr->defragArea;
+    if (!area)
+        area = pExaScr->info->offScreenAreas->prev;
+
+    while (area != pExaScr->info->offScreenAreas) {
         ExaOffscreenArea *prev = area->prev;
         PixmapPtr pSrcPix;
         ExaPixmapPrivPtr pExaSrcPix;
@@ -505,20 +868,11 @@ ExaOffscreenDefragment(ScreenPtr pScreen)
         }
 
         if (prev->state == ExaOffscreenAvail) {
-            if (area == largest_available) {
-                largest_available = prev;
-                largest_size += prev->size;
-            }
             area = prev;
             ExaOffscreenMerge(pExaScr, area);
             continue;
         }
 
-        if (area->size > largest_size) {
-            largest_available = area;
-            largest_size = area->size;
-        }
-
         pSrcPix = prev->privData;
         pExaSrcPix = ExaGetPixmapPriv(pSrcPix);
 
@@ -565,6 +919,7 @@ ExaOffscreenDefragment(ScreenPtr pScreen)
         DBG_OFFSCREEN(("Before swap: prev=0x%08x-0x%08x-0x%08x area=0x%08x-0x%08x-0x%08x\n", prev->base_offset, prev->offset, prev->base_offset + prev->size, area->base_offset, area->offset, area->base_offset + area->size));
 
         /* Calculate swapped area offsets and sizes */
+        exaOffscreenFreeRemove(pExaScr, area);
         area->base_offset = prev->base_offset;
         area->offset = area->base_offset;
         prev->offset += pExaDstPix->fb_ptr - pExaSrcPix->fb_ptr;
@@ -576,6 +931,7 @@ ExaOffscreenDefragment(ScreenPtr pScreen)
         else
             prev->size = pExaScr->info->memorySize - prev->base_offset;
         area->size = prev->base_offset - area->base_offset;
+        exaOffscreenFreeInsert(pExaScr, area);
 
         DBG_OFFSCREEN(("After swap: area=0x%08x-0x%08x-0x%08x prev=0x%08x-0x%08x-0x%08x\n", area->base_offset, area->offset, area->base_offset + area->size, prev->base_offset, prev->offset, prev->base_offset + prev->size));
 
@@ -606,6 +962,15 @@ ExaOffscreenDefragment(ScreenPtr pScreen)
         pExaSrcPix->fb_ptr = pExaDstPix->fb_ptr;
         pExaSrcPix->use_gpu_copy = save_use_gpu_copy;
         pSrcPix->devKind = save_pitch;
+
+        /* Free areas are never left next to each other between steps */
+        if (area->prev->next && area->prev->state == ExaOffscreenAvail) {
+            area = area->prev;
+            ExaOffscreenMerge(pExaScr, area);
+        }
+
+        if (budget && GetTimeInMillis() - start >= budget)
+            break;
     }
 
     pDstPix->drawable.width = 0;
@@ -615,10 +980,13 @@ ExaOffscreenDefragment(ScreenPtr pScreen)
 
     (*pScreen->DestroyPixmap) (pDstPix);
 
-    if (area->state == ExaOffscreenAvail && area->size > largest_size)
-        return area;
+    if (area == pExaScr->info->offScreenAreas) {
+        pExaScr->defragArea = NULL;
+        return TRUE;
+    }
 
-    return largest_available;
+    pExaScr->defragArea = area;
+    return FALSE;
 }
 
 /**
@@ -636,7 +1004,7 @@ exaOffscreenInit(ScreenPtr pScreen)
     ExaOffscreenArea *area;
 
     /* Allocate a big free area */
-    area = malloc(sizeof(ExaOffscreenArea));
+    area = malloc(sizeof(ExaOffscreenAreaPrivRec));
 
     if (!area)
         return FALSE;
@@ -651,11 +1019,13 @@ exaOffscreenInit(ScreenPtr pScreen)
     area->prev = area;
     area->last_use = 0;
     area->eviction_cost = 0;
+    ExaOffscreenAreaPriv(area)->heap_index = -1;
 
     /* Add it to the free areas */
     pExaScr->info->offScreenAreas = area;
     pExaScr->offScreenCounter = 1;
     pExaScr->numOffscreenAvailable = 1;
+    exaOffscreenFreeInsert(pExaScr, area);
 
     ExaOffscreenValidate(pScreen);
 
@@ -673,4 +1043,13 @@ ExaOffscreenFini(ScreenPtr pScreen)
         pExaScr->info->offScreenAreas = area->next;
         free(area);
     }
+
+    pExaScr->offScreenFreeFL = 0;
+    memset(pExaScr->offScreenFreeSL, 0, sizeof(pExaScr->offScreenFreeSL));
+    memset(pExaScr->offScreenFree, 0, sizeof(pExaScr->offScreenFree));
+    free(pExaScr->offScreenHeap);
+    pExaScr->offScreenHeap = NULL;
+    pExaScr->offScreenHeapSize = 0;
+    pExaScr->offScreenHeapAlloc = 0;
+    pExaScr->defragArea = NULL;
 }
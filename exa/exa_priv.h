@@ -136,6 +136,29 @@ typedef struct {
 
 #define EXA_NUM_GLYPH_CACHES 4
 
+/* Free offscreen areas are filed by size class: the position of the highest
+ * bit of the size, then the next EXA_OFFSCREEN_SL_SHIFT bits below it.
+ */
+#define EXA_OFFSCREEN_SL_SHIFT 3
+#define EXA_OFFSCREEN_SL (1 << EXA_OFFSCREEN_SL_SHIFT)
+#define EXA_OFFSCREEN_FL 32
+
+/* Milliseconds of pixmap moves a defragment step may take */
+#define EXA_DEFRAGMENT_BUDGET 2
+
+/* Classic EXA allocates its offscreen areas with room for the indexes the
+ * allocator keeps on the side.
+ */
+typedef struct _ExaOffscreenAreaPriv {
+    ExaOffscreenArea area;
+    /* Free areas: the list of their size class */
+    struct _ExaOffscreenAreaPriv *free_prev;
+    struct _ExaOffscreenAreaPriv *free_next;
+    /* Removable areas: position in the eviction heap, or -1 */
+    int heap_index;
+    unsigned heap_key;
+} ExaOffscreenAreaPrivRec, *ExaOffscreenAreaPrivPtr;
+
 #define EXA_FALLBACK_COPYWINDOW (1 << 0)
 #define EXA_ACCEL_COPYWINDOW (1 << 1)
 
@@ -186,6 +209,17 @@ typedef struct {
     unsigned numOffscreenAvailable;
     CARD32 lastDefragment;
     CARD32 nextDefragment;
+    ExaOffscreenArea *defragArea;       /* where a defragment pass stopped */
+
+    /* Offscreen free areas by size class, with bitmaps of the non-empty
+     * classes, and the removable areas least recently used first.
+     */
+    CARD32 offScreenFreeFL;
+    CARD8 offScreenFreeSL[EXA_OFFSCREEN_FL];
+    ExaOffscreenAreaPrivPtr offScreenFree[EXA_OFFSCREEN_FL][EXA_OFFSCREEN_SL];
+    ExaOffscreenAreaPrivPtr *offScreenHeap;
+    int offScreenHeapSize;
+    int offScreenHeapAlloc;
     PixmapPtr deferred_mixed_pixmap;
 
     /* Reference counting for accessed pixmaps */
@@ -530,7 +564,8 @@ void
 void
  ExaOffscreenSwapIn(ScreenPtr pScreen);
 
-ExaOffscreenArea *ExaOffscreenDefragment(ScreenPtr pScreen);
+Bool
+ ExaOffscreenDefragment(ScreenPtr pScreen, CARD32 budget);
 
 Bool
  exaOffscreenInit(ScreenPtr pScreen);
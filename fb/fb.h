@@ -431,6 +431,8 @@ typedef void (*FinishWrapProcPtr) (DrawablePtr pDraw);
 extern _X_EXPORT DevPrivateKey
 fbGetScreenPrivateKey(void);
 
+typedef struct _FbGlyphCache *FbGlyphCachePtr;
+
 /* private field of a screen */
 typedef struct {
     unsigned char win32bpp;     /* window bpp for 32-bpp images */
@@ -441,6 +443,7 @@ typedef struct {
 #endif
     DevPrivateKeyRec    gcPrivateKeyRec;
     DevPrivateKeyRec    winPrivateKeyRec;
+    FbGlyphCachePtr     glyphCache;     /* fbpict.c */
 } FbScreenPrivRec, *FbScreenPrivPtr;
 
 #define fbGetScreenPrivate(pScreen) ((FbScreenPrivPtr) \
@@ -1114,6 +1117,9 @@ extern _X_EXPORT Bool
 extern _X_EXPORT void
 fbDestroyGlyphCache(void);
 
+extern _X_EXPORT void
+fbDestroyScreenGlyphCache(ScreenPtr pScreen);
+
 /*
  * fbpixmap.c
  */
@@ -1253,6 +1259,36 @@ fbSetSpans(DrawablePtr pDrawable,
            GCPtr pGC,
            char *src, DDXPointPtr ppt, int *pwidth, int nspans, int fSorted);
 
+/*
+ * fbsimd.c
+ */
+
+#define FB_SIMD_NONE	0
+#define FB_SIMD_SSE2	1
+#define FB_SIMD_AVX2	2
+
+extern _X_EXPORT int fbSimd;    /* kernels in use, -1 until probed */
+
+extern _X_EXPORT int
+fbProbeSimd(void);
+
+#define fbSimdLevel()	(fbSimd >= 0 ? fbSimd : fbProbeSimd())
+
+extern _X_EXPORT int
+fbBltSimd(FbBits * dst,
+          FbBits * src,
+          int n,
+          int leftShift,
+          int rightShift,
+          Bool reverse, FbBits ca1, FbBits cx1, FbBits ca2, FbBits cx2);
+
+extern _X_EXPORT int
+fbBltOneSimd(FbBits * dst,
+             FbStip bits,
+             int dstBpp,
+             Bool copy,
+             FbBits fgand, FbBits fgxor, FbBits bgand, FbBits bgxor);
+
 /*
  * fbsolid.c
  */
@@ -1269,6 +1305,21 @@ fbSolid24(FbBits * dst,
           FbStride dstStride,
           int dstX, int width, int height, FbBits and, FbBits xor);
 
+/*
+ * fbthread.c
+ */
+
+/* Operations covering fewer pixels than this stay on the calling thread */
+#define FB_THREAD_PIXELS_DEFAULT (256 * 1024)
+
+typedef void (*FbRowsProcPtr) (void *closure, int y, int height);
+
+extern _X_EXPORT int fbThreads;         /* worker threads, 0 disables */
+extern _X_EXPORT int fbThreadPixels;
+
+extern _X_EXPORT Bool
+fbParallelRows(int width, int height, FbRowsProcPtr rows, void *closure);
+
 /*
  * fbutil.c
  */
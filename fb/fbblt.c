@@ -39,6 +39,52 @@
     } \
 }
 
+#if defined(FB_SIMD) && !defined(FB_ACCESS_WRAPPER)
+
+/* Rows with fewer middle words than this stay entirely scalar */
+#define FB_BLT_SIMD_MIN 8
+
+/*
+ * The vector kernels read a whole vector of source words before storing
+ * any of the destination, and a shifted blt reloads the source word
+ * before each vector instead of carrying it along.  Only give them spans
+ * where that comes to the same thing as the scalar loop: the destination
+ * trails the source in the direction of the blt, or they don't meet.
+ */
+static inline Bool
+fbBltSimdSafe(FbBits * dst, FbBits * src, int n, Bool shifted, Bool reverse)
+{
+    uintptr_t d = (uintptr_t) dst, s = (uintptr_t) src;
+    uintptr_t len = n * sizeof(FbBits);
+
+    if (d == s)
+        return !shifted;
+    if (reverse)
+        return d > s || d <= s - len;
+    return d < s || d >= s + len;
+}
+
+#define FbBltSimdMiddle(ls, rs, carry) { \
+    int _done; \
+    if (n >= FB_BLT_SIMD_MIN && fbBltSimdSafe(dst, src, n, ls != 0, reverse) && \
+        (_done = fbBltSimd(dst, src, n, ls, rs, reverse, \
+                           _ca1, _cx1, _ca2, _cx2)) != 0) { \
+        n -= _done; \
+        if (reverse) { \
+            dst -= _done; \
+            src -= _done; \
+        } else { \
+            dst += _done; \
+            src += _done; \
+        } \
+        carry; \
+    } \
+}
+
+#else
+#define FbBltSimdMiddle(ls, rs, carry)
+#endif
+
 void
 fbBlt(FbBits * srcLine,
       FbStride srcStride,
@@ -133,6 +179,7 @@ fbBlt(FbBits * srcLine,
                     FbDoRightMaskByteMergeRop(dst, bits, endbyte, endmask);
                 }
                 n = nmiddle;
+                FbBltSimdMiddle(0, 0, (void) 0);
                 if (destInvarient) {
                     while (n--)
                         WRITE(--dst, FbDoDestInvarientMergeRop(READ(--src)));
@@ -157,6 +204,7 @@ fbBlt(FbBits * srcLine,
                     dst++;
                 }
                 n = nmiddle;
+                FbBltSimdMiddle(0, 0, (void) 0);
                 if (destInvarient) {
 #if 0
                     /*
@@ -226,6 +274,7 @@ fbBlt(FbBits * srcLine,
                     FbDoRightMaskByteMergeRop(dst, bits, endbyte, endmask);
                 }
                 n = nmiddle;
+                FbBltSimdMiddle(leftShift, rightShift, bits1 = READ(src));
                 if (destInvarient) {
                     while (n--) {
                         bits = FbScrRight(bits1, rightShift);
@@ -267,6 +316,7 @@ fbBlt(FbBits * srcLine,
                     dst++;
                 }
                 n = nmiddle;
+                FbBltSimdMiddle(leftShift, rightShift, bits1 = READ(src - 1));
                 if (destInvarient) {
                     while (n--) {
                         bits = FbScrLeft(bits1, leftShift);
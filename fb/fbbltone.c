@@ -157,6 +157,25 @@ static const FbBits fbStipple1Bits[2] = {
 	bits = (src < srcEnd ? READ(src++) : 0); \
 }
 
+#if defined(FB_SIMD) && !defined(FB_ACCESS_WRAPPER)
+/*
+ * A whole stipple word of the middle goes to the vector code; blank
+ * words of a transparent stipple don't touch the destination at all.
+ */
+#define FbBltOneSimdWord() { \
+    if (n == unitsPerSrc && \
+        ((transparent && !bits) || \
+         fbBltOneSimd(dst, bits, dstBpp, copy, \
+                      fgand, fgxor, bgand, bgxor))) { \
+        dst += n; \
+        n = 0; \
+        bits = 0; \
+    } \
+}
+#else
+#define FbBltOneSimdWord()
+#endif
+
 void
 fbBltOne(FbStip * src, FbStride srcStride,      /* FbStip units per scanline */
          int srcX,              /* bit position of source */
@@ -328,6 +347,7 @@ fbBltOne(FbStip * src, FbStride srcStride,      /* FbStip units per scanline */
              */
             for (;;) {
                 w -= n;
+                FbBltOneSimdWord();
                 if (copy) {
                     while (n--) {
                         mask = fbBits[FbLeftStipBits(bits, pixelsPerDst)];
@@ -28,6 +28,61 @@
 
 #include "fb.h"
 
+/*
+ * One box of fbCopyNtoN.  Bands of rows can be copied independently as
+ * long as the source rows of one band are not the destination of another.
+ */
+typedef struct {
+    FbBits *src;
+    FbStride srcStride;
+    int srcBpp;
+    int srcX, srcY;
+    FbBits *dst;
+    FbStride dstStride;
+    int dstBpp;
+    int dstX, dstY;
+    int width;
+    CARD8 alu;
+    FbBits pm;
+    Bool reverse, upsidedown;
+} FbCopyRowsRec;
+
+static void
+fbCopyRows(void *closure, int y, int height)
+{
+    FbCopyRowsRec *copy = closure;
+
+#ifndef FB_ACCESS_WRAPPER       /* pixman_blt() doesn't support accessors yet */
+    if (copy->pm == FB_ALLONES && copy->alu == GXcopy &&
+        !copy->reverse && !copy->upsidedown) {
+        if (pixman_blt((uint32_t *) copy->src, (uint32_t *) copy->dst,
+                       copy->srcStride, copy->dstStride,
+                       copy->srcBpp, copy->dstBpp,
+                       copy->srcX, copy->srcY + y, copy->dstX, copy->dstY + y,
+                       copy->width, height))
+            return;
+    }
+#endif
+    fbBlt(copy->src + (copy->srcY + y) * copy->srcStride,
+          copy->srcStride,
+          copy->srcX * copy->srcBpp,
+          copy->dst + (copy->dstY + y) * copy->dstStride,
+          copy->dstStride,
+          copy->dstX * copy->dstBpp,
+          copy->width * copy->dstBpp,
+          height, copy->alu, copy->pm, copy->dstBpp,
+          copy->reverse, copy->upsidedown);
+}
+
+static Bool
+fbCopyRowsOverlap(FbCopyRowsRec *copy, int height)
+{
+    return copy->src == copy->dst &&
+        copy->srcY != copy->dstY &&
+        abs(copy->srcY - copy->dstY) < height &&
+        abs(copy->srcX - copy->dstX) < copy->width;
+}
+
 void
 fbCopyNtoN(DrawablePtr pSrcDrawable,
            DrawablePtr pDstDrawable,
@@ -37,46 +92,32 @@ fbCopyNtoN(DrawablePtr pSrcDrawable,
            int dx,
            int dy, Bool reverse, Bool upsidedown, Pixel bitplane, void *closure)
 {
-    CARD8 alu = pGC ? pGC->alu : GXcopy;
-    FbBits pm = pGC ? fbGetGCPrivate(pGC)->pm : FB_ALLONES;
-    FbBits *src;
-    FbStride srcStride;
-    int srcBpp;
+    FbCopyRowsRec copy;
     int srcXoff, srcYoff;
-    FbBits *dst;
-    FbStride dstStride;
-    int dstBpp;
     int dstXoff, dstYoff;
+    int height;
 
-    fbGetDrawable(pSrcDrawable, src, srcStride, srcBpp, srcXoff, srcYoff);
-    fbGetDrawable(pDstDrawable, dst, dstStride, dstBpp, dstXoff, dstYoff);
+    copy.alu = pGC ? pGC->alu : GXcopy;
+    copy.pm = pGC ? fbGetGCPrivate(pGC)->pm : FB_ALLONES;
+    copy.reverse = reverse;
+    copy.upsidedown = upsidedown;
+
+    fbGetDrawable(pSrcDrawable, copy.src, copy.srcStride, copy.srcBpp,
+                  srcXoff, srcYoff);
+    fbGetDrawable(pDstDrawable, copy.dst, copy.dstStride, copy.dstBpp,
+                  dstXoff, dstYoff);
 
     while (nbox--) {
-#ifndef FB_ACCESS_WRAPPER       /* pixman_blt() doesn't support accessors yet */
-        if (pm == FB_ALLONES && alu == GXcopy && !reverse && !upsidedown) {
-            if (!pixman_blt
-                ((uint32_t *) src, (uint32_t *) dst, srcStride, dstStride,
-                 srcBpp, dstBpp, (pbox->x1 + dx + srcXoff),
-                 (pbox->y1 + dy + srcYoff), (pbox->x1 + dstXoff),
-                 (pbox->y1 + dstYoff), (pbox->x2 - pbox->x1),
-                 (pbox->y2 - pbox->y1)))
-                goto fallback;
-            else
-                goto next;
-        }
- fallback:
-#endif
-        fbBlt(src + (pbox->y1 + dy + srcYoff) * srcStride,
-              srcStride,
-              (pbox->x1 + dx + srcXoff) * srcBpp,
-              dst + (pbox->y1 + dstYoff) * dstStride,
-              dstStride,
-              (pbox->x1 + dstXoff) * dstBpp,
-              (pbox->x2 - pbox->x1) * dstBpp,
-              (pbox->y2 - pbox->y1), alu, pm, dstBpp, reverse, upsidedown);
-#ifndef FB_ACCESS_WRAPPER
- next:
-#endif
+        copy.srcX = pbox->x1 + dx + srcXoff;
+        copy.srcY = pbox->y1 + dy + srcYoff;
+        copy.dstX = pbox->x1 + dstXoff;
+        copy.dstY = pbox->y1 + dstYoff;
+        copy.width = pbox->x2 - pbox->x1;
+        height = pbox->y2 - pbox->y1;
+
+        if (fbCopyRowsOverlap(&copy, height) ||
+            !fbParallelRows(copy.width, height, fbCopyRows, &copy))
+            fbCopyRows(&copy, 0, height);
         pbox++;
     }
     fbFinishAccess(pDstDrawable);
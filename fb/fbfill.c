@@ -108,8 +108,9 @@ fbStipple(FbBits * dst, FbStride dstStride,
     }
 }
 
-void
-fbFill(DrawablePtr pDrawable, GCPtr pGC, int x, int y, int width, int height)
+static void
+fbFillArea(DrawablePtr pDrawable, GCPtr pGC,
+           int x, int y, int width, int height)
 {
     FbBits *dst;
     FbStride dstStride;
@@ -220,6 +221,67 @@ fbFill(DrawablePtr pDrawable, GCPtr pGC, int x, int y, int width, int height)
     fbFinishAccess(pDrawable);
 }
 
+/*
+ * Filling a band of rows gives the same pixels as the corresponding rows
+ * of the whole fill: the pattern origin doesn't depend on where the fill
+ * starts.
+ */
+typedef struct {
+    DrawablePtr pDrawable;
+    GCPtr pGC;
+    int x, y, width;
+} FbFillRowsRec;
+
+static void
+fbFillRows(void *closure, int y, int height)
+{
+    FbFillRowsRec *fill = closure;
+
+    fbFillArea(fill->pDrawable, fill->pGC,
+               fill->x, fill->y + y, fill->width, height);
+}
+
+void
+fbFill(DrawablePtr pDrawable, GCPtr pGC, int x, int y, int width, int height)
+{
+    FbFillRowsRec fill = {
+        .pDrawable = pDrawable,
+        .pGC = pGC,
+        .x = x,
+        .y = y,
+        .width = width
+    };
+
+    if (!fbParallelRows(width, height, fbFillRows, &fill))
+        fbFillArea(pDrawable, pGC, x, y, width, height);
+}
+
+typedef struct {
+    FbBits *dst;
+    FbStride dstStride;
+    int dstBpp;
+    int x, y, width;            /* in pixels, relative to dst */
+    FbBits and, xor;
+} FbSolidRowsRec;
+
+static void
+fbSolidRows(void *closure, int y, int height)
+{
+    FbSolidRowsRec *solid = closure;
+
+    y += solid->y;
+#ifndef FB_ACCESS_WRAPPER
+    if (solid->and ||
+        !pixman_fill((uint32_t *) solid->dst, solid->dstStride, solid->dstBpp,
+                     solid->x, y, solid->width, height, solid->xor))
+#endif
+        fbSolid(solid->dst + y * solid->dstStride,
+                solid->dstStride,
+                solid->x * solid->dstBpp,
+                solid->dstBpp,
+                solid->width * solid->dstBpp, height, solid->and, solid->xor);
+}
+
 void
 fbSolidBoxClipped(DrawablePtr pDrawable,
                   RegionPtr pClip,
@@ -232,9 +294,16 @@ fbSolidBoxClipped(DrawablePtr pDrawable,
     BoxPtr pbox;
     int nbox;
     int partX1, partX2, partY1, partY2;
+    FbSolidRowsRec solid;
 
     fbGetDrawable(pDrawable, dst, dstStride, dstBpp, dstXoff, dstYoff);
 
+    solid.dst = dst;
+    solid.dstStride = dstStride;
+    solid.dstBpp = dstBpp;
+    solid.and = and;
+    solid.xor = xor;
+
     for (nbox = RegionNumRects(pClip), pbox = RegionRects(pClip);
          nbox--; pbox++) {
         partX1 = pbox->x1;
@@ -259,16 +328,11 @@ fbSolidBoxClipped(DrawablePtr pDrawable,
         if (partY2 <= partY1)
             continue;
 
-#ifndef FB_ACCESS_WRAPPER
-        if (and || !pixman_fill((uint32_t *) dst, dstStride, dstBpp,
-                                partX1 + dstXoff, partY1 + dstYoff,
-                                (partX2 - partX1), (partY2 - partY1), xor))
-#endif
-            fbSolid(dst + (partY1 + dstYoff) * dstStride,
-                    dstStride,
-                    (partX1 + dstXoff) * dstBpp,
-                    dstBpp,
-                    (partX2 - partX1) * dstBpp, (partY2 - partY1), and, xor);
+        solid.x = partX1 + dstXoff;
+        solid.y = partY1 + dstYoff;
+        solid.width = partX2 - partX1;
+        if (!fbParallelRows(solid.width, partY2 - partY1, fbSolidRows, &solid))
+            fbSolidRows(&solid, 0, partY2 - partY1);
     }
     fbFinishAccess(pDrawable);
 }
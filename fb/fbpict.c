@@ -27,6 +27,7 @@
 #include <dix-config.h>
 #endif
 
+#include <stdio.h>
 #include <string.h>
 
 #include "fb.h"
@@ -70,24 +71,481 @@ fbComposite(CARD8 op,
     free_pixman_pict(pDst, dest);
 }
 
-static pixman_glyph_cache_t *glyphCache;
+/*
+ * Each screen keeps its own pixman glyph cache, with a record of every
+ * glyph in it so that its size is known and the least recently used ones
+ * can be dropped once the images add up to more than GlyphCacheLimit.
+ * The records are found by glyph pointer, replacing the lookup in the
+ * pixman cache.
+ */
+
+/*
+ * pixman trims its glyph cache on thaw once more than 16384 glyphs have
+ * gone into it, which would leave dangling glyph handles behind.
+ * Starting over with an empty cache after this many insertions keeps it
+ * from ever getting that far.
+ */
+#define FB_GLYPH_CACHE_GLYPHS	8192
+
+typedef struct _FbGlyphEntry {
+    struct _FbGlyphEntry *next;
+    GlyphPtr glyph;
+    const void *handle;         /* in the pixman glyph cache */
+    unsigned long bytes;
+    CARD32 stamp;
+} FbGlyphEntryRec, *FbGlyphEntryPtr;
+
+/*
+ * Terminals and editors draw the same lines over and over.  Each run of
+ * glyphs seen recently is kept with its pixman glyphs already looked up
+ * and positioned relative to the first glyph list's origin, so drawing it
+ * again, wherever on the screen, only costs hashing and comparing the
+ * glyph pointers.  A run is dropped when one of its glyphs is freed, as
+ * the pointer may be reused for another glyph; when the cache is trimmed
+ * or emptied, all of them are invalidated by bumping the cache generation.
+ */
+#define FB_GLYPH_RUN_SETS	64
+#define FB_GLYPH_RUN_WAYS	4
+#define FB_GLYPH_RUN_MAX	256
+
+typedef struct _FbGlyphRunList {
+    INT16 xOff;
+    INT16 yOff;
+    CARD16 len;
+} FbGlyphRunListRec, *FbGlyphRunListPtr;
+
+typedef struct _FbGlyphRun {
+    CARD32 hash;
+    CARD32 generation;
+    CARD32 stamp;
+    int nlist;
+    int nglyphs;                /* glyphs in the request */
+    int npglyphs;               /* of those, glyphs with a picture */
+    Bool hasExtents;
+    pixman_box32_t extents;
+    /* allocated along with the run */
+    pixman_glyph_t *pglyphs;
+    FbGlyphEntryPtr *entries;   /* of each of pglyphs */
+    GlyphPtr *glyphs;
+    FbGlyphRunListPtr lists;
+} FbGlyphRunRec, *FbGlyphRunPtr;
+
+typedef struct _FbGlyphCache {
+    pixman_glyph_cache_t *cache;
+    FbGlyphEntryPtr *hash;
+    int hashBits;
+    int entries;
+    int inserts;                /* since the pixman cache was created */
+    unsigned long bytes;
+    CARD32 clock;
+    CARD32 generation;
+    FbGlyphRunPtr runs[FB_GLYPH_RUN_SETS][FB_GLYPH_RUN_WAYS];
+    unsigned long hits, misses, evictions;
+    unsigned long runHits, runMisses;
+} FbGlyphCacheRec;
+
+#define FB_GLYPH_HASH_BITS	8
+
+#define FbGlyphHash(cache, glyph)	\
+    (((CARD32) ((uintptr_t) (glyph) >> 4) * 0x9e3779b1) >> \
+     (32 - (cache)->hashBits))
+
+static void
+fbGlyphReportStatistics(CallbackListPtr *pcbl, void *data, void *call_data)
+{
+    ScreenPtr pScreen = data;
+    FbGlyphCachePtr cache = fbGetScreenPrivate(pScreen)->glyphCache;
+    ServerStatisticsPtr stats = call_data;
+    char name[64];
+
+    snprintf(name, sizeof(name), "fb.%d.glyphs.hit", pScreen->myNum);
+    AddServerStatistic(stats, name, cache->hits);
+    snprintf(name, sizeof(name), "fb.%d.glyphs.miss", pScreen->myNum);
+    AddServerStatistic(stats, name, cache->misses);
+    snprintf(name, sizeof(name), "fb.%d.glyphs.evicted", pScreen->myNum);
+    AddServerStatistic(stats, name, cache->evictions);
+    snprintf(name, sizeof(name), "fb.%d.glyphs.bytes", pScreen->myNum);
+    AddServerStatistic(stats, name, cache->bytes);
+    snprintf(name, sizeof(name), "fb.%d.glyphs.runs.hit", pScreen->myNum);
+    AddServerStatistic(stats, name, cache->runHits);
+    snprintf(name, sizeof(name), "fb.%d.glyphs.runs.miss", pScreen->myNum);
+    AddServerStatistic(stats, name, cache->runMisses);
+}
+
+static FbGlyphCachePtr
+fbCreateGlyphCache(ScreenPtr pScreen)
+{
+    FbGlyphCachePtr cache = calloc(1, sizeof(FbGlyphCacheRec));
+
+    if (!cache)
+        return NULL;
+    cache->hashBits = FB_GLYPH_HASH_BITS;
+    cache->hash = calloc(1 << cache->hashBits, sizeof(FbGlyphEntryPtr));
+    cache->cache = pixman_glyph_cache_create();
+    if (!cache->hash || !cache->cache) {
+        if (cache->cache)
+            pixman_glyph_cache_destroy(cache->cache);
+        free(cache->hash);
+        free(cache);
+        return NULL;
+    }
+    AddCallback(&ServerStatisticsCallback, fbGlyphReportStatistics, pScreen);
+    return cache;
+}
+
+/* Forget every glyph, leaving the statistics alone */
+static void
+fbEmptyGlyphCache(FbGlyphCachePtr cache)
+{
+    FbGlyphEntryPtr entry, next;
+    int i;
+
+    for (i = 0; i < 1 << cache->hashBits; i++) {
+        for (entry = cache->hash[i]; entry; entry = next) {
+            next = entry->next;
+            free(entry);
+        }
+        cache->hash[i] = NULL;
+    }
+    cache->entries = 0;
+    cache->bytes = 0;
+    cache->generation++;
+}
+
+static void
+fbRestartGlyphCache(FbGlyphCachePtr cache)
+{
+    pixman_glyph_cache_t *fresh = pixman_glyph_cache_create();
+
+    if (!fresh)
+        return;
+    cache->evictions += cache->entries;
+    fbEmptyGlyphCache(cache);
+    pixman_glyph_cache_destroy(cache->cache);
+    cache->cache = fresh;
+    cache->inserts = 0;
+}
+
+void
+fbDestroyScreenGlyphCache(ScreenPtr pScreen)
+{
+    FbScreenPrivPtr pScrPriv = fbGetScreenPrivate(pScreen);
+    FbGlyphCachePtr cache = pScrPriv->glyphCache;
+    int i, j;
+
+    if (!cache)
+        return;
+
+    DeleteCallback(&ServerStatisticsCallback, fbGlyphReportStatistics,
+                   pScreen);
+    fbEmptyGlyphCache(cache);
+    for (i = 0; i < FB_GLYPH_RUN_SETS; i++)
+        for (j = 0; j < FB_GLYPH_RUN_WAYS; j++)
+            free(cache->runs[i][j]);
+    pixman_glyph_cache_destroy(cache->cache);
+    free(cache->hash);
+    free(cache);
+    pScrPriv->glyphCache = NULL;
+}
 
 void
 fbDestroyGlyphCache(void)
 {
-    if (glyphCache)
-    {
-	pixman_glyph_cache_destroy (glyphCache);
-	glyphCache = NULL;
+    int i;
+
+    for (i = 0; i < screenInfo.numScreens; i++)
+        fbDestroyScreenGlyphCache(screenInfo.screens[i]);
+    for (i = 0; i < screenInfo.numGPUScreens; i++)
+        fbDestroyScreenGlyphCache(screenInfo.gpuscreens[i]);
+}
+
+static FbGlyphEntryPtr
+fbLookupGlyphEntry(FbGlyphCachePtr cache, GlyphPtr glyph)
+{
+    FbGlyphEntryPtr entry;
+
+    for (entry = cache->hash[FbGlyphHash(cache, glyph)]; entry;
+         entry = entry->next)
+        if (entry->glyph == glyph)
+            return entry;
+    return NULL;
+}
+
+static void
+fbGrowGlyphHash(FbGlyphCachePtr cache)
+{
+    FbGlyphEntryPtr *old = cache->hash, entry, next;
+    int i, oldBits = cache->hashBits;
+
+    cache->hash = calloc(2 << oldBits, sizeof(FbGlyphEntryPtr));
+    if (!cache->hash) {
+        cache->hash = old;
+        return;
+    }
+    cache->hashBits++;
+    for (i = 0; i < 1 << oldBits; i++) {
+        for (entry = old[i]; entry; entry = next) {
+            CARD32 h = FbGlyphHash(cache, entry->glyph);
+
+            next = entry->next;
+            entry->next = cache->hash[h];
+            cache->hash[h] = entry;
+        }
     }
+    free(old);
+}
+
+static FbGlyphEntryPtr
+fbAddGlyphEntry(FbGlyphCachePtr cache, GlyphPtr glyph, PicturePtr pPicture)
+{
+    FbGlyphEntryPtr entry;
+    pixman_image_t *glyphImage;
+    DrawablePtr pDrawable = pPicture->pDrawable;
+    int xoff, yoff;
+    CARD32 h;
+
+    if (!(entry = malloc(sizeof(FbGlyphEntryRec))))
+        return NULL;
+
+    if (!(glyphImage = image_from_pict(pPicture, FALSE, &xoff, &yoff))) {
+        free(entry);
+        return NULL;
+    }
+
+    entry->handle = pixman_glyph_cache_insert(cache->cache, glyph, NULL,
+                                              glyph->info.x, glyph->info.y,
+                                              glyphImage);
+
+    free_pixman_pict(pPicture, glyphImage);
+
+    if (!entry->handle) {
+        free(entry);
+        return NULL;
+    }
+
+    entry->glyph = glyph;
+    entry->bytes = (((pDrawable->width * pDrawable->bitsPerPixel + 31) >> 5) *
+                    4 * pDrawable->height);
+    entry->stamp = cache->clock;
+
+    if (cache->entries >= 1 << cache->hashBits)
+        fbGrowGlyphHash(cache);
+    h = FbGlyphHash(cache, glyph);
+    entry->next = cache->hash[h];
+    cache->hash[h] = entry;
+    cache->entries++;
+    cache->inserts++;
+    cache->bytes += entry->bytes;
+    return entry;
+}
+
+static void
+fbRemoveGlyphEntry(FbGlyphCachePtr cache, FbGlyphEntryPtr entry)
+{
+    FbGlyphEntryPtr *prev = &cache->hash[FbGlyphHash(cache, entry->glyph)];
+
+    while (*prev != entry)
+        prev = &(*prev)->next;
+    *prev = entry->next;
+
+    pixman_glyph_cache_remove(cache->cache, entry->glyph, NULL);
+    cache->entries--;
+    cache->bytes -= entry->bytes;
+    free(entry);
+}
+
+static int
+fbCompareGlyphEntries(const void *a, const void *b)
+{
+    CARD32 sa = (*(FbGlyphEntryPtr const *) a)->stamp;
+    CARD32 sb = (*(FbGlyphEntryPtr const *) b)->stamp;
+
+    return sa == sb ? 0 : (INT32) (sa - sb) < 0 ? -1 : 1;
+}
+
+/*
+ * Once the glyphs take more than GlyphCacheLimit, drop the least recently
+ * used until they're down to three quarters of it, so this happens
+ * seldom enough for the sort not to matter.  Glyphs drawn through a
+ * cached run aren't stamped one by one; they take the run's stamp here.
+ */
+static void
+fbTrimGlyphCache(FbGlyphCachePtr cache)
+{
+    unsigned long target = GlyphCacheLimit - GlyphCacheLimit / 4;
+    FbGlyphEntryPtr *entries, entry;
+    FbGlyphRunPtr run;
+    int i, j, n;
+
+    if (!GlyphCacheLimit || cache->bytes <= GlyphCacheLimit)
+        return;
+
+    if (!(entries = xallocarray(cache->entries, sizeof(FbGlyphEntryPtr)))) {
+        fbRestartGlyphCache(cache);
+        return;
+    }
+
+    for (i = 0; i < FB_GLYPH_RUN_SETS; i++) {
+        for (j = 0; j < FB_GLYPH_RUN_WAYS; j++) {
+            run = cache->runs[i][j];
+            if (!run || run->generation != cache->generation)
+                continue;
+            for (n = 0; n < run->npglyphs; n++) {
+                entry = run->entries[n];
+                if ((INT32) (run->stamp - entry->stamp) > 0)
+                    entry->stamp = run->stamp;
+            }
+        }
+    }
+
+    for (i = 0, n = 0; i < 1 << cache->hashBits; i++)
+        for (entry = cache->hash[i]; entry; entry = entry->next)
+            entries[n++] = entry;
+    qsort(entries, n, sizeof(FbGlyphEntryPtr), fbCompareGlyphEntries);
+
+    for (i = 0; i < n && cache->bytes > target; i++) {
+        fbRemoveGlyphEntry(cache, entries[i]);
+        cache->evictions++;
+    }
+    cache->generation++;
+    free(entries);
+}
+
+static CARD32
+fbGlyphRunHash(int nlist, GlyphListPtr list, GlyphPtr *glyphs)
+{
+    uint64_t hash = nlist;
+    int i, n;
+
+#define MIX(v)	(hash = (hash ^ (uint64_t) (uintptr_t) (v)) * 0x9e3779b1)
+    for (i = 0; i < nlist; i++) {
+        /* the first list's offset is where the run is drawn */
+        if (i)
+            MIX(((CARD32) (CARD16) list[i].xOff << 16) | (CARD16) list[i].yOff);
+        MIX(list[i].len);
+        for (n = 0; n < list[i].len; n++)
+            MIX(*glyphs++);
+    }
+#undef MIX
+    return (CARD32) (hash ^ (hash >> 39) ^ (hash >> 15));
+}
+
+static FbGlyphRunPtr
+fbLookupGlyphRun(FbGlyphCachePtr cache, CARD32 hash, int nlist,
+                 GlyphListPtr list, GlyphPtr *glyphs, int nglyphs)
+{
+    FbGlyphRunPtr *set = cache->runs[hash % FB_GLYPH_RUN_SETS];
+    FbGlyphRunPtr run;
+    FbGlyphRunListPtr runList;
+    int i, j;
+
+    for (j = 0; j < FB_GLYPH_RUN_WAYS; j++) {
+        run = set[j];
+        if (!run || run->hash != hash ||
+            run->generation != cache->generation ||
+            run->nlist != nlist || run->nglyphs != nglyphs)
+            continue;
+
+        runList = run->lists;
+        for (i = 0; i < nlist; i++) {
+            if (runList[i].len != list[i].len ||
+                (i && (runList[i].xOff != list[i].xOff ||
+                       runList[i].yOff != list[i].yOff)))
+                break;
+        }
+        if (i < nlist ||
+            memcmp(run->glyphs, glyphs, nglyphs * sizeof(GlyphPtr)))
+            continue;
+
+        run->stamp = cache->clock;
+        return run;
+    }
+    return NULL;
+}
+
+static FbGlyphRunPtr
+fbStoreGlyphRun(FbGlyphCachePtr cache, CARD32 hash, int nlist,
+                GlyphListPtr list, GlyphPtr *glyphs, int nglyphs,
+                pixman_glyph_t *pglyphs, FbGlyphEntryPtr *entries,
+                int npglyphs)
+{
+    FbGlyphRunPtr *set = cache->runs[hash % FB_GLYPH_RUN_SETS];
+    FbGlyphRunPtr run;
+    FbGlyphRunListPtr runList;
+    int i, victim = 0;
+
+    if (nglyphs > FB_GLYPH_RUN_MAX || nlist > FB_GLYPH_RUN_MAX)
+        return NULL;
+
+    /* replace an empty or stale way if there is one, else the oldest */
+    for (i = 0; i < FB_GLYPH_RUN_WAYS; i++) {
+        if (!set[i] || set[i]->generation != cache->generation) {
+            victim = i;
+            break;
+        }
+        if ((INT32) (set[i]->stamp - set[victim]->stamp) < 0)
+            victim = i;
+    }
+
+    free(set[victim]);
+    set[victim] = run = malloc(sizeof(FbGlyphRunRec) +
+                               npglyphs * (sizeof(pixman_glyph_t) +
+                                           sizeof(FbGlyphEntryPtr)) +
+                               nglyphs * sizeof(GlyphPtr) +
+                               nlist * sizeof(FbGlyphRunListRec));
+    if (!run)
+        return NULL;
+
+    run->hash = hash;
+    run->generation = cache->generation;
+    run->stamp = cache->clock;
+    run->nlist = nlist;
+    run->nglyphs = nglyphs;
+    run->npglyphs = npglyphs;
+    run->hasExtents = FALSE;
+    run->pglyphs = (pixman_glyph_t *) (run + 1);
+    run->entries = (FbGlyphEntryPtr *) (run->pglyphs + npglyphs);
+    run->glyphs = (GlyphPtr *) (run->entries + npglyphs);
+    run->lists = (FbGlyphRunListPtr) (run->glyphs + nglyphs);
+    memcpy(run->pglyphs, pglyphs, npglyphs * sizeof(pixman_glyph_t));
+    memcpy(run->entries, entries, npglyphs * sizeof(FbGlyphEntryPtr));
+    memcpy(run->glyphs, glyphs, nglyphs * sizeof(GlyphPtr));
+    runList = run->lists;
+    for (i = 0; i < nlist; i++) {
+        runList[i].xOff = list[i].xOff;
+        runList[i].yOff = list[i].yOff;
+        runList[i].len = list[i].len;
+    }
+    return run;
 }
 
 static void
 fbUnrealizeGlyph(ScreenPtr pScreen,
 		 GlyphPtr pGlyph)
 {
-    if (glyphCache)
-	pixman_glyph_cache_remove (glyphCache, pGlyph, NULL);
+    FbGlyphCachePtr cache = fbGetScreenPrivate(pScreen)->glyphCache;
+    FbGlyphEntryPtr entry;
+    FbGlyphRunPtr run;
+    int i, j, n;
+
+    if (!cache || !(entry = fbLookupGlyphEntry(cache, pGlyph)))
+        return;
+    fbRemoveGlyphEntry(cache, entry);
+
+    /* only the runs drawing this glyph hold its entry */
+    for (i = 0; i < FB_GLYPH_RUN_SETS; i++) {
+        for (j = 0; j < FB_GLYPH_RUN_WAYS; j++) {
+            if (!(run = cache->runs[i][j]))
+                continue;
+            for (n = 0; n < run->nglyphs; n++)
+                if (run->glyphs[n] == pGlyph)
+                    break;
+            if (n < run->nglyphs) {
+                free(run);
+                cache->runs[i][j] = NULL;
+            }
+        }
+    }
 }
 
 void
@@ -102,12 +560,21 @@ fbGlyphs(CARD8 op,
 {
 #define N_STACK_GLYPHS 512
     ScreenPtr pScreen = pDst->pDrawable->pScreen;
+    FbScreenPrivPtr pScrPriv = fbGetScreenPrivate(pScreen);
+    FbGlyphCachePtr cache;
     pixman_glyph_t stack_glyphs[N_STACK_GLYPHS];
+    FbGlyphEntryPtr stack_entries[N_STACK_GLYPHS];
     pixman_glyph_t *pglyphs = stack_glyphs;
+    FbGlyphEntryPtr *entries = stack_entries;
     pixman_image_t *srcImage, *dstImage;
     int srcXoff, srcYoff, dstXoff, dstYoff;
     GlyphPtr glyph;
-    int n_glyphs;
+    FbGlyphRunPtr run;
+    GlyphListPtr runList;
+    GlyphPtr *runGlyphs;
+    int runNlist;
+    CARD32 hash;
+    int n_glyphs, n_request;
     int x, y;
     int i, n;
     int xDst = list->xOff, yDst = list->yOff;
@@ -117,32 +584,55 @@ fbGlyphs(CARD8 op,
     n_glyphs = 0;
     for (i = 0; i < nlist; ++i)
 	n_glyphs += list[i].len;
-
-    if (!glyphCache)
-	glyphCache = pixman_glyph_cache_create();
-
-    pixman_glyph_cache_freeze (glyphCache);
+    n_request = n_glyphs;
+
+    if (!pScrPriv->glyphCache &&
+	!(pScrPriv->glyphCache = fbCreateGlyphCache(pScreen)))
+	return;
+    cache = pScrPriv->glyphCache;
+    cache->clock++;
+
+    pixman_glyph_cache_freeze (cache->cache);
+
+    hash = fbGlyphRunHash(nlist, list, glyphs);
+    run = fbLookupGlyphRun(cache, hash, nlist, list, glyphs, n_request);
+    if (run) {
+	cache->runHits++;
+	pglyphs = run->pglyphs;
+	n_glyphs = run->npglyphs;
+	goto draw;
+    }
+    cache->runMisses++;
 
     if (n_glyphs > N_STACK_GLYPHS) {
-	if (!(pglyphs = xallocarray(n_glyphs, sizeof(pixman_glyph_t))))
+	pglyphs = xallocarray(n_glyphs, sizeof(pixman_glyph_t));
+	entries = xallocarray(n_glyphs, sizeof(FbGlyphEntryPtr));
+	if (!pglyphs || !entries)
 	    goto out;
     }
 
+    /* glyphs are placed relative to the start of the first list */
+    runList = list;
+    runGlyphs = glyphs;
+    runNlist = nlist;
     i = 0;
-    x = y = 0;
+    x = -xDst;
+    y = -yDst;
     while (nlist--) {
         x += list->xOff;
         y += list->yOff;
         n = list->len;
         while (n--) {
-	    const void *g;
+	    FbGlyphEntryPtr entry;
 
             glyph = *glyphs++;
 
-	    if (!(g = pixman_glyph_cache_lookup (glyphCache, glyph, NULL))) {
-		pixman_image_t *glyphImage;
+	    if ((entry = fbLookupGlyphEntry(cache, glyph))) {
+		entry->stamp = cache->clock;
+		cache->hits++;
+	    }
+	    else {
 		PicturePtr pPicture;
-		int xoff, yoff;
 
 		pPicture = GetGlyphPicture(glyph, pScreen);
 		if (!pPicture) {
@@ -150,23 +640,15 @@ fbGlyphs(CARD8 op,
 		    goto next;
 		}
 
-		if (!(glyphImage = image_from_pict(pPicture, FALSE, &xoff, &yoff)))
-		    goto out;
-
-		g = pixman_glyph_cache_insert(glyphCache, glyph, NULL,
-					      glyph->info.x,
-					      glyph->info.y,
-					      glyphImage);
-
-		free_pixman_pict(pPicture, glyphImage);
-
-		if (!g)
+		if (!(entry = fbAddGlyphEntry(cache, glyph, pPicture)))
 		    goto out;
+		cache->misses++;
 	    }
 
 	    pglyphs[i].x = x;
 	    pglyphs[i].y = y;
-	    pglyphs[i].glyph = g;
+	    pglyphs[i].glyph = entry->handle;
+	    entries[i] = entry;
 	    i++;
 
 	next:
@@ -176,6 +658,10 @@ fbGlyphs(CARD8 op,
 	list++;
     }
 
+    run = fbStoreGlyphRun(cache, hash, runNlist, runList, runGlyphs,
+			  n_request, pglyphs, entries, n_glyphs);
+
+draw:
     if (!(srcImage = image_from_pict(pSrc, FALSE, &srcXoff, &srcYoff)))
 	goto out;
 
@@ -188,21 +674,29 @@ fbGlyphs(CARD8 op,
 
 	format = maskFormat->format | (maskFormat->depth << 24);
 
-	pixman_glyph_get_extents(glyphCache, n_glyphs, pglyphs, &extents);
+	if (run && run->hasExtents)
+	    extents = run->extents;
+	else {
+	    pixman_glyph_get_extents(cache->cache, n_glyphs, pglyphs, &extents);
+	    if (run) {
+		run->extents = extents;
+		run->hasExtents = TRUE;
+	    }
+	}
 
 	pixman_composite_glyphs(op, srcImage, dstImage, format,
-				xSrc + srcXoff + extents.x1 - xDst, ySrc + srcYoff + extents.y1 - yDst,
+				xSrc + srcXoff + extents.x1, ySrc + srcYoff + extents.y1,
 				extents.x1, extents.y1,
-				extents.x1 + dstXoff, extents.y1 + dstYoff,
+				extents.x1 + xDst + dstXoff, extents.y1 + yDst + dstYoff,
 				extents.x2 - extents.x1,
 				extents.y2 - extents.y1,
-				glyphCache, n_glyphs, pglyphs);
+				cache->cache, n_glyphs, pglyphs);
     }
     else {
 	pixman_composite_glyphs_no_mask(op, srcImage, dstImage,
-					xSrc + srcXoff - xDst, ySrc + srcYoff - yDst,
-					dstXoff, dstYoff,
-					glyphCache, n_glyphs, pglyphs);
+					xSrc + srcXoff, ySrc + srcYoff,
+					xDst + dstXoff, yDst + dstYoff,
+					cache->cache, n_glyphs, pglyphs);
     }
 
     free_pixman_pict(pDst, dstImage);
@@ -211,9 +705,16 @@ out_free_src:
     free_pixman_pict(pSrc, srcImage);
 
 out:
-    pixman_glyph_cache_thaw(glyphCache);
-    if (pglyphs != stack_glyphs)
+    pixman_glyph_cache_thaw(cache->cache);
+    if (pglyphs != stack_glyphs && !(run && pglyphs == run->pglyphs))
 	free(pglyphs);
+    if (entries != stack_entries)
+	free(entries);
+
+    if (cache->inserts > FB_GLYPH_CACHE_GLYPHS)
+	fbRestartGlyphCache(cache);
+    else
+	fbTrimGlyphCache(cache);
 }
 
 static pixman_image_t *
@@ -32,7 +32,7 @@ fbCloseScreen(ScreenPtr pScreen)
     int d;
     DepthPtr depths = pScreen->allowedDepths;
 
-    fbDestroyGlyphCache();
+    fbDestroyScreenGlyphCache(pScreen);
     for (d = 0; d < pScreen->numDepths; d++)
         free(depths[d].vids);
     free(depths);
@@ -0,0 +1,390 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include "fb.h"
+
+/*
+ * SSE2 and AVX2 versions of the inner loops of fb, picked at run time.
+ * Each kernel does the whole vectors of a span and returns how many
+ * words it did, leaving the rest to the scalar code that called it, so
+ * they only ever see the unmasked middle of a row.
+ *
+ * The accessor wrapped build has no kernels; every access has to go
+ * through the wrappers.
+ */
+
+int fbSimd = -1;
+
+#if defined(FB_SIMD) && !defined(FB_ACCESS_WRAPPER)
+
+#include <immintrin.h>
+
+#define FB_SSE2	__attribute__((target("sse2")))
+#define FB_AVX2	__attribute__((target("avx2")))
+
+int
+fbProbeSimd(void)
+{
+    int simd = FB_SIMD_NONE;
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        simd = FB_SIMD_SSE2;
+    if (__builtin_cpu_supports("avx2"))
+        simd = FB_SIMD_AVX2;
+    fbSimd = simd;
+    return simd;
+}
+
+/*
+ * fbBlt
+ *
+ * A word of a shifted blt is put together from two neighbouring source
+ * words, so with p the source word lined up with the destination word
+ * the same shifts work on whole vectors loaded from p - 1 and p.  Going
+ * backwards the scalar code lines the destination up with the word
+ * after its source, hence the extra increment for reverse blts.
+ */
+
+#if BITMAP_BIT_ORDER == LSBFirst
+#define FbSse2ScrLeft(v,c)	_mm_srl_epi32(v, c)
+#define FbSse2ScrRight(v,c)	_mm_sll_epi32(v, c)
+#define FbAvx2ScrLeft(v,c)	_mm256_srl_epi32(v, c)
+#define FbAvx2ScrRight(v,c)	_mm256_sll_epi32(v, c)
+#else
+#define FbSse2ScrLeft(v,c)	_mm_sll_epi32(v, c)
+#define FbSse2ScrRight(v,c)	_mm_srl_epi32(v, c)
+#define FbAvx2ScrLeft(v,c)	_mm256_sll_epi32(v, c)
+#define FbAvx2ScrRight(v,c)	_mm256_srl_epi32(v, c)
+#endif
+
+static inline FB_SSE2 __attribute__((always_inline)) int
+fbBltSse2Loop(FbBits * dst, FbBits * src, int n, int leftShift,
+              int rightShift, Bool reverse, Bool destInvarient,
+              FbBits ca1, FbBits cx1, FbBits ca2, FbBits cx2)
+{
+    __m128i ls = _mm_cvtsi32_si128(leftShift);
+    __m128i rs = _mm_cvtsi32_si128(rightShift);
+    __m128i a1 = _mm_set1_epi32(ca1), x1 = _mm_set1_epi32(cx1);
+    __m128i a2 = _mm_set1_epi32(ca2), x2 = _mm_set1_epi32(cx2);
+    int step = reverse ? -4 : 4;
+    int done;
+
+    if (reverse) {
+        dst -= 4;
+        src -= 4;
+        if (leftShift)
+            src++;
+    }
+    for (done = 0; done + 4 <= n; done += 4, dst += step, src += step) {
+        __m128i s, d;
+
+        if (leftShift)
+            s = _mm_or_si128(FbSse2ScrLeft(_mm_loadu_si128((__m128i *) (src - 1)), ls),
+                             FbSse2ScrRight(_mm_loadu_si128((__m128i *) src), rs));
+        else
+            s = _mm_loadu_si128((__m128i *) src);
+        d = _mm_xor_si128(_mm_and_si128(s, a2), x2);
+        if (!destInvarient)
+            d = _mm_xor_si128(_mm_and_si128(_mm_loadu_si128((__m128i *) dst),
+                                            _mm_xor_si128(_mm_and_si128(s, a1),
+                                                          x1)), d);
+        _mm_storeu_si128((__m128i *) dst, d);
+    }
+    return done;
+}
+
+static inline FB_AVX2 __attribute__((always_inline)) int
+fbBltAvx2Loop(FbBits * dst, FbBits * src, int n, int leftShift,
+              int rightShift, Bool reverse, Bool destInvarient,
+              FbBits ca1, FbBits cx1, FbBits ca2, FbBits cx2)
+{
+    __m128i ls = _mm_cvtsi32_si128(leftShift);
+    __m128i rs = _mm_cvtsi32_si128(rightShift);
+    __m256i a1 = _mm256_set1_epi32(ca1), x1 = _mm256_set1_epi32(cx1);
+    __m256i a2 = _mm256_set1_epi32(ca2), x2 = _mm256_set1_epi32(cx2);
+    int step = reverse ? -8 : 8;
+    int done;
+
+    if (reverse) {
+        dst -= 8;
+        src -= 8;
+        if (leftShift)
+            src++;
+    }
+    for (done = 0; done + 8 <= n; done += 8, dst += step, src += step) {
+        __m256i s, d;
+
+        if (leftShift)
+            s = _mm256_or_si256(FbAvx2ScrLeft(_mm256_loadu_si256((__m256i *) (src - 1)), ls),
+                                FbAvx2ScrRight(_mm256_loadu_si256((__m256i *) src), rs));
+        else
+            s = _mm256_loadu_si256((__m256i *) src);
+        d = _mm256_xor_si256(_mm256_and_si256(s, a2), x2);
+        if (!destInvarient)
+            d = _mm256_xor_si256(_mm256_and_si256(_mm256_loadu_si256((__m256i *) dst),
+                                                  _mm256_xor_si256(_mm256_and_si256(s, a1),
+                                                                   x1)), d);
+        _mm256_storeu_si256((__m256i *) dst, d);
+    }
+    return done;
+}
+
+/* Give the compiler a separate loop for each shape of blt */
+#define FbBltSimdLoops(loop) \
+    if (ca1 == 0 && cx1 == 0) { \
+        if (leftShift) \
+            return loop(dst, src, n, leftShift, rightShift, reverse, TRUE, \
+                        ca1, cx1, ca2, cx2); \
+        return loop(dst, src, n, 0, 0, reverse, TRUE, ca1, cx1, ca2, cx2); \
+    } \
+    if (leftShift) \
+        return loop(dst, src, n, leftShift, rightShift, reverse, FALSE, \
+                    ca1, cx1, ca2, cx2); \
+    return loop(dst, src, n, 0, 0, reverse, FALSE, ca1, cx1, ca2, cx2)
+
+static FB_SSE2 int
+fbBltSse2(FbBits * dst, FbBits * src, int n, int leftShift, int rightShift,
+          Bool reverse, FbBits ca1, FbBits cx1, FbBits ca2, FbBits cx2)
+{
+    FbBltSimdLoops(fbBltSse2Loop);
+}
+
+static FB_AVX2 int
+fbBltAvx2(FbBits * dst, FbBits * src, int n, int leftShift, int rightShift,
+          Bool reverse, FbBits ca1, FbBits cx1, FbBits ca2, FbBits cx2)
+{
+    FbBltSimdLoops(fbBltAvx2Loop);
+}
+
+/*
+ * Combine the n words of a row starting at dst (forwards) or ending just
+ * before it (reverse) exactly as the middle loop of fbBlt would, with
+ * leftShift 0 for an unshifted blt.  A shifted blt reads the source word
+ * before the one lined up with the first destination word, so the caller
+ * must have read it already.
+ */
+int
+fbBltSimd(FbBits * dst, FbBits * src, int n, int leftShift, int rightShift,
+          Bool reverse, FbBits ca1, FbBits cx1, FbBits ca2, FbBits cx2)
+{
+    switch (fbSimdLevel()) {
+    case FB_SIMD_AVX2:
+        return fbBltAvx2(dst, src, n, leftShift, rightShift, reverse,
+                         ca1, cx1, ca2, cx2);
+    case FB_SIMD_SSE2:
+        return fbBltSse2(dst, src, n, leftShift, rightShift, reverse,
+                         ca1, cx1, ca2, cx2);
+    }
+    return 0;
+}
+
+/*
+ * fbBltOne
+ *
+ * One stipple word covers FB_STIP_UNIT pixels, a whole number of vectors
+ * at 8, 16 and 32bpp.  Each pixel's bit is spread across its lanes by
+ * comparing against a constant with only that bit set.  This relies on
+ * stipple bit n being pixel n in memory order, so only LSBFirst builds
+ * get it.
+ */
+
+#define FbBltOneCombine(op, si, m, d) \
+    (copy ? op##_or_##si(op##_and_##si(m, fx), op##_andnot_##si(m, bx)) : \
+     op##_or_##si(op##_and_##si(m, op##_xor_##si(op##_and_##si(d, fa), fx)), \
+                  op##_andnot_##si(m, op##_xor_##si(op##_and_##si(d, ba), bx))))
+
+static inline FB_SSE2 __attribute__((always_inline)) __m128i
+fbSse2StipMask(FbStip bits, int dstBpp, int i)
+{
+    __m128i b, sel;
+
+    switch (dstBpp) {
+    case 8:
+        b = _mm_cvtsi32_si128(bits >> (i * 16));
+        b = _mm_unpacklo_epi8(b, b);
+        b = _mm_unpacklo_epi16(b, b);
+        b = _mm_unpacklo_epi32(b, b);
+        sel = _mm_set_epi8(-128, 64, 32, 16, 8, 4, 2, 1,
+                           -128, 64, 32, 16, 8, 4, 2, 1);
+        return _mm_cmpeq_epi8(_mm_and_si128(b, sel), sel);
+    case 16:
+        b = _mm_set1_epi16((bits >> (i * 8)) & 0xff);
+        sel = _mm_set_epi16(128, 64, 32, 16, 8, 4, 2, 1);
+        return _mm_cmpeq_epi16(_mm_and_si128(b, sel), sel);
+    default:
+        b = _mm_set1_epi32(bits >> (i * 4));
+        sel = _mm_set_epi32(8, 4, 2, 1);
+        return _mm_cmpeq_epi32(_mm_and_si128(b, sel), sel);
+    }
+}
+
+static inline FB_AVX2 __attribute__((always_inline)) __m256i
+fbAvx2StipMask(FbStip bits, int dstBpp, int i)
+{
+    __m256i b, sel;
+
+    switch (dstBpp) {
+    case 8:
+        b = _mm256_shuffle_epi8(_mm256_set1_epi32(bits),
+                                _mm256_set_epi64x(0x0303030303030303LL,
+                                                  0x0202020202020202LL,
+                                                  0x0101010101010101LL,
+                                                  0));
+        sel = _mm256_set1_epi64x(0x8040201008040201LL);
+        return _mm256_cmpeq_epi8(_mm256_and_si256(b, sel), sel);
+    case 16:
+        b = _mm256_set1_epi16((bits >> (i * 16)) & 0xffff);
+        sel = _mm256_set_epi16(-32768, 16384, 8192, 4096, 2048, 1024, 512, 256,
+                               128, 64, 32, 16, 8, 4, 2, 1);
+        return _mm256_cmpeq_epi16(_mm256_and_si256(b, sel), sel);
+    default:
+        b = _mm256_set1_epi32(bits >> (i * 8));
+        sel = _mm256_set_epi32(128, 64, 32, 16, 8, 4, 2, 1);
+        return _mm256_cmpeq_epi32(_mm256_and_si256(b, sel), sel);
+    }
+}
+
+static inline FB_SSE2 __attribute__((always_inline)) void
+fbBltOneSse2Loop(FbBits * dst, FbStip bits, int dstBpp, Bool copy,
+                 FbBits fgand, FbBits fgxor, FbBits bgand, FbBits bgxor)
+{
+    __m128i fa = _mm_set1_epi32(fgand), fx = _mm_set1_epi32(fgxor);
+    __m128i ba = _mm_set1_epi32(bgand), bx = _mm_set1_epi32(bgxor);
+    __m128i m, d = _mm_setzero_si128();
+    int i;
+
+    for (i = 0; i < dstBpp / 4; i++, dst += 4) {
+        m = fbSse2StipMask(bits, dstBpp, i);
+        if (!copy)
+            d = _mm_loadu_si128((__m128i *) dst);
+        _mm_storeu_si128((__m128i *) dst, FbBltOneCombine(_mm, si128, m, d));
+    }
+}
+
+static inline FB_AVX2 __attribute__((always_inline)) void
+fbBltOneAvx2Loop(FbBits * dst, FbStip bits, int dstBpp, Bool copy,
+                 FbBits fgand, FbBits fgxor, FbBits bgand, FbBits bgxor)
+{
+    __m256i fa = _mm256_set1_epi32(fgand), fx = _mm256_set1_epi32(fgxor);
+    __m256i ba = _mm256_set1_epi32(bgand), bx = _mm256_set1_epi32(bgxor);
+    __m256i m, d = _mm256_setzero_si256();
+    int i;
+
+    for (i = 0; i < dstBpp / 8; i++, dst += 8) {
+        m = fbAvx2StipMask(bits, dstBpp, i);
+        if (!copy)
+            d = _mm256_loadu_si256((__m256i *) dst);
+        _mm256_storeu_si256((__m256i *) dst, FbBltOneCombine(_mm256, si256, m, d));
+    }
+}
+
+/* Give the compiler a separate loop for each depth and for copies */
+#define FbBltOneSimdLoops(loop) \
+    switch (dstBpp) { \
+    case 8: \
+        if (copy) \
+            loop(dst, bits, 8, TRUE, fgand, fgxor, bgand, bgxor); \
+        else \
+            loop(dst, bits, 8, FALSE, fgand, fgxor, bgand, bgxor); \
+        break; \
+    case 16: \
+        if (copy) \
+            loop(dst, bits, 16, TRUE, fgand, fgxor, bgand, bgxor); \
+        else \
+            loop(dst, bits, 16, FALSE, fgand, fgxor, bgand, bgxor); \
+        break; \
+    case 32: \
+        if (copy) \
+            loop(dst, bits, 32, TRUE, fgand, fgxor, bgand, bgxor); \
+        else \
+            loop(dst, bits, 32, FALSE, fgand, fgxor, bgand, bgxor); \
+        break; \
+    }
+
+static FB_SSE2 void
+fbBltOneSse2(FbBits * dst, FbStip bits, int dstBpp, Bool copy,
+             FbBits fgand, FbBits fgxor, FbBits bgand, FbBits bgxor)
+{
+    FbBltOneSimdLoops(fbBltOneSse2Loop);
+}
+
+static FB_AVX2 void
+fbBltOneAvx2(FbBits * dst, FbStip bits, int dstBpp, Bool copy,
+             FbBits fgand, FbBits fgxor, FbBits bgand, FbBits bgxor)
+{
+    FbBltOneSimdLoops(fbBltOneAvx2Loop);
+}
+
+/*
+ * Expand a whole stipple word, with its first pixel where FbLeftStipBits
+ * looks, into the words starting at dst as the middle loop of fbBltOne
+ * would, with copy set when the result doesn't depend on the
+ * destination.  Returns the number of words written, which is
+ * FB_STIP_UNIT * dstBpp / FB_UNIT, or 0 when the caller has to do it.
+ */
+int
+fbBltOneSimd(FbBits * dst, FbStip bits, int dstBpp, Bool copy,
+             FbBits fgand, FbBits fgxor, FbBits bgand, FbBits bgxor)
+{
+#if BITMAP_BIT_ORDER == LSBFirst
+    if (dstBpp != 8 && dstBpp != 16 && dstBpp != 32)
+        return 0;
+    switch (fbSimdLevel()) {
+    case FB_SIMD_AVX2:
+        fbBltOneAvx2(dst, bits, dstBpp, copy, fgand, fgxor, bgand, bgxor);
+        return FB_STIP_UNIT * dstBpp / FB_UNIT;
+    case FB_SIMD_SSE2:
+        fbBltOneSse2(dst, bits, dstBpp, copy, fgand, fgxor, bgand, bgxor);
+        return FB_STIP_UNIT * dstBpp / FB_UNIT;
+    }
+#endif
+    return 0;
+}
+
+#else
+
+int
+fbProbeSimd(void)
+{
+    fbSimd = FB_SIMD_NONE;
+    return fbSimd;
+}
+
+int
+fbBltSimd(FbBits * dst, FbBits * src, int n, int leftShift, int rightShift,
+          Bool reverse, FbBits ca1, FbBits cx1, FbBits ca2, FbBits cx2)
+{
+    return 0;
+}
+
+int
+fbBltOneSimd(FbBits * dst, FbStip bits, int dstBpp, Bool copy,
+             FbBits fgand, FbBits fgxor, FbBits bgand, FbBits bgxor)
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,160 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include "fb.h"
+
+/*
+ * Large fills and copies are split into bands of rows which are rendered
+ * by a pool of worker threads, with the calling thread taking a band
+ * itself and waiting for the rest before returning.  Each band does
+ * exactly what the serial code would have done for those rows, so the
+ * result is the same either way.
+ *
+ * The accessor wrapped build keeps everything on the calling thread; the
+ * wrappers are global and set up per drawable.
+ */
+
+int fbThreads;
+int fbThreadPixels = FB_THREAD_PIXELS_DEFAULT;
+
+#if defined(FB_THREADS) && !defined(FB_ACCESS_WRAPPER)
+
+#include <pthread.h>
+#include <signal.h>
+
+#define FB_MAX_THREADS 64
+
+typedef struct {
+    FbRowsProcPtr rows;
+    void *closure;
+    int height;
+    int bandHeight;
+    int numBands;
+    int nextBand;               /* next band to hand out */
+    int bandsDone;
+} FbThreadJob;
+
+static pthread_mutex_t fbThreadMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fbThreadWork = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t fbThreadDone = PTHREAD_COND_INITIALIZER;
+static FbThreadJob *fbThreadJob;
+static int fbThreadsRunning;
+
+/* Called with fbThreadMutex held, which is dropped while rendering */
+static void
+fbThreadRunBand(FbThreadJob *job)
+{
+    int y = job->nextBand++ * job->bandHeight;
+    int height = min(job->bandHeight, job->height - y);
+
+    pthread_mutex_unlock(&fbThreadMutex);
+    (*job->rows) (job->closure, y, height);
+    pthread_mutex_lock(&fbThreadMutex);
+
+    if (++job->bandsDone == job->numBands)
+        pthread_cond_signal(&fbThreadDone);
+}
+
+static void *
+fbThreadMain(void *arg)
+{
+    sigset_t set;
+
+    /* Don't handle any signals on this thread */
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    pthread_mutex_lock(&fbThreadMutex);
+    for (;;) {
+        while (!fbThreadJob || fbThreadJob->nextBand == fbThreadJob->numBands)
+            pthread_cond_wait(&fbThreadWork, &fbThreadMutex);
+        fbThreadRunBand(fbThreadJob);
+    }
+    return NULL;
+}
+
+static void
+fbStartThreads(int count)
+{
+    pthread_t thread;
+
+    count = min(count, FB_MAX_THREADS);
+    while (fbThreadsRunning < count) {
+        if (pthread_create(&thread, NULL, fbThreadMain, NULL)) {
+            ErrorF("fb: only %d of %d rendering threads started\n",
+                   fbThreadsRunning, count);
+            fbThreads = fbThreadsRunning;
+            break;
+        }
+        pthread_detach(thread);
+        fbThreadsRunning++;
+    }
+}
+
+Bool
+fbParallelRows(int width, int height, FbRowsProcPtr rows, void *closure)
+{
+    FbThreadJob job;
+
+    if (fbThreads <= 0 || height < 2 ||
+        (long) width * height < fbThreadPixels)
+        return FALSE;
+
+    if (fbThreadsRunning < fbThreads)
+        fbStartThreads(fbThreads);
+    if (!fbThreadsRunning)
+        return FALSE;
+
+    job.rows = rows;
+    job.closure = closure;
+    job.height = height;
+    job.numBands = min(fbThreadsRunning + 1, height);
+    job.bandHeight = (height + job.numBands - 1) / job.numBands;
+    job.numBands = (height + job.bandHeight - 1) / job.bandHeight;
+    job.nextBand = 0;
+    job.bandsDone = 0;
+
+    pthread_mutex_lock(&fbThreadMutex);
+    fbThreadJob = &job;
+    pthread_cond_broadcast(&fbThreadWork);
+    while (job.nextBand < job.numBands)
+        fbThreadRunBand(&job);
+    while (job.bandsDone < job.numBands)
+        pthread_cond_wait(&fbThreadDone, &fbThreadMutex);
+    fbThreadJob = NULL;
+    pthread_mutex_unlock(&fbThreadMutex);
+
+    return TRUE;
+}
+
+#else
+
+Bool
+fbParallelRows(int width, int height, FbRowsProcPtr rows, void *closure)
+{
+    return FALSE;
+}
+
+#endif
@@ -88,6 +88,210 @@ typedef void (*CompositeShapesFunc) (pixman_op_t op,
                                      int x_dst, int y_dst,
                                      int n_shapes, const uint8_t * shapes);
 
+/*
+ * With a mask format, pixman rasterizes every shape into a temporary mask
+ * covering their bounds and then composites through it once.  Building
+ * that mask here instead lets the rasterizing be split into bands of mask
+ * rows on fb's threads: pixman steps edges exactly and only ever adds
+ * coverage, so a band comes out the same as those rows of the whole mask
+ * no matter which shapes reach into it or in what order.  The mask bounds
+ * are worked out the way pixman does, so the final composite is the one
+ * pixman would have made.
+ */
+typedef struct {
+    pixman_format_code_t format;
+    uint8_t *bits;
+    int stride;
+    int width;
+    int x_off, y_off;           /* of the shapes within the mask */
+    Bool triangles;
+    int nshapes;
+    const uint8_t *shapes;
+    Bool failed;                /* a band couldn't be rasterized */
+} FbShapeRowsRec;
+
+static void
+fbShapeRows(void *closure, int y, int height)
+{
+    FbShapeRowsRec *mask = closure;
+    pixman_image_t *band;
+    int i;
+
+    band = pixman_image_create_bits(mask->format, mask->width, height,
+                                    (uint32_t *) (mask->bits +
+                                                  y * mask->stride),
+                                    mask->stride);
+    if (!band) {
+        mask->failed = TRUE;
+        return;
+    }
+
+    if (mask->triangles) {
+        /* Cheap enough to let pixman skip the ones in other bands */
+        pixman_add_triangles(band, mask->x_off, mask->y_off - y,
+                             mask->nshapes,
+                             (const pixman_triangle_t *) mask->shapes);
+    }
+    else {
+        const xTrapezoid *trap = (const xTrapezoid *) mask->shapes;
+
+        for (i = 0; i < mask->nshapes; i++, trap++) {
+            int top = xFixedToInt(trap->top) + mask->y_off;
+            int bottom = xFixedToInt(xFixedCeil(trap->bottom)) + mask->y_off;
+
+            if (bottom <= y || top >= y + height)
+                continue;
+            pixman_rasterize_trapezoid(band, (const pixman_trapezoid_t *) trap,
+                                       mask->x_off, mask->y_off - y);
+        }
+    }
+
+    pixman_image_unref(band);
+}
+
+/* Whether a transparent source leaves the destination alone */
+static Bool
+fbZeroSourceNoEffect(pixman_op_t op)
+{
+    switch (op) {
+    case PIXMAN_OP_DST:
+    case PIXMAN_OP_OVER:
+    case PIXMAN_OP_OVER_REVERSE:
+    case PIXMAN_OP_OUT_REVERSE:
+    case PIXMAN_OP_ATOP:
+    case PIXMAN_OP_XOR:
+    case PIXMAN_OP_ADD:
+    case PIXMAN_OP_SATURATE:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+static void
+fbExtendBoundsX(pixman_box32_t *box, xFixed x)
+{
+    box->x1 = min(box->x1, xFixedToInt(x));
+    box->x2 = max(box->x2, xFixedToInt(xFixedCeil(x)));
+}
+
+static void
+fbExtendBoundsY(pixman_box32_t *box, xFixed top, xFixed bottom)
+{
+    box->y1 = min(box->y1, xFixedToInt(top));
+    box->y2 = max(box->y2, xFixedToInt(xFixedCeil(bottom)));
+}
+
+static Bool
+fbShapesBounds(pixman_op_t op, pixman_image_t *dst, Bool triangles,
+               int nshapes, const uint8_t *shapes, pixman_box32_t *box)
+{
+    int i;
+
+    /* Anything else changes the destination outside the shapes too */
+    if (!fbZeroSourceNoEffect(op)) {
+        box->x1 = 0;
+        box->y1 = 0;
+        box->x2 = pixman_image_get_width(dst);
+        box->y2 = pixman_image_get_height(dst);
+        return TRUE;
+    }
+
+    box->x1 = box->y1 = INT32_MAX;
+    box->x2 = box->y2 = INT32_MIN;
+
+    if (triangles) {
+        const xTriangle *tri = (const xTriangle *) shapes;
+
+        /* Only triangles flat in y give no valid trapezoids */
+        for (i = 0; i < nshapes; i++, tri++) {
+            if (tri->p1.y == tri->p2.y && tri->p2.y == tri->p3.y)
+                continue;
+            fbExtendBoundsX(box, tri->p1.x);
+            fbExtendBoundsX(box, tri->p2.x);
+            fbExtendBoundsX(box, tri->p3.x);
+            fbExtendBoundsY(box, min(tri->p1.y, min(tri->p2.y, tri->p3.y)),
+                            max(tri->p1.y, max(tri->p2.y, tri->p3.y)));
+        }
+    }
+    else {
+        const xTrapezoid *trap = (const xTrapezoid *) shapes;
+
+        for (i = 0; i < nshapes; i++, trap++) {
+            if (!xTrapezoidValid(trap))
+                continue;
+            fbExtendBoundsY(box, trap->top, trap->bottom);
+            fbExtendBoundsX(box, trap->left.p1.x);
+            fbExtendBoundsX(box, trap->left.p2.x);
+            fbExtendBoundsX(box, trap->right.p1.x);
+            fbExtendBoundsX(box, trap->right.p2.x);
+        }
+    }
+
+    return box->x1 < box->x2 && box->y1 < box->y2;
+}
+
+/*
+ * Returns FALSE when the shapes should be left to pixman, which is
+ * whenever fb's threads aren't in use.
+ */
+static Bool
+fbParallelShapes(pixman_op_t op, pixman_image_t *src, pixman_image_t *dst,
+                 pixman_format_code_t format,
+                 int x_src, int y_src, int x_dst, int y_dst,
+                 Bool triangles, int nshapes, const uint8_t *shapes)
+{
+    FbShapeRowsRec mask;
+    pixman_image_t *image;
+    pixman_box32_t box;
+    int width, height;
+
+    if (fbThreads <= 0)
+        return FALSE;
+
+    /* pixman may add these straight to the destination instead */
+    if (op == PIXMAN_OP_ADD && pixman_image_get_format(dst) == format)
+        return FALSE;
+
+    if (!fbShapesBounds(op, dst, triangles, nshapes, shapes, &box))
+        return TRUE;
+
+    width = box.x2 - box.x1;
+    height = box.y2 - box.y1;
+    if ((long) width * height < fbThreadPixels)
+        return FALSE;
+
+    image = pixman_image_create_bits(format, width, height, NULL, -1);
+    if (!image)
+        return FALSE;
+
+    mask.format = format;
+    mask.bits = (uint8_t *) pixman_image_get_data(image);
+    mask.stride = pixman_image_get_stride(image);
+    mask.width = width;
+    mask.x_off = -box.x1;
+    mask.y_off = -box.y1;
+    mask.triangles = triangles;
+    mask.nshapes = nshapes;
+    mask.shapes = shapes;
+    mask.failed = FALSE;
+
+    if (!fbParallelRows(width, height, fbShapeRows, &mask))
+        fbShapeRows(&mask, 0, height);
+
+    /* nothing has been drawn yet, so pixman can still do it all */
+    if (mask.failed) {
+        pixman_image_unref(image);
+        return FALSE;
+    }
+
+    pixman_image_composite32(op, src, image, dst,
+                             x_src + box.x1, y_src + box.y1, 0, 0,
+                             x_dst + box.x1, y_dst + box.y1, width, height);
+    pixman_image_unref(image);
+    return TRUE;
+}
+
 static void
 fbShapes(CompositeShapesFunc composite,
          pixman_op_t op,
@@ -142,9 +346,14 @@ fbShapes(CompositeShapesFunc composite,
                 break;
             }
 
-            composite(op, src, dst, format,
-                      xSrc + src_xoff,
-                      ySrc + src_yoff, dst_xoff, dst_yoff, nshapes, shapes);
+            if (!fbParallelShapes(op, src, dst, format,
+                                  xSrc + src_xoff, ySrc + src_yoff,
+                                  dst_xoff, dst_yoff,
+                                  shape_size == sizeof(xTriangle),
+                                  nshapes, shapes))
+                composite(op, src, dst, format,
+                          xSrc + src_xoff,
+                          ySrc + src_yoff, dst_xoff, dst_yoff, nshapes, shapes);
         }
 
         DamageRegionProcessPending(pDst->pDrawable);
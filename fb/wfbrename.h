@@ -15,8 +15,10 @@
 #define fbArc8 wfbArc8
 #define fbBlt wfbBlt
 #define fbBlt24 wfbBlt24
+#define fbBltSimd wfbBltSimd
 #define fbBltOne wfbBltOne
 #define fbBltOne24 wfbBltOne24
+#define fbBltOneSimd wfbBltOneSimd
 #define fbBltPlane wfbBltPlane
 #define fbBltStip wfbBltStip
 #define fbBres wfbBres
@@ -50,6 +52,7 @@
 #define fbCreatePixmapBpp wfbCreatePixmapBpp
 #define fbCreateWindow wfbCreateWindow
 #define fbDestroyGlyphCache wfbDestroyGlyphCache
+#define fbDestroyScreenGlyphCache wfbDestroyScreenGlyphCache
 #define fbDestroyPixmap wfbDestroyPixmap
 #define fbDestroyWindow wfbDestroyWindow
 #define fbDoCopy wfbDoCopy
@@ -96,6 +99,7 @@
 #define fbOverlayWindowExposures wfbOverlayWindowExposures
 #define fbOverlayWindowLayer wfbOverlayWindowLayer
 #define fbPadPixmap wfbPadPixmap
+#define fbParallelRows wfbParallelRows
 #define fbPictureInit wfbPictureInit
 #define fbPixmapToRegion wfbPixmapToRegion
 #define fbPolyArc wfbPolyArc
@@ -113,6 +117,7 @@
 #define fbPolySegment32 wfbPolySegment32
 #define fbPolySegment8 wfbPolySegment8
 #define fbPositionWindow wfbPositionWindow
+#define fbProbeSimd wfbProbeSimd
 #define fbPushFill wfbPushFill
 #define fbPushImage wfbPushImage
 #define fbPushPattern wfbPushPattern
@@ -132,10 +137,13 @@
 #define fbSetupScreen wfbSetupScreen
 #define fbSetVisualTypes wfbSetVisualTypes
 #define fbSetVisualTypesAndMasks wfbSetVisualTypesAndMasks
+#define fbSimd wfbSimd
 #define _fbSetWindowPixmap _wfbSetWindowPixmap
 #define fbSolid wfbSolid
 #define fbSolid24 wfbSolid24
 #define fbSolidBoxClipped wfbSolidBoxClipped
+#define fbThreadPixels wfbThreadPixels
+#define fbThreads wfbThreads
 #define fbTrapezoids wfbTrapezoids
 #define fbTriangles wfbTriangles
 #define fbUninstallColormap wfbUninstallColormap
@@ -79,6 +79,7 @@ Bool kdEmulateMiddleButton;
 Bool kdRawPointerCoordinates;
 Bool kdDisableZaphod;
 Bool kdAllowZap;
+Bool kdShadowTiles;
 Bool kdEnabled;
 int kdSubpixelOrder;
 int kdVirtualTerminal = -1;
@@ -193,6 +194,9 @@ KdEnableScreen(ScreenPtr pScreen)
     if (!pScreenPriv->screen->dumb && pScreenPriv->card->cfuncs->enableAccel)
         (*pScreenPriv->card->cfuncs->enableAccel) (pScreen);
     KdEnableColormap(pScreen);
+    /* The framebuffer may have been cleared or remapped meanwhile */
+    if (pScreenPriv->screen->fb.shadow)
+        shadowInvalidateTiles(pScreen);
     SetRootClip(pScreen, ROOT_CLIP_FULL);
     if (pScreenPriv->card->cfuncs->dpms)
         (*pScreenPriv->card->cfuncs->dpms) (pScreen, pScreenPriv->dpmsState);
@@ -470,6 +474,7 @@ KdUseMsg(void)
         ("-rawcoord        Don't transform pointer coordinates on rotation\n");
     ErrorF("-dumb            Disable hardware acceleration\n");
     ErrorF("-softCursor      Force software cursor\n");
+    ErrorF("-shadowtiles     Skip unchanged tiles in shadow updates\n");
     ErrorF("-videoTest       Start the server, pause momentarily and exit\n");
     ErrorF
         ("-origin X,Y      Locates the next screen in the the virtual screen (Xinerama)\n");
@@ -531,6 +536,10 @@ KdProcessArgument(int argc, char **argv, int i)
         kdSoftCursor = TRUE;
         return 1;
     }
+    if (!strcmp(argv[i], "-shadowtiles")) {
+        kdShadowTiles = TRUE;
+        return 1;
+    }
     if (!strcmp(argv[i], "-videoTest")) {
         kdVideoTest = TRUE;
         return 1;
@@ -340,6 +340,7 @@ extern Bool kdSwitchPending;
 extern Bool kdEmulateMiddleButton;
 extern Bool kdDisableZaphod;
 extern Bool kdAllowZap;
+extern Bool kdShadowTiles;
 extern int kdVirtualTerminal;
 extern char *kdSwitchCmd;
 extern KdOsFuncs *kdOsFuncs;
@@ -67,8 +67,10 @@ KdShadowSet(ScreenPtr pScreen, int randr, ShadowUpdateProc update,
 
     shadowRemove(pScreen, pScreen->GetScreenPixmap(pScreen));
     if (screen->fb.shadow) {
-        return shadowAdd(pScreen, pScreen->GetScreenPixmap(pScreen),
-                         update, window, randr, 0);
+        if (!shadowAdd(pScreen, pScreen->GetScreenPixmap(pScreen),
+                       update, window, randr, 0))
+            return FALSE;
+        shadowSetTileCache(pScreen, kdShadowTiles);
     }
     return TRUE;
 }
@@ -242,6 +242,10 @@ ddxUseMsg(void)
     ErrorF("-linebias n            adjust thin line pixelization\n");
     ErrorF("-blackpixel n          pixel value for black\n");
     ErrorF("-whitepixel n          pixel value for white\n");
+#ifdef FB_THREADS
+    ErrorF("-fbthreads n           render large fills and copies on n threads\n");
+    ErrorF("-fbthreadpixels n      smallest operation split across threads\n");
+#endif
 
 #ifdef HAVE_MMAP
     ErrorF
@@ -362,6 +366,20 @@ ddxProcessArgument(int argc, char *argv[], int i)
         return 2;
     }
 
+#ifdef FB_THREADS
+    if (strcmp(argv[i], "-fbthreads") == 0) {   /* -fbthreads n */
+        CHECK_FOR_REQUIRED_ARGUMENTS(1);
+        fbThreads = atoi(argv[++i]);
+        return 2;
+    }
+
+    if (strcmp(argv[i], "-fbthreadpixels") == 0) {      /* -fbthreadpixels n */
+        CHECK_FOR_REQUIRED_ARGUMENTS(1);
+        fbThreadPixels = atoi(argv[++i]);
+        return 2;
+    }
+#endif
+
 #ifdef HAVE_MMAP
     if (strcmp(argv[i], "-fbdir") == 0) {       /* -fbdir directory */
         CHECK_FOR_REQUIRED_ARGUMENTS(1);
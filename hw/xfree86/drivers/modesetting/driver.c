@@ -131,6 +131,7 @@ static const OptionInfoRec Options[] = {
     {OPTION_PAGEFLIP, "PageFlip", OPTV_BOOLEAN, {0}, FALSE},
     {OPTION_ZAPHOD_HEADS, "ZaphodHeads", OPTV_STRING, {0}, FALSE},
     {OPTION_DOUBLE_SHADOW, "DoubleShadow", OPTV_BOOLEAN, {0}, FALSE},
+    {OPTION_SHADOW_TILE_CACHE, "ShadowTileCache", OPTV_BOOLEAN, {0}, FALSE},
     {-1, NULL, OPTV_NONE, {0}, FALSE}
 };
 
@@ -990,6 +991,11 @@ PreInit(ScrnInfoPtr pScrn, int flags)
                    ms->drmmode.shadow_enable ? "YES" : "NO");
 
         ms->drmmode.shadow_enable2 = msShouldDoubleShadow(pScrn, ms);
+        /* The double shadow already drops unchanged tiles */
+        if (!ms->drmmode.shadow_enable2)
+            ms->drmmode.shadow_tiles =
+                xf86ReturnOptValBool(ms->drmmode.Options,
+                                     OPTION_SHADOW_TILE_CACHE, FALSE);
     }
 
     ms->drmmode.pageflip =
@@ -1338,6 +1344,7 @@ CreateScreenResources(ScreenPtr pScreen)
         if (!shadowAdd(pScreen, rootPixmap, msUpdatePacked, msShadowWindow,
                        0, 0))
             return FALSE;
+        shadowSetTileCache(pScreen, ms->drmmode.shadow_tiles);
     }
 
     err = drmModeDirtyFB(ms->fd, ms->drmmode.fb_id, NULL, 0);
@@ -1752,6 +1759,10 @@ EnterVT(ScrnInfoPtr pScrn)
 
     SetMaster(pScrn);
 
+    /* Whatever was on the scanout buffer may be gone */
+    if (ms->drmmode.shadow_enable)
+        shadowInvalidateTiles(xf86ScrnToScreen(pScrn));
+
     if (!drmmode_set_desired_modes(pScrn, &ms->drmmode, TRUE))
         return FALSE;
 
@@ -53,6 +53,7 @@ typedef enum {
     OPTION_PAGEFLIP,
     OPTION_ZAPHOD_HEADS,
     OPTION_DOUBLE_SHADOW,
+    OPTION_SHADOW_TILE_CACHE,
 } modesettingOpts;
 
 typedef struct
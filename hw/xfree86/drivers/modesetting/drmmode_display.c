@@ -49,6 +49,7 @@
 #include <X11/extensions/dpmsconst.h>
 
 #include "driver.h"
+#include "shadow.h"
 
 static Bool drmmode_xf86crtc_resize(ScrnInfoPtr scrn, int width, int height);
 static PixmapPtr drmmode_create_pixmap_header(ScreenPtr pScreen, int width, int height,
@@ -2035,6 +2036,8 @@ drmmode_xf86crtc_resize(ScrnInfoPtr scrn, int width, int height)
 
     screen->ModifyPixmapHeader(ppix, width, height, -1, -1,
                                scrn->displayWidth * cpp, new_pixels);
+    if (drmmode->shadow_enable)
+        shadowInvalidateTiles(screen);
 
     if (!drmmode_glamor_handle_new_screen_pixmap(drmmode))
         goto fail;
@@ -67,6 +67,8 @@ typedef struct {
     Bool glamor;
     Bool shadow_enable;
     Bool shadow_enable2;
+    /** Is Option "ShadowTileCache" enabled? */
+    Bool shadow_tiles;
     /** Is Option "PageFlip" enabled? */
     Bool pageflip;
     Bool force_24_32;
@@ -596,6 +596,35 @@ typedef struct {
 
 extern _X_EXPORT CallbackListPtr RootWindowFinalizeCallback;
 
+/*
+ *  ServerStatisticsCallback stuff
+ *
+ *  Called when server statistics are collected, e.g. for the X-Resource
+ *  extension.  call_data is a ServerStatisticsPtr; report each counter
+ *  with AddServerStatistic().
+ */
+
+extern _X_EXPORT CallbackListPtr ServerStatisticsCallback;
+
+typedef struct {
+    char *name;
+    uint64_t value;
+} ServerStatisticRec;
+
+typedef struct _ServerStatistics {
+    int num;
+    int size;
+    ServerStatisticRec *stats;
+} ServerStatisticsRec;
+
+extern _X_EXPORT void AddServerStatistic(ServerStatisticsPtr /*stats */ ,
+                                         const char * /*name */ ,
+                                         uint64_t /*value */ );
+
+extern _X_EXPORT ServerStatisticsPtr CollectServerStatistics(void);
+
+extern _X_EXPORT void FreeServerStatistics(ServerStatisticsPtr /*stats */ );
+
 extern int
 XItoCoreType(int xi_type);
 extern Bool
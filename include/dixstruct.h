@@ -73,6 +73,19 @@ typedef struct _saveSet {
 #define SaveSetAssignToRoot(ss,tr)  ((ss).toRoot = (tr))
 #define SaveSetAssignMap(ss,m)      ((ss).map = (m))
 
+/*
+ * Time spent dispatching requests.  Bucket 0 of the histogram counts
+ * requests taking less than a microsecond, bucket n those taking
+ * [2^(n-1), 2^n) microseconds; the last bucket catches everything slower.
+ */
+#define DISPATCH_HISTOGRAM_BUCKETS 32
+
+typedef struct _DispatchStats {
+    uint64_t requests;
+    uint64_t time;              /* microseconds */
+    uint32_t histogram[DISPATCH_HISTOGRAM_BUCKETS];
+} DispatchStatsRec, *DispatchStatsPtr;
+
 typedef struct _Client {
     void *requestBuffer;
     void *osPrivate;             /* for OS layer, including scheduler */
@@ -108,6 +121,10 @@ typedef struct _Client {
 
     int smart_start_tick;
     int smart_stop_tick;
+    uint64_t smart_slices;      /* times picked by the scheduler */
+    uint64_t smart_expired;     /* slices run until the time was up */
+
+    DispatchStatsRec dispatchStats;
 
     DeviceIntPtr clientPtr;
     ClientIdPtr clientIds;
@@ -140,6 +157,12 @@ extern Bool SmartScheduleSignalEnable;
 extern void SmartScheduleStartTimer(void);
 extern void SmartScheduleStopTimer(void);
 
+/* Dispatch statistics for each major opcode, summed over all clients */
+extern _X_EXPORT DispatchStatsRec MajorDispatchStats[256];
+
+/* Log the dispatch statistics of every client and opcode */
+extern _X_EXPORT void LogDispatchStats(void);
+
 /* Client has requests queued or data on the network */
 void mark_client_ready(ClientPtr client);
 
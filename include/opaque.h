@@ -39,6 +39,7 @@ extern _X_EXPORT int MaxClients;
 extern _X_EXPORT int LimitClients;
 extern _X_EXPORT volatile char isItTimeToYield;
 extern _X_EXPORT volatile char dispatchException;
+extern _X_EXPORT volatile char dispatchStatsRequested;
 
 /* bit values for dispatchException */
 #define DE_RESET     1
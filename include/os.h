@@ -121,6 +121,29 @@ extern _X_EXPORT void SetCriticalOutputPending(void);
 extern _X_EXPORT int WriteToClient(ClientPtr /*who */ , int /*count */ ,
                                    const void * /*buf */ );
 
+/*
+ * WriteToClientRef sends buf without staging it in the connection's output
+ * buffer.  buf must stay valid until release(closure) is called, which
+ * happens exactly once, possibly before WriteToClientRef returns.
+ */
+typedef void (*ClientOutputReleaseProcPtr) (void *closure);
+
+extern _X_EXPORT int WriteToClientRef(ClientPtr /*who */ , int /*count */ ,
+                                      const void * /*buf */ ,
+                                      ClientOutputReleaseProcPtr /*release */ ,
+                                      void * /*closure */ );
+
+typedef struct _ClientOutputStats {
+    uint64_t bytesCopied;       /* staged in connection output buffers */
+    uint64_t bytesDirect;       /* written straight from the caller's memory */
+} ClientOutputStatsRec, *ClientOutputStatsPtr;
+
+extern _X_EXPORT void GetClientOutputStats(ClientOutputStatsPtr /*stats */ );
+
+typedef struct _ServerStatistics *ServerStatisticsPtr;
+
+extern _X_EXPORT void ReportOsStatistics(ServerStatisticsPtr /*stats */ );
+
 extern _X_EXPORT void ResetOsBuffers(void);
 
 extern _X_EXPORT void InitConnectionLimits(void);
@@ -212,6 +235,8 @@ extern _X_EXPORT void AutoResetServer(int /*sig */ );
 
 extern _X_EXPORT void GiveUp(int /*sig */ );
 
+extern _X_EXPORT void RequestDispatchStats(int /*sig */ );
+
 extern _X_EXPORT void UseMsg(void);
 
 extern _X_EXPORT void ProcessCommandLine(int /*argc */ , char * /*argv */ []);
@@ -50,6 +50,7 @@ SOFTWARE.
 #include "window.h"
 
 typedef struct _Property *PropertyPtr;
+typedef struct _PropertyIndex *PropertyIndexPtr;
 
 extern _X_EXPORT int dixLookupProperty(PropertyPtr * /*result */ ,
                                        WindowPtr /*pWin */ ,
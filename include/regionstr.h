@@ -241,6 +241,30 @@ RegionUnion(RegionPtr newReg,   /* destination Region */
     return pixman_region_union(newReg, reg1, reg2);
 }
 
+/*
+ * Like RegionNull/RegionUninit, but the rectangle storage comes from and
+ * goes back to a pool shared by temporaries.
+ */
+extern _X_EXPORT void RegionNullScratch(RegionPtr /*pReg */ );
+
+extern _X_EXPORT void RegionUninitScratch(RegionPtr /*pReg */ );
+
+extern _X_EXPORT void RegionScratchReset(void);
+
+extern _X_EXPORT Bool RegionIntersectSubtract(RegionPtr /*newReg */ ,
+                                              RegionPtr /*reg1 */ ,
+                                              RegionPtr /*reg2 */ ,
+                                              RegionPtr /*reg3 */ );
+
+extern _X_EXPORT Bool RegionTranslateIntersect(RegionPtr /*newReg */ ,
+                                               RegionPtr /*reg1 */ ,
+                                               RegionPtr /*reg2 */ ,
+                                               int /*dx */ ,
+                                               int /*dy */ );
+
+extern _X_EXPORT Bool RegionSimplify(RegionPtr /*pReg */ ,
+                                     int /*maxBoxes */ );
+
 extern _X_EXPORT Bool RegionAppend(RegionPtr /*dstrgn */ ,
                                    RegionPtr /*rgn */ );
 
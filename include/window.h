@@ -71,6 +71,7 @@ struct _Cursor;
 
 typedef struct _BackingStore *BackingStorePtr;
 typedef struct _Window *WindowPtr;
+typedef struct _WindowIndex *WindowIndexPtr;
 
 enum RootClipMode {
     ROOT_CLIP_NONE = 0, /**< resize the root window to 0x0 */
@@ -232,4 +233,12 @@ extern _X_EXPORT void PrintWindowTree(void);
 extern _X_EXPORT void PrintPassiveGrabs(void);
 
 extern _X_EXPORT VisualPtr WindowGetVisual(WindowPtr /*pWin*/);
+
+extern _X_EXPORT WindowPtr ChildWindowAtPoint(WindowPtr /*pParent */ ,
+                                              int /*x */ ,
+                                              int /*y */ );
+
+extern void WindowIndexUpdate(WindowPtr /*pWin */ );
+extern void WindowIndexInvalidate(WindowPtr /*pParent */ );
+extern void WindowIndexFree(WindowPtr /*pWin */ );
 #endif                          /* WINDOW_H */
@@ -766,51 +766,230 @@ miComputeWideEllipse(int lw, xArc * parc)
     return spdata;
 }
 
+/*
+ * Programs tend to draw the same few sizes of arc over and over, markers
+ * on a plot or the nodes of a diagram.  The spans of an ellipse depend
+ * only on its size and line width, so the last few computed are kept and
+ * reused at each new position, along with the outline of the whole
+ * ellipse once one has been filled and the last few pieces drawArc made
+ * of it.  The one least recently used goes first, and big arcs aren't
+ * kept at all.
+ */
+
+/*
+ * What drawArc made of one part of the ellipse: the spans, relative to
+ * the arc's position, and the faces at its ends, which don't depend on
+ * the position at all.
+ */
+typedef struct {
+    int y, xmin, xmax;
+} miArcOutlineSpan;
+
+typedef struct {
+    Bool valid;
+    int a0, a1;
+    Bool right, left;           /* faces asked for */
+    int nspans;
+    int size;
+    miArcOutlineSpan *spans;
+    miArcFaceRec rightFace, leftFace;
+} miArcOutlineRec, *miArcOutlinePtr;
+
+#define ARC_CACHE_OUTLINES      4
+
+typedef struct {
+    unsigned long lrustamp;
+    int lw;
+    unsigned short width, height;
+    miArcSpanData *spdata;
+    int nspans;                 /* outline spans, centered on 0, 0 */
+    DDXPointPtr points;
+    int *widths;
+    miArcOutlineRec outlines[ARC_CACHE_OUTLINES];
+    int nextOutline;            /* slot to replace next */
+} miArcCacheRec, *miArcCachePtr;
+
+#define ARC_CACHE_SIZE          32
+#define ARC_CACHE_MAX_HEIGHT    1024
+
+static miArcCacheRec arcCache[ARC_CACHE_SIZE];
+static miArcCachePtr lastCacheHit = &arcCache[0];
+static unsigned long lrustamp;
+
+/* Outline newFinalSpan is adding to, if any, and where the arc is */
+static miArcOutlinePtr arcRecording;
+static int arcRecordX, arcRecordY;
+
 static void
-miFillWideEllipse(DrawablePtr pDraw, GCPtr pGC, xArc * parc)
+miFreeArcCacheEntry(miArcCachePtr cent)
+{
+    int i;
+
+    free(cent->spdata);
+    free(cent->points);
+    free(cent->widths);
+    cent->spdata = NULL;
+    cent->points = NULL;
+    cent->widths = NULL;
+    for (i = 0; i < ARC_CACHE_OUTLINES; i++) {
+        free(cent->outlines[i].spans);
+        cent->outlines[i].spans = NULL;
+        cent->outlines[i].size = 0;
+        cent->outlines[i].valid = FALSE;
+    }
+}
+
+/*
+ * Look up the spans for parc, computing them if need be.  Arcs too big to
+ * keep go in uncached, and are freed by miReleaseWideEllipse.
+ */
+static miArcCachePtr
+miGetWideEllipse(int lw, xArc * parc, miArcCachePtr uncached)
+{
+    miArcCachePtr cent, lru;
+
+    if (!lw)
+        lw = 1;
+    cent = lastCacheHit;
+    if (cent->spdata && cent->lw == lw &&
+        cent->width == parc->width && cent->height == parc->height) {
+        cent->lrustamp = ++lrustamp;
+        return cent;
+    }
+
+    if ((int) parc->height + lw > ARC_CACHE_MAX_HEIGHT) {
+        cent = uncached;
+        memset(cent, 0, sizeof(*cent));
+    }
+    else {
+        lru = &arcCache[0];
+        for (cent = &arcCache[0]; cent < &arcCache[ARC_CACHE_SIZE]; cent++) {
+            if (cent->spdata && cent->lw == lw &&
+                cent->width == parc->width && cent->height == parc->height) {
+                cent->lrustamp = ++lrustamp;
+                lastCacheHit = cent;
+                return cent;
+            }
+            if (cent->lrustamp < lru->lrustamp)
+                lru = cent;
+        }
+        cent = lru;
+        miFreeArcCacheEntry(cent);
+    }
+
+    cent->spdata = miComputeWideEllipse(lw, parc);
+    if (!cent->spdata)
+        return NULL;
+    cent->lw = lw;
+    cent->width = parc->width;
+    cent->height = parc->height;
+    cent->nspans = 0;
+    if (cent != uncached) {
+        cent->lrustamp = ++lrustamp;
+        lastCacheHit = cent;
+    }
+    return cent;
+}
+
+static void
+miReleaseWideEllipse(miArcCachePtr cent)
+{
+    if (cent < &arcCache[0] || cent >= &arcCache[ARC_CACHE_SIZE])
+        miFreeArcCacheEntry(cent);
+}
+
+/*
+ * Find what drawArc made of this part of the ellipse before, or failing
+ * that set up to record it this time.
+ */
+static miArcOutlinePtr
+miLookupArcOutline(miArcCachePtr cent, int a0, int a1,
+                   miArcFacePtr right, miArcFacePtr left, Bool *found)
+{
+    miArcOutlinePtr outline;
+    int i;
+
+    for (i = 0; i < ARC_CACHE_OUTLINES; i++) {
+        outline = &cent->outlines[i];
+        if (outline->valid && outline->a0 == a0 && outline->a1 == a1 &&
+            outline->right == !!right && outline->left == !!left) {
+            *found = TRUE;
+            return outline;
+        }
+    }
+    *found = FALSE;
+    outline = &cent->outlines[cent->nextOutline];
+    cent->nextOutline = (cent->nextOutline + 1) % ARC_CACHE_OUTLINES;
+    outline->valid = FALSE;
+    outline->a0 = a0;
+    outline->a1 = a1;
+    outline->right = !!right;
+    outline->left = !!left;
+    outline->nspans = 0;
+    return outline;
+}
+
+static void
+miRecordArcSpan(int y, int xmin, int xmax)
+{
+    miArcOutlinePtr outline = arcRecording;
+    miArcOutlineSpan *span;
+
+    if (outline->nspans == outline->size) {
+        int size = max(2 * outline->size, 32);
+
+        span = reallocarray(outline->spans, size, sizeof(*span));
+        if (!span) {
+            /* give up on keeping this one */
+            arcRecording = NULL;
+            return;
+        }
+        outline->spans = span;
+        outline->size = size;
+    }
+    span = &outline->spans[outline->nspans++];
+    span->y = y - arcRecordY;
+    span->xmin = xmin - arcRecordX;
+    span->xmax = xmax - arcRecordX;
+}
+
+/*
+ * Turn the spans of a whole ellipse into its outline, centered on 0, 0
+ */
+static Bool
+miComputeEllipseOutline(miArcCachePtr cent)
 {
-    DDXPointPtr points;
     DDXPointPtr pts;
-    int *widths;
     int *wids;
-    miArcSpanData *spdata;
+    miArcSpanData *spdata = cent->spdata;
     miArcSpan *span;
-    int xorg, yorgu, yorgl;
+    int yorgu, yorgl;
     int n;
 
-    yorgu = parc->height + pGC->lineWidth;
-    n = (sizeof(int) * 2) * yorgu;
-    widths = malloc(n + (sizeof(DDXPointRec) * 2) * yorgu);
-    if (!widths)
-        return;
-    points = (DDXPointPtr) ((char *) widths + n);
-    spdata = miComputeWideEllipse((int) pGC->lineWidth, parc);
-    if (!spdata) {
-        free(widths);
-        return;
-    }
-    pts = points;
-    wids = widths;
+    n = 2 * ((int) cent->height + cent->lw);
+    cent->points = xallocarray(n, sizeof(DDXPointRec));
+    cent->widths = xallocarray(n, sizeof(int));
+    if (!cent->points || !cent->widths) {
+        free(cent->points);
+        free(cent->widths);
+        cent->points = NULL;
+        cent->widths = NULL;
+        return FALSE;
+    }
+    pts = cent->points;
+    wids = cent->widths;
     span = spdata->spans;
-    xorg = parc->x + (parc->width >> 1);
-    yorgu = parc->y + (parc->height >> 1);
-    yorgl = yorgu + (parc->height & 1);
-    if (pGC->miTranslate) {
-        xorg += pDraw->x;
-        yorgu += pDraw->y;
-        yorgl += pDraw->y;
-    }
-    yorgu -= spdata->k;
-    yorgl += spdata->k;
+    yorgu = -spdata->k;
+    yorgl = (cent->height & 1) + spdata->k;
     if (spdata->top) {
-        pts->x = xorg;
+        pts->x = 0;
         pts->y = yorgu - 1;
         pts++;
         *wids++ = 1;
         span++;
     }
     for (n = spdata->count1; --n >= 0;) {
-        pts[0].x = xorg + span->lx;
+        pts[0].x = span->lx;
         pts[0].y = yorgu;
         wids[0] = span->lw;
         pts[1].x = pts[0].x;
@@ -823,17 +1002,17 @@ miFillWideEllipse(DrawablePtr pDraw, GCPtr pGC, xArc * parc)
         span++;
     }
     if (spdata->hole) {
-        pts[0].x = xorg;
+        pts[0].x = 0;
         pts[0].y = yorgl;
         wids[0] = 1;
         pts++;
         wids++;
     }
     for (n = spdata->count2; --n >= 0;) {
-        pts[0].x = xorg + span->lx;
+        pts[0].x = span->lx;
         pts[0].y = yorgu;
         wids[0] = span->lw;
-        pts[1].x = xorg + span->rx;
+        pts[1].x = span->rx;
         pts[1].y = pts[0].y;
         wids[1] = span->rw;
         pts[2].x = pts[0].x;
@@ -850,27 +1029,65 @@ miFillWideEllipse(DrawablePtr pDraw, GCPtr pGC, xArc * parc)
     }
     if (spdata->bot) {
         if (span->rw <= 0) {
-            pts[0].x = xorg + span->lx;
+            pts[0].x = span->lx;
             pts[0].y = yorgu;
             wids[0] = span->lw;
             pts++;
             wids++;
         }
         else {
-            pts[0].x = xorg + span->lx;
+            pts[0].x = span->lx;
             pts[0].y = yorgu;
             wids[0] = span->lw;
-            pts[1].x = xorg + span->rx;
+            pts[1].x = span->rx;
             pts[1].y = pts[0].y;
             wids[1] = span->rw;
             pts += 2;
             wids += 2;
         }
     }
-    free(spdata);
-    (*pGC->ops->FillSpans) (pDraw, pGC, pts - points, points, widths, FALSE);
+    cent->nspans = pts - cent->points;
+    return TRUE;
+}
+
+static void
+miFillWideEllipse(DrawablePtr pDraw, GCPtr pGC, xArc * parc)
+{
+    miArcCacheRec uncached;
+    miArcCachePtr cent;
+    DDXPointPtr points;
+    int *widths;
+    int xorg, yorg;
+    int i;
+
+    cent = miGetWideEllipse((int) pGC->lineWidth, parc, &uncached);
+    if (!cent)
+        return;
+    if (!cent->points && !miComputeEllipseOutline(cent)) {
+        miReleaseWideEllipse(cent);
+        return;
+    }
 
+    points = xallocarray(cent->nspans, sizeof(DDXPointRec));
+    widths = xallocarray(cent->nspans, sizeof(int));
+    if (points && widths) {
+        xorg = parc->x + (parc->width >> 1);
+        yorg = parc->y + (parc->height >> 1);
+        if (pGC->miTranslate) {
+            xorg += pDraw->x;
+            yorg += pDraw->y;
+        }
+        for (i = 0; i < cent->nspans; i++) {
+            points[i].x = cent->points[i].x + xorg;
+            points[i].y = cent->points[i].y + yorg;
+        }
+        memcpy(widths, cent->widths, cent->nspans * sizeof(int));
+        (*pGC->ops->FillSpans) (pDraw, pGC, cent->nspans, points, widths,
+                                FALSE);
+    }
+    free(points);
     free(widths);
+    miReleaseWideEllipse(cent);
 }
 
 /*
@@ -3004,6 +3221,7 @@ static int finalMiny = 0, finalMaxy = -1;
 static int finalSize = 0;
 
 static int nspans = 0;          /* total spans, not just y coords */
+static int spanMiny, spanMaxy;  /* rows with spans in them */
 
 struct finalSpan {
     struct finalSpan *next;
@@ -3066,10 +3284,12 @@ disposeFinalSpans(void)
     finalSpans = 0;
 }
 
+#define FINAL_SPANS_KEEP   1024
+
 static void
 fillSpans(DrawablePtr pDrawable, GCPtr pGC)
 {
-    struct finalSpan *span;
+    struct finalSpan *span, *next;
     DDXPointPtr xSpan;
     int *xWidth;
     int i;
@@ -3082,29 +3302,36 @@ fillSpans(DrawablePtr pDrawable, GCPtr pGC)
         return;
     xSpan = xSpans = xallocarray(nspans, sizeof(DDXPointRec));
     xWidth = xWidths = xallocarray(nspans, sizeof(int));
-    if (xSpans && xWidths) {
-        i = 0;
-        f = finalSpans;
-        for (spany = finalMiny; spany <= finalMaxy; spany++, f++) {
-            for (span = *f; span; span = span->next) {
-                if (span->max <= span->min)
-                    continue;
+    i = 0;
+    f = &finalSpans[spanMiny - finalMiny];
+    for (spany = spanMiny; spany <= spanMaxy; spany++, f++) {
+        for (span = *f; span; span = next) {
+            next = span->next;
+            if (xSpans && xWidths && span->max > span->min) {
                 xSpan->x = span->min;
                 xSpan->y = spany;
                 ++xSpan;
                 *xWidth++ = span->max - span->min;
                 ++i;
             }
+            span->next = freeFinalSpans;
+            freeFinalSpans = span;
         }
-        (*pGC->ops->FillSpans) (pDrawable, pGC, i, xSpans, xWidths, TRUE);
+        *f = NULL;
     }
-    disposeFinalSpans();
+    if (xSpans && xWidths)
+        (*pGC->ops->FillSpans) (pDrawable, pGC, i, xSpans, xWidths, TRUE);
     free(xSpans);
     free(xWidths);
-    finalMiny = 0;
-    finalMaxy = -1;
-    finalSize = 0;
     nspans = 0;
+
+    /* The next arc can reuse the rows and spans, unless there are lots */
+    if (finalSize > FINAL_SPANS_KEEP) {
+        disposeFinalSpans();
+        finalMiny = 0;
+        finalMaxy = -1;
+        finalSize = 0;
+    }
 }
 
 #define SPAN_REALLOC	100
@@ -3122,6 +3349,12 @@ realFindSpan(int y)
     int i;
 
     if (y < finalMiny || y > finalMaxy) {
+        if (!nspans && finalSize) {
+            /* all the rows are empty, move them to y */
+            finalMiny = y - finalSize / 2;
+            finalMaxy = finalMiny + finalSize - 1;
+            return &finalSpans[y - finalMiny];
+        }
         if (!finalSize) {
             finalMiny = y;
             finalMaxy = y - 1;
@@ -3172,6 +3405,8 @@ newFinalSpan(int y, int xmin, int xmax)
     struct finalSpan *oldx;
     struct finalSpan *prev;
 
+    if (arcRecording)
+        miRecordArcSpan(y, xmin, xmax);
     f = findSpan(y);
     if (!f)
         return;
@@ -3191,6 +3426,8 @@ newFinalSpan(int y, int xmin, int xmax)
                         prev->next = x->next;
                     else
                         *f = x->next;
+                    x->next = freeFinalSpans;
+                    freeFinalSpans = x;
                     --nspans;
                 }
                 else {
@@ -3214,7 +3451,12 @@ newFinalSpan(int y, int xmin, int xmax)
             x->max = xmax;
             x->next = *f;
             *f = x;
-            ++nspans;
+            if (!nspans++)
+                spanMiny = spanMaxy = y;
+            else if (y < spanMiny)
+                spanMiny = y;
+            else if (y > spanMaxy)
+                spanMaxy = y;
         }
     }
 }
@@ -3268,11 +3510,36 @@ drawArc(xArc * tarc,
     int i, j;
     int flipRight = 0, flipLeft = 0;
     int copyEnd = 0;
+    miArcCacheRec uncached;
+    miArcCachePtr cent;
+    miArcOutlinePtr outline = NULL;
     miArcSpanData *spdata;
 
-    spdata = miComputeWideEllipse(l, tarc);
-    if (!spdata)
+    cent = miGetWideEllipse(l, tarc, &uncached);
+    if (!cent)
         return;
+    spdata = cent->spdata;
+
+    if (cent != &uncached) {
+        Bool found;
+
+        outline = miLookupArcOutline(cent, a0, a1, right, left, &found);
+        if (found) {
+            for (i = 0; i < outline->nspans; i++)
+                newFinalSpan(tarc->y + outline->spans[i].y,
+                             tarc->x + outline->spans[i].xmin,
+                             tarc->x + outline->spans[i].xmax);
+            if (right)
+                *right = outline->rightFace;
+            if (left)
+                *left = outline->leftFace;
+            miReleaseWideEllipse(cent);
+            return;
+        }
+        arcRecording = outline;
+        arcRecordX = tarc->x;
+        arcRecordY = tarc->y;
+    }
 
     if (a1 < a0)
         a1 += 360 * 64;
@@ -3482,7 +3749,15 @@ drawArc(xArc * tarc,
             left->counterClock = temp;
         }
     }
-    free(spdata);
+    if (outline && arcRecording == outline) {
+        if (right)
+            outline->rightFace = *right;
+        if (left)
+            outline->leftFace = *left;
+        outline->valid = TRUE;
+    }
+    arcRecording = NULL;
+    miReleaseWideEllipse(cent);
 }
 
 static void
@@ -54,14 +54,33 @@ in this Software without prior written authorization from The Open Group.
 #include   "exglobals.h"
 #include   "eventstr.h"
 
+#if INPUTTHREAD
+#include <sched.h>
+#endif
+
 #ifdef DPMSExtension
 #include "dpmsproc.h"
 #include <X11/extensions/dpmsconst.h>
 #endif
 
-/* Maximum size should be initial size multiplied by a power of 2 */
+/*
+ * The queue is a chain of fixed-size chunks.  Input drivers append at the
+ * tail with input_lock held, which keeps them in order among themselves;
+ * the main thread takes events off the head without the lock, so a busy
+ * main thread never holds up the input thread and the other way round.
+ *
+ * Each slot carries a state word.  The producer publishes a slot by
+ * setting it READY and then bumping tail; the consumer claims it with
+ * READY -> READING and hands it back as FREE before bumping head.  Motion
+ * coalescing rewrites the newest slot in place, which the producer may
+ * only do after winning READY -> WRITING, so an event the main thread has
+ * started on is never changed underneath it.
+ *
+ * Chunks the consumer is finished with go on a free stack.  The producer
+ * only ever takes the whole stack at once, so there is no ABA problem.
+ */
+#define QUEUE_CHUNK_SIZE                   256
 #define QUEUE_INITIAL_SIZE                 512
-#define QUEUE_RESERVED_SIZE                 64
 #define QUEUE_MAXIMUM_SIZE                4096
 #define QUEUE_DROP_BACKTRACE_FREQUENCY     100
 #define QUEUE_DROP_BACKTRACE_MAX            10
@@ -69,19 +88,45 @@ in this Software without prior written authorization from The Open Group.
 #define EnqueueScreen(dev) dev->spriteInfo->sprite->pEnqueueScreen
 #define DequeueScreen(dev) dev->spriteInfo->sprite->pDequeueScreen
 
+#define mieqLoad(p)             __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define mieqStore(p, v)         __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define mieqCount(p, n)         __atomic_fetch_add(p, n, __ATOMIC_RELAXED)
+
+enum {
+    EVENT_FREE = 0,
+    EVENT_READY,                /* waiting to be processed */
+    EVENT_WRITING,              /* being coalesced by the producer */
+    EVENT_READING,              /* being copied out by the consumer */
+};
+
 typedef struct _Event {
     InternalEvent *events;
     ScreenPtr pScreen;
     DeviceIntPtr pDev;          /* device this event _originated_ from */
+    int state;
 } EventRec, *EventPtr;
 
+typedef struct _EventChunk {
+    struct _EventChunk *next;
+    EventRec events[QUEUE_CHUNK_SIZE];
+} EventChunkRec, *EventChunkPtr;
+
 typedef struct _EventQueue {
-    HWEventQueueType head, tail;        /* long for SetInputCheck */
+    HWEventQueueType head, tail;        /* events taken and put, for SetInputCheck */
     CARD32 lastEventTime;       /* to avoid time running backwards */
     int lastMotion;             /* device ID if last event motion? */
-    EventRec *events;           /* our queue as an array */
-    size_t nevents;             /* the number of buckets in our queue */
+    /* producer side, under input_lock */
+    EventChunkPtr tailChunk;
+    int tailIndex;
+    EventChunkPtr spareChunks;  /* taken from freeChunks, not yet in use */
+    int nchunks;
+    /* consumer side */
+    EventChunkPtr headChunk;
+    int headIndex;
+    /* shared */
+    EventChunkPtr freeChunks;   /* retired by the consumer */
     size_t dropped;             /* counter for number of consecutive dropped events */
+    uint64_t enqueued, coalesced, droppedTotal;
     mieqHandler handlers[128];  /* custom event handler */
 } EventQueueRec, *EventQueuePtr;
 
@@ -105,88 +150,134 @@ wait_for_server_init(void)
 }
 #endif
 
-static size_t
-mieqNumEnqueued(EventQueuePtr eventQueue)
+static inline Bool
+mieqClaim(int *state, int from, int to)
 {
-    size_t n_enqueued = 0;
-
-    if (eventQueue->nevents) {
-        /* % is not well-defined with negative numbers... sigh */
-        n_enqueued = eventQueue->tail - eventQueue->head + eventQueue->nevents;
-        if (n_enqueued >= eventQueue->nevents)
-            n_enqueued -= eventQueue->nevents;
-    }
-    return n_enqueued;
+    return __atomic_compare_exchange_n(state, &from, to, FALSE,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
 }
 
-/* Pre-condition: Called with input_lock held */
-static Bool
-mieqGrowQueue(EventQueuePtr eventQueue, size_t new_nevents)
+static inline size_t
+mieqNumEnqueued(EventQueuePtr eventQueue)
 {
-    size_t i, n_enqueued, first_hunk;
-    EventRec *new_events;
+    return (unsigned) mieqLoad(&eventQueue->tail) -
+        (unsigned) mieqLoad(&eventQueue->head);
+}
 
-    if (!eventQueue) {
-        ErrorF("[mi] mieqGrowQueue called with a NULL eventQueue\n");
-        return FALSE;
-    }
+static EventChunkPtr
+mieqAllocChunk(void)
+{
+    EventChunkPtr chunk = calloc(1, sizeof(EventChunkRec));
+    int i;
 
-    if (new_nevents <= eventQueue->nevents)
-        return FALSE;
+    if (!chunk)
+        return NULL;
 
-    new_events = calloc(new_nevents, sizeof(EventRec));
-    if (new_events == NULL) {
-        ErrorF("[mi] mieqGrowQueue memory allocation error.\n");
-        return FALSE;
+    for (i = 0; i < QUEUE_CHUNK_SIZE; i++) {
+        chunk->events[i].events = InitEventList(1);
+        if (!chunk->events[i].events) {
+            while (i--)
+                FreeEventList(chunk->events[i].events, 1);
+            free(chunk);
+            return NULL;
+        }
     }
+    return chunk;
+}
 
-    n_enqueued = mieqNumEnqueued(eventQueue);
-
-    /* First copy the existing events */
-    first_hunk = eventQueue->nevents - eventQueue->head;
-    memcpy(new_events,
-           &eventQueue->events[eventQueue->head],
-           first_hunk * sizeof(EventRec));
-    memcpy(&new_events[first_hunk],
-           eventQueue->events, eventQueue->head * sizeof(EventRec));
+static void
+mieqFreeChunks(EventChunkPtr chunk)
+{
+    EventChunkPtr next;
+    int i;
 
-    /* Initialize the new portion */
-    for (i = eventQueue->nevents; i < new_nevents; i++) {
-        InternalEvent *evlist = InitEventList(1);
+    for (; chunk; chunk = next) {
+        next = chunk->next;
+        for (i = 0; i < QUEUE_CHUNK_SIZE; i++)
+            FreeEventList(chunk->events[i].events, 1);
+        free(chunk);
+    }
+}
 
-        if (!evlist) {
-            size_t j;
+/* Pre-condition: Called with input_lock held */
+static EventChunkPtr
+mieqNextChunk(EventQueuePtr eventQueue)
+{
+    EventChunkPtr chunk;
+
+    if (!eventQueue->spareChunks)
+        eventQueue->spareChunks =
+            __atomic_exchange_n(&eventQueue->freeChunks, NULL,
+                                __ATOMIC_ACQUIRE);
+
+    chunk = eventQueue->spareChunks;
+    if (chunk)
+        eventQueue->spareChunks = chunk->next;
+    else if (eventQueue->nchunks < QUEUE_MAXIMUM_SIZE / QUEUE_CHUNK_SIZE &&
+             (chunk = mieqAllocChunk()))
+        mieqCount(&eventQueue->nchunks, 1);
+    else
+        return NULL;
 
-            for (j = 0; j < i; j++)
-                FreeEventList(new_events[j].events, 1);
-            free(new_events);
-            OsReleaseSignals();
-            return FALSE;
-        }
-        new_events[i].events = evlist;
-    }
+    chunk->next = NULL;
+    return chunk;
+}
 
-    /* And update our record */
-    eventQueue->tail = n_enqueued;
-    eventQueue->head = 0;
-    eventQueue->nevents = new_nevents;
-    free(eventQueue->events);
-    eventQueue->events = new_events;
+/* Called by the consumer once it has moved past every slot of chunk */
+static void
+mieqRetireChunk(EventQueuePtr eventQueue, EventChunkPtr chunk)
+{
+    EventChunkPtr top = __atomic_load_n(&eventQueue->freeChunks,
+                                        __ATOMIC_RELAXED);
+
+    do {
+        chunk->next = top;
+    } while (!__atomic_compare_exchange_n(&eventQueue->freeChunks, &top, chunk,
+                                          TRUE, __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED));
+}
 
-    return TRUE;
+static void
+mieqReportStatistics(CallbackListPtr *pcbl, void *data, void *call_data)
+{
+    ServerStatisticsPtr stats = call_data;
+
+    AddServerStatistic(stats, "mieq.events.enqueued",
+                       __atomic_load_n(&miEventQueue.enqueued,
+                                       __ATOMIC_RELAXED));
+    AddServerStatistic(stats, "mieq.events.coalesced",
+                       __atomic_load_n(&miEventQueue.coalesced,
+                                       __ATOMIC_RELAXED));
+    AddServerStatistic(stats, "mieq.events.dropped",
+                       __atomic_load_n(&miEventQueue.droppedTotal,
+                                       __ATOMIC_RELAXED));
+    AddServerStatistic(stats, "mieq.chunks",
+                       __atomic_load_n(&miEventQueue.nchunks,
+                                       __ATOMIC_RELAXED));
 }
 
 Bool
 mieqInit(void)
 {
+    EventChunkPtr chunk;
+
     memset(&miEventQueue, 0, sizeof(miEventQueue));
     miEventQueue.lastEventTime = GetTimeInMillis();
 
     input_lock();
-    if (!mieqGrowQueue(&miEventQueue, QUEUE_INITIAL_SIZE))
-        FatalError("Could not allocate event queue.\n");
+    while (miEventQueue.nchunks < QUEUE_INITIAL_SIZE / QUEUE_CHUNK_SIZE) {
+        if (!(chunk = mieqAllocChunk()))
+            FatalError("Could not allocate event queue.\n");
+        chunk->next = miEventQueue.spareChunks;
+        miEventQueue.spareChunks = chunk;
+        miEventQueue.nchunks++;
+    }
+    miEventQueue.tailChunk = miEventQueue.headChunk =
+        mieqNextChunk(&miEventQueue);
     input_unlock();
 
+    AddCallback(&ServerStatisticsCallback, mieqReportStatistics, NULL);
+
     SetInputCheck(&miEventQueue.head, &miEventQueue.tail);
     return TRUE;
 }
@@ -194,15 +285,47 @@ mieqInit(void)
 void
 mieqFini(void)
 {
-    int i;
+    DeleteCallback(&ServerStatisticsCallback, mieqReportStatistics, NULL);
+
+    /* Everything from the head to the tail is still linked together */
+    mieqFreeChunks(miEventQueue.headChunk);
+    mieqFreeChunks(miEventQueue.spareChunks);
+    mieqFreeChunks(miEventQueue.freeChunks);
+    miEventQueue.headChunk = miEventQueue.tailChunk = NULL;
+    miEventQueue.spareChunks = miEventQueue.freeChunks = NULL;
+}
+
+static void
+mieqDropped(void)
+{
+    size_t dropped = __atomic_add_fetch(&miEventQueue.dropped, 1,
+                                        __ATOMIC_RELAXED);
 
-    for (i = 0; i < miEventQueue.nevents; i++) {
-        if (miEventQueue.events[i].events != NULL) {
-            FreeEventList(miEventQueue.events[i].events, 1);
-            miEventQueue.events[i].events = NULL;
+    mieqCount(&miEventQueue.droppedTotal, 1);
+
+    /* Toss events which come in late.  Usually this means your server's
+     * stuck in an infinite loop in the main thread.
+     */
+    if (dropped == 1) {
+        ErrorFSigSafe("[mi] EQ overflowing.  Additional events will be "
+                      "discarded until existing events are processed.\n");
+        xorg_backtrace();
+        ErrorFSigSafe("[mi] These backtraces from mieqEnqueue may point to "
+                      "a culprit higher up the stack.\n");
+        ErrorFSigSafe("[mi] mieq is *NOT* the cause.  It is a victim.\n");
+    }
+    else if (dropped % QUEUE_DROP_BACKTRACE_FREQUENCY == 0 &&
+             dropped / QUEUE_DROP_BACKTRACE_FREQUENCY <=
+             QUEUE_DROP_BACKTRACE_MAX) {
+        ErrorFSigSafe("[mi] EQ overflow continuing.  %zu events have been "
+                      "dropped.\n", dropped);
+        if (dropped / QUEUE_DROP_BACKTRACE_FREQUENCY ==
+            QUEUE_DROP_BACKTRACE_MAX) {
+            ErrorFSigSafe("[mi] No further overflow reports will be "
+                          "reported until the clog is cleared.\n");
         }
+        xorg_backtrace();
     }
-    free(miEventQueue.events);
 }
 
 /*
@@ -213,12 +336,13 @@ mieqFini(void)
 void
 mieqEnqueue(DeviceIntPtr pDev, InternalEvent *e)
 {
-    unsigned int oldtail = miEventQueue.tail;
+    EventQueuePtr eq = &miEventQueue;
+    EventPtr slot = NULL;
     InternalEvent *evt;
+    Bool append = FALSE;
     int isMotion = 0;
     int evlen;
     Time time;
-    size_t n_enqueued;
 
 #ifdef XQUARTZ
     wait_for_server_init();
@@ -226,64 +350,58 @@ mieqEnqueue(DeviceIntPtr pDev, InternalEvent *e)
 
     verify_internal_event(e);
 
-    n_enqueued = mieqNumEnqueued(&miEventQueue);
-
     /* avoid merging events from different devices */
     if (e->any.type == ET_Motion)
         isMotion = pDev->id;
 
-    if (isMotion && isMotion == miEventQueue.lastMotion &&
-        oldtail != miEventQueue.head) {
-        oldtail = (oldtail - 1) % miEventQueue.nevents;
+    /* Overwrite the last motion event, unless the main thread got to it */
+    if (isMotion && isMotion == eq->lastMotion && eq->tailIndex > 0) {
+        slot = &eq->tailChunk->events[eq->tailIndex - 1];
+        if (mieqClaim(&slot->state, EVENT_READY, EVENT_WRITING))
+            mieqCount(&eq->coalesced, 1);
+        else
+            slot = NULL;
     }
-    else if (n_enqueued + 1 == miEventQueue.nevents) {
-        if (!mieqGrowQueue(&miEventQueue, miEventQueue.nevents << 1)) {
-            /* Toss events which come in late.  Usually this means your server's
-             * stuck in an infinite loop in the main thread.
-             */
-            miEventQueue.dropped++;
-            if (miEventQueue.dropped == 1) {
-                ErrorFSigSafe("[mi] EQ overflowing.  Additional events will be "
-                              "discarded until existing events are processed.\n");
-                xorg_backtrace();
-                ErrorFSigSafe("[mi] These backtraces from mieqEnqueue may point to "
-                              "a culprit higher up the stack.\n");
-                ErrorFSigSafe("[mi] mieq is *NOT* the cause.  It is a victim.\n");
-            }
-            else if (miEventQueue.dropped % QUEUE_DROP_BACKTRACE_FREQUENCY == 0 &&
-                     miEventQueue.dropped / QUEUE_DROP_BACKTRACE_FREQUENCY <=
-                     QUEUE_DROP_BACKTRACE_MAX) {
-                ErrorFSigSafe("[mi] EQ overflow continuing.  %zu events have been "
-                              "dropped.\n", miEventQueue.dropped);
-                if (miEventQueue.dropped / QUEUE_DROP_BACKTRACE_FREQUENCY ==
-                    QUEUE_DROP_BACKTRACE_MAX) {
-                    ErrorFSigSafe("[mi] No further overflow reports will be "
-                                  "reported until the clog is cleared.\n");
-                }
-                xorg_backtrace();
+
+    if (!slot) {
+        if (eq->tailIndex == QUEUE_CHUNK_SIZE) {
+            EventChunkPtr chunk = mieqNextChunk(eq);
+
+            if (!chunk) {
+                mieqDropped();
+                return;
             }
-            return;
+            mieqStore(&eq->tailChunk->next, chunk);
+            eq->tailChunk = chunk;
+            eq->tailIndex = 0;
         }
-        oldtail = miEventQueue.tail;
+        slot = &eq->tailChunk->events[eq->tailIndex];
+        append = TRUE;
     }
 
     evlen = e->any.length;
-    evt = miEventQueue.events[oldtail].events;
+    evt = slot->events;
     memcpy(evt, e, evlen);
 
     time = e->any.time;
     /* Make sure that event times don't go backwards - this
      * is "unnecessary", but very useful. */
-    if (time < miEventQueue.lastEventTime &&
-        miEventQueue.lastEventTime - time < 10000)
-        e->any.time = miEventQueue.lastEventTime;
-
-    miEventQueue.lastEventTime = evt->any.time;
-    miEventQueue.events[oldtail].pScreen = pDev ? EnqueueScreen(pDev) : NULL;
-    miEventQueue.events[oldtail].pDev = pDev;
+    if (time < eq->lastEventTime &&
+        eq->lastEventTime - time < 10000)
+        e->any.time = eq->lastEventTime;
+
+    eq->lastEventTime = evt->any.time;
+    slot->pScreen = pDev ? EnqueueScreen(pDev) : NULL;
+    slot->pDev = pDev;
+
+    mieqStore(&slot->state, EVENT_READY);
+    if (append) {
+        eq->tailIndex++;
+        mieqCount(&eq->enqueued, 1);
+        mieqStore(&eq->tail, (unsigned) eq->tail + 1);
+    }
 
-    miEventQueue.lastMotion = isMotion;
-    miEventQueue.tail = (oldtail + 1) % miEventQueue.nevents;
+    eq->lastMotion = isMotion;
 }
 
 /**
@@ -524,14 +642,14 @@ mieqProcessDeviceEvent(DeviceIntPtr dev, InternalEvent *event, ScreenPtr screen)
 void
 mieqProcessInputEvents(void)
 {
+    EventQueuePtr eq = &miEventQueue;
     EventRec *e = NULL;
     ScreenPtr screen;
     InternalEvent event;
     DeviceIntPtr dev = NULL, master = NULL;
+    size_t dropped;
     static Bool inProcessInputEvents = FALSE;
 
-    input_lock();
-
     /*
      * report an error if mieqProcessInputEvents() is called recursively;
      * this can happen, e.g., if something in the mieqProcessDeviceEvent()
@@ -540,24 +658,38 @@ mieqProcessInputEvents(void)
     BUG_WARN_MSG(inProcessInputEvents, "[mi] mieqProcessInputEvents() called recursively.\n");
     inProcessInputEvents = TRUE;
 
-    if (miEventQueue.dropped) {
+    dropped = __atomic_exchange_n(&eq->dropped, 0, __ATOMIC_RELAXED);
+    if (dropped) {
         ErrorF("[mi] EQ processing has resumed after %lu dropped events.\n",
-               (unsigned long) miEventQueue.dropped);
+               (unsigned long) dropped);
         ErrorF
             ("[mi] This may be caused by a misbehaving driver monopolizing the server's resources.\n");
-        miEventQueue.dropped = 0;
     }
 
-    while (miEventQueue.head != miEventQueue.tail) {
-        e = &miEventQueue.events[miEventQueue.head];
+    while (mieqNumEnqueued(eq)) {
+        if (eq->headIndex == QUEUE_CHUNK_SIZE) {
+            EventChunkPtr chunk = eq->headChunk;
+
+            eq->headChunk = mieqLoad(&chunk->next);
+            eq->headIndex = 0;
+            mieqRetireChunk(eq, chunk);
+        }
+        e = &eq->headChunk->events[eq->headIndex];
+
+        /* The producer may be coalescing into this very slot */
+        while (!mieqClaim(&e->state, EVENT_READY, EVENT_READING)) {
+#if INPUTTHREAD
+            sched_yield();
+#endif
+        }
 
         event = *e->events;
         dev = e->pDev;
         screen = e->pScreen;
 
-        miEventQueue.head = (miEventQueue.head + 1) % miEventQueue.nevents;
-
-        input_unlock();
+        mieqStore(&e->state, EVENT_FREE);
+        eq->headIndex++;
+        mieqStore(&eq->head, (unsigned) eq->head + 1);
 
         master = (dev) ? GetMaster(dev, MASTER_ATTACHED) : NULL;
 
@@ -580,11 +712,7 @@ mieqProcessInputEvents(void)
                event.any.type == ET_TouchUpdate) &&
               event.device_event.flags & TOUCH_POINTER_EMULATED)))
             miPointerUpdateSprite(dev);
-
-        input_lock();
     }
 
     inProcessInputEvents = FALSE;
-
-    input_unlock();
 }
@@ -940,6 +940,8 @@ miOverlayMoveWindow(WindowPtr pWin,
     pWin->origin.y = y + (int) bw;
     x = pWin->drawable.x = pParent->drawable.x + x + (int) bw;
     y = pWin->drawable.y = pParent->drawable.y + y + (int) bw;
+    /* before anything can look up the pointer's window again */
+    WindowIndexUpdate(pWin);
 
     SetWinSize(pWin);
     SetBorderSize(pWin);
@@ -1188,6 +1190,7 @@ miOverlayResizeWindow(WindowPtr pWin,
 
     x = pWin->drawable.x = newx;
     y = pWin->drawable.y = newy;
+    WindowIndexUpdate(pWin);
 
     SetWinSize(pWin);
     SetBorderSize(pWin);
@@ -1495,6 +1498,7 @@ miOverlayChangeBorderWidth(WindowPtr pWin, unsigned int width)
 
     pWin->borderWidth = width;
     SetBorderSize(pWin);
+    WindowIndexUpdate(pWin);
 
     if (WasViewable) {
         if (width > oldwidth) {
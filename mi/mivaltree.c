@@ -393,8 +393,8 @@ miComputeClips(WindowPtr pParent,
         RegionCopy(&pParent->borderClip, universe);
 
     if ((pChild = pParent->firstChild) && pParent->mapped) {
-        RegionNull(&childUniverse);
-        RegionNull(&childUnion);
+        RegionNullScratch(&childUniverse);
+        RegionNullScratch(&childUnion);
         if ((pChild->drawable.y < pParent->lastChild->drawable.y) ||
             ((pChild->drawable.y == pParent->lastChild->drawable.y) &&
              (pChild->drawable.x < pParent->lastChild->drawable.x))) {
@@ -439,8 +439,8 @@ miComputeClips(WindowPtr pParent,
         }
         if (!overlap)
             RegionSubtract(universe, universe, &childUnion);
-        RegionUninit(&childUnion);
-        RegionUninit(&childUniverse);
+        RegionUninitScratch(&childUnion);
+        RegionUninitScratch(&childUniverse);
     }                           /* if any children */
 
     /*
@@ -571,8 +571,8 @@ miValidateTree(WindowPtr pParent,       /* Parent to validate */
     if (pChild == NullWindow)
         pChild = pParent->firstChild;
 
-    RegionNull(&childClip);
-    RegionNull(&exposed);
+    RegionNullScratch(&childClip);
+    RegionNullScratch(&exposed);
 
     /*
      * compute the area of the parent window occupied
@@ -580,7 +580,7 @@ miValidateTree(WindowPtr pParent,       /* Parent to validate */
      * is the area which can be divied up among the marked
      * children in their new configuration.
      */
-    RegionNull(&totalClip);
+    RegionNullScratch(&totalClip);
     viewvals = 0;
     if (RegionBroken(&pParent->clipList) && !RegionBroken(&pParent->borderClip)) {
         kind = VTBroken;
@@ -589,8 +589,7 @@ miValidateTree(WindowPtr pParent,       /* Parent to validate */
          * assume everything is busted.
          */
         forward = TRUE;
-        RegionCopy(&totalClip, &pParent->borderClip);
-        RegionIntersect(&totalClip, &totalClip, &pParent->winSize);
+        RegionIntersect(&totalClip, &pParent->borderClip, &pParent->winSize);
 
         for (pWin = pParent->firstChild; pWin != pChild; pWin = pWin->nextSib) {
             if (pWin->viewable && !TreatAsTransparent(pWin))
@@ -650,7 +649,7 @@ miValidateTree(WindowPtr pParent,       /* Parent to validate */
              * lower than the cost of multiple Subtracts in the
              * loop below.
              */
-            RegionNull(&childUnion);
+            RegionNullScratch(&childUnion);
             if (forward) {
                 for (pWin = pChild; pWin; pWin = pWin->nextSib)
                     if (pWin->valdata && pWin->viewable &&
@@ -670,7 +669,7 @@ miValidateTree(WindowPtr pParent,       /* Parent to validate */
             }
             RegionValidate(&childUnion, &overlap);
             if (overlap)
-                RegionUninit(&childUnion);
+                RegionUninitScratch(&childUnion);
         }
     }
 
@@ -698,10 +697,10 @@ miValidateTree(WindowPtr pParent,       /* Parent to validate */
         }
     }
 
-    RegionUninit(&childClip);
+    RegionUninitScratch(&childClip);
     if (!overlap) {
         RegionSubtract(&totalClip, &totalClip, &childUnion);
-        RegionUninit(&childUnion);
+        RegionUninitScratch(&childUnion);
     }
 
     RegionNull(&pParent->valdata->after.exposed);
@@ -730,8 +729,8 @@ miValidateTree(WindowPtr pParent,       /* Parent to validate */
         break;
     }
 
-    RegionUninit(&totalClip);
-    RegionUninit(&exposed);
+    RegionUninitScratch(&totalClip);
+    RegionUninitScratch(&exposed);
     if (pScreen->ClipNotify)
         (*pScreen->ClipNotify) (pParent, 0, 0);
     return 1;
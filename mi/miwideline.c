@@ -566,34 +566,395 @@ miFillUniqueSpanGroup(DrawablePtr pDraw, GCPtr pGC, SpanGroup * spanGroup)
     spanGroup->ymax = MINSHORT;
 }
 
+/*
+ * When everything is drawn in the foreground, which is all but
+ * LineDoubleDash, the spans from each piece of the line only need to be
+ * unioned.  Rather than keep them all to sort and merge at the end, each
+ * span is set in a bitmap covering the line, one bit per pixel, which is
+ * read back as sorted, unique spans.  The bitmap and span arrays are kept
+ * from one line to the next unless they got big, and a line which would
+ * need too large a bitmap goes back to the span group.
+ */
+
+typedef struct {
+    CARD32 *bits;
+    int x, y;                   /* position of the first bit */
+    int stride;                 /* words per row */
+    int height;
+    BoxRec used;                /* bits set are within this */
+    DDXPointPtr points;         /* scratch spans */
+    int *widths;
+    int sizeSpans;
+} SpanBuffer;
+
+#define SPAN_BUFFER_KEEP_BYTES  (64 * 1024)
+#define SPAN_BUFFER_MAX_BYTES   (4 * 1024 * 1024)
+#define SPAN_BUFFER_KEEP_SPANS  4096
+
+static SpanBuffer spanBuffer;
+
+static void
+miSpanBufferInit(SpanBuffer * buffer)
+{
+    buffer->used.x1 = buffer->used.y1 = MAXSHORT;
+    buffer->used.x2 = buffer->used.y2 = MINSHORT;
+}
+
+static void
+miSpanBufferFree(SpanBuffer * buffer)
+{
+    free(buffer->bits);
+    free(buffer->points);
+    free(buffer->widths);
+    memset(buffer, 0, sizeof(*buffer));
+    miSpanBufferInit(buffer);
+}
+
 static Bool
-InitSpans(Spans * spans, size_t nspans)
+miSpanBufferGetSpans(SpanBuffer * buffer, Spans * spans, size_t nspans)
 {
-    spans->points = xallocarray(nspans, sizeof(*spans->points));
-    if (!spans->points)
+    if (nspans > buffer->sizeSpans) {
+        size_t size = max(nspans, 2 * buffer->sizeSpans);
+        DDXPointPtr points;
+        int *widths;
+
+        if (size > INT_MAX)
+            return FALSE;
+        points = reallocarray(buffer->points, size, sizeof(*points));
+        if (!points)
+            return FALSE;
+        buffer->points = points;
+        widths = reallocarray(buffer->widths, size, sizeof(*widths));
+        if (!widths)
+            return FALSE;
+        buffer->widths = widths;
+        buffer->sizeSpans = size;
+    }
+    spans->points = buffer->points;
+    spans->widths = buffer->widths;
+    return TRUE;
+}
+
+/*
+ * Place one side of the bitmap, leaving the spare room on the side the
+ * line is heading towards.
+ */
+static int
+miSpanBufferPlace(int size, int used1, int used2, int new1, int new2)
+{
+    if (used1 >= used2)
+        return new1 - (size - (new2 - new1)) / 2;
+    if (new1 < used1)
+        return max(new2, used2) - size;
+    return min(new1, used1);
+}
+
+/*
+ * Make sure the bitmap covers box, keeping whatever is already set.
+ * Fails when that would make it larger than SPAN_BUFFER_MAX_BYTES.
+ */
+static Bool
+miSpanBufferCover(SpanBuffer * buffer, BoxPtr box)
+{
+    Bool empty = buffer->used.x1 >= buffer->used.x2;
+    BoxRec need;
+    CARD32 *bits;
+    int stride, height, x, y, row;
+
+    need = *box;
+    if (!empty) {
+        need.x1 = min(need.x1, buffer->used.x1);
+        need.y1 = min(need.y1, buffer->used.y1);
+        need.x2 = max(need.x2, buffer->used.x2);
+        need.y2 = max(need.y2, buffer->used.y2);
+    }
+
+    if (buffer->bits &&
+        need.x1 >= buffer->x && need.x2 <= buffer->x + buffer->stride * 32 &&
+        need.y1 >= buffer->y && need.y2 <= buffer->y + buffer->height)
+        return TRUE;
+
+    /* An empty bitmap which is big enough only needs moving */
+    if (buffer->bits && empty &&
+        need.x2 - need.x1 <= (buffer->stride - 1) * 32 &&
+        need.y2 - need.y1 <= buffer->height) {
+        buffer->x = miSpanBufferPlace((buffer->stride - 1) * 32, 0, 0,
+                                      need.x1, need.x2) & ~31;
+        buffer->y = miSpanBufferPlace(buffer->height, 0, 0, need.y1, need.y2);
+        return TRUE;
+    }
+
+    stride = (max(2 * (need.x2 - need.x1), 256) + 31) / 32 + 1;
+    height = max(2 * (need.y2 - need.y1), 64);
+    if ((size_t) stride * height * sizeof(CARD32) > SPAN_BUFFER_MAX_BYTES)
         return FALSE;
-    spans->widths = xallocarray(nspans, sizeof(*spans->widths));
-    if (!spans->widths) {
-        free(spans->points);
+    bits = calloc((size_t) stride * height, sizeof(CARD32));
+    if (!bits)
+        return FALSE;
+
+    x = miSpanBufferPlace((stride - 1) * 32, buffer->used.x1,
+                          buffer->used.x2, box->x1, box->x2) & ~31;
+    y = miSpanBufferPlace(height, buffer->used.y1, buffer->used.y2,
+                          box->y1, box->y2);
+    if (!empty) {
+        int first = (buffer->used.x1 - buffer->x) >> 5;
+        int last = (buffer->used.x2 - 1 - buffer->x) >> 5;
+        int shift = (buffer->x - x) >> 5;
+
+        for (row = buffer->used.y1; row < buffer->used.y2; row++)
+            memcpy(bits + (row - y) * stride + first + shift,
+                   buffer->bits + (row - buffer->y) * buffer->stride + first,
+                   (last - first + 1) * sizeof(CARD32));
+    }
+    free(buffer->bits);
+    buffer->bits = bits;
+    buffer->x = x;
+    buffer->y = y;
+    buffer->stride = stride;
+    buffer->height = height;
+    return TRUE;
+}
+
+static void
+miSpanBufferSet(SpanBuffer * buffer, int x1, int x2, int y)
+{
+    CARD32 *line = buffer->bits + (y - buffer->y) * buffer->stride;
+    int first = x1 - buffer->x;
+    int last = x2 - 1 - buffer->x;
+    CARD32 firstMask = ~0U << (first & 31);
+    CARD32 lastMask = ~0U >> (31 - (last & 31));
+    int w;
+
+    first >>= 5;
+    last >>= 5;
+    if (first == last) {
+        line[first] |= firstMask & lastMask;
+        return;
+    }
+    line[first] |= firstMask;
+    for (w = first + 1; w < last; w++)
+        line[w] = ~0U;
+    line[last] |= lastMask;
+}
+
+/*
+ * Add spans to the bitmap, or fail leaving it untouched if it can't be
+ * made large enough to hold them.
+ */
+static Bool
+miSpanBufferAppend(SpanBuffer * buffer, Spans * spans)
+{
+    DDXPointPtr points = spans->points;
+    int *widths = spans->widths;
+    BoxRec box;
+    int i, x1, y1, x2, y2;
+
+    x1 = y1 = MAXSHORT;
+    x2 = y2 = MINSHORT;
+    for (i = 0; i < spans->count; i++) {
+        if (widths[i] <= 0)
+            continue;
+        x1 = min(x1, points[i].x);
+        x2 = max(x2, points[i].x + widths[i]);
+        y1 = min(y1, points[i].y);
+        y2 = max(y2, points[i].y + 1);
+    }
+    if (x1 >= x2)
+        return TRUE;
+    /* the bitmap is tracked in a BoxRec; leave the far edges to the
+     * span group
+     */
+    if (x2 > MAXSHORT || y2 > MAXSHORT)
+        return FALSE;
+    box.x1 = x1;
+    box.y1 = y1;
+    box.x2 = x2;
+    box.y2 = y2;
+    if (!miSpanBufferCover(buffer, &box))
+        return FALSE;
+
+    for (i = 0; i < spans->count; i++)
+        if (widths[i] > 0)
+            miSpanBufferSet(buffer, points[i].x, points[i].x + widths[i],
+                            points[i].y);
+    if (buffer->used.x1 >= buffer->used.x2)
+        buffer->used = box;
+    else {
+        buffer->used.x1 = min(buffer->used.x1, box.x1);
+        buffer->used.y1 = min(buffer->used.y1, box.y1);
+        buffer->used.x2 = max(buffer->used.x2, box.x2);
+        buffer->used.y2 = max(buffer->used.y2, box.y2);
+    }
+    return TRUE;
+}
+
+/*
+ * Read the bitmap back into the scratch spans, clearing it as it goes.
+ */
+static Bool
+miSpanBufferGather(SpanBuffer * buffer, Spans * spans)
+{
+    int first, last, y, w, bit, start, x;
+    CARD32 *line, bits, m;
+    Bool open;
+
+    spans->count = 0;
+    if (buffer->used.x1 >= buffer->used.x2)
+        return TRUE;
+    if (!miSpanBufferGetSpans(buffer, spans, 64)) {
+        miSpanBufferFree(buffer);
         return FALSE;
     }
+
+    first = (buffer->used.x1 - buffer->x) >> 5;
+    last = (buffer->used.x2 - 1 - buffer->x) >> 5;
+    for (y = buffer->used.y1; y < buffer->used.y2; y++) {
+        line = buffer->bits + (y - buffer->y) * buffer->stride;
+        start = 0;
+        open = FALSE;
+        for (w = first; w <= last + 1; w++) {
+            bits = w <= last ? line[w] : 0;
+            x = buffer->x + w * 32;
+            for (bit = 0; bit < 32;) {
+                if (!open) {
+                    m = bits & (~0U << bit);
+                    if (!m)
+                        break;
+                    bit = ffs(m) - 1;
+                    start = x + bit;
+                    open = TRUE;
+                }
+                else {
+                    m = ~bits & (~0U << bit);
+                    if (!m)
+                        break;
+                    bit = ffs(m) - 1;
+                    if (spans->count == buffer->sizeSpans &&
+                        !miSpanBufferGetSpans(buffer, spans,
+                                              spans->count + 1)) {
+                        miSpanBufferFree(buffer);
+                        return FALSE;
+                    }
+                    spans->points[spans->count].x = start;
+                    spans->points[spans->count].y = y;
+                    spans->widths[spans->count] = x + bit - start;
+                    spans->count++;
+                    open = FALSE;
+                }
+            }
+        }
+        memset(line + first, 0, (last - first + 1) * sizeof(CARD32));
+    }
+    miSpanBufferInit(buffer);
     return TRUE;
 }
 
+static void
+miSpanBufferFill(DrawablePtr pDraw, GCPtr pGC, SpanBuffer * buffer)
+{
+    Spans spans;
+
+    if (miSpanBufferGather(buffer, &spans) && spans.count)
+        (*pGC->ops->FillSpans) (pDraw, pGC, spans.count, spans.points,
+                                spans.widths, TRUE);
+
+    if ((size_t) buffer->stride * buffer->height * sizeof(CARD32) >
+        SPAN_BUFFER_KEEP_BYTES || buffer->sizeSpans > SPAN_BUFFER_KEEP_SPANS)
+        miSpanBufferFree(buffer);
+    else
+        miSpanBufferInit(buffer);
+}
+
+/*
+ * Move everything to spanGroup, including pending, which may be in the
+ * scratch spans, and release the buffer.
+ */
+static void
+miSpanBufferSpill(SpanBuffer * buffer, SpanGroup * spanGroup,
+                  Spans * pending)
+{
+    Spans spans, copy;
+
+    copy.count = pending->count;
+    copy.points = xallocarray(copy.count, sizeof(*copy.points));
+    copy.widths = xallocarray(copy.count, sizeof(*copy.widths));
+    if (copy.points && copy.widths) {
+        memcpy(copy.points, pending->points,
+               copy.count * sizeof(*copy.points));
+        memcpy(copy.widths, pending->widths,
+               copy.count * sizeof(*copy.widths));
+    }
+
+    if (miSpanBufferGather(buffer, &spans) && spans.count) {
+        Spans set;
+
+        set.count = spans.count;
+        set.points = xallocarray(set.count, sizeof(*set.points));
+        set.widths = xallocarray(set.count, sizeof(*set.widths));
+        if (set.points && set.widths) {
+            memcpy(set.points, spans.points, set.count * sizeof(*set.points));
+            memcpy(set.widths, spans.widths, set.count * sizeof(*set.widths));
+            miAppendSpans(spanGroup, NULL, &set);
+        }
+        else {
+            free(set.points);
+            free(set.widths);
+        }
+    }
+    miSpanBufferFree(buffer);
+
+    if (copy.points && copy.widths)
+        miAppendSpans(spanGroup, NULL, &copy);
+    else {
+        free(copy.points);
+        free(copy.widths);
+    }
+}
+
 /*
  * interface data to span-merging polygon filler
  */
 
 typedef struct _SpanData {
     SpanGroup fgGroup, bgGroup;
+    SpanBuffer *buffer;         /* instead of the groups when all fg */
 } SpanDataRec, *SpanDataPtr;
 
+/*
+ * Spans handed to fillSpans are freed there, except when they belong to
+ * the span buffer.
+ */
+static Bool
+InitSpans(SpanDataPtr spanData, Spans * spans, size_t nspans)
+{
+    if (spanData && spanData->buffer)
+        return miSpanBufferGetSpans(spanData->buffer, spans, nspans);
+    spans->points = xallocarray(nspans, sizeof(*spans->points));
+    if (!spans->points)
+        return FALSE;
+    spans->widths = xallocarray(nspans, sizeof(*spans->widths));
+    if (!spans->widths) {
+        free(spans->points);
+        return FALSE;
+    }
+    return TRUE;
+}
+
 static void
 AppendSpanGroup(GCPtr pGC, unsigned long pixel, Spans * spanPtr,
                 SpanDataPtr spanData)
 {
     SpanGroup *group, *othergroup = NULL;
 
+    if (spanData->buffer) {
+        if (miSpanBufferAppend(spanData->buffer, spanPtr))
+            return;
+        /* Too spread out for the bitmap, carry on with the span group */
+        miSpanBufferSpill(spanData->buffer, &spanData->fgGroup, spanPtr);
+        spanData->buffer = NULL;
+        return;
+    }
+
     if (pixel == pGC->fgPixel) {
         group = &spanData->fgGroup;
         if (pGC->lineStyle == LineDoubleDash)
@@ -666,7 +1027,7 @@ miFillPolyHelper(DrawablePtr pDrawable, GCPtr pGC, unsigned long pixel,
     int xorg;
     Spans spanRec;
 
-    if (!InitSpans(&spanRec, overall_height))
+    if (!InitSpans(spanData, &spanRec, overall_height))
         return;
     ppt = spanRec.points;
     pwidth = spanRec.widths;
@@ -766,7 +1127,7 @@ miFillRectPolyHelper(DrawablePtr pDrawable,
         }
     }
     else {
-        if (!InitSpans(&spanRec, h))
+        if (!InitSpans(spanData, &spanRec, h))
             return;
         ppt = spanRec.points;
         pwidth = spanRec.widths;
@@ -1489,7 +1850,7 @@ miLineArc(DrawablePtr pDraw,
         }
         isInt = FALSE;
     }
-    if (!InitSpans(&spanRec, pGC->lineWidth))
+    if (!InitSpans(spanData, &spanRec, pGC->lineWidth))
         return;
     if (isInt)
         n = miLineArcI(pDraw, pGC, xorgi, yorgi, spanRec.points,
@@ -1865,8 +2226,11 @@ miSetupSpanData(GCPtr pGC, SpanDataPtr spanData, int npt)
 {
     if ((npt < 3 && pGC->capStyle != CapRound) || miSpansEasyRop(pGC->alu))
         return (SpanDataPtr) NULL;
+    spanData->buffer = NULL;
     if (pGC->lineStyle == LineDoubleDash)
         miInitSpanGroup(&spanData->bgGroup);
+    else
+        spanData->buffer = &spanBuffer;
     miInitSpanGroup(&spanData->fgGroup);
     return spanData;
 }
@@ -1874,6 +2238,10 @@ miSetupSpanData(GCPtr pGC, SpanDataPtr spanData, int npt)
 static void
 miCleanupSpanData(DrawablePtr pDrawable, GCPtr pGC, SpanDataPtr spanData)
 {
+    if (spanData->buffer) {
+        miSpanBufferFill(pDrawable, pGC, spanData->buffer);
+        return;
+    }
     if (pGC->lineStyle == LineDoubleDash) {
         ChangeGCVal oldPixel, pixel;
 
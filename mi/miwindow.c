@@ -270,6 +270,8 @@ miMoveWindow(WindowPtr pWin, int x, int y, WindowPtr pNextSib, VTKind kind)
     pWin->origin.y = y + (int) bw;
     x = pWin->drawable.x = pParent->drawable.x + x + (int) bw;
     y = pWin->drawable.y = pParent->drawable.y + y + (int) bw;
+    /* before anything can look up the pointer's window again */
+    WindowIndexUpdate(pWin);
 
     SetWinSize(pWin);
     SetBorderSize(pWin);
@@ -435,6 +437,7 @@ miResizeWindow(WindowPtr pWin, int x, int y, unsigned int w, unsigned int h,
 
     x = pWin->drawable.x = newx;
     y = pWin->drawable.y = newy;
+    WindowIndexUpdate(pWin);
 
     SetWinSize(pWin);
     SetBorderSize(pWin);
@@ -703,6 +706,7 @@ miChangeBorderWidth(WindowPtr pWin, unsigned int width)
 
     pWin->borderWidth = width;
     SetBorderSize(pWin);
+    WindowIndexUpdate(pWin);
 
     if (WasViewable) {
         if (width > oldwidth) {
@@ -749,42 +753,17 @@ WindowPtr
 miSpriteTrace(SpritePtr pSprite, int x, int y)
 {
     WindowPtr pWin;
-    BoxRec box;
 
-    pWin = DeepestSpriteWin(pSprite)->firstChild;
+    pWin = ChildWindowAtPoint(DeepestSpriteWin(pSprite), x, y);
     while (pWin) {
-        if ((pWin->mapped) &&
-            (x >= pWin->drawable.x - wBorderWidth(pWin)) &&
-            (x < pWin->drawable.x + (int) pWin->drawable.width +
-             wBorderWidth(pWin)) &&
-            (y >= pWin->drawable.y - wBorderWidth(pWin)) &&
-            (y < pWin->drawable.y + (int) pWin->drawable.height +
-             wBorderWidth(pWin))
-            /* When a window is shaped, a further check
-             * is made to see if the point is inside
-             * borderSize
-             */
-            && (!wBoundingShape(pWin) || PointInBorderSize(pWin, x, y))
-            && (!wInputShape(pWin) ||
-                RegionContainsPoint(wInputShape(pWin),
-                                    x - pWin->drawable.x,
-                                    y - pWin->drawable.y, &box))
-            /* In rootless mode windows may be offscreen, even when
-             * they're in X's stack. (E.g. if the native window system
-             * implements some form of virtual desktop system).
-             */
-            && !pWin->unhittable) {
-            if (pSprite->spriteTraceGood >= pSprite->spriteTraceSize) {
-                pSprite->spriteTraceSize += 10;
-                pSprite->spriteTrace = reallocarray(pSprite->spriteTrace,
-                                                    pSprite->spriteTraceSize,
-                                                    sizeof(WindowPtr));
-            }
-            pSprite->spriteTrace[pSprite->spriteTraceGood++] = pWin;
-            pWin = pWin->firstChild;
+        if (pSprite->spriteTraceGood >= pSprite->spriteTraceSize) {
+            pSprite->spriteTraceSize += 10;
+            pSprite->spriteTrace = reallocarray(pSprite->spriteTrace,
+                                                pSprite->spriteTraceSize,
+                                                sizeof(WindowPtr));
         }
-        else
-            pWin = pWin->nextSib;
+        pSprite->spriteTrace[pSprite->spriteTraceGood++] = pWin;
+        pWin = ChildWindowAtPoint(pWin, x, y);
     }
     return DeepestSpriteWin(pSprite);
 }
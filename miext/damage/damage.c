@@ -120,6 +120,19 @@ getDrawableDamageRef(DrawablePtr pDrawable)
     DamagePtr	*pPrev = (DamagePtr *) \
 	dixLookupPrivateAddr(&(pWindow)->devPrivates, damageWinPrivateKey)
 
+/*
+ * Add a region to the accumulated damage, then bring it back under the
+ * box limit if one is set.
+ */
+static void
+damageAccumulate(DamagePtr pDamage, RegionPtr pRegion)
+{
+    RegionUnion(&pDamage->damage, &pDamage->damage, pRegion);
+    if (pDamage->boxLimit &&
+        RegionNumRects(&pDamage->damage) > pDamage->boxLimit)
+        RegionSimplify(&pDamage->damage, pDamage->boxLimit);
+}
+
 #if DAMAGE_DEBUG_ENABLE
 static void
 _damageRegionAppend(DrawablePtr pDrawable, RegionPtr pRegion, Bool clip,
@@ -179,7 +192,7 @@ damageRegionAppend(DrawablePtr pDrawable, RegionPtr pRegion, Bool clip,
          * any drawable-based clipping. */
     }
 
-    RegionNull(&clippedRec);
+    RegionNullScratch(&clippedRec);
     for (; pDamage; pDamage = pNext) {
         pNext = pDamage->pNext;
         /*
@@ -264,7 +277,7 @@ damageRegionAppend(DrawablePtr pDrawable, RegionPtr pRegion, Bool clip,
             if (pDamage->damageReport)
                 DamageReportDamage(pDamage, pDamageRegion);
             else
-                RegionUnion(&pDamage->damage, &pDamage->damage, pDamageRegion);
+                damageAccumulate(pDamage, pDamageRegion);
         }
 
         /*
@@ -278,7 +291,7 @@ damageRegionAppend(DrawablePtr pDrawable, RegionPtr pRegion, Bool clip,
         RegionTranslate(pRegion, -screen_x, -screen_y);
 #endif
 
-    RegionUninit(&clippedRec);
+    RegionUninitScratch(&clippedRec);
 }
 
 static void
@@ -290,8 +303,7 @@ damageRegionProcessPending(DamagePtr pDamage)
             if (pDamage->damageReport)
                 DamageReportDamage(pDamage, &pDamage->pendingDamage);
             else
-                RegionUnion(&pDamage->damage, &pDamage->damage,
-                            &pDamage->pendingDamage);
+                damageAccumulate(pDamage, &pDamage->pendingDamage);
         }
 
         if (pDamage->reportAfter)
@@ -456,9 +468,83 @@ damageDestroyClip(GCPtr pGC)
 #define BOX_NOT_EMPTY(box) \
     (((box.x2 - box.x1) > 0) && ((box.y2 - box.y1) > 0))
 
-#define checkGCDamage(d,g)	(d && \
+/*
+ * Whether drawing within pClip on pDrawable could change any damage.  It
+ * can't for damages that skip the drawing anyway, that don't overlap the
+ * clip, or that already cover their whole drawable in a single box and
+ * don't report every region as it is drawn.  Letting those out early
+ * saves working out the bounds of drawing that repaints whole windows,
+ * as video and games do every frame.
+ */
+static Bool
+damageWanted(DrawablePtr pDrawable, DamagePtr pDamage, RegionPtr pClip)
+{
+    damageScrPriv(pDrawable->pScreen);
+    BoxRec op, bounds;
+    int draw_x, draw_y;
+
+    if (pClip) {
+        op = pClip->extents;
+#ifdef COMPOSITE
+        if (pDrawable->type != DRAWABLE_WINDOW) {
+            int screen_x = ((PixmapPtr) pDrawable)->screen_x;
+            int screen_y = ((PixmapPtr) pDrawable)->screen_y;
+
+            op.x1 += screen_x;
+            op.x2 += screen_x;
+            op.y1 += screen_y;
+            op.y2 += screen_y;
+        }
+#endif
+    }
+
+    for (; pDamage; pDamage = pDamage->pNext) {
+        if (pScrPriv->internalLevel > 0 && !pDamage->isInternal)
+            continue;
+
+        /* bounds in screen coordinates, as damageRegionAppend clips */
+        draw_x = pDamage->pDrawable->x;
+        draw_y = pDamage->pDrawable->y;
+        if (pDamage->pDrawable->type == DRAWABLE_WINDOW) {
+            WindowPtr pWin = (WindowPtr) pDamage->pDrawable;
+
+            if (!pWin->realized)
+                continue;
+            bounds = *RegionExtents(&pWin->borderClip);
+        }
+        else {
+#ifdef COMPOSITE
+            draw_x += ((PixmapPtr) pDamage->pDrawable)->screen_x;
+            draw_y += ((PixmapPtr) pDamage->pDrawable)->screen_y;
+#endif
+            bounds.x1 = draw_x;
+            bounds.y1 = draw_y;
+            bounds.x2 = draw_x + pDamage->pDrawable->width;
+            bounds.y2 = draw_y + pDamage->pDrawable->height;
+        }
+        if (bounds.x1 >= bounds.x2 || bounds.y1 >= bounds.y2)
+            continue;
+        if (pClip && (op.x1 >= bounds.x2 || op.x2 <= bounds.x1 ||
+                      op.y1 >= bounds.y2 || op.y2 <= bounds.y1))
+            continue;
+
+        if (pDamage->damageReport &&
+            pDamage->damageLevel == DamageReportRawRegion)
+            return TRUE;
+        if (RegionNumRects(&pDamage->damage) != 1 ||
+            pDamage->damage.extents.x1 > bounds.x1 - draw_x ||
+            pDamage->damage.extents.y1 > bounds.y1 - draw_y ||
+            pDamage->damage.extents.x2 < bounds.x2 - draw_x ||
+            pDamage->damage.extents.y2 < bounds.y2 - draw_y)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+#define checkGCDamage(p,d,g)	(d && \
 				 (!g->pCompositeClip ||\
-				  RegionNotEmpty(g->pCompositeClip)))
+				  RegionNotEmpty(g->pCompositeClip)) && \
+				 damageWanted(p, d, g->pCompositeClip))
 
 #define TRIM_PICTURE_BOX(box, pDst) { \
     BoxPtr extents = &pDst->pCompositeClip->extents;\
@@ -468,7 +554,9 @@ damageDestroyClip(GCPtr pGC)
     if(box.y2 > extents->y2) box.y2 = extents->y2; \
     }
 
-#define checkPictureDamage(d, p) (d && RegionNotEmpty(p->pCompositeClip))
+#define checkPictureDamage(d, p) (d && RegionNotEmpty(p->pCompositeClip) && \
+				  damageWanted(p->pDrawable, d, \
+					       p->pCompositeClip))
 
 static void
 damageComposite(CARD8 op,
@@ -628,7 +716,7 @@ damageFillSpans(DrawablePtr pDrawable,
 {
     DAMAGE_GC_OP_PROLOGUE(pGC, pDrawable);
 
-    if (npt && checkGCDamage(pDamage, pGC)) {
+    if (npt && checkGCDamage(pDrawable, pDamage, pGC)) {
         int nptTmp = npt;
         DDXPointPtr pptTmp = ppt;
         int *pwidthTmp = pwidth;
@@ -676,7 +764,7 @@ damageSetSpans(DrawablePtr pDrawable,
 {
     DAMAGE_GC_OP_PROLOGUE(pGC, pDrawable);
 
-    if (npt && checkGCDamage(pDamage, pGC)) {
+    if (npt && checkGCDamage(pDrawable, pDamage, pGC)) {
         DDXPointPtr pptTmp = ppt;
         int *pwidthTmp = pwidth;
         int nptTmp = npt;
@@ -722,7 +810,7 @@ damagePutImage(DrawablePtr pDrawable,
                int y, int w, int h, int leftPad, int format, char *pImage)
 {
     DAMAGE_GC_OP_PROLOGUE(pGC, pDrawable);
-    if (checkGCDamage(pDamage, pGC)) {
+    if (checkGCDamage(pDrawable, pDamage, pGC)) {
         BoxRec box;
 
         box.x1 = x + pDrawable->x;
@@ -750,7 +838,7 @@ damageCopyArea(DrawablePtr pSrc,
 
     DAMAGE_GC_OP_PROLOGUE(pGC, pDst);
 
-    if (checkGCDamage(pDamage, pGC)) {
+    if (checkGCDamage(pDst, pDamage, pGC)) {
         BoxRec box;
 
         box.x1 = dstx + pDst->x;
@@ -783,7 +871,7 @@ damageCopyPlane(DrawablePtr pSrc,
 
     DAMAGE_GC_OP_PROLOGUE(pGC, pDst);
 
-    if (checkGCDamage(pDamage, pGC)) {
+    if (checkGCDamage(pDst, pDamage, pGC)) {
         BoxRec box;
 
         box.x1 = dstx + pDst->x;
@@ -810,7 +898,7 @@ damagePolyPoint(DrawablePtr pDrawable,
 {
     DAMAGE_GC_OP_PROLOGUE(pGC, pDrawable);
 
-    if (npt && checkGCDamage(pDamage, pGC)) {
+    if (npt && checkGCDamage(pDrawable, pDamage, pGC)) {
         BoxRec box;
         int nptTmp = npt;
         xPoint *pptTmp = ppt;
@@ -850,7 +938,7 @@ damagePolylines(DrawablePtr pDrawable,
 {
     DAMAGE_GC_OP_PROLOGUE(pGC, pDrawable);
 
-    if (npt && checkGCDamage(pDamage, pGC)) {
+    if (npt && checkGCDamage(pDrawable, pDamage, pGC)) {
         int nptTmp = npt;
         DDXPointPtr pptTmp = ppt;
         BoxRec box;
@@ -922,7 +1010,7 @@ damagePolySegment(DrawablePtr pDrawable, GCPtr pGC, int nSeg, xSegment * pSeg)
 {
     DAMAGE_GC_OP_PROLOGUE(pGC, pDrawable);
 
-    if (nSeg && checkGCDamage(pDamage, pGC)) {
+    if (nSeg && checkGCDamage(pDrawable, pDamage, pGC)) {
         BoxRec box;
         int extra = pGC->lineWidth;
         int nsegTmp = nSeg;
@@ -1002,7 +1090,7 @@ damagePolyRectangle(DrawablePtr pDrawable,
 {
     DAMAGE_GC_OP_PROLOGUE(pGC, pDrawable);
 
-    if (nRects && checkGCDamage(pDamage, pGC)) {
+    if (nRects && checkGCDamage(pDrawable, pDamage, pGC)) {
         BoxRec box;
         int offset1, offset2, offset3;
         int nRectsTmp = nRects;
@@ -1060,7 +1148,7 @@ damagePolyArc(DrawablePtr pDrawable, GCPtr pGC, int nArcs, xArc * pArcs)
 {
     DAMAGE_GC_OP_PROLOGUE(pGC, pDrawable);
 
-    if (nArcs && checkGCDamage(pDamage, pGC)) {
+    if (nArcs && checkGCDamage(pDrawable, pDamage, pGC)) {
         int extra = pGC->lineWidth >> 1;
         BoxRec box;
         int nArcsTmp = nArcs;
@@ -1108,7 +1196,7 @@ damageFillPolygon(DrawablePtr pDrawable,
 {
     DAMAGE_GC_OP_PROLOGUE(pGC, pDrawable);
 
-    if (npt > 2 && checkGCDamage(pDamage, pGC)) {
+    if (npt > 2 && checkGCDamage(pDrawable, pDamage, pGC)) {
         DDXPointPtr pptTmp = ppt;
         int nptTmp = npt;
         BoxRec box;
@@ -1166,7 +1254,7 @@ damagePolyFillRect(DrawablePtr pDrawable,
                    GCPtr pGC, int nRects, xRectangle *pRects)
 {
     DAMAGE_GC_OP_PROLOGUE(pGC, pDrawable);
-    if (nRects && checkGCDamage(pDamage, pGC)) {
+    if (nRects && checkGCDamage(pDrawable, pDamage, pGC)) {
         BoxRec box;
         xRectangle *pRectsTmp = pRects;
         int nRectsTmp = nRects;
@@ -1202,7 +1290,7 @@ damagePolyFillArc(DrawablePtr pDrawable, GCPtr pGC, int nArcs, xArc * pArcs)
 {
     DAMAGE_GC_OP_PROLOGUE(pGC, pDrawable);
 
-    if (nArcs && checkGCDamage(pDamage, pGC)) {
+    if (nArcs && checkGCDamage(pDrawable, pDamage, pGC)) {
         BoxRec box;
         int nArcsTmp = nArcs;
         xArc *pArcsTmp = pArcs;
@@ -1289,7 +1377,7 @@ damageText(DrawablePtr pDrawable, GCPtr pGC, int x, int y, unsigned long count,
 
     imageblt = (textType == TT_IMAGE8) || (textType == TT_IMAGE16);
 
-    if (!pDamage)
+    if (!checkGCDamage(pDrawable, pDamage, pGC))
         return;
 
     charinfo = xallocarray(count, sizeof(CharInfoPtr));
@@ -1396,7 +1484,7 @@ damagePushPixels(GCPtr pGC,
                  DrawablePtr pDrawable, int dx, int dy, int xOrg, int yOrg)
 {
     DAMAGE_GC_OP_PROLOGUE(pGC, pDrawable);
-    if (checkGCDamage(pDamage, pGC)) {
+    if (checkGCDamage(pDrawable, pDamage, pGC)) {
         BoxRec box;
 
         box.x1 = xOrg;
@@ -1699,6 +1787,7 @@ DamageCreate(DamageReportFunc damageReport,
     pDamage->isWindow = FALSE;
     pDamage->pDrawable = 0;
     pDamage->reportAfter = FALSE;
+    pDamage->boxLimit = 0;
 
     pDamage->damageReport = damageReport;
     pDamage->damageDestroy = damageDestroy;
@@ -1816,29 +1905,29 @@ DamageDestroy(DamagePtr pDamage)
 Bool
 DamageSubtract(DamagePtr pDamage, const RegionPtr pRegion)
 {
-    RegionPtr pClip;
     RegionRec pixmapClip;
     DrawablePtr pDrawable = pDamage->pDrawable;
 
-    RegionSubtract(&pDamage->damage, &pDamage->damage, pRegion);
-    if (pDrawable) {
-        if (pDrawable->type == DRAWABLE_WINDOW)
-            pClip = &((WindowPtr) pDrawable)->borderClip;
-        else {
-            BoxRec box;
-
-            box.x1 = pDrawable->x;
-            box.y1 = pDrawable->y;
-            box.x2 = pDrawable->x + pDrawable->width;
-            box.y2 = pDrawable->y + pDrawable->height;
-            RegionInit(&pixmapClip, &box, 1);
-            pClip = &pixmapClip;
-        }
-        RegionTranslate(&pDamage->damage, pDrawable->x, pDrawable->y);
-        RegionIntersect(&pDamage->damage, &pDamage->damage, pClip);
-        RegionTranslate(&pDamage->damage, -pDrawable->x, -pDrawable->y);
-        if (pDrawable->type != DRAWABLE_WINDOW)
-            RegionUninit(&pixmapClip);
+    /* clip in drawable coordinates rather than moving the damage */
+    if (!pDrawable)
+        RegionSubtract(&pDamage->damage, &pDamage->damage, pRegion);
+    else if (pDrawable->type == DRAWABLE_WINDOW) {
+        RegionSubtract(&pDamage->damage, &pDamage->damage, pRegion);
+        RegionTranslateIntersect(&pDamage->damage, &pDamage->damage,
+                                 &((WindowPtr) pDrawable)->borderClip,
+                                 -pDrawable->x, -pDrawable->y);
+    }
+    else {
+        BoxRec box;
+
+        box.x1 = 0;
+        box.y1 = 0;
+        box.x2 = pDrawable->width;
+        box.y2 = pDrawable->height;
+        RegionInit(&pixmapClip, &box, 1);
+        RegionIntersectSubtract(&pDamage->damage, &pDamage->damage,
+                                &pixmapClip, pRegion);
+        RegionUninit(&pixmapClip);
     }
     return RegionNotEmpty(&pDamage->damage);
 }
@@ -1894,6 +1983,14 @@ DamageSetReportAfterOp(DamagePtr pDamage, Bool reportAfter)
     pDamage->reportAfter = reportAfter;
 }
 
+void
+DamageSetBoxLimit(DamagePtr pDamage, int maxBoxes)
+{
+    pDamage->boxLimit = max(maxBoxes, 0);
+    if (pDamage->boxLimit)
+        RegionSimplify(&pDamage->damage, pDamage->boxLimit);
+}
+
 DamageScreenFuncsPtr
 DamageGetScreenFuncs(ScreenPtr pScreen)
 {
@@ -1910,21 +2007,35 @@ DamageReportDamage(DamagePtr pDamage, RegionPtr pDamageRegion)
 
     switch (pDamage->damageLevel) {
     case DamageReportRawRegion:
-        RegionUnion(&pDamage->damage, &pDamage->damage, pDamageRegion);
+        damageAccumulate(pDamage, pDamageRegion);
         (*pDamage->damageReport) (pDamage, pDamageRegion, pDamage->closure);
         break;
     case DamageReportDeltaRegion:
-        RegionNull(&tmpRegion);
+        RegionNullScratch(&tmpRegion);
         RegionSubtract(&tmpRegion, pDamageRegion, &pDamage->damage);
         if (RegionNotEmpty(&tmpRegion)) {
-            RegionUnion(&pDamage->damage, &pDamage->damage, pDamageRegion);
+            RegionRec oldRegion;
+
+            /*
+             * A simplified damage region covers more than was drawn; report
+             * that too, or later deltas would never include it.
+             */
+            if (pDamage->boxLimit) {
+                RegionNullScratch(&oldRegion);
+                RegionCopy(&oldRegion, &pDamage->damage);
+            }
+            damageAccumulate(pDamage, pDamageRegion);
+            if (pDamage->boxLimit) {
+                RegionSubtract(&tmpRegion, &pDamage->damage, &oldRegion);
+                RegionUninitScratch(&oldRegion);
+            }
             (*pDamage->damageReport) (pDamage, &tmpRegion, pDamage->closure);
         }
-        RegionUninit(&tmpRegion);
+        RegionUninitScratch(&tmpRegion);
         break;
     case DamageReportBoundingBox:
         tmpBox = *RegionExtents(&pDamage->damage);
-        RegionUnion(&pDamage->damage, &pDamage->damage, pDamageRegion);
+        damageAccumulate(pDamage, pDamageRegion);
         if (!BOX_SAME(&tmpBox, RegionExtents(&pDamage->damage))) {
             (*pDamage->damageReport) (pDamage, &pDamage->damage,
                                       pDamage->closure);
@@ -1932,14 +2043,14 @@ DamageReportDamage(DamagePtr pDamage, RegionPtr pDamageRegion)
         break;
     case DamageReportNonEmpty:
         was_empty = !RegionNotEmpty(&pDamage->damage);
-        RegionUnion(&pDamage->damage, &pDamage->damage, pDamageRegion);
+        damageAccumulate(pDamage, pDamageRegion);
         if (was_empty && RegionNotEmpty(&pDamage->damage)) {
             (*pDamage->damageReport) (pDamage, &pDamage->damage,
                                       pDamage->closure);
         }
         break;
     case DamageReportNone:
-        RegionUnion(&pDamage->damage, &pDamage->damage, pDamageRegion);
+        damageAccumulate(pDamage, pDamageRegion);
         break;
     }
 }
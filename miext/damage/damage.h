@@ -110,6 +110,13 @@ extern _X_EXPORT void
 extern _X_EXPORT void
  DamageSetReportAfterOp(DamagePtr pDamage, Bool reportAfter);
 
+/*
+ * Keep the accumulated damage to at most maxBoxes boxes by growing it to
+ * cover nearby undamaged pixels.  Zero, the default, keeps it exact.
+ */
+extern _X_EXPORT void
+ DamageSetBoxLimit(DamagePtr pDamage, int maxBoxes);
+
 extern _X_EXPORT DamageScreenFuncsPtr DamageGetScreenFuncs(ScreenPtr);
 
 #endif                          /* _DAMAGE_H_ */
@@ -47,6 +47,7 @@ typedef struct _damage {
     DamageDestroyFunc damageDestroy;
 
     Bool reportAfter;
+    int boxLimit;               /* 0, or most boxes kept in damage */
     RegionRec pendingDamage;    /* will be flushed post submission at the latest */
     ScreenPtr pScreen;
     PrivateRec *devPrivates;
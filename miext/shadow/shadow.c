@@ -25,6 +25,8 @@
 #endif
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 
 #include    <X11/X.h>
 #include    "scrnintstr.h"
@@ -34,6 +36,7 @@
 #include    "regionstr.h"
 #include    "globals.h"
 #include    "gcstruct.h"
+#include    "dix.h"
 #include    "shadow.h"
 
 static DevPrivateKeyRec shadowScrPrivateKeyRec;
@@ -49,6 +52,173 @@ static DevPrivateKeyRec shadowScrPrivateKeyRec;
     real->mem = priv->mem; \
 }
 
+/*
+ * The tile cache keeps a 64-bit hash of every SHADOW_TILE_SIZE square of
+ * the shadow pixmap as it was last sent to the device.  Damaged tiles
+ * whose hash hasn't changed are dropped from the damage region before the
+ * update function sees it, so clients redrawing identical pixels cost a
+ * hash of the tile instead of a copy to (often slow) device memory.
+ * A hash of 0 means the tile hasn't been seen yet.
+ *
+ * The hashes only say what the device has as long as neither side is
+ * replaced: they are dropped when the shadow pixmap's storage, stride or
+ * size changes, and drivers call shadowInvalidateTiles when the device
+ * framebuffer itself was lost or reallocated, as on VT switch or resize.
+ */
+
+#define SHADOW_HASH_PRIME1  0x9e3779b185ebca87ULL
+#define SHADOW_HASH_PRIME2  0xc2b2ae3d27d4eb4fULL
+
+static inline uint64_t
+shadowHashWord(uint64_t h, uint64_t w)
+{
+    h += w * SHADOW_HASH_PRIME2;
+    h = (h << 31) | (h >> 33);
+    return h * SHADOW_HASH_PRIME1;
+}
+
+static uint64_t
+shadowHashTile(PixmapPtr pPixmap, BoxPtr box)
+{
+    int bpp = pPixmap->drawable.bitsPerPixel;
+    int stride = pPixmap->devKind;
+    int bytes = ((box->x2 - box->x1) * bpp + 7) >> 3;
+    CARD8 *line = (CARD8 *) pPixmap->devPrivate.ptr + box->y1 * stride +
+        ((box->x1 * bpp) >> 3);
+    uint64_t h = SHADOW_HASH_PRIME1, w;
+    int y, i;
+
+    for (y = box->y1; y < box->y2; y++) {
+        for (i = 0; i + sizeof(w) <= bytes; i += sizeof(w)) {
+            memcpy(&w, line + i, sizeof(w));
+            h = shadowHashWord(h, w);
+        }
+        if (i < bytes) {
+            w = 0;
+            memcpy(&w, line + i, bytes - i);
+            h = shadowHashWord(h, w);
+        }
+        line += stride;
+    }
+
+    h ^= h >> 33;
+    h *= SHADOW_HASH_PRIME2;
+    h ^= h >> 29;
+    return h ? h : 1;
+}
+
+static void
+shadowFreeTiles(shadowBufPtr pBuf)
+{
+    free(pBuf->tileHash);
+    pBuf->tileHash = NULL;
+    pBuf->tileCols = 0;
+    pBuf->tileRows = 0;
+    pBuf->tileBits = NULL;
+}
+
+static Bool
+shadowAllocTiles(shadowBufPtr pBuf)
+{
+    PixmapPtr pPixmap = pBuf->pPixmap;
+    int cols = (pPixmap->drawable.width + SHADOW_TILE_SIZE - 1) /
+        SHADOW_TILE_SIZE;
+    int rows = (pPixmap->drawable.height + SHADOW_TILE_SIZE - 1) /
+        SHADOW_TILE_SIZE;
+
+    if (pBuf->tileHash &&
+        pBuf->tileBits == pPixmap->devPrivate.ptr &&
+        pBuf->tileStride == pPixmap->devKind &&
+        pBuf->tileWidth == pPixmap->drawable.width &&
+        pBuf->tileHeight == pPixmap->drawable.height)
+        return TRUE;
+
+    shadowFreeTiles(pBuf);
+    pBuf->tileHash = calloc(cols * rows, sizeof(uint64_t));
+    if (!pBuf->tileHash)
+        return FALSE;
+    pBuf->tileCols = cols;
+    pBuf->tileRows = rows;
+    pBuf->tileBits = pPixmap->devPrivate.ptr;
+    pBuf->tileStride = pPixmap->devKind;
+    pBuf->tileWidth = pPixmap->drawable.width;
+    pBuf->tileHeight = pPixmap->drawable.height;
+    return TRUE;
+}
+
+/* Drop the damaged tiles whose contents are what the device already has */
+static void
+shadowDamageTiles(shadowBufPtr pBuf)
+{
+    PixmapPtr pPixmap = pBuf->pPixmap;
+    RegionPtr damage = DamageRegion(pBuf->pDamage), tiles;
+    BoxPtr extents = RegionExtents(damage);
+    xRectangle *prect;
+    uint64_t *hash, h;
+    int nrects;
+    int i, j, tx1, tx2, ty1, ty2;
+
+    if (!pPixmap->devPrivate.ptr || !shadowAllocTiles(pBuf))
+        return;
+
+    tx1 = max(extents->x1, 0) / SHADOW_TILE_SIZE;
+    tx2 = min((extents->x2 + SHADOW_TILE_SIZE - 1) / SHADOW_TILE_SIZE,
+              pBuf->tileCols);
+    ty1 = max(extents->y1, 0) / SHADOW_TILE_SIZE;
+    ty2 = min((extents->y2 + SHADOW_TILE_SIZE - 1) / SHADOW_TILE_SIZE,
+              pBuf->tileRows);
+    if (tx1 >= tx2 || ty1 >= ty2)
+        return;
+
+    nrects = (tx2 - tx1) * (ty2 - ty1);
+    if (!(prect = calloc(nrects, sizeof(xRectangle))))
+        return;
+
+    nrects = 0;
+    for (j = ty1; j < ty2; j++) {
+        for (i = tx1; i < tx2; i++) {
+            BoxRec tile, box;
+
+            tile.x1 = i * SHADOW_TILE_SIZE;
+            tile.y1 = j * SHADOW_TILE_SIZE;
+            tile.x2 = min(tile.x1 + SHADOW_TILE_SIZE,
+                          pPixmap->drawable.width);
+            tile.y2 = min(tile.y1 + SHADOW_TILE_SIZE,
+                          pPixmap->drawable.height);
+
+            box.x1 = max(tile.x1, extents->x1);
+            box.y1 = max(tile.y1, extents->y1);
+            box.x2 = min(tile.x2, extents->x2);
+            box.y2 = min(tile.y2, extents->y2);
+
+            if (RegionContainsRect(damage, &box) == rgnOUT)
+                continue;
+
+            /* The whole tile is hashed, the parts outside the damage
+             * are known to match the device already */
+            pBuf->tilesChecked++;
+            hash = &pBuf->tileHash[j * pBuf->tileCols + i];
+            h = shadowHashTile(pPixmap, &tile);
+            if (h == *hash) {
+                pBuf->tilesUnchanged++;
+                continue;
+            }
+            *hash = h;
+
+            prect[nrects].x = box.x1;
+            prect[nrects].y = box.y1;
+            prect[nrects].width = box.x2 - box.x1;
+            prect[nrects].height = box.y2 - box.y1;
+            nrects++;
+        }
+    }
+
+    tiles = RegionFromRects(nrects, prect, CT_NONE);
+    RegionIntersect(damage, damage, tiles);
+    RegionDestroy(tiles);
+    free(prect);
+}
+
 static void
 shadowRedisplay(ScreenPtr pScreen)
 {
@@ -58,12 +228,69 @@ shadowRedisplay(ScreenPtr pScreen)
     if (!pBuf || !pBuf->pDamage || !pBuf->update)
         return;
     pRegion = DamageRegion(pBuf->pDamage);
+    if (RegionNotEmpty(pRegion) && pBuf->tileCache)
+        shadowDamageTiles(pBuf);
     if (RegionNotEmpty(pRegion)) {
         (*pBuf->update) (pScreen, pBuf);
         DamageEmpty(pBuf->pDamage);
     }
 }
 
+static void
+shadowReportStatistics(CallbackListPtr *pcbl, void *data, void *call_data)
+{
+    ScreenPtr pScreen = data;
+    ServerStatisticsPtr stats = call_data;
+    char name[64];
+
+    shadowBuf(pScreen);
+
+    if (!pBuf->tileCache)
+        return;
+
+    snprintf(name, sizeof(name), "shadow.%d.tiles.checked", pScreen->myNum);
+    AddServerStatistic(stats, name, pBuf->tilesChecked);
+    snprintf(name, sizeof(name), "shadow.%d.tiles.unchanged", pScreen->myNum);
+    AddServerStatistic(stats, name, pBuf->tilesUnchanged);
+}
+
+/*
+ * Turn the tile cache on or off.  Worth it when pushing pixels to the
+ * device costs more than reading them back, as with uncached framebuffer
+ * memory or a screen streamed over the network.
+ */
+void
+shadowSetTileCache(ScreenPtr pScreen, Bool enable)
+{
+    shadowBuf(pScreen);
+
+    if (pBuf->tileCache == enable)
+        return;
+    pBuf->tileCache = enable;
+    if (enable) {
+        AddCallback(&ServerStatisticsCallback, shadowReportStatistics,
+                    pScreen);
+    }
+    else {
+        DeleteCallback(&ServerStatisticsCallback, shadowReportStatistics,
+                       pScreen);
+        shadowFreeTiles(pBuf);
+    }
+}
+
+/*
+ * Forget what the device is known to have, for when its framebuffer was
+ * reallocated or its contents lost.  Every damaged tile is sent again.
+ */
+void
+shadowInvalidateTiles(ScreenPtr pScreen)
+{
+    shadowBuf(pScreen);
+
+    if (pBuf)
+        shadowFreeTiles(pBuf);
+}
+
 static void
 shadowBlockHandler(ScreenPtr pScreen, void *timeout)
 {
@@ -101,6 +328,7 @@ shadowCloseScreen(ScreenPtr pScreen)
     unwrap(pBuf, pScreen, CloseScreen);
     unwrap(pBuf, pScreen, BlockHandler);
     shadowRemove(pScreen, pBuf->pPixmap);
+    shadowSetTileCache(pScreen, FALSE);
     DamageDestroy(pBuf->pDamage);
     if (pBuf->pPixmap)
         pScreen->DestroyPixmap(pBuf->pPixmap);
@@ -138,6 +366,13 @@ shadowSetup(ScreenPtr pScreen)
     pBuf->pPixmap = 0;
     pBuf->closure = 0;
     pBuf->randr = 0;
+    pBuf->tileCache = FALSE;
+    pBuf->tileHash = NULL;
+    pBuf->tileCols = 0;
+    pBuf->tileRows = 0;
+    pBuf->tileBits = NULL;
+    pBuf->tilesChecked = 0;
+    pBuf->tilesUnchanged = 0;
 
     dixSetPrivate(&pScreen->devPrivates, shadowScrPrivateKey, pBuf);
     return TRUE;
@@ -172,6 +407,7 @@ shadowAdd(ScreenPtr pScreen, PixmapPtr pPixmap, ShadowUpdateProc update,
     pBuf->randr = randr;
     pBuf->closure = closure;
     pBuf->pPixmap = pPixmap;
+    shadowFreeTiles(pBuf);
     DamageRegister(&pPixmap->drawable, pBuf->pDamage);
     return TRUE;
 }
@@ -188,5 +424,6 @@ shadowRemove(ScreenPtr pScreen, PixmapPtr pPixmap)
         pBuf->randr = 0;
         pBuf->closure = 0;
         pBuf->pPixmap = 0;
+        shadowFreeTiles(pBuf);
     }
 }
@@ -55,8 +55,24 @@ typedef struct _shadowBuf {
     GetImageProcPtr GetImage;
     CloseScreenProcPtr CloseScreen;
     ScreenBlockHandlerProcPtr BlockHandler;
+
+    /* content hashes of the shadow tiles, see shadowSetTileCache */
+    Bool tileCache;
+    uint64_t *tileHash;
+    int tileCols;
+    int tileRows;
+    /* the pixmap storage the hashes were taken of */
+    void *tileBits;
+    int tileStride;
+    int tileWidth;
+    int tileHeight;
+    uint64_t tilesChecked;
+    uint64_t tilesUnchanged;
 } shadowBufRec;
 
+/* Size in pixels of the tiles hashed by the tile cache */
+#define SHADOW_TILE_SIZE    64
+
 /* Match defines from randr extension */
 #define SHADOW_ROTATE_0	    1
 #define SHADOW_ROTATE_90    2
@@ -88,6 +104,12 @@ shadowAdd(ScreenPtr pScreen,
 extern _X_EXPORT void
  shadowRemove(ScreenPtr pScreen, PixmapPtr pPixmap);
 
+extern _X_EXPORT void
+ shadowSetTileCache(ScreenPtr pScreen, Bool enable);
+
+extern _X_EXPORT void
+ shadowInvalidateTiles(ScreenPtr pScreen);
+
 extern _X_EXPORT void *shadowAlloc(int width, int height, int bpp);
 
 extern _X_EXPORT void
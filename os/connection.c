@@ -402,6 +402,7 @@ CreateWellKnownSockets(void)
 #if !defined(WIN32)
     OsSignal(SIGPIPE, SIG_IGN);
     OsSignal(SIGHUP, AutoResetServer);
+    OsSignal(SIGUSR2, RequestDispatchStats);
 #endif
     OsSignal(SIGINT, GiveUp);
     OsSignal(SIGTERM, GiveUp);
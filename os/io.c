@@ -91,20 +91,82 @@ typedef struct _connectionInput {
     unsigned int ignoreBytes;   /* bytes to ignore before the next request */
 } ConnectionInput;
 
+/*
+ * Output that could not be written immediately is queued in order: first
+ * the bytes in buf, then the chunk list.  A chunk either references memory
+ * handed over through WriteToClientRef (release != NULL), or owns a copy of
+ * data written while earlier chunks were still pending.
+ */
+typedef struct _outputChunk {
+    struct _outputChunk *next;
+    const char *data;           /* next byte to write */
+    int count;                  /* bytes left to write */
+    int room;                   /* space left after data + count, if owned */
+    char *buf;                  /* owned buffer */
+    int size;
+    ClientOutputReleaseProcPtr release;
+    void *closure;
+} OutputChunk;
+
 typedef struct _connectionOutput {
     struct _connectionOutput *next;
     unsigned char *buf;
     int size;
     int count;
+    OutputChunk *chunks;        /* queued after buf */
+    OutputChunk *lastChunk;
+    long chunkBytes;            /* bytes left to write in chunks */
 } ConnectionOutput;
 
+/*
+ * Connection buffers come in a few size classes, each with its own free
+ * list, so that a client growing its buffer for a burst of big requests
+ * or replies picks up a buffer someone else just gave back instead of
+ * going to realloc.  Buffers that stay unused on a free list for a whole
+ * trim interval are returned to the system, so the pool follows the
+ * working set of the server rather than its peak.  Anything bigger than
+ * the largest class is allocated directly.
+ */
+typedef struct _poolBuffer {
+    struct _poolBuffer *next;
+} PoolBuffer;
+
+typedef struct _bufferClass {
+    const char *name;
+    int size;
+    int maxFree;                /* never keep more than this many around */
+    PoolBuffer *free;
+    int numFree;
+    int lowFree;                /* fewest free buffers this trim interval */
+    int inUse;
+    uint64_t allocated;         /* buffers obtained from malloc */
+    uint64_t reused;            /* buffers taken from the free list */
+    uint64_t trimmed;           /* free buffers given back to the system */
+} BufferClass;
+
+static BufferClass BufferClasses[] = {
+    {.name = "4k",.size = 4096,.maxFree = 128},
+    {.name = "16k",.size = 16384,.maxFree = 64},
+    {.name = "64k",.size = 65536,.maxFree = 16},
+    {.name = "1m",.size = 1048576,.maxFree = 4},
+};
+
+#define NUM_BUFFER_CLASSES ARRAY_SIZE(BufferClasses)
+#define BUFFER_TRIM_INTERVAL 10000      /* milliseconds */
+
+static OsTimerPtr BufferTrimTimer;
+static Bool BufferTrimPending;
+static uint64_t OversizeBuffers;
+
 static ConnectionInputPtr AllocateInputBuffer(void);
 static ConnectionOutputPtr AllocateOutputBuffer(void);
+static void FreeInputBuffer(ConnectionInputPtr oci);
+static void FreeOutputBuffer(ConnectionOutputPtr oco);
 
 static Bool CriticalOutputPending;
+static ClientOutputStatsRec OutputStats;
+static const char padBuffer[3];
 static int timesThisConnection = 0;
-static ConnectionInputPtr FreeInputs = (ConnectionInputPtr) NULL;
-static ConnectionOutputPtr FreeOutputs = (ConnectionOutputPtr) NULL;
 static OsCommPtr AvailableInput = (OsCommPtr) NULL;
 
 #define get_req_len(req,cli) ((cli)->swapped ? \
@@ -119,6 +181,8 @@ static OsCommPtr AvailableInput = (OsCommPtr) NULL;
 #define MAX_TIMES_PER         10
 #define BUFSIZE 16384
 #define BUFWATERMARK 32768
+#define CHUNKSIZE 4096
+#define OUTPUT_IOV_MAX 16
 
 /*
  *   A lot of the code in this file manipulates a ConnectionInputPtr:
@@ -176,6 +240,119 @@ static OsCommPtr AvailableInput = (OsCommPtr) NULL;
  *    a partial request) because others clients need to be scheduled.
  *****************************************************************/
 
+static BufferClass *
+FindBufferClass(int size)
+{
+    int i;
+
+    for (i = 0; i < NUM_BUFFER_CLASSES; i++)
+        if (size <= BufferClasses[i].size)
+            return &BufferClasses[i];
+    return NULL;
+}
+
+/* Free buffers nobody asked for during the last interval */
+static CARD32
+TrimBuffers(OsTimerPtr timer, CARD32 now, void *arg)
+{
+    BufferClass *bc;
+    PoolBuffer *pb;
+    Bool pending = FALSE;
+    int i;
+
+    for (i = 0; i < NUM_BUFFER_CLASSES; i++) {
+        bc = &BufferClasses[i];
+        while (bc->lowFree > 0) {
+            pb = bc->free;
+            bc->free = pb->next;
+            free(pb);
+            bc->numFree--;
+            bc->lowFree--;
+            bc->trimmed++;
+        }
+        bc->lowFree = bc->numFree;
+        if (bc->numFree)
+            pending = TRUE;
+    }
+
+    BufferTrimPending = pending;
+    return pending ? BUFFER_TRIM_INTERVAL : 0;
+}
+
+/*
+ * Returns a buffer of at least *size bytes and updates *size to what was
+ * actually allocated.
+ */
+static void *
+AllocateBuffer(int *size)
+{
+    BufferClass *bc = FindBufferClass(*size);
+    PoolBuffer *pb;
+
+    if (!bc) {
+        OversizeBuffers++;
+        return malloc(*size);
+    }
+
+    *size = bc->size;
+    if ((pb = bc->free)) {
+        bc->free = pb->next;
+        if (--bc->numFree < bc->lowFree)
+            bc->lowFree = bc->numFree;
+        bc->reused++;
+    }
+    else {
+        if (!(pb = malloc(bc->size)))
+            return NULL;
+        bc->allocated++;
+    }
+    bc->inUse++;
+    return pb;
+}
+
+static void
+FreeBuffer(void *buf, int size)
+{
+    BufferClass *bc = FindBufferClass(size);
+    PoolBuffer *pb = buf;
+
+    if (!bc || bc->size != size) {
+        free(buf);
+        return;
+    }
+
+    bc->inUse--;
+    if (bc->numFree >= bc->maxFree) {
+        free(buf);
+        return;
+    }
+    pb->next = bc->free;
+    bc->free = pb;
+    bc->numFree++;
+
+    if (!BufferTrimPending) {
+        BufferTrimTimer = TimerSet(BufferTrimTimer, 0, BUFFER_TRIM_INTERVAL,
+                                   TrimBuffers, NULL);
+        BufferTrimPending = BufferTrimTimer != NULL;
+    }
+}
+
+/*
+ * Replace buf with a buffer of at least *size bytes, keeping the first
+ * keep bytes.
+ */
+static void *
+ResizeBuffer(void *buf, int oldSize, int *size, int keep)
+{
+    void *nbuf = AllocateBuffer(size);
+
+    if (!nbuf)
+        return NULL;
+    memcpy(nbuf, buf, keep);
+    FreeBuffer(buf, oldSize);
+    return nbuf;
+}
+
 static void
 YieldControl(void)
 {
@@ -196,26 +373,16 @@ YieldControlDeath(void)
     timesThisConnection = 0;
 }
 
-/* If an input buffer was empty, either free it if it is too big or link it
- * into our list of free input buffers.  This means that different clients can
- * share the same input buffer (at different times).  This was done to save
- * memory.
+/* If an input buffer was empty, give it back to the buffer pool.  This
+ * means that different clients can share the same input buffer (at
+ * different times).  This was done to save memory.
  */
 static void
 NextAvailableInput(OsCommPtr oc)
 {
     if (AvailableInput) {
         if (AvailableInput != oc) {
-            ConnectionInputPtr aci = AvailableInput->input;
-
-            if (aci->size > BUFWATERMARK) {
-                free(aci->buffer);
-                free(aci);
-            }
-            else {
-                aci->next = FreeInputs;
-                FreeInputs = aci;
-            }
+            FreeInputBuffer(AvailableInput->input);
             AvailableInput->input = NULL;
         }
         AvailableInput = NULL;
@@ -239,10 +406,7 @@ ReadRequestFromClient(ClientPtr client)
     /* make sure we have an input buffer */
 
     if (!oci) {
-        if ((oci = FreeInputs)) {
-            FreeInputs = oci->next;
-        }
-        else if (!(oci = AllocateInputBuffer())) {
+        if (!(oci = AllocateInputBuffer())) {
             YieldControlDeath();
             return -1;
         }
@@ -261,9 +425,27 @@ ReadRequestFromClient(ClientPtr client)
 
     oci->bufptr += oci->lenLastReq;
 
+    /*
+     * Clients pipelining small requests leave lots of them in the buffer
+     * after a single read.  Hand those out straight away; anything that
+     * needs reading, buffer management or Big Request decoding takes the
+     * long way below.
+     */
+    gotnow = oci->bufcnt + oci->buffer - oci->bufptr;
+    if (gotnow >= sizeof(xReq) && !oci->ignoreBytes) {
+        request = (xReq *) oci->bufptr;
+        needed = get_req_len(request, client) << 2;
+        if (needed && gotnow >= needed) {
+            client->req_len = needed >> 2;
+            oci->lenLastReq = needed;
+            if (gotnow == needed)
+                AvailableInput = oc;
+            goto done;
+        }
+    }
+
     need_header = FALSE;
     move_header = FALSE;
-    gotnow = oci->bufcnt + oci->buffer - oci->bufptr;
 
     if (oci->ignoreBytes > 0) {
         if (oci->ignoreBytes > oci->size)
@@ -325,13 +507,14 @@ ReadRequestFromClient(ClientPtr client)
             if (needed > oci->size) {
                 /* make buffer bigger to accomodate request */
                 char *ibuf;
+                int size = needed;
 
-                ibuf = (char *) realloc(oci->buffer, needed);
+                ibuf = ResizeBuffer(oci->buffer, oci->size, &size, gotnow);
                 if (!ibuf) {
                     YieldControlDeath();
                     return -1;
                 }
-                oci->size = needed;
+                oci->size = size;
                 oci->buffer = ibuf;
             }
             oci->bufptr = oci->buffer;
@@ -371,10 +554,11 @@ ReadRequestFromClient(ClientPtr client)
         if ((oci->size > BUFWATERMARK) &&
             (oci->bufcnt < BUFSIZE) && (needed < BUFSIZE)) {
             char *ibuf;
+            int size = BUFSIZE;
 
-            ibuf = (char *) realloc(oci->buffer, BUFSIZE);
+            ibuf = ResizeBuffer(oci->buffer, oci->size, &size, oci->bufcnt);
             if (ibuf) {
-                oci->size = BUFSIZE;
+                oci->size = size;
                 oci->buffer = ibuf;
                 oci->bufptr = ibuf + oci->bufcnt - gotnow;
             }
@@ -447,6 +631,8 @@ ReadRequestFromClient(ClientPtr client)
         oci->lenLastReq -= (sizeof(xBigReq) - sizeof(xReq));
         client->req_len -= bytes_to_int32(sizeof(xBigReq) - sizeof(xReq));
     }
+
+ done:
     client->requestBuffer = (void *) oci->bufptr;
 #ifdef DEBUG_COMMUNICATION
     {
@@ -501,9 +687,7 @@ InsertFakeRequest(ClientPtr client, char *data, int count)
     NextAvailableInput(oc);
 
     if (!oci) {
-        if ((oci = FreeInputs))
-            FreeInputs = oci->next;
-        else if (!(oci = AllocateInputBuffer()))
+        if (!(oci = AllocateInputBuffer()))
             return FALSE;
         oc->input = oci;
     }
@@ -512,11 +696,12 @@ InsertFakeRequest(ClientPtr client, char *data, int count)
     gotnow = oci->bufcnt + oci->buffer - oci->bufptr;
     if ((gotnow + count) > oci->size) {
         char *ibuf;
+        int size = gotnow + count;
 
-        ibuf = (char *) realloc(oci->buffer, gotnow + count);
+        ibuf = ResizeBuffer(oci->buffer, oci->size, &size, oci->bufcnt);
         if (!ibuf)
             return FALSE;
-        oci->size = gotnow + count;
+        oci->size = size;
         oci->buffer = ibuf;
         oci->bufptr = ibuf + oci->bufcnt - gotnow;
     }
@@ -646,19 +831,127 @@ SetCriticalOutputPending(void)
  *    this routine as int.
  *****************/
 
-int
-WriteToClient(ClientPtr who, int count, const void *__buf)
+static void
+FreeOutputChunk(OutputChunk *chunk)
+{
+    if (chunk->release)
+        (*chunk->release) (chunk->closure);
+    if (chunk->buf)
+        FreeBuffer(chunk->buf, chunk->size);
+    free(chunk);
+}
+
+static void
+DiscardOutput(ConnectionOutputPtr oco)
+{
+    OutputChunk *chunk;
+
+    while ((chunk = oco->chunks)) {
+        oco->chunks = chunk->next;
+        FreeOutputChunk(chunk);
+    }
+    oco->lastChunk = NULL;
+    oco->chunkBytes = 0;
+    oco->count = 0;
+}
+
+static void
+QueueOutputChunk(ConnectionOutputPtr oco, OutputChunk *chunk)
+{
+    chunk->next = NULL;
+    if (oco->lastChunk)
+        oco->lastChunk->next = chunk;
+    else
+        oco->chunks = chunk;
+    oco->lastChunk = chunk;
+    oco->chunkBytes += chunk->count;
+}
+
+/* Room for a copy at the end of the queued output */
+static int
+OutputSpace(ConnectionOutputPtr oco)
+{
+    if (oco->chunks)
+        return oco->lastChunk->room;
+    return oco->size - oco->count;
+}
+
+/*
+ * Copy data behind everything already queued.  While chunks are pending the
+ * copy has to go after them, into an owned chunk, to keep the byte order.
+ */
+static Bool
+AppendOutput(ConnectionOutputPtr oco, const char *data, int count)
+{
+    OutputChunk *chunk = oco->lastChunk;
+
+    if (!count)
+        return TRUE;
+
+    if (!oco->chunks) {
+        if (oco->count + count > oco->size) {
+            unsigned char *obuf = NULL;
+            int size = oco->count + count + BUFSIZE;
+
+            if ((long) oco->count + count + BUFSIZE <= INT_MAX)
+                obuf = ResizeBuffer(oco->buf, oco->size, &size, oco->count);
+            if (!obuf)
+                return FALSE;
+            oco->size = size;
+            oco->buf = obuf;
+        }
+        memmove(oco->buf + oco->count, data, count);
+        oco->count += count;
+    }
+    else {
+        if (chunk->room < count) {
+            int size = max(count, CHUNKSIZE);
+
+            chunk = malloc(sizeof(OutputChunk));
+            if (!chunk)
+                return FALSE;
+            chunk->buf = AllocateBuffer(&size);
+            if (!chunk->buf) {
+                free(chunk);
+                return FALSE;
+            }
+            chunk->size = size;
+            chunk->data = chunk->buf;
+            chunk->count = 0;
+            chunk->room = size;
+            chunk->release = NULL;
+            chunk->closure = NULL;
+            QueueOutputChunk(oco, chunk);
+        }
+        memmove((char *) chunk->data + chunk->count, data, count);
+        chunk->count += count;
+        chunk->room -= count;
+        oco->chunkBytes += count;
+    }
+    OutputStats.bytesCopied += count;
+    return TRUE;
+}
+
+static int FlushOutput(ClientPtr who, OsCommPtr oc,
+                       const char *extraBuf, int extraCount,
+                       ClientOutputReleaseProcPtr release, void *closure);
+
+static int
+WriteOutput(ClientPtr who, int count, const char *buf,
+            ClientOutputReleaseProcPtr release, void *closure)
 {
     OsCommPtr oc;
     ConnectionOutputPtr oco;
     int padBytes;
-    const char *buf = __buf;
 
 #ifdef DEBUG_COMMUNICATION
     Bool multicount = FALSE;
 #endif
-    if (!count || !who || who == serverClient || who->clientGone)
+    if (!count || !who || who == serverClient || who->clientGone) {
+        if (release)
+            (*release) (closure);
         return 0;
+    }
     oc = who->osPrivate;
     oco = oc->output;
 #ifdef DEBUG_COMMUNICATION
@@ -703,16 +996,15 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
 #endif
 
     if (!oco) {
-        if ((oco = FreeOutputs)) {
-            FreeOutputs = oco->next;
-        }
-        else if (!(oco = AllocateOutputBuffer())) {
+        if (!(oco = AllocateOutputBuffer())) {
             if (oc->trans_conn) {
                 _XSERVTransDisconnect(oc->trans_conn);
                 _XSERVTransClose(oc->trans_conn);
                 oc->trans_conn = NULL;
             }
             MarkClientException(who);
+            if (release)
+                (*release) (closure);
             return -1;
         }
         oc->output = oco;
@@ -760,7 +1052,8 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
         }
     }
 #endif
-    if (oco->count == 0 || oco->count + count + padBytes > oco->size) {
+    if ((oco->count == 0 && !oco->chunks) ||
+        count + padBytes > OutputSpace(oco)) {
         output_pending_clear(who);
         if (!any_output_pending()) {
             CriticalOutputPending = FALSE;
@@ -770,20 +1063,45 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
         if (FlushCallback)
             CallCallbacks(&FlushCallback, NULL);
 
-        return FlushClient(who, oc, buf, count);
+        return FlushOutput(who, oc, buf, count, release, closure);
     }
 
     NewOutputPending = TRUE;
     output_pending_mark(who);
-    memmove((char *) oco->buf + oco->count, buf, count);
-    oco->count += count;
-    if (padBytes) {
-        memset(oco->buf + oco->count, '\0', padBytes);
-        oco->count += padBytes;
-    }
+    AppendOutput(oco, buf, count);
+    AppendOutput(oco, padBuffer, padBytes);
+    if (release)
+        (*release) (closure);
     return count;
 }
 
+int
+WriteToClient(ClientPtr who, int count, const void *buf)
+{
+    return WriteOutput(who, count, buf, NULL, NULL);
+}
+
+/*****************
+ * WriteToClientRef
+ *    Like WriteToClient, but if the client can't take all of buf right
+ *    away the rest is queued by reference instead of being copied into
+ *    the output buffer.  Meant for large replies the caller would free
+ *    right after writing them anyway, such as image data.
+ *****************/
+
+int
+WriteToClientRef(ClientPtr who, int count, const void *buf,
+                 ClientOutputReleaseProcPtr release, void *closure)
+{
+    return WriteOutput(who, count, buf, release, closure);
+}
+
+void
+GetClientOutputStats(ClientOutputStatsPtr stats)
+{
+    *stats = OutputStats;
+}
+
  /********************
  * FlushClient()
  *    If the client isn't keeping up with us, then we try to continue
@@ -795,69 +1113,106 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
  **********************/
 
 int
-FlushClient(ClientPtr who, OsCommPtr oc, const void *__extraBuf, int extraCount)
+FlushClient(ClientPtr who, OsCommPtr oc, const void *extraBuf, int extraCount)
+{
+    return FlushOutput(who, oc, extraBuf, extraCount, NULL, NULL);
+}
+
+static int
+FlushOutput(ClientPtr who, OsCommPtr oc, const char *extraBuf, int extraCount,
+            ClientOutputReleaseProcPtr release, void *closure)
 {
     ConnectionOutputPtr oco = oc->output;
     XtransConnInfo trans_conn = oc->trans_conn;
-    struct iovec iov[3];
-    static char padBuffer[3];
-    const char *extraBuf = __extraBuf;
-    long written;
+    struct iovec iov[OUTPUT_IOV_MAX];
+    OutputChunk *chunk;
+    long bufDone, extraDone;
     long padsize;
     long notWritten;
     long todo;
+    long len;
 
-    if (!oco)
+    if (!oco) {
+        if (release)
+            (*release) (closure);
 	return 0;
-    written = 0;
+    }
+    bufDone = extraDone = 0;
     padsize = padding_for_int32(extraCount);
-    notWritten = oco->count + extraCount + padsize;
-    if (!notWritten)
+    notWritten = oco->count + oco->chunkBytes + extraCount + padsize;
+    if (!notWritten) {
+        if (release)
+            (*release) (closure);
         return 0;
+    }
 
     todo = notWritten;
     while (notWritten) {
-        long before = written;  /* amount of whole thing written */
         long remain = todo;     /* amount to try this time, <= notWritten */
         int i = 0;
-        long len;
-
-        /* You could be very general here and have "in" and "out" iovecs
-         * and write a loop without using a macro, but what the heck.  This
-         * translates to:
-         *
-         *     how much of this piece is new?
-         *     if more new then we are trying this time, clamp
-         *     if nothing new
-         *         then bump down amount already written, for next piece
-         *         else put new stuff in iovec, will need all of next piece
-         *
-         * Note that todo had better be at least 1 or else we'll end up
-         * writing 0 iovecs.
+
+        /* Gather as much of the queued output as fits in the iovec, in
+         * order: the output buffer, the queued chunks and finally the
+         * caller's data and its padding.  Note that todo had better be at
+         * least 1 or else we'll end up writing 0 iovecs.
          */
 #define InsertIOV(pointer, length) \
-	len = (length) - before; \
+	len = (length); \
 	if (len > remain) \
 	    len = remain; \
-	if (len <= 0) { \
-	    before = (-len); \
-	} else { \
+	if (len > 0) { \
 	    iov[i].iov_len = len; \
-	    iov[i].iov_base = (pointer) + before;	\
+	    iov[i].iov_base = (char *) (pointer); \
 	    i++; \
 	    remain -= len; \
-	    before = 0; \
 	}
 
-        InsertIOV((char *) oco->buf, oco->count)
-            InsertIOV((char *) extraBuf, extraCount)
-            InsertIOV(padBuffer, padsize)
+        InsertIOV(oco->buf + bufDone, oco->count - bufDone)
+        for (chunk = oco->chunks; chunk && i < OUTPUT_IOV_MAX - 2;
+             chunk = chunk->next) {
+            InsertIOV(chunk->data, chunk->count)
+        }
+        if (!chunk) {
+            if (extraDone < extraCount) {
+                InsertIOV(extraBuf + extraDone, extraCount - extraDone)
+                InsertIOV(padBuffer, padsize)
+            }
+            else {
+                InsertIOV(padBuffer, padsize - (extraDone - extraCount))
+            }
+        }
+#undef InsertIOV
 
-            errno = 0;
+        errno = 0;
         if (trans_conn && (len = _XSERVTransWritev(trans_conn, iov, i)) >= 0) {
-            written += len;
             notWritten -= len;
             todo = notWritten;
+
+            /* Retire whatever made it out, in queue order */
+            if (bufDone < oco->count) {
+                long n = min(len, oco->count - bufDone);
+
+                bufDone += n;
+                len -= n;
+            }
+            while (len > 0 && (chunk = oco->chunks)) {
+                long n = min(len, chunk->count);
+
+                chunk->data += n;
+                chunk->count -= n;
+                oco->chunkBytes -= n;
+                if (chunk->release)
+                    OutputStats.bytesDirect += n;
+                len -= n;
+                if (!chunk->count) {
+                    if (!(oco->chunks = chunk->next))
+                        oco->lastChunk = NULL;
+                    FreeOutputChunk(chunk);
+                }
+            }
+            if (extraDone < extraCount)
+                OutputStats.bytesDirect += min(len, extraCount - extraDone);
+            extraDone += len;
         }
         else if (ETEST(errno)
 #ifdef SUNSYSV                  /* check for another brain-damaged OS bug */
@@ -868,48 +1223,50 @@ FlushClient(ClientPtr who, OsCommPtr oc, const void *__extraBuf, int extraCount)
 #endif
             ) {
             /* If we've arrived here, then the client is stuffed to the gills
-               and not ready to accept more.  Make a note of it and buffer
+               and not ready to accept more.  Make a note of it and queue
                the rest. */
             output_pending_mark(who);
 
-            if (written < oco->count) {
-                if (written > 0) {
-                    oco->count -= written;
-                    memmove((char *) oco->buf,
-                            (char *) oco->buf + written, oco->count);
-                    written = 0;
-                }
-            }
-            else {
-                written -= oco->count;
-                oco->count = 0;
+            if (bufDone > 0) {
+                oco->count -= bufDone;
+                memmove((char *) oco->buf,
+                        (char *) oco->buf + bufDone, oco->count);
             }
 
-            if (notWritten > oco->size) {
-                unsigned char *obuf = NULL;
-
-                if (notWritten + BUFSIZE <= INT_MAX) {
-                    obuf = realloc(oco->buf, notWritten + BUFSIZE);
-                }
-                if (!obuf) {
-                    _XSERVTransDisconnect(oc->trans_conn);
-                    _XSERVTransClose(oc->trans_conn);
-                    oc->trans_conn = NULL;
-                    MarkClientException(who);
-                    oco->count = 0;
-                    return -1;
+            /* Referenced data stays where it is, anything else is copied.
+               If the amount written extended into the padBuffer, then the
+               difference "extraCount - extraDone" may be less than 0 */
+            if ((len = extraCount - extraDone) > 0 && release) {
+                chunk = malloc(sizeof(OutputChunk));
+                if (chunk) {
+                    chunk->buf = NULL;
+                    chunk->size = 0;
+                    chunk->data = extraBuf + extraDone;
+                    chunk->count = len;
+                    chunk->room = 0;
+                    chunk->release = release;
+                    chunk->closure = closure;
+                    QueueOutputChunk(oco, chunk);
+                    extraDone = extraCount;
+                    release = NULL;
                 }
-                oco->size = notWritten + BUFSIZE;
-                oco->buf = obuf;
             }
+            if (!AppendOutput(oco, extraBuf + extraDone,
+                              max(extraCount - extraDone, 0)) ||
+                !AppendOutput(oco, padBuffer + max(extraDone - extraCount, 0),
+                              padsize - max(extraDone - extraCount, 0))) {
+                _XSERVTransDisconnect(oc->trans_conn);
+                _XSERVTransClose(oc->trans_conn);
+                oc->trans_conn = NULL;
+                MarkClientException(who);
+                DiscardOutput(oco);
+                if (release)
+                    (*release) (closure);
+                return -1;
+            }
+            if (release)
+                (*release) (closure);
 
-            /* If the amount written extended into the padBuffer, then the
-               difference "extraCount - written" may be less than 0 */
-            if ((len = extraCount - written) > 0)
-                memmove((char *) oco->buf + oco->count,
-                        extraBuf + written, len);
-
-            oco->count = notWritten;    /* this will include the pad */
             ospoll_listen(server_poll, oc->fd, X_NOTIFY_WRITE);
 
             /* return only the amount explicitly requested */
@@ -927,23 +1284,20 @@ FlushClient(ClientPtr who, OsCommPtr oc, const void *__extraBuf, int extraCount)
                 oc->trans_conn = NULL;
             }
             MarkClientException(who);
-            oco->count = 0;
+            DiscardOutput(oco);
+            if (release)
+                (*release) (closure);
             return -1;
         }
     }
 
     /* everything was flushed out */
+    if (release)
+        (*release) (closure);
     oco->count = 0;
     output_pending_clear(who);
 
-    if (oco->size > BUFWATERMARK) {
-        free(oco->buf);
-        free(oco);
-    }
-    else {
-        oco->next = FreeOutputs;
-        FreeOutputs = oco;
-    }
+    FreeOutputBuffer(oco);
     oc->output = (ConnectionOutputPtr) NULL;
     return extraCount;          /* return only the amount explicitly requested */
 }
@@ -952,16 +1306,17 @@ static ConnectionInputPtr
 AllocateInputBuffer(void)
 {
     ConnectionInputPtr oci;
+    int size = BUFSIZE;
 
     oci = malloc(sizeof(ConnectionInput));
     if (!oci)
         return NULL;
-    oci->buffer = malloc(BUFSIZE);
+    oci->buffer = AllocateBuffer(&size);
     if (!oci->buffer) {
         free(oci);
         return NULL;
     }
-    oci->size = BUFSIZE;
+    oci->size = size;
     oci->bufptr = oci->buffer;
     oci->bufcnt = 0;
     oci->lenLastReq = 0;
@@ -969,73 +1324,98 @@ AllocateInputBuffer(void)
     return oci;
 }
 
+static void
+FreeInputBuffer(ConnectionInputPtr oci)
+{
+    FreeBuffer(oci->buffer, oci->size);
+    free(oci);
+}
+
 static ConnectionOutputPtr
 AllocateOutputBuffer(void)
 {
     ConnectionOutputPtr oco;
+    int size = BUFSIZE;
 
     oco = malloc(sizeof(ConnectionOutput));
     if (!oco)
         return NULL;
-    oco->buf = calloc(1, BUFSIZE);
+    oco->buf = AllocateBuffer(&size);
     if (!oco->buf) {
         free(oco);
         return NULL;
     }
-    oco->size = BUFSIZE;
+    oco->size = size;
     oco->count = 0;
+    oco->chunks = oco->lastChunk = NULL;
+    oco->chunkBytes = 0;
     return oco;
 }
 
+static void
+FreeOutputBuffer(ConnectionOutputPtr oco)
+{
+    DiscardOutput(oco);
+    FreeBuffer(oco->buf, oco->size);
+    free(oco);
+}
+
 void
 FreeOsBuffers(OsCommPtr oc)
 {
-    ConnectionInputPtr oci;
-    ConnectionOutputPtr oco;
-
     if (AvailableInput == oc)
         AvailableInput = (OsCommPtr) NULL;
-    if ((oci = oc->input)) {
-        if (FreeInputs) {
-            free(oci->buffer);
-            free(oci);
-        }
-        else {
-            FreeInputs = oci;
-            oci->next = (ConnectionInputPtr) NULL;
-            oci->bufptr = oci->buffer;
-            oci->bufcnt = 0;
-            oci->lenLastReq = 0;
-            oci->ignoreBytes = 0;
-        }
+    if (oc->input) {
+        FreeInputBuffer(oc->input);
+        oc->input = NULL;
     }
-    if ((oco = oc->output)) {
-        if (FreeOutputs) {
-            free(oco->buf);
-            free(oco);
-        }
-        else {
-            FreeOutputs = oco;
-            oco->next = (ConnectionOutputPtr) NULL;
-            oco->count = 0;
-        }
+    if (oc->output) {
+        FreeOutputBuffer(oc->output);
+        oc->output = NULL;
     }
 }
 
 void
 ResetOsBuffers(void)
 {
-    ConnectionInputPtr oci;
-    ConnectionOutputPtr oco;
-
-    while ((oci = FreeInputs)) {
-        FreeInputs = oci->next;
-        free(oci->buffer);
-        free(oci);
+    BufferClass *bc;
+    PoolBuffer *pb;
+    int i;
+
+    for (i = 0; i < NUM_BUFFER_CLASSES; i++) {
+        bc = &BufferClasses[i];
+        while ((pb = bc->free)) {
+            bc->free = pb->next;
+            free(pb);
+            bc->trimmed++;
+        }
+        bc->numFree = bc->lowFree = 0;
     }
-    while ((oco = FreeOutputs)) {
-        FreeOutputs = oco->next;
-        free(oco->buf);
-        free(oco);
+}
+
+void
+ReportOsStatistics(ServerStatisticsPtr stats)
+{
+    BufferClass *bc;
+    char name[64];
+    int i;
+
+    for (i = 0; i < NUM_BUFFER_CLASSES; i++) {
+        bc = &BufferClasses[i];
+#define REPORT(field, value) \
+        snprintf(name, sizeof(name), "os.buffers.%s.%s", bc->name, field); \
+        AddServerStatistic(stats, name, value)
+        REPORT("in-use", bc->inUse);
+        REPORT("free", bc->numFree);
+        REPORT("allocated", bc->allocated);
+        REPORT("reused", bc->reused);
+        REPORT("trimmed", bc->trimmed);
+#undef REPORT
     }
+    AddServerStatistic(stats, "os.buffers.oversize.allocated",
+                       OversizeBuffers);
+    AddServerStatistic(stats, "os.output.bytes-copied",
+                       OutputStats.bytesCopied);
+    AddServerStatistic(stats, "os.output.bytes-direct",
+                       OutputStats.bytesDirect);
 }
@@ -121,6 +121,7 @@ __stdcall unsigned long GetTickCount(void);
 #include "xkbsrv.h"
 
 #include "picture.h"
+#include "glyphstr.h"
 
 Bool noTestExtensions;
 
@@ -431,6 +432,15 @@ GiveUp(int sig)
     errno = olderrno;
 }
 
+/* Log dispatch statistics on SIGUSR2 */
+
+void
+RequestDispatchStats(int sig)
+{
+    dispatchStatsRequested = TRUE;
+    isItTimeToYield = TRUE;
+}
+
 #ifdef MONOTONIC_CLOCK
 void
 ForceClockId(clockid_t forced_clockid)
@@ -539,6 +549,7 @@ UseMsg(void)
     ErrorF("-fc string             cursor font\n");
     ErrorF("-fn string             default font name\n");
     ErrorF("-fp string             default font path\n");
+    ErrorF("-glyphcache kilobytes  glyph images cached per screen (0 for no limit)\n");
     ErrorF("-help                  prints message with these options\n");
     ErrorF("+iglx                  Allow creating indirect GLX contexts\n");
     ErrorF("-iglx                  Prohibit creating indirect GLX contexts (default)\n");
@@ -780,6 +791,21 @@ ProcessCommandLine(int argc, char *argv[])
             if (++i >= argc || !xfont2_parse_glyph_caching_mode(argv[i]))
                 UseMsg();
         }
+        else if (strcmp(argv[i], "-glyphcache") == 0) {
+            if (++i < argc) {
+                char *end;
+                long kb;
+
+                errno = 0;
+                kb = strtol(argv[i], &end, 10);
+                if (end == argv[i] || *end || errno || kb < 0 ||
+                    kb > ULONG_MAX / 1024)
+                    FatalError("Bad glyphcache size: %s\n", argv[i]);
+                GlyphCacheLimit = kb * 1024UL;
+            }
+            else
+                UseMsg();
+        }
         else if (strcmp(argv[i], "-f") == 0) {
             if (++i < argc)
                 defaultKeyboardControl.bell = atoi(argv[i]);
@@ -35,6 +35,7 @@
 static uint64_t         present_event_id;
 static struct xorg_list present_exec_queue;
 static struct xorg_list present_flip_queue;
+static struct xorg_list present_batch_queue;
 
 #if 0
 #define DebugPresent(x) ErrorF x
@@ -276,6 +277,14 @@ present_get_ust_msc(ScreenPtr screen, RRCrtcPtr crtc, uint64_t *ust, uint64_t *m
         return (*screen_priv->info->get_ust_msc)(crtc, ust, msc);
 }
 
+/*
+ * Non-zero while a batch of vblanks is being executed
+ */
+static int present_batch_depth;
+
+static void
+present_execute_complete(present_vblank_ptr vblank, uint64_t ust, uint64_t crtc_msc);
+
 static void
 present_flush(WindowPtr window)
 {
@@ -288,9 +297,58 @@ present_flush(WindowPtr window)
     if (!screen_priv->info)
         return;
 
+    /* Drivers flush everything on the screen, so once is enough */
+    if (present_batch_depth) {
+        screen_priv->flush_window = window;
+        return;
+    }
+
     (*screen_priv->info->flush) (window);
 }
 
+/*
+ * Vblanks which come due together, as the software vblank clock's do,
+ * are executed as a batch: all the copies first, then one flush per
+ * screen, then the idle and complete events, which mustn't go out
+ * before the flush.  Completions keep the order the vblanks executed in,
+ * including those of vblanks that didn't copy anything, so a client
+ * waiting on an MSC never hears about it before an earlier swap.
+ */
+void
+present_execute_batch_begin(void)
+{
+    present_batch_depth++;
+}
+
+void
+present_execute_batch_end(void)
+{
+    present_vblank_ptr          vblank, tmp;
+    int                         s;
+
+    if (--present_batch_depth)
+        return;
+
+    for (s = 0; s < screenInfo.numScreens; s++) {
+        ScreenPtr               screen = screenInfo.screens[s];
+        present_screen_priv_ptr screen_priv = present_screen_priv(screen);
+        WindowPtr               window;
+
+        if (!screen_priv || !screen_priv->flush_window)
+            continue;
+        window = screen_priv->flush_window;
+        screen_priv->flush_window = NULL;
+        present_flush(window);
+    }
+
+    xorg_list_for_each_entry_safe(vblank, tmp, &present_batch_queue, event_queue) {
+        xorg_list_del(&vblank->event_queue);
+        if (vblank->exec_copied)
+            present_pixmap_idle(vblank->pixmap, vblank->window, vblank->serial, vblank->idle_fence);
+        present_execute_complete(vblank, vblank->exec_ust, vblank->exec_msc);
+    }
+}
+
 static int
 present_queue_vblank(ScreenPtr screen,
                      RRCrtcPtr crtc,
@@ -632,7 +690,6 @@ present_execute(present_vblank_ptr vblank, uint64_t ust, uint64_t crtc_msc)
     WindowPtr                   window = vblank->window;
     ScreenPtr                   screen = window->drawable.pScreen;
     present_screen_priv_ptr     screen_priv = present_screen_priv(screen);
-    uint8_t                     mode;
 
     if (vblank->requeue) {
         vblank->requeue = FALSE;
@@ -751,9 +808,33 @@ present_execute(present_vblank_ptr vblank, uint64_t ust, uint64_t crtc_msc)
         vblank->update = NULL;
         present_flush(window);
 
-        present_pixmap_idle(vblank->pixmap, vblank->window, vblank->serial, vblank->idle_fence);
+        if (present_batch_depth)
+            vblank->exec_copied = TRUE;
+        else
+            present_pixmap_idle(vblank->pixmap, vblank->window, vblank->serial, vblank->idle_fence);
     }
 
+    /* Everything executed in a batch completes after its flush, in order,
+     * copy or not
+     */
+    if (present_batch_depth) {
+        vblank->exec_ust = ust;
+        vblank->exec_msc = crtc_msc;
+        xorg_list_append(&vblank->event_queue, &present_batch_queue);
+        return;
+    }
+
+    present_execute_complete(vblank, ust, crtc_msc);
+}
+
+/*
+ * Send the complete event for an executed request and free it
+ */
+static void
+present_execute_complete(present_vblank_ptr vblank, uint64_t ust, uint64_t crtc_msc)
+{
+    uint8_t                     mode;
+
     /* Compute correct CompleteMode
      */
     if (vblank->kind == PresentCompleteKindPixmap) {
@@ -1071,6 +1152,6 @@ present_init(void)
 {
     xorg_list_init(&present_exec_queue);
     xorg_list_init(&present_flip_queue);
-    present_fake_queue_init();
+    xorg_list_init(&present_batch_queue);
     return TRUE;
 }
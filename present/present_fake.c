@@ -20,6 +20,7 @@
  * OF THIS SOFTWARE.
  */
 
+
 #ifdef HAVE_XORG_CONFIG_H
 #include <xorg-config.h>
 #endif
@@ -27,14 +28,12 @@
 #include "present_priv.h"
 #include "list.h"
 
-static struct xorg_list fake_vblank_queue;
-
-typedef struct present_fake_vblank {
-    struct xorg_list            list;
-    uint64_t                    event_id;
-    OsTimerPtr                  timer;
-    ScreenPtr                   screen;
-} present_fake_vblank_rec, *present_fake_vblank_ptr;
+/*
+ * Each screen runs one software vblank clock.  Pending vblanks wait on a
+ * per-screen list sorted by MSC, and a single timer is set for the first
+ * of them.  When it fires, every vblank which is due is notified in the
+ * same pass, so the copies for one frame go out together.
+ */
 
 int
 present_fake_get_ust_msc(ScreenPtr screen, uint64_t *ust, uint64_t *msc)
@@ -55,32 +54,73 @@ present_fake_notify(ScreenPtr screen, uint64_t event_id)
     present_event_notify(event_id, ust, msc);
 }
 
+/*
+ * Milliseconds until 'msc' starts, or zero if it already has
+ */
+static INT32
+present_fake_delay(present_screen_priv_ptr screen_priv, uint64_t msc)
+{
+    uint64_t                    ust = msc * screen_priv->fake_interval;
+    INT32                       delay = ((int64_t) (ust - GetTimeInMicros())) / 1000;
+
+    return delay > 0 ? delay : 0;
+}
+
 static CARD32
 present_fake_do_timer(OsTimerPtr timer,
                       CARD32 time,
                       void *arg)
 {
-    present_fake_vblank_ptr     fake_vblank = arg;
+    ScreenPtr                   screen = arg;
+    present_screen_priv_ptr     screen_priv = present_screen_priv(screen);
+    present_fake_vblank_ptr     fake_vblank, tmp;
+    struct xorg_list            due;
+
+    /* Take everything which is due off the queue first, as notifying
+     * may queue new vblanks
+     */
+    xorg_list_init(&due);
+    xorg_list_for_each_entry_safe(fake_vblank, tmp, &screen_priv->fake_queue, list) {
+        if (present_fake_delay(screen_priv, fake_vblank->msc))
+            break;
+        xorg_list_del(&fake_vblank->list);
+        xorg_list_append(&fake_vblank->list, &due);
+    }
+
+    present_execute_batch_begin();
+    xorg_list_for_each_entry_safe(fake_vblank, tmp, &due, list) {
+        xorg_list_del(&fake_vblank->list);
+        present_fake_notify(screen, fake_vblank->event_id);
+        free(fake_vblank);
+    }
+    present_execute_batch_end();
 
-    present_fake_notify(fake_vblank->screen, fake_vblank->event_id);
-    xorg_list_del(&fake_vblank->list);
-    free(fake_vblank);
-    return 0;
+    if (xorg_list_is_empty(&screen_priv->fake_queue))
+        return 0;
+    fake_vblank = xorg_list_first_entry(&screen_priv->fake_queue,
+                                        present_fake_vblank_rec, list);
+    return max(present_fake_delay(screen_priv, fake_vblank->msc), 1);
 }
 
 void
 present_fake_abort_vblank(ScreenPtr screen, uint64_t event_id, uint64_t msc)
 {
+    present_screen_priv_ptr     screen_priv = present_screen_priv(screen);
     present_fake_vblank_ptr     fake_vblank, tmp;
 
-    xorg_list_for_each_entry_safe(fake_vblank, tmp, &fake_vblank_queue, list) {
+    xorg_list_for_each_entry_safe(fake_vblank, tmp, &screen_priv->fake_queue, list) {
         if (fake_vblank->event_id == event_id) {
-            TimerCancel(fake_vblank->timer);
             xorg_list_del(&fake_vblank->list);
             free (fake_vblank);
             break;
         }
     }
+
+    /* Leave the timer for any others; it finds nothing due if the
+     * aborted one was first, and sets itself for the next
+     */
+    if (xorg_list_is_empty(&screen_priv->fake_queue))
+        TimerCancel(screen_priv->fake_timer);
 }
 
 int
@@ -89,12 +129,11 @@ present_fake_queue_vblank(ScreenPtr     screen,
                           uint64_t      msc)
 {
     present_screen_priv_ptr     screen_priv = present_screen_priv(screen);
-    uint64_t                    ust = msc * screen_priv->fake_interval;
-    uint64_t                    now = GetTimeInMicros();
-    INT32                       delay = ((int64_t) (ust - now)) / 1000;
+    INT32                       delay = present_fake_delay(screen_priv, msc);
     present_fake_vblank_ptr     fake_vblank;
+    struct xorg_list            *pos;
 
-    if (delay <= 0) {
+    if (delay == 0) {
         present_fake_notify(screen, event_id);
         return Success;
     }
@@ -103,15 +142,32 @@ present_fake_queue_vblank(ScreenPtr     screen,
     if (!fake_vblank)
         return BadAlloc;
 
-    fake_vblank->screen = screen;
     fake_vblank->event_id = event_id;
-    fake_vblank->timer = TimerSet(NULL, 0, delay, present_fake_do_timer, fake_vblank);
-    if (!fake_vblank->timer) {
-        free(fake_vblank);
-        return BadAlloc;
+    fake_vblank->msc = msc;
+
+    /* Most vblanks are for the next frame or two, so look for the spot
+     * from the end.  Vblanks for the same MSC stay in the order queued.
+     */
+    for (pos = screen_priv->fake_queue.prev; pos != &screen_priv->fake_queue; pos = pos->prev) {
+        present_fake_vblank_ptr prev = xorg_list_entry(pos, present_fake_vblank_rec, list);
+
+        if ((int64_t) (msc - prev->msc) >= 0)
+            break;
     }
+    xorg_list_add(&fake_vblank->list, pos);
 
-    xorg_list_add(&fake_vblank->list, &fake_vblank_queue);
+    /* The timer is already set for an earlier vblank unless this is first */
+    if (pos == &screen_priv->fake_queue || !screen_priv->fake_timer) {
+        OsTimerPtr timer = TimerSet(screen_priv->fake_timer, 0, delay,
+                                    present_fake_do_timer, screen);
+
+        if (!timer) {
+            xorg_list_del(&fake_vblank->list);
+            free(fake_vblank);
+            return BadAlloc;
+        }
+        screen_priv->fake_timer = timer;
+    }
 
     return Success;
 }
@@ -131,10 +187,21 @@ present_fake_screen_init(ScreenPtr screen)
         screen_priv->fake_interval = 1000000;
     else
         screen_priv->fake_interval = 16667;
+
+    xorg_list_init(&screen_priv->fake_queue);
+    screen_priv->fake_timer = NULL;
 }
 
 void
-present_fake_queue_init(void)
+present_fake_screen_fini(ScreenPtr screen)
 {
-    xorg_list_init(&fake_vblank_queue);
+    present_screen_priv_ptr     screen_priv = present_screen_priv(screen);
+    present_fake_vblank_ptr     fake_vblank, tmp;
+
+    TimerFree(screen_priv->fake_timer);
+    screen_priv->fake_timer = NULL;
+    xorg_list_for_each_entry_safe(fake_vblank, tmp, &screen_priv->fake_queue, list) {
+        xorg_list_del(&fake_vblank->list);
+        free(fake_vblank);
+    }
 }
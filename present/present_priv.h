@@ -65,6 +65,9 @@ struct present_vblank {
     uint64_t            event_id;
     uint64_t            target_msc;
     uint64_t            msc_offset;
+    uint64_t            exec_ust;       /* when executed, while batched */
+    uint64_t            exec_msc;
+    Bool                exec_copied;    /* idle the pixmap after the flush */
     present_fence_ptr   idle_fence;
     present_fence_ptr   wait_fence;
     present_notify_ptr  notifies;
@@ -77,6 +80,12 @@ struct present_vblank {
     Bool                abort_flip;     /* aborting this flip */
 };
 
+typedef struct present_fake_vblank {
+    struct xorg_list            list;
+    uint64_t                    event_id;
+    uint64_t                    msc;
+} present_fake_vblank_rec, *present_fake_vblank_ptr;
+
 typedef struct present_screen_priv {
     CloseScreenProcPtr          CloseScreen;
     ConfigNotifyProcPtr         ConfigNotify;
@@ -87,6 +96,11 @@ typedef struct present_screen_priv {
     uint64_t                    unflip_event_id;
 
     uint32_t                    fake_interval;
+    OsTimerPtr                  fake_timer;
+    struct xorg_list            fake_queue;     /* sorted by MSC */
+
+    /* Window to flush once the current batch of vblanks is done */
+    WindowPtr                   flush_window;
 
     /* Currently active flipped pixmap and fence */
     RRCrtcPtr                   flip_crtc;
@@ -189,6 +203,12 @@ present_flip_destroy(ScreenPtr screen);
 void
 present_check_flip_window(WindowPtr window);
 
+void
+present_execute_batch_begin(void);
+
+void
+present_execute_batch_end(void);
+
 RRCrtcPtr
 present_get_crtc(WindowPtr window);
 
@@ -239,7 +259,7 @@ void
 present_fake_screen_init(ScreenPtr screen);
 
 void
-present_fake_queue_init(void);
+present_fake_screen_fini(ScreenPtr screen);
 
 /*
  * present_fence.c
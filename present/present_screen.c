@@ -59,6 +59,7 @@ present_close_screen(ScreenPtr screen)
     present_screen_priv_ptr screen_priv = present_screen_priv(screen);
 
     present_flip_destroy(screen);
+    present_fake_screen_fini(screen);
 
     unwrap(screen_priv, screen, CloseScreen);
     (*screen->CloseScreen) (screen);
@@ -110,6 +111,9 @@ present_destroy_window(WindowPtr window)
     present_screen_priv_ptr screen_priv = present_screen_priv(screen);
     present_window_priv_ptr window_priv = present_window_priv(window);
 
+    if (screen_priv->flush_window == window)
+        screen_priv->flush_window = NULL;
+
     if (window_priv) {
         present_clear_window_notifies(window);
         present_free_events(window);
@@ -26,7 +26,9 @@
 #include <dix-config.h>
 #endif
 
+#ifdef GLYPH_HASH_SHA1
 #include "xsha1.h"
+#endif
 
 #include "misc.h"
 #include "scrnintstr.h"
@@ -45,6 +47,8 @@
 #include "glyphstr.h"
 #include "mipict.h"
 
+unsigned long GlyphCacheLimit = 16384 * 1024;
+
 /*
  * From Knuth -- a good choice for hash/rehash values is p, p-2 where
  * p and p-2 are both prime.  These tables are sized to have an extra 10%
@@ -82,6 +86,155 @@ static GlyphHashSetRec glyphHashSets[] = {
 
 static GlyphHashRec globalGlyphs[GlyphFormatNum];
 
+/*
+ * What a glyph is looked up by in the global tables: its hash and, unless
+ * the hash is SHA1, the glyph itself to compare against on a hash match.
+ */
+typedef struct _GlyphKey {
+    unsigned char *sha1;
+    xGlyphInfo *info;
+    CARD8 *bits;
+    CARD32 size;
+} GlyphKeyRec, *GlyphKeyPtr;
+
+#ifndef GLYPH_HASH_SHA1
+
+/*
+ * The hash fills the first GLYPH_HASH_SIZE bytes of glyph->sha1.  The
+ * rest holds a serial number, so the whole 20 bytes still tell glyphs
+ * apart for the acceleration code even if two of them hash the same.
+ * A copy of the bitmap follows the per-screen pictures.
+ */
+#define GLYPH_HASH_SIZE 16
+
+static CARD32 glyphSerial;
+
+#define GlyphBitsHeader(glyph) \
+    ((CARD32 *) (GlyphPicture(glyph) + screenInfo.numScreens))
+#define GlyphBitsSize(glyph) (*GlyphBitsHeader(glyph))
+#define GlyphBits(glyph) ((CARD8 *) (GlyphBitsHeader(glyph) + 1))
+
+#define GLYPH_PRIME1 0x9E3779B185EBCA87ULL
+#define GLYPH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define GLYPH_PRIME3 0x165667B19E3779F9ULL
+#define GLYPH_PRIME4 0x85EBCA77C2B2AE63ULL
+
+static inline uint64_t
+GlyphRotate(uint64_t v, int bits)
+{
+    return (v << bits) | (v >> (64 - bits));
+}
+
+static inline uint64_t
+GlyphRead64(const CARD8 *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t
+GlyphRound(uint64_t acc, uint64_t input)
+{
+    acc += input * GLYPH_PRIME2;
+    return GlyphRotate(acc, 31) * GLYPH_PRIME1;
+}
+
+static inline uint64_t
+GlyphAvalanche(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= GLYPH_PRIME2;
+    h ^= h >> 29;
+    h *= GLYPH_PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+/*
+ * A 128-bit hash along the lines of xxHash: four independent lanes over
+ * 32 bytes at a time, which the compiler keeps in registers and can
+ * vectorize, and two differently mixed results.  Not meant to stand up
+ * to someone looking for collisions; matches are checked byte by byte.
+ */
+static void
+GlyphHash128(xGlyphInfo * gi, const CARD8 *bits, unsigned long size,
+             unsigned char hash[GLYPH_HASH_SIZE])
+{
+    CARD32 info[3];
+    uint64_t seed1, seed2, v1, v2, v3, v4, h1, h2;
+    const CARD8 *p = bits, *end = bits + size;
+
+    memcpy(info, gi, sizeof(info));
+    seed1 = info[0] | (uint64_t) info[1] << 32;
+    seed2 = info[2] | (uint64_t) size << 32;
+
+    v1 = seed1 + GLYPH_PRIME1 + GLYPH_PRIME2;
+    v2 = seed1 + GLYPH_PRIME2;
+    v3 = seed2;
+    v4 = seed2 - GLYPH_PRIME1;
+
+    for (; end - p >= 32; p += 32) {
+        v1 = GlyphRound(v1, GlyphRead64(p));
+        v2 = GlyphRound(v2, GlyphRead64(p + 8));
+        v3 = GlyphRound(v3, GlyphRead64(p + 16));
+        v4 = GlyphRound(v4, GlyphRead64(p + 24));
+    }
+    for (; end - p >= 8; p += 8) {
+        v1 = GlyphRound(v1, GlyphRead64(p));
+        v3 = GlyphRound(v3, v1);
+    }
+    for (; p < end; p++) {
+        v2 = GlyphRotate(v2 ^ (*p * GLYPH_PRIME4), 11) * GLYPH_PRIME1;
+        v4 = GlyphRound(v4, v2);
+    }
+
+    h1 = GlyphRotate(v1, 1) + GlyphRotate(v2, 7) +
+        GlyphRotate(v3, 12) + GlyphRotate(v4, 18);
+    h2 = (v1 ^ GlyphRotate(v3, 29)) * GLYPH_PRIME3 +
+        (v2 ^ GlyphRotate(v4, 37)) * GLYPH_PRIME4;
+    h1 = GlyphAvalanche(h1 + size);
+    h2 = GlyphAvalanche(h2 ^ h1);
+
+    memcpy(hash, &h1, sizeof(h1));
+    memcpy(hash + sizeof(h1), &h2, sizeof(h2));
+}
+
+static Bool
+GlyphMatches(GlyphPtr glyph, GlyphKeyPtr key)
+{
+    return memcmp(glyph->sha1, key->sha1, GLYPH_HASH_SIZE) == 0 &&
+        memcmp(&glyph->info, key->info, sizeof(xGlyphInfo)) == 0 &&
+        GlyphBitsSize(glyph) == key->size &&
+        memcmp(GlyphBits(glyph), key->bits, key->size) == 0;
+}
+
+static void
+GlyphKey(GlyphPtr glyph, GlyphKeyPtr key)
+{
+    key->sha1 = glyph->sha1;
+    key->info = &glyph->info;
+    key->bits = GlyphBits(glyph);
+    key->size = GlyphBitsSize(glyph);
+}
+
+#else
+
+static Bool
+GlyphMatches(GlyphPtr glyph, GlyphKeyPtr key)
+{
+    return memcmp(glyph->sha1, key->sha1, 20) == 0;
+}
+
+static void
+GlyphKey(GlyphPtr glyph, GlyphKeyPtr key)
+{
+    key->sha1 = glyph->sha1;
+}
+
+#endif
+
 void
 GlyphUninit(ScreenPtr pScreen)
 {
@@ -117,9 +270,9 @@ FindGlyphHashSet(CARD32 filled)
     return 0;
 }
 
+/* Glyph ids are looked up with a NULL key, glyph contents with one */
 static GlyphRefPtr
-FindGlyphRef(GlyphHashPtr hash,
-             CARD32 signature, Bool match, unsigned char sha1[20])
+FindGlyphRef(GlyphHashPtr hash, CARD32 signature, GlyphKeyPtr key)
 {
     CARD32 elt, step, s;
     GlyphPtr glyph;
@@ -145,8 +298,7 @@ FindGlyphRef(GlyphHashPtr hash,
             else if (gr == del)
                 break;
         }
-        else if (s == signature &&
-                 (!match || memcmp(glyph->sha1, sha1, 20) == 0)) {
+        else if (s == signature && (!key || GlyphMatches(glyph, key))) {
             break;
         }
         if (!step) {
@@ -165,6 +317,11 @@ int
 HashGlyph(xGlyphInfo * gi,
           CARD8 *bits, unsigned long size, unsigned char sha1[20])
 {
+#ifndef GLYPH_HASH_SHA1
+    GlyphHash128(gi, bits, size, sha1);
+    memset(sha1 + GLYPH_HASH_SIZE, 0, 20 - GLYPH_HASH_SIZE);
+    return Success;
+#else
     void *ctx = x_sha1_init();
     int success;
 
@@ -181,18 +338,21 @@ HashGlyph(xGlyphInfo * gi,
     if (!success)
         return BadAlloc;
     return Success;
+#endif
 }
 
 GlyphPtr
-FindGlyphByHash(unsigned char sha1[20], int format)
+FindGlyphByHash(unsigned char sha1[20], xGlyphInfo * gi,
+                CARD8 *bits, unsigned long size, int format)
 {
     GlyphRefPtr gr;
     CARD32 signature = *(CARD32 *) sha1;
+    GlyphKeyRec key = { sha1, gi, bits, size };
 
     if (!globalGlyphs[format].hashSet)
         return NULL;
 
-    gr = FindGlyphRef(&globalGlyphs[format], signature, TRUE, sha1);
+    gr = FindGlyphRef(&globalGlyphs[format], signature, &key);
 
     if (gr->glyph && gr->glyph != DeletedGlyph)
         return gr->glyph;
@@ -251,6 +411,7 @@ FreeGlyph(GlyphPtr glyph, int format)
     CheckDuplicates(&globalGlyphs[format], "FreeGlyph");
     if (--glyph->refcnt == 0) {
         GlyphRefPtr gr;
+        GlyphKeyRec key;
         int i;
         int first;
         CARD32 signature;
@@ -264,7 +425,8 @@ FreeGlyph(GlyphPtr glyph, int format)
             }
 
         signature = *(CARD32 *) glyph->sha1;
-        gr = FindGlyphRef(&globalGlyphs[format], signature, TRUE, glyph->sha1);
+        GlyphKey(glyph, &key);
+        gr = FindGlyphRef(&globalGlyphs[format], signature, &key);
         if (gr - globalGlyphs[format].table != first)
             DuplicateRef(glyph, "Found wrong one");
         if (gr->glyph && gr->glyph != DeletedGlyph) {
@@ -282,13 +444,14 @@ void
 AddGlyph(GlyphSetPtr glyphSet, GlyphPtr glyph, Glyph id)
 {
     GlyphRefPtr gr;
+    GlyphKeyRec key;
     CARD32 signature;
 
     CheckDuplicates(&globalGlyphs[glyphSet->fdepth], "AddGlyph top global");
     /* Locate existing matching glyph */
     signature = *(CARD32 *) glyph->sha1;
-    gr = FindGlyphRef(&globalGlyphs[glyphSet->fdepth], signature,
-                      TRUE, glyph->sha1);
+    GlyphKey(glyph, &key);
+    gr = FindGlyphRef(&globalGlyphs[glyphSet->fdepth], signature, &key);
     if (gr->glyph && gr->glyph != DeletedGlyph && gr->glyph != glyph) {
         FreeGlyphPicture(glyph);
         dixFreeObjectWithPrivates(glyph, PRIVATE_GLYPH);
@@ -301,7 +464,7 @@ AddGlyph(GlyphSetPtr glyphSet, GlyphPtr glyph, Glyph id)
     }
 
     /* Insert/replace glyphset value */
-    gr = FindGlyphRef(&glyphSet->hash, id, FALSE, 0);
+    gr = FindGlyphRef(&glyphSet->hash, id, NULL);
     ++glyph->refcnt;
     if (gr->glyph && gr->glyph != DeletedGlyph)
         FreeGlyph(gr->glyph, glyphSet->fdepth);
@@ -318,7 +481,7 @@ DeleteGlyph(GlyphSetPtr glyphSet, Glyph id)
     GlyphRefPtr gr;
     GlyphPtr glyph;
 
-    gr = FindGlyphRef(&glyphSet->hash, id, FALSE, 0);
+    gr = FindGlyphRef(&glyphSet->hash, id, NULL);
     glyph = gr->glyph;
     if (glyph && glyph != DeletedGlyph) {
         gr->glyph = DeletedGlyph;
@@ -334,14 +497,15 @@ FindGlyph(GlyphSetPtr glyphSet, Glyph id)
 {
     GlyphPtr glyph;
 
-    glyph = FindGlyphRef(&glyphSet->hash, id, FALSE, 0)->glyph;
+    glyph = FindGlyphRef(&glyphSet->hash, id, NULL)->glyph;
     if (glyph == DeletedGlyph)
         glyph = 0;
     return glyph;
 }
 
 GlyphPtr
-AllocateGlyph(xGlyphInfo * gi, int fdepth)
+AllocateGlyph(xGlyphInfo * gi, CARD8 *bits, unsigned long bits_size,
+              unsigned char sha1[20], int fdepth)
 {
     PictureScreenPtr ps;
     int size;
@@ -350,6 +514,10 @@ AllocateGlyph(xGlyphInfo * gi, int fdepth)
     int head_size;
 
     head_size = sizeof(GlyphRec) + screenInfo.numScreens * sizeof(PicturePtr);
+#ifndef GLYPH_HASH_SHA1
+    head_size += pad_to_int32(sizeof(CARD32) + bits_size);
+    head_size = (head_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+#endif
     size = (head_size + dixPrivatesSize(PRIVATE_GLYPH));
     glyph = (GlyphPtr) malloc(size);
     if (!glyph)
@@ -357,6 +525,14 @@ AllocateGlyph(xGlyphInfo * gi, int fdepth)
     glyph->refcnt = 0;
     glyph->size = size + sizeof(xGlyphInfo);
     glyph->info = *gi;
+    memcpy(glyph->sha1, sha1, 20);
+#ifndef GLYPH_HASH_SHA1
+    glyphSerial++;
+    memcpy(glyph->sha1 + GLYPH_HASH_SIZE, &glyphSerial,
+           20 - GLYPH_HASH_SIZE);
+    GlyphBitsSize(glyph) = bits_size;
+    memcpy(GlyphBits(glyph), bits, bits_size);
+#endif
     dixInitPrivates(glyph, (char *) glyph + head_size, PRIVATE_GLYPH);
 
     for (i = 0; i < screenInfo.numScreens; i++) {
@@ -401,6 +577,7 @@ ResizeGlyphHash(GlyphHashPtr hash, CARD32 change, Bool global)
     GlyphHashSetPtr hashSet;
     GlyphHashRec newHash;
     GlyphRefPtr gr;
+    GlyphKeyRec key;
     GlyphPtr glyph;
     int i;
     int oldSize;
@@ -420,7 +597,8 @@ ResizeGlyphHash(GlyphHashPtr hash, CARD32 change, Bool global)
             glyph = hash->table[i].glyph;
             if (glyph && glyph != DeletedGlyph) {
                 s = hash->table[i].signature;
-                gr = FindGlyphRef(&newHash, s, global, glyph->sha1);
+                GlyphKey(glyph, &key);
+                gr = FindGlyphRef(&newHash, s, global ? &key : NULL);
 
                 gr->signature = s;
                 gr->glyph = glyph;
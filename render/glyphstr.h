@@ -93,7 +93,8 @@ typedef struct _GlyphList {
 extern void
  GlyphUninit(ScreenPtr pScreen);
 
-extern GlyphPtr FindGlyphByHash(unsigned char sha1[20], int format);
+extern GlyphPtr FindGlyphByHash(unsigned char sha1[20], xGlyphInfo * gi,
+                                CARD8 *bits, unsigned long size, int format);
 
 extern int
 HashGlyph(xGlyphInfo * gi,
@@ -107,7 +108,9 @@ extern Bool
 
 extern GlyphPtr FindGlyph(GlyphSetPtr glyphSet, Glyph id);
 
-extern GlyphPtr AllocateGlyph(xGlyphInfo * gi, int format);
+extern GlyphPtr AllocateGlyph(xGlyphInfo * gi, CARD8 *bits,
+                               unsigned long size, unsigned char sha1[20],
+                               int format);
 
 extern Bool
  ResizeGlyphSet(GlyphSetPtr glyphSet, CARD32 change);
@@ -117,6 +120,12 @@ extern GlyphSetPtr AllocateGlyphSet(int fdepth, PictFormatPtr format);
 extern int
  FreeGlyphSet(void *value, XID gid);
 
+/*
+ * Bytes of glyph images a screen may keep cached for drawing, set with
+ * -glyphcache.  0 means no limit.
+ */
+extern _X_EXPORT unsigned long GlyphCacheLimit;
+
 #define GLYPH_HAS_GLYPH_PICTURE_ACCESSOR 1 /* used for api compat */
 extern _X_EXPORT PicturePtr
  GetGlyphPicture(GlyphPtr glyph, ScreenPtr pScreen);
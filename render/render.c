@@ -1072,7 +1072,8 @@ ProcRenderAddGlyphs(ClientPtr client)
         if (err)
             goto bail;
 
-        glyph_new->glyph = FindGlyphByHash(glyph_new->sha1, glyphSet->fdepth);
+        glyph_new->glyph = FindGlyphByHash(glyph_new->sha1, &gi[i], bits, size,
+                                           glyphSet->fdepth);
 
         if (glyph_new->glyph && glyph_new->glyph != DeletedGlyph) {
             glyph_new->found = TRUE;
@@ -1081,7 +1082,9 @@ ProcRenderAddGlyphs(ClientPtr client)
             GlyphPtr glyph;
 
             glyph_new->found = FALSE;
-            glyph_new->glyph = glyph = AllocateGlyph(&gi[i], glyphSet->fdepth);
+            glyph_new->glyph = glyph = AllocateGlyph(&gi[i], bits, size,
+                                                     glyph_new->sha1,
+                                                     glyphSet->fdepth);
             if (!glyph) {
                 err = BadAlloc;
                 goto bail;
@@ -1149,8 +1152,6 @@ ProcRenderAddGlyphs(ClientPtr client)
                 FreeScratchPixmapHeader(pSrcPix);
                 pSrcPix = NULL;
             }
-
-            memcpy(glyph_new->glyph->sha1, glyph_new->sha1, 20);
         }
 
         glyph_new->id = gids[i];
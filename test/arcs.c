@@ -0,0 +1,208 @@
+/*
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "misc.h"
+#include "scrnintstr.h"
+#include "pixmapstr.h"
+#include "gcstruct.h"
+#include "mi.h"
+#include "fb.h"
+#include "tests-common.h"
+
+/*
+ * Wide arcs are kept by size and replayed wherever they're drawn next, so
+ * an arc drawn in one place must come out the same, moved, when drawn
+ * again somewhere else.  Random arcs of a few sizes are drawn at two
+ * places and the results compared.  With --bench, also prints the time
+ * per arc for whole circles, for partial arcs of a few sizes and for
+ * partial arcs of a different size each time, which never reuse
+ * anything.
+ */
+
+#define SIZE 256
+#define AREA 128
+#define ROUNDS 2000
+#define BENCH_ARCS 20000
+
+static ScreenRec screen;
+
+static int
+arc_count_pixels(PixmapPtr pixmap)
+{
+    CARD8 *bits = pixmap->devPrivate.ptr;
+    int i, n = 0;
+
+    for (i = 0; i < pixmap->devKind * SIZE; i++)
+        n += bits[i] != 0;
+    return n;
+}
+
+/* Whether b holds a's AREA x AREA corner moved by dx, dy, and no more */
+static Bool
+arc_same_moved(PixmapPtr a, PixmapPtr b, int dx, int dy)
+{
+    CARD8 *abits = a->devPrivate.ptr;
+    CARD8 *bbits = b->devPrivate.ptr;
+    int x, y;
+
+    for (y = 0; y < AREA; y++)
+        for (x = 0; x < AREA; x++)
+            if (abits[y * a->devKind + x] !=
+                bbits[(y + dy) * b->devKind + x + dx])
+                return FALSE;
+    return arc_count_pixels(a) == arc_count_pixels(b);
+}
+
+static GCPtr
+arc_make_gc(PixmapPtr pixmap)
+{
+    GCPtr gc = GetScratchGC(8, &screen);
+    ChangeGCVal vals[6];
+    unsigned char dashes[3];
+    int i;
+
+    assert(gc);
+    vals[0].val = 1;
+    vals[1].val = 2;
+    vals[2].val = 1 + rand() % 8;
+    vals[3].val = LineSolid + rand() % 3;
+    vals[4].val = CapButt + rand() % 3;
+    vals[5].val = JoinMiter + rand() % 3;
+    assert(ChangeGC(NullClient, gc, GCForeground | GCBackground |
+                    GCLineWidth | GCLineStyle | GCCapStyle | GCJoinStyle,
+                    vals) == Success);
+    for (i = 0; i < ARRAY_SIZE(dashes); i++)
+        dashes[i] = 1 + rand() % 10;
+    assert(SetDashes(gc, rand() % 10, ARRAY_SIZE(dashes), dashes) ==
+           Success);
+    ValidateGC(&pixmap->drawable, gc);
+    return gc;
+}
+
+static void
+arc_random(xArc *arcs, int n)
+{
+    static const CARD16 sizes[] = { 5, 8, 11, 16, 24, 33, 48 };
+    int i;
+
+    for (i = 0; i < n; i++) {
+        arcs[i].x = 16 + rand() % 32;
+        arcs[i].y = 16 + rand() % 32;
+        arcs[i].width = sizes[rand() % ARRAY_SIZE(sizes)];
+        arcs[i].height = rand() % 2 ? arcs[i].width :
+            sizes[rand() % ARRAY_SIZE(sizes)];
+        arcs[i].angle1 = (rand() % 8) * 45 * 64;
+        arcs[i].angle2 = rand() % 3 ? 360 * 64 : (rand() % 15 - 7) * 45 * 64;
+    }
+}
+
+static void
+arc_replay(void)
+{
+    PixmapPtr a = test_make_pixmap(&screen, SIZE, SIZE, 8, 8);
+    PixmapPtr b = test_make_pixmap(&screen, SIZE, SIZE, 8, 8);
+    xArc arcs[4], moved[4];
+    GCPtr gc;
+    int i, j, n, dx, dy;
+
+    for (i = 0; i < ROUNDS; i++) {
+        n = 1 + rand() % ARRAY_SIZE(arcs);
+        arc_random(arcs, n);
+        dx = rand() % (SIZE - AREA);
+        dy = rand() % (SIZE - AREA);
+        for (j = 0; j < n; j++) {
+            moved[j] = arcs[j];
+            moved[j].x += dx;
+            moved[j].y += dy;
+        }
+
+        gc = arc_make_gc(a);
+        test_clear_pixmap(a);
+        miPolyArc(&a->drawable, gc, n, arcs);
+        test_clear_pixmap(b);
+        miPolyArc(&b->drawable, gc, n, moved);
+        assert(arc_same_moved(a, b, dx, dy));
+        FreeScratchGC(gc);
+    }
+}
+
+static void
+arc_bench_one(PixmapPtr pixmap, GCPtr gc, const char *what,
+              int angle2, int sizes)
+{
+    uint64_t start, elapsed;
+    xArc arc;
+    int i;
+
+    start = now_ns();
+    for (i = 0; i < BENCH_ARCS; i++) {
+        arc.x = rand() % (SIZE - 80);
+        arc.y = rand() % (SIZE - 80);
+        arc.width = arc.height = 8 + i % sizes;
+        arc.angle1 = 0;
+        arc.angle2 = angle2;
+        miPolyArc(&pixmap->drawable, gc, 1, &arc);
+    }
+    elapsed = now_ns() - start;
+
+    printf("%-32s %6.2f us/arc\n", what, (double) elapsed / BENCH_ARCS / 1000);
+}
+
+static void
+arc_bench(void)
+{
+    PixmapPtr pixmap = test_make_pixmap(&screen, SIZE, SIZE, 8, 8);
+    GCPtr gc = GetScratchGC(8, &screen);
+    ChangeGCVal vals[2];
+
+    assert(gc);
+    vals[0].val = 1;
+    vals[1].val = 2;
+    assert(ChangeGC(NullClient, gc, GCForeground | GCLineWidth,
+                    vals) == Success);
+    ValidateGC(&pixmap->drawable, gc);
+
+    arc_bench_one(pixmap, gc, "circles, 4 sizes:", 360 * 64, 4);
+    arc_bench_one(pixmap, gc, "3/4 circles, 4 sizes:", 270 * 64, 4);
+    arc_bench_one(pixmap, gc, "3/4 circles, all sizes:", 270 * 64, 64);
+    FreeScratchGC(gc);
+}
+
+int
+main(int argc, char **argv)
+{
+    bench_init(argc, argv);
+    test_init_fb_screen(&screen);
+
+    arc_replay();
+    if (benchmarking)
+        arc_bench();
+
+    return 0;
+}
@@ -0,0 +1,395 @@
+/*
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "misc.h"
+#include "scrnintstr.h"
+#include "pixmapstr.h"
+#include "privates.h"
+#include "exa_priv.h"
+#include "tests-common.h"
+
+/*
+ * The classic EXA offscreen allocator under random allocations, frees and
+ * uses.  Every area is filled with its own byte, and after every operation
+ * the area list must still cover offscreen memory, every live area must be
+ * aligned and keep its bytes, including areas that a defragment step moved.
+ * With --bench, also prints the time to free and allocate a pixmap among
+ * thousands of small ones.
+ */
+
+#define OFFSCREEN_BASE (1 << 20)
+#define MAX_AREAS 16384
+#define ROUNDS 10000
+#define BENCH_OPS 20000
+
+typedef struct {
+    ExaOffscreenArea *area;
+    PixmapPtr pixmap;
+    int size;
+    CARD8 fill;
+} TestArea;
+
+static ScreenRec screen;
+static ExaScreenPrivRec exaScr;
+static ExaDriverRec driver;
+static CARD8 *memory;
+static TestArea areas[MAX_AREAS];
+static int nareas;
+static PixmapPtr copySrc;
+static Bool failCreate;
+
+static PixmapPtr
+exa_create_pixmap(ScreenPtr pScreen, int width, int height, int depth,
+                  unsigned usage_hint)
+{
+    PixmapPtr pixmap;
+
+    if (failCreate)
+        return NULL;
+    pixmap = dixAllocateScreenObjectWithPrivates(pScreen, PixmapRec,
+                                                 PRIVATE_PIXMAP);
+    assert(pixmap);
+    pixmap->drawable.pScreen = pScreen;
+    pixmap->refcnt = 1;
+    return pixmap;
+}
+
+static Bool
+exa_destroy_pixmap(PixmapPtr pixmap)
+{
+    dixFreeObjectWithPrivates(pixmap, PRIVATE_PIXMAP);
+    return TRUE;
+}
+
+static Bool
+exa_prepare_copy(PixmapPtr src, PixmapPtr dst, int dx, int dy, int alu,
+                 Pixel planemask)
+{
+    copySrc = src;
+    return TRUE;
+}
+
+static void
+exa_copy(PixmapPtr dst, int srcX, int srcY, int dstX, int dstY,
+         int width, int height)
+{
+    memmove(ExaGetPixmapPriv(dst)->fb_ptr, ExaGetPixmapPriv(copySrc)->fb_ptr,
+            dst->devKind * height);
+}
+
+static void
+exa_done_copy(PixmapPtr dst)
+{
+}
+
+static void
+exa_setup_screen(void)
+{
+    test_init_screen(&screen);
+    screen.CreatePixmap = exa_create_pixmap;
+    screen.DestroyPixmap = exa_destroy_pixmap;
+
+    assert(dixRegisterPrivateKey(&exaScreenPrivateKeyRec, PRIVATE_SCREEN, 0));
+    test_init_screen_privates(&screen);
+    assert(dixRegisterScreenSpecificPrivateKey(&screen,
+                                               &exaScr.pixmapPrivateKeyRec,
+                                               PRIVATE_PIXMAP,
+                                               sizeof(ExaPixmapPrivRec)));
+    dixSetPrivate(&screen.devPrivates, exaScreenPrivateKey, &exaScr);
+
+    driver.offScreenBase = OFFSCREEN_BASE;
+    driver.flags = EXA_OFFSCREEN_PIXMAPS | EXA_SUPPORTS_OFFSCREEN_OVERLAPS;
+    driver.PrepareCopy = exa_prepare_copy;
+    driver.Copy = exa_copy;
+    driver.DoneCopy = exa_done_copy;
+    exaScr.info = &driver;
+}
+
+static void
+exa_init_offscreen(int memorySize)
+{
+    /* offsets and pointers into memory line up the same way */
+    free(memory);
+    memory = malloc(memorySize + 4096);
+    assert(memory);
+    driver.memoryBase = (CARD8 *) (((uintptr_t) memory + 4095) & ~4095);
+    driver.memorySize = memorySize;
+
+    nareas = 0;
+    assert(exaOffscreenInit(&screen));
+}
+
+static void
+exa_forget_area(int i)
+{
+    areas[i] = areas[--nareas];
+    if (areas[i].pixmap)
+        areas[i].pixmap->drawable.serialNumber = i;
+}
+
+/* Evicted areas are forgotten the same way as freed ones */
+static void
+exa_evict(ScreenPtr pScreen, ExaOffscreenArea *area)
+{
+    int i;
+
+    assert(area->state == ExaOffscreenRemovable);
+    for (i = 0; i < nareas; i++)
+        if (areas[i].area == area)
+            break;
+    assert(i < nareas);
+    if (areas[i].pixmap)
+        exa_destroy_pixmap(areas[i].pixmap);
+    exa_forget_area(i);
+}
+
+static Bool
+exa_alloc(int size, int align, Bool locked, Bool pixmap)
+{
+    ExaOffscreenArea *area;
+    TestArea *t;
+
+    if (nareas == MAX_AREAS)
+        return FALSE;
+    if (pixmap)
+        size = (size + 255) & ~255;
+    area = exaOffscreenAlloc(&screen, size, align, locked, exa_evict, NULL);
+    if (!area)
+        return FALSE;
+
+    t = &areas[nareas];
+    t->area = area;
+    t->size = size;
+    t->fill = rand();
+    t->pixmap = NULL;
+    memset(driver.memoryBase + area->offset, t->fill, size);
+
+    /* Pixmaps can be moved by defragmenting */
+    if (pixmap) {
+        ExaPixmapPrivPtr pExaPixmap;
+
+        t->pixmap = exa_create_pixmap(&screen, 0, 0, 0, 0);
+        t->pixmap->drawable.width = 256;
+        t->pixmap->drawable.height = size / 256;
+        t->pixmap->drawable.bitsPerPixel = 8;
+        t->pixmap->drawable.depth = 8;
+        t->pixmap->drawable.serialNumber = nareas;
+        t->pixmap->devKind = 256;
+        pExaPixmap = ExaGetPixmapPriv(t->pixmap);
+        pExaPixmap->fb_ptr = driver.memoryBase + area->offset;
+        pExaPixmap->fb_pitch = 256;
+        pExaPixmap->area = area;
+        area->save = exaPixmapSave;
+        area->privData = t->pixmap;
+    }
+    nareas++;
+    return TRUE;
+}
+
+static void
+exa_free(int i)
+{
+    exaOffscreenFree(&screen, areas[i].area);
+    if (areas[i].pixmap)
+        exa_destroy_pixmap(areas[i].pixmap);
+    exa_forget_area(i);
+}
+
+static void
+exa_check(void)
+{
+    ExaOffscreenArea *area, *prev = NULL;
+    unsigned avail = 0;
+    int i;
+
+    for (area = driver.offScreenAreas; area; area = area->next) {
+        assert(area->base_offset ==
+               (prev ? prev->base_offset + prev->size : OFFSCREEN_BASE));
+        if (area->state == ExaOffscreenAvail) {
+            /* free neighbours are always merged */
+            assert(!prev || prev->state != ExaOffscreenAvail);
+            avail++;
+        }
+        prev = area;
+    }
+    assert(prev->base_offset + prev->size == driver.memorySize);
+    assert(avail == exaScr.numOffscreenAvailable);
+
+    for (i = 0; i < nareas; i++) {
+        TestArea *t = &areas[i];
+        CARD8 *bits = driver.memoryBase + t->area->offset;
+
+        assert(t->area->state != ExaOffscreenAvail);
+        assert(t->area->offset % t->area->align == 0);
+        assert(t->area->offset >= t->area->base_offset);
+        assert(t->area->offset + t->size <=
+               t->area->base_offset + t->area->size);
+        if (t->pixmap)
+            assert(ExaGetPixmapPriv(t->pixmap)->fb_ptr == bits);
+        assert(bits[0] == t->fill);
+        assert(memcmp(bits, bits + 1, t->size - 1) == 0);
+    }
+}
+
+static int
+exa_random_size(void)
+{
+    switch (rand() % 8) {
+    case 0:
+        return 65536 + rand() % (1 << 20);
+    case 1:
+    case 2:
+        return 4096 + rand() % 65536;
+    default:
+        return 1 + rand() % 8192;
+    }
+}
+
+static void
+exa_use(void)
+{
+    if (nareas)
+        areas[rand() % nareas].area->last_use = exaScr.offScreenCounter++;
+}
+
+/* Not enough memory for everything, so areas get evicted */
+static void
+exa_evictions(void)
+{
+    int aligns[] = { 1, 4, 64, 256, 4096 };
+    int i;
+
+    exa_init_offscreen(OFFSCREEN_BASE + (4 << 20));
+
+    for (i = 0; i < ROUNDS; i++) {
+        int op = rand() % 10;
+
+        if (op < 5 || !nareas)
+            exa_alloc(exa_random_size(), aligns[rand() % ARRAY_SIZE(aligns)],
+                      rand() % 50 == 0, FALSE);
+        else if (op < 8)
+            exa_free(rand() % nareas);
+        else
+            exa_use();
+        if (i % 16 == 0)
+            exa_check();
+    }
+    exa_check();
+
+    ExaOffscreenFini(&screen);
+}
+
+/* Room for everything, pixmaps move around to make larger free areas */
+static void
+exa_defragment(void)
+{
+    int i;
+
+    exa_init_offscreen(OFFSCREEN_BASE + (16 << 20));
+
+    for (i = 0; i < ROUNDS; i++) {
+        int op = rand() % 20;
+
+        if ((op < 9 && nareas < 200) || !nareas)
+            assert(exa_alloc(exa_random_size() / 4 + 1, 64, FALSE, TRUE));
+        else if (op < 17)
+            exa_free(rand() % nareas);
+        else if (op < 19)
+            ExaOffscreenDefragment(&screen, 1);
+        else {
+            ExaOffscreenArea *area;
+
+            /* Finish the pass a step may have started, then in a whole new
+             * pass nothing stops pixmaps all moving to the end, short of
+             * what aligning them loses
+             */
+            assert(ExaOffscreenDefragment(&screen, 0));
+            assert(ExaOffscreenDefragment(&screen, 0));
+            assert(driver.offScreenAreas->state == ExaOffscreenAvail);
+            for (area = driver.offScreenAreas->next; area; area = area->next)
+                assert(area->state != ExaOffscreenAvail || area->size < 64);
+        }
+        if (i % 8 == 0 || op >= 17)
+            exa_check();
+    }
+
+    /* A pass which can't get its scratch pixmap is dropped, not retried
+     * at every block handler
+     */
+    exaScr.defragArea = driver.offScreenAreas->prev;
+    failCreate = TRUE;
+    assert(!ExaOffscreenDefragment(&screen, 1));
+    assert(exaScr.defragArea == NULL);
+    failCreate = FALSE;
+    exa_check();
+
+    while (nareas)
+        exa_free(0);
+    ExaOffscreenFini(&screen);
+}
+
+static void
+exa_bench(void)
+{
+    uint64_t start, elapsed;
+    int i;
+
+    exa_init_offscreen(OFFSCREEN_BASE + (64 << 20));
+
+    while (nareas < 12000 && exa_alloc(1 + rand() % 8192, 64, FALSE, FALSE))
+        ;
+
+    start = now_ns();
+    for (i = 0; i < BENCH_OPS; i++) {
+        exa_free(rand() % nareas);
+        exa_alloc(1 + rand() % 8192, 64, FALSE, FALSE);
+        exa_use();
+    }
+    elapsed = now_ns() - start;
+    exa_check();
+
+    printf("%d areas: %6.2f us per free and alloc\n", nareas,
+           (double) elapsed / BENCH_OPS / 1000);
+
+    ExaOffscreenFini(&screen);
+}
+
+int
+main(int argc, char **argv)
+{
+    bench_init(argc, argv);
+    exa_setup_screen();
+
+    exa_evictions();
+    exa_defragment();
+    if (benchmarking)
+        exa_bench();
+
+    return 0;
+}
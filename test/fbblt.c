@@ -0,0 +1,314 @@
+/*
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "misc.h"
+#include "fb.h"
+#include "tests-common.h"
+
+/*
+ * fbBlt hands the middle of long rows to SSE2 or AVX2 code when the CPU
+ * has it.  Every raster op, plane mask, depth and alignment must give the
+ * same pixels as the scalar code, both between two pictures and within
+ * one picture where source and destination overlap.  fbBltOne does the
+ * same for whole stipple words, which must expand exactly like the
+ * stipple tables, opaque and transparent.  With --bench, also prints the
+ * throughput of the scalar and vector code for a few common copies and
+ * expansions.
+ */
+
+#define WIDTH 307                       /* pixels */
+#define HEIGHT 41
+#define STRIDE ((WIDTH * 32 + 64) / FB_UNIT)
+#define ROUNDS 4000
+
+static FbBits src[STRIDE * HEIGHT];
+static FbBits serial[STRIDE * HEIGHT];
+static FbBits vector[STRIDE * HEIGHT];
+
+static const int depths[] = { 8, 16, 24, 32 };
+
+static void
+fb_random_bits(FbBits *bits, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        bits[i] = ((FbBits) rand() << 16) ^ rand();
+}
+
+static FbBits
+fb_random_pm(int bpp)
+{
+    if (rand() % 2)
+        return FB_ALLONES;
+    return fbReplicatePixel(((Pixel) rand() << 16) ^ rand(), bpp);
+}
+
+/* Draw one blt with the scalar code into serial and with simd into vector */
+static void
+fb_blt_test(int simd, Bool overlap)
+{
+    int bpp = depths[rand() % ARRAY_SIZE(depths)];
+    int pixels = WIDTH * 32 / bpp;
+    int width = 1 + rand() % pixels;
+    int height = 1 + rand() % HEIGHT;
+    int dstX = rand() % (pixels - width + 1);
+    int dstY = rand() % (HEIGHT - height + 1);
+    int srcX = rand() % (pixels - width + 1);
+    int srcY = rand() % (HEIGHT - height + 1);
+    int alu = rand() % 16;
+    FbBits pm = fb_random_pm(bpp);
+    Bool reverse = FALSE, upsidedown = FALSE;
+    FbBits *s;
+
+    if (overlap) {
+        /* stay near the source, like a scroll */
+        dstX = srcX + rand() % 65 - 32;
+        dstY = srcY + rand() % 5 - 2;
+        if (dstX < 0 || dstX + width > pixels ||
+            dstY < 0 || dstY + height > HEIGHT)
+            return;
+        reverse = srcX < dstX;
+        upsidedown = srcY < dstY;
+    }
+
+    fb_random_bits(serial, ARRAY_SIZE(serial));
+    memcpy(vector, serial, sizeof(serial));
+
+    s = overlap ? serial : src;
+    fbSimd = FB_SIMD_NONE;
+    fbBlt(s + srcY * STRIDE, STRIDE, srcX * bpp,
+          serial + dstY * STRIDE, STRIDE, dstX * bpp,
+          width * bpp, height, alu, pm, bpp, reverse, upsidedown);
+
+    s = overlap ? vector : src;
+    fbSimd = simd;
+    fbBlt(s + srcY * STRIDE, STRIDE, srcX * bpp,
+          vector + dstY * STRIDE, STRIDE, dstX * bpp,
+          width * bpp, height, alu, pm, bpp, reverse, upsidedown);
+
+    if (memcmp(serial, vector, sizeof(serial)) != 0) {
+        fprintf(stderr, "simd %d bpp %d alu %d pm %08x %s: "
+                "%dx%d from %d,%d to %d,%d\n", simd, bpp, alu, pm,
+                overlap ? "overlapping" : "disjoint",
+                width, height, srcX, srcY, dstX, dstY);
+        assert(0);
+    }
+}
+
+static const int one_depths[] = { 8, 16, 32 };
+
+/* Expand src as a stipple with the scalar code into serial and simd into vector */
+static void
+fb_blt_one_test(int simd)
+{
+    int bpp = one_depths[rand() % ARRAY_SIZE(one_depths)];
+    int pixels = WIDTH * 32 / bpp;
+    int width = 1 + rand() % pixels;
+    int height = 1 + rand() % HEIGHT;
+    int dstX = rand() % (pixels - width + 1);
+    int dstY = rand() % (HEIGHT - height + 1);
+    int srcX = rand() % (STRIDE * FB_UNIT - width + 1);
+    int alu = rand() % 16;
+    FbBits pm = fb_random_pm(bpp);
+    FbBits fg = fbReplicatePixel(rand(), bpp);
+    FbBits bg = fbReplicatePixel(rand(), bpp);
+    Bool opaque = rand() % 2;
+    FbBits fgand, fgxor, bgand, bgxor;
+
+    /* a run of blank words now and then, as text has */
+    fb_random_bits(src, ARRAY_SIZE(src));
+    if (rand() % 2)
+        memset(src + rand() % (ARRAY_SIZE(src) / 2), 0,
+               ARRAY_SIZE(src) / 2 * sizeof(FbBits));
+
+    fgand = fbAnd(alu, fg, pm);
+    fgxor = fbXor(alu, fg, pm);
+    if (opaque) {
+        bgand = fbAnd(alu, bg, pm);
+        bgxor = fbXor(alu, bg, pm);
+    }
+    else {
+        bgand = fbAnd(GXnoop, (FbBits) 0, FB_ALLONES);
+        bgxor = fbXor(GXnoop, (FbBits) 0, FB_ALLONES);
+    }
+
+    fb_random_bits(serial, ARRAY_SIZE(serial));
+    memcpy(vector, serial, sizeof(serial));
+
+    fbSimd = FB_SIMD_NONE;
+    fbBltOne((FbStip *) src, STRIDE, srcX,
+             serial + dstY * STRIDE, STRIDE, dstX * bpp, bpp,
+             width * bpp, height, fgand, fgxor, bgand, bgxor);
+
+    fbSimd = simd;
+    fbBltOne((FbStip *) src, STRIDE, srcX,
+             vector + dstY * STRIDE, STRIDE, dstX * bpp, bpp,
+             width * bpp, height, fgand, fgxor, bgand, bgxor);
+
+    if (memcmp(serial, vector, sizeof(serial)) != 0) {
+        fprintf(stderr, "simd %d bpp %d alu %d pm %08x %s stipple: "
+                "%dx%d from %d to %d,%d\n", simd, bpp, alu, pm,
+                opaque ? "opaque" : "transparent",
+                width, height, srcX, dstX, dstY);
+        assert(0);
+    }
+}
+
+#define BENCH_WIDTH 1024                /* pixels */
+#define BENCH_HEIGHT 256
+#define BENCH_STRIDE ((BENCH_WIDTH * 32 + 64) / FB_UNIT)
+#define BENCH_BYTES (64 << 20)
+
+static const struct {
+    const char *name;
+    int srcX, dstX;
+    Bool overlap;
+} bench_cases[] = {
+    { "aligned", 0, 0, FALSE },
+    { "src +1", 1, 0, FALSE },
+    { "dst +1", 0, 1, FALSE },
+    { "scroll right", 0, 1, TRUE },
+    { "scroll left", 1, 0, TRUE },
+};
+
+static double
+fb_blt_bench_one(FbBits *from, FbBits *to, int bpp, int alu,
+                 int srcX, int dstX, Bool reverse)
+{
+    int width = BENCH_WIDTH - 1;
+    int rows = BENCH_BYTES / (width * bpp / 8);
+    uint64_t start = now_ns();
+    int y;
+
+    for (y = 0; y < rows; y += BENCH_HEIGHT)
+        fbBlt(from, BENCH_STRIDE, srcX * bpp, to, BENCH_STRIDE, dstX * bpp,
+              width * bpp, BENCH_HEIGHT, alu, FB_ALLONES, bpp, reverse, FALSE);
+
+    return (double) (y * (width * bpp / 8)) / (now_ns() - start) * 1e3;
+}
+
+static double
+fb_blt_one_bench_one(FbStip *from, FbBits *to, int bpp, Bool opaque)
+{
+    int width = BENCH_WIDTH - 1;
+    int rows = BENCH_BYTES / (width * bpp / 8);
+    FbBits fg = fbReplicatePixel(0x123456, bpp);
+    FbBits bg = fbReplicatePixel(0x654321, bpp);
+    uint64_t start = now_ns();
+    int y;
+
+    for (y = 0; y < rows; y += BENCH_HEIGHT) {
+        if (opaque)
+            fbBltOne(from, BENCH_STRIDE, 0, to, BENCH_STRIDE, bpp, bpp,
+                     width * bpp, BENCH_HEIGHT, 0, fg, 0, bg);
+        else
+            fbBltOne(from, BENCH_STRIDE, 0, to, BENCH_STRIDE, bpp, bpp,
+                     width * bpp, BENCH_HEIGHT, 0, fg, FB_ALLONES, 0);
+    }
+
+    return (double) (y * (width * bpp / 8)) / (now_ns() - start) * 1e3;
+}
+
+static void
+fb_blt_bench(void)
+{
+    static const char *simd_names[] = { "scalar", "sse2", "avx2" };
+    static const int alus[] = { GXcopy, GXxor };
+    FbBits *from = calloc(BENCH_STRIDE * BENCH_HEIGHT, sizeof(FbBits));
+    FbBits *to = calloc(BENCH_STRIDE * BENCH_HEIGHT, sizeof(FbBits));
+    int best = fbProbeSimd();
+    int d, a, c, simd;
+
+    assert(from && to);
+    for (d = 0; d < ARRAY_SIZE(depths); d++) {
+        for (a = 0; a < ARRAY_SIZE(alus); a++) {
+            for (c = 0; c < ARRAY_SIZE(bench_cases); c++) {
+                printf("%2dbpp %-6s %-12s", depths[d],
+                       alus[a] == GXcopy ? "GXcopy" : "GXxor",
+                       bench_cases[c].name);
+                for (simd = FB_SIMD_NONE; simd <= best; simd++) {
+                    fbSimd = simd;
+                    printf(" %s %6.0f MB/s", simd_names[simd],
+                           fb_blt_bench_one(from,
+                                            bench_cases[c].overlap ? from : to,
+                                            depths[d], alus[a],
+                                            bench_cases[c].srcX,
+                                            bench_cases[c].dstX,
+                                            bench_cases[c].overlap &&
+                                            bench_cases[c].srcX <
+                                            bench_cases[c].dstX));
+                }
+                printf("\n");
+            }
+        }
+    }
+
+    /* stipple bits as busy as text */
+    for (c = 0; c < BENCH_STRIDE * BENCH_HEIGHT; c++)
+        from[c] = (c * 0x9e3779b9) & 0x3c3c3c3c;
+    for (d = 0; d < ARRAY_SIZE(one_depths); d++) {
+        for (a = 0; a < 2; a++) {
+            printf("%2dbpp %-19s", one_depths[d],
+                   a ? "opaque stipple" : "transparent stipple");
+            for (simd = FB_SIMD_NONE; simd <= best; simd++) {
+                fbSimd = simd;
+                printf(" %s %6.0f MB/s", simd_names[simd],
+                       fb_blt_one_bench_one((FbStip *) from, to,
+                                            one_depths[d], a));
+            }
+            printf("\n");
+        }
+    }
+    fbSimd = best;
+    free(from);
+    free(to);
+}
+
+int
+main(int argc, char **argv)
+{
+    int best = fbProbeSimd();
+    int simd, i;
+
+    bench_init(argc, argv);
+    fb_random_bits(src, ARRAY_SIZE(src));
+    for (simd = FB_SIMD_NONE; simd <= best; simd++) {
+        for (i = 0; i < ROUNDS; i++) {
+            fb_blt_test(simd, FALSE);
+            fb_blt_test(simd, TRUE);
+            fb_blt_one_test(simd);
+        }
+    }
+
+    if (benchmarking)
+        fb_blt_bench();
+
+    return 0;
+}
@@ -0,0 +1,333 @@
+/*
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "misc.h"
+#include "scrnintstr.h"
+#include "pixmapstr.h"
+#include "picturestr.h"
+#include "glyphstr.h"
+#include "fb.h"
+#include "fbpict.h"
+#include "tests-common.h"
+
+/*
+ * fbGlyphs keeps runs of glyphs it has drawn before, positioned relative
+ * to where the run starts.  Drawing a run, the first time or again
+ * anywhere else, must give the same pixels as compositing its glyphs one
+ * by one, including runs split in several lists, runs with glyphs that
+ * have no picture and runs that were cached before fb had to start its
+ * glyph cache over.  Then again with a glyph cache too small for all the
+ * glyphs, which must stay within its limit.  With --bench, also prints
+ * the time per glyph for redrawing the lines of a terminal.
+ */
+
+#define WIDTH 301
+#define HEIGHT 97
+#define FONT_GLYPHS 96
+#define MANY_GLYPHS (35 * 250)
+#define NUM_GLYPHS (FONT_GLYPHS + 2 * MANY_GLYPHS)
+#define ROUNDS 500
+#define MAX_RUN 120
+
+static ScreenRec screen;
+static GlyphPtr glyphs[NUM_GLYPHS];
+
+static PictFormatRec formats[] = {
+    { .format = PICT_x8r8g8b8, .depth = 24 },
+    { .format = PICT_a8r8g8b8, .depth = 32 },
+    { .format = PICT_a8, .depth = 8 },
+};
+
+static uint64_t
+fb_glyph_statistic(const char *name)
+{
+    ServerStatisticsPtr stats = CollectServerStatistics();
+    uint64_t value = 0;
+    int i;
+
+    assert(stats);
+    for (i = 0; i < stats->num; i++)
+        if (strcmp(stats->stats[i].name, name) == 0)
+            value = stats->stats[i].value;
+    FreeServerStatistics(stats);
+    return value;
+}
+
+static void
+fb_make_glyphs(void)
+{
+    int i;
+
+    for (i = 0; i < NUM_GLYPHS; i++) {
+        GlyphPtr glyph = calloc(1, sizeof(GlyphRec) + sizeof(PicturePtr));
+        int width = 1 + rand() % 9, height = 1 + rand() % 13;
+
+        assert(glyph);
+        glyph->refcnt = 1;
+        glyph->info.width = width;
+        glyph->info.height = height;
+        glyph->info.x = rand() % 3 - 1;
+        glyph->info.y = height - rand() % 3;
+        glyph->info.xOff = width + rand() % 2;
+        glyph->info.yOff = rand() % 8 ? 0 : rand() % 3 - 1;
+        /* a few glyphs never got a picture */
+        if (rand() % 50) {
+            PixmapPtr pixmap = test_make_pixmap(&screen, width, height, 8, 8);
+
+            test_random_pixmap(pixmap);
+            GlyphPicture(glyph)[0] = test_make_picture(pixmap, &formats[2], 0);
+        }
+        glyphs[i] = glyph;
+    }
+}
+
+typedef struct {
+    int nlist;
+    GlyphListRec list[4];
+    GlyphPtr glyphs[MAX_RUN];
+} Run;
+
+static void
+fb_random_run(Run *run, int first, int count)
+{
+    int i, n = 0;
+
+    run->nlist = 1 + rand() % 4;
+    for (i = 0; i < run->nlist; i++) {
+        run->list[i].xOff = rand() % 40 - 5;
+        run->list[i].yOff = rand() % 20 - 5;
+        run->list[i].len = rand() % (MAX_RUN / 4);
+        run->list[i].format = NULL;
+        n += run->list[i].len;
+    }
+    for (i = 0; i < n; i++)
+        run->glyphs[i] = glyphs[first + rand() % count];
+}
+
+static void
+fb_draw_run(Run *run, PicturePtr src, PicturePtr dst, PictFormatPtr mask,
+            int x, int y)
+{
+    INT16 xOff = run->list[0].xOff, yOff = run->list[0].yOff;
+
+    run->list[0].xOff += x;
+    run->list[0].yOff += y;
+    fbGlyphs(PictOpOver, src, dst, mask, 3, 7, run->nlist, run->list,
+             run->glyphs);
+    run->list[0].xOff = xOff;
+    run->list[0].yOff = yOff;
+}
+
+/*
+ * The same run, a glyph at a time, the way miGlyphs draws it: each glyph
+ * added into a mask covering them all, or straight to the destination
+ * without one.
+ */
+static void
+fb_reference_run(Run *run, PicturePtr src, PicturePtr dst,
+                 PictFormatPtr mask, int x, int y)
+{
+    int xDst = run->list[0].xOff + x, yDst = run->list[0].yOff + y;
+    int gx[MAX_RUN], gy[MAX_RUN];
+    BoxRec extents = { MAXSHORT, MAXSHORT, MINSHORT, MINSHORT };
+    PicturePtr pMask = NULL;
+    PixmapPtr maskPixmap = NULL;
+    GlyphPtr glyph;
+    int i, n, cx = x, cy = y;
+
+    for (i = 0, n = 0; i < run->nlist; i++) {
+        int len = run->list[i].len;
+
+        cx += run->list[i].xOff;
+        cy += run->list[i].yOff;
+        while (len--) {
+            glyph = run->glyphs[n];
+            gx[n] = cx - glyph->info.x;
+            gy[n] = cy - glyph->info.y;
+            if (GlyphPicture(glyph)[0]) {
+                extents.x1 = min(extents.x1, gx[n]);
+                extents.y1 = min(extents.y1, gy[n]);
+                extents.x2 = max(extents.x2, gx[n] + glyph->info.width);
+                extents.y2 = max(extents.y2, gy[n] + glyph->info.height);
+            }
+            cx += glyph->info.xOff;
+            cy += glyph->info.yOff;
+            n++;
+        }
+    }
+    if (extents.x1 >= extents.x2)
+        return;
+
+    if (mask) {
+        maskPixmap = test_make_pixmap(&screen, extents.x2 - extents.x1,
+                                      extents.y2 - extents.y1, 8, 8);
+        pMask = test_make_picture(maskPixmap, mask, 0);
+    }
+
+    for (i = 0; i < n; i++) {
+        PicturePtr pGlyph = GlyphPicture(run->glyphs[i])[0];
+
+        if (!pGlyph)
+            continue;
+        glyph = run->glyphs[i];
+        if (pMask)
+            fbComposite(PictOpAdd, pGlyph, NULL, pMask, 0, 0, 0, 0,
+                        gx[i] - extents.x1, gy[i] - extents.y1,
+                        glyph->info.width, glyph->info.height);
+        else
+            fbComposite(PictOpOver, src, pGlyph, dst,
+                        3 + gx[i] - xDst, 7 + gy[i] - yDst, 0, 0,
+                        gx[i], gy[i], glyph->info.width, glyph->info.height);
+    }
+
+    if (pMask) {
+        fbComposite(PictOpOver, src, pMask, dst,
+                    3 + extents.x1 - xDst, 7 + extents.y1 - yDst, 0, 0,
+                    extents.x1, extents.y1,
+                    extents.x2 - extents.x1, extents.y2 - extents.y1);
+        test_free_picture(pMask);
+        test_free_pixmap(maskPixmap);
+    }
+}
+
+static void
+fb_glyph_runs(unsigned long limit)
+{
+    PixmapPtr src = test_make_pixmap(&screen, 23, 19, 32, 32);
+    PixmapPtr drawn = test_make_pixmap(&screen, WIDTH, HEIGHT, 24, 32);
+    PixmapPtr reference = test_make_pixmap(&screen, WIDTH, HEIGHT, 24, 32);
+    PicturePtr pSrc = test_make_picture(src, &formats[1], RepeatNormal);
+    PicturePtr pDrawn = test_make_picture(drawn, &formats[0], RepeatNone);
+    PicturePtr pReference = test_make_picture(reference, &formats[0],
+                                              RepeatNone);
+    static Run runs[16];
+    GlyphListRec lists[MANY_GLYPHS / 250];
+    PictFormatPtr mask;
+    int i, j, x, y;
+
+    GlyphCacheLimit = limit;
+    test_random_pixmap(src);
+    test_random_pixmap(drawn);
+    test_copy_pixmap(reference, drawn);
+
+    for (i = 0; i < ARRAY_SIZE(runs); i++)
+        fb_random_run(&runs[i], 0, FONT_GLYPHS);
+
+    for (i = 0; i < ROUNDS; i++) {
+        Run *run = &runs[rand() % ARRAY_SIZE(runs)];
+
+        /* now and then, a run of glyphs not seen before */
+        if (i % 10 == 9)
+            fb_random_run(run, FONT_GLYPHS + rand() % (NUM_GLYPHS - MAX_RUN -
+                                                       FONT_GLYPHS),
+                          MAX_RUN);
+
+        x = rand() % WIDTH - 20;
+        y = rand() % HEIGHT;
+        mask = rand() % 2 ? &formats[2] : NULL;
+        fb_draw_run(run, pSrc, pDrawn, mask, x, y);
+        fb_reference_run(run, pSrc, pReference, mask, x, y);
+        assert(test_same_pixmap(drawn, reference));
+        assert(fb_glyph_statistic("fb.0.glyphs.bytes") <= limit);
+
+        /* or with nothing cached at all */
+        if (i % 200 == 0)
+            fbDestroyGlyphCache();
+
+        /* and every so often, many new glyphs at once */
+        if (i % 100 == 50) {
+            for (j = 0; j < ARRAY_SIZE(lists); j++) {
+                lists[j].xOff = j ? -250 * 4 : 0;
+                lists[j].yOff = j ? 3 : 0;
+                lists[j].len = 250;
+                lists[j].format = NULL;
+            }
+            fbGlyphs(PictOpOver, pSrc, pDrawn, NULL, 0, 0, ARRAY_SIZE(lists),
+                     lists, glyphs + FONT_GLYPHS + i / 100 % 2 * MANY_GLYPHS);
+            test_copy_pixmap(reference, drawn);
+        }
+    }
+
+    assert(fb_glyph_statistic("fb.0.glyphs.runs.hit") > 0);
+}
+
+#define LINES 40
+#define COLUMNS 80
+#define REDRAWS 50
+
+static void
+fb_glyph_bench(void)
+{
+    PixmapPtr src = test_make_pixmap(&screen, 1, 1, 32, 32);
+    PixmapPtr dst = test_make_pixmap(&screen, COLUMNS * 10, LINES * 14, 24, 32);
+    PicturePtr pSrc = test_make_picture(src, &formats[1], RepeatNormal);
+    PicturePtr pDst = test_make_picture(dst, &formats[0], RepeatNone);
+    static GlyphPtr line[LINES][COLUMNS];
+    GlyphListRec list;
+    uint64_t start, elapsed;
+    int i, j;
+
+    test_random_pixmap(src);
+    for (i = 0; i < LINES; i++)
+        for (j = 0; j < COLUMNS; j++)
+            line[i][j] = glyphs[rand() % FONT_GLYPHS];
+
+    list.len = COLUMNS;
+    list.format = NULL;
+    start = now_ns();
+    for (i = 0; i < REDRAWS * LINES; i++) {
+        list.xOff = 0;
+        list.yOff = 14 * (i % LINES) + 12;
+        fbGlyphs(PictOpOver, pSrc, pDst, &formats[2], 0, 0, 1, &list,
+                 line[(i + i / LINES) % LINES]);
+    }
+    elapsed = now_ns() - start;
+
+    printf("%d lines of %d glyphs: %.1f ns per glyph\n", LINES, COLUMNS,
+           (double) elapsed / (REDRAWS * LINES * COLUMNS));
+}
+
+int
+main(int argc, char **argv)
+{
+    unsigned long limit = GlyphCacheLimit;
+
+    bench_init(argc, argv);
+    test_init_fb_screen(&screen);
+
+    fb_make_glyphs();
+    fb_glyph_runs(limit);
+    fb_glyph_runs(16 << 10);
+    assert(fb_glyph_statistic("fb.0.glyphs.evicted") > 0);
+    GlyphCacheLimit = limit;
+    if (benchmarking)
+        fb_glyph_bench();
+
+    return 0;
+}
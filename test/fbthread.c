@@ -0,0 +1,335 @@
+/*
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "misc.h"
+#include "scrnintstr.h"
+#include "pixmapstr.h"
+#include "gcstruct.h"
+#include "picturestr.h"
+#include "damage.h"
+#include "fb.h"
+#include "fbpict.h"
+#include "tests-common.h"
+
+/*
+ * Fills, copies and trapezoids split across fb's worker threads must give
+ * exactly the same pixels as the serial code.  Every operation is run on
+ * two copies of the same random picture, once on the calling thread only
+ * and once with every operation split into bands, and the results
+ * compared.  Trapezoids and triangles are also drawn to a picture away
+ * from the origin of its pixmap, the way a window is.
+ */
+
+#define WIDTH 317
+#define HEIGHT 263
+#define THREADS 3
+#define ROUNDS 50
+
+static ScreenRec screen;
+
+static GCPtr
+fb_make_gc(PixmapPtr dst, int alu, int fillStyle, PixmapPtr pattern)
+{
+    GCPtr gc = GetScratchGC(dst->drawable.depth, &screen);
+    ChangeGCVal vals[5];
+    BITS32 mask = GCFunction | GCForeground | GCBackground | GCFillStyle;
+
+    assert(gc);
+    vals[0].val = alu;
+    vals[1].val = rand();
+    vals[2].val = rand();
+    vals[3].val = fillStyle;
+    if (fillStyle == FillTiled) {
+        vals[4].ptr = pattern;
+        mask |= GCTile;
+    }
+    else if (fillStyle != FillSolid) {
+        vals[4].ptr = pattern;
+        mask |= GCStipple;
+    }
+    assert(ChangeGC(NullClient, gc, mask, vals) == Success);
+    gc->patOrg.x = rand() % 16;
+    gc->patOrg.y = rand() % 16;
+
+    ValidateGC(&dst->drawable, gc);
+    return gc;
+}
+
+static void
+fb_random_box(BoxPtr box, int maxWidth, int maxHeight)
+{
+    box->x1 = rand() % maxWidth;
+    box->y1 = rand() % maxHeight;
+    box->x2 = box->x1 + 1 + rand() % (maxWidth - box->x1);
+    box->y2 = box->y1 + 1 + rand() % (maxHeight - box->y1);
+}
+
+static void
+fb_set_threads(Bool threaded)
+{
+    fbThreads = threaded ? THREADS : 0;
+    fbThreadPixels = 1;
+}
+
+static void
+fb_fill_test(PixmapPtr serial, PixmapPtr threaded, GCPtr gc)
+{
+    BoxRec box;
+    int i;
+
+    for (i = 0; i < ROUNDS; i++) {
+        fb_random_box(&box, WIDTH, HEIGHT);
+
+        fb_set_threads(FALSE);
+        fbFill(&serial->drawable, gc, box.x1, box.y1,
+               box.x2 - box.x1, box.y2 - box.y1);
+        fb_set_threads(TRUE);
+        fbFill(&threaded->drawable, gc, box.x1, box.y1,
+               box.x2 - box.x1, box.y2 - box.y1);
+        assert(test_same_pixmap(serial, threaded));
+    }
+}
+
+static void
+fb_fill(void)
+{
+    PixmapPtr serial = test_make_pixmap(&screen, WIDTH, HEIGHT, 24, 32);
+    PixmapPtr threaded = test_make_pixmap(&screen, WIDTH, HEIGHT, 24, 32);
+    PixmapPtr tile = test_make_pixmap(&screen, 7, 5, 24, 32);
+    PixmapPtr stipple = test_make_pixmap(&screen, 13, 11, 1, 1);
+    int alus[] = { GXcopy, GXxor, GXand, GXinvert };
+    int i;
+
+    test_random_pixmap(serial);
+    test_copy_pixmap(threaded, serial);
+    test_random_pixmap(tile);
+    test_random_pixmap(stipple);
+
+    for (i = 0; i < ARRAY_SIZE(alus); i++) {
+        fb_fill_test(serial, threaded,
+                     fb_make_gc(serial, alus[i], FillSolid, NULL));
+        fb_fill_test(serial, threaded,
+                     fb_make_gc(serial, alus[i], FillTiled, tile));
+        fb_fill_test(serial, threaded,
+                     fb_make_gc(serial, alus[i], FillStippled, stipple));
+        fb_fill_test(serial, threaded,
+                     fb_make_gc(serial, alus[i], FillOpaqueStippled, stipple));
+    }
+}
+
+static void
+fb_solid_box_clipped(void)
+{
+    PixmapPtr serial = test_make_pixmap(&screen, WIDTH, HEIGHT, 24, 32);
+    PixmapPtr threaded = test_make_pixmap(&screen, WIDTH, HEIGHT, 24, 32);
+    RegionRec clip;
+    BoxRec boxes[4], box;
+    FbBits and, xor;
+    int i, j;
+
+    test_random_pixmap(serial);
+    test_copy_pixmap(threaded, serial);
+
+    for (i = 0; i < ROUNDS; i++) {
+        RegionNull(&clip);
+        for (j = 0; j < ARRAY_SIZE(boxes); j++) {
+            RegionRec part;
+
+            fb_random_box(&boxes[j], WIDTH, HEIGHT);
+            RegionInit(&part, &boxes[j], 1);
+            RegionUnion(&clip, &clip, &part);
+            RegionUninit(&part);
+        }
+        fb_random_box(&box, WIDTH, HEIGHT);
+        and = i & 1 ? rand() : 0;
+        xor = rand();
+
+        fb_set_threads(FALSE);
+        fbSolidBoxClipped(&serial->drawable, &clip,
+                          box.x1, box.y1, box.x2, box.y2, and, xor);
+        fb_set_threads(TRUE);
+        fbSolidBoxClipped(&threaded->drawable, &clip,
+                          box.x1, box.y1, box.x2, box.y2, and, xor);
+        assert(test_same_pixmap(serial, threaded));
+        RegionUninit(&clip);
+    }
+}
+
+static void
+fb_copy_test(PixmapPtr src, PixmapPtr serial, PixmapPtr threaded,
+             GCPtr gc, Bool scroll)
+{
+    BoxRec box;
+    int i, dx, dy;
+    Bool reverse, upsidedown;
+
+    for (i = 0; i < ROUNDS; i++) {
+        fb_random_box(&box, WIDTH / 2, HEIGHT / 2);
+        box.x1 += WIDTH / 4;
+        box.x2 += WIDTH / 4;
+        box.y1 += HEIGHT / 4;
+        box.y2 += HEIGHT / 4;
+        dx = rand() % (WIDTH / 2) - WIDTH / 4;
+        dy = rand() % 3 ? rand() % (HEIGHT / 2) - HEIGHT / 4 : 0;
+
+        /* what miCopyRegion would ask for */
+        reverse = scroll && dx < 0;
+        upsidedown = scroll && dy < 0;
+
+        fb_set_threads(FALSE);
+        fbCopyNtoN(scroll ? &serial->drawable : &src->drawable,
+                   &serial->drawable, gc, &box, 1, dx, dy,
+                   reverse, upsidedown, 0, NULL);
+        fb_set_threads(TRUE);
+        fbCopyNtoN(scroll ? &threaded->drawable : &src->drawable,
+                   &threaded->drawable, gc, &box, 1, dx, dy,
+                   reverse, upsidedown, 0, NULL);
+        assert(test_same_pixmap(serial, threaded));
+    }
+}
+
+static void
+fb_copy(void)
+{
+    PixmapPtr src = test_make_pixmap(&screen, WIDTH, HEIGHT, 24, 32);
+    PixmapPtr serial = test_make_pixmap(&screen, WIDTH, HEIGHT, 24, 32);
+    PixmapPtr threaded = test_make_pixmap(&screen, WIDTH, HEIGHT, 24, 32);
+    GCPtr gc = fb_make_gc(serial, GXxor, FillSolid, NULL);
+
+    test_random_pixmap(src);
+    test_random_pixmap(serial);
+    test_copy_pixmap(threaded, serial);
+
+    fb_copy_test(src, serial, threaded, NULL, FALSE);
+    fb_copy_test(src, serial, threaded, gc, FALSE);
+    fb_copy_test(src, serial, threaded, NULL, TRUE);
+    fb_copy_test(src, serial, threaded, gc, TRUE);
+}
+
+static PictFormatRec formats[] = {
+    { .format = PICT_x8r8g8b8, .depth = 24 },
+    { .format = PICT_a8r8g8b8, .depth = 32 },
+    { .format = PICT_a8, .depth = 8 },
+    { .format = PICT_a1, .depth = 1 },
+};
+
+static xFixed
+fb_random_fixed(int max)
+{
+    return rand() % (max << 16) - (max << 13);
+}
+
+static void
+fb_random_trapezoid(xTrapezoid *trap)
+{
+    trap->top = fb_random_fixed(HEIGHT);
+    trap->bottom = trap->top + 1 + rand() % (HEIGHT << 14);
+    trap->left.p1.x = fb_random_fixed(WIDTH);
+    trap->left.p1.y = trap->top - rand() % (8 << 16);
+    trap->left.p2.x = fb_random_fixed(WIDTH);
+    trap->left.p2.y = trap->bottom + 1 + rand() % (8 << 16);
+    trap->right.p1.x = trap->left.p1.x + rand() % (WIDTH << 15);
+    trap->right.p1.y = trap->top - rand() % (8 << 16);
+    trap->right.p2.x = trap->left.p2.x + rand() % (WIDTH << 15);
+    trap->right.p2.y = trap->bottom + 1 + rand() % (8 << 16);
+}
+
+static void
+fb_random_triangle(xTriangle *tri)
+{
+    tri->p1.x = fb_random_fixed(WIDTH);
+    tri->p1.y = fb_random_fixed(HEIGHT);
+    tri->p2.x = fb_random_fixed(WIDTH);
+    tri->p2.y = rand() % 8 ? fb_random_fixed(HEIGHT) : tri->p1.y;
+    tri->p3.x = fb_random_fixed(WIDTH);
+    tri->p3.y = fb_random_fixed(HEIGHT);
+}
+
+#define SHAPES 300
+
+/* x and y place the destination within its pixmap, like a window's */
+static void
+fb_shapes(int x, int y)
+{
+    PixmapPtr src = test_make_pixmap(&screen, 29, 31, 32, 32);
+    PixmapPtr serial = test_make_pixmap(&screen, WIDTH, HEIGHT, 24, 32);
+    PixmapPtr threaded = test_make_pixmap(&screen, WIDTH, HEIGHT, 24, 32);
+    PicturePtr pSrc, pSerial, pThreaded;
+    CARD8 ops[] = { PictOpOver, PictOpAdd, PictOpSrc, PictOpIn, PictOpXor };
+    xTrapezoid traps[SHAPES];
+    xTriangle tris[SHAPES];
+    PictFormatPtr mask;
+    int i, j, n;
+    CARD8 op;
+
+    serial->drawable.x = threaded->drawable.x = x;
+    serial->drawable.y = threaded->drawable.y = y;
+    pSrc = test_make_picture(src, &formats[1], RepeatNormal);
+    pSerial = test_make_picture(serial, &formats[0], RepeatNone);
+    pThreaded = test_make_picture(threaded, &formats[0], RepeatNone);
+
+    test_random_pixmap(src);
+    test_random_pixmap(serial);
+    test_copy_pixmap(threaded, serial);
+
+    for (i = 0; i < ROUNDS; i++) {
+        n = 1 + rand() % SHAPES;
+        op = ops[rand() % ARRAY_SIZE(ops)];
+        mask = &formats[2 + rand() % 2];
+
+        for (j = 0; j < n; j++)
+            fb_random_trapezoid(&traps[j]);
+        fb_set_threads(FALSE);
+        fbTrapezoids(op, pSrc, pSerial, mask, 3, 5, n, traps);
+        fb_set_threads(TRUE);
+        fbTrapezoids(op, pSrc, pThreaded, mask, 3, 5, n, traps);
+        assert(test_same_pixmap(serial, threaded));
+
+        for (j = 0; j < n; j++)
+            fb_random_triangle(&tris[j]);
+        fb_set_threads(FALSE);
+        fbTriangles(op, pSrc, pSerial, mask, 7, 2, n, tris);
+        fb_set_threads(TRUE);
+        fbTriangles(op, pSrc, pThreaded, mask, 7, 2, n, tris);
+        assert(test_same_pixmap(serial, threaded));
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    test_init_fb_screen(&screen);
+    assert(DamageSetup(&screen));
+
+    fb_fill();
+    fb_solid_box_clipped();
+    fb_copy();
+    fb_shapes(0, 0);
+    fb_shapes(41, 23);
+
+    return 0;
+}
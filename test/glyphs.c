@@ -0,0 +1,194 @@
+/*
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include "misc.h"
+#include "scrnintstr.h"
+#include "privates.h"
+#include "glyphstr.h"
+#include "tests-common.h"
+
+/*
+ * What AddGlyphs does for every glyph in a request: hash the bitmap, look
+ * for a glyph with the same contents, otherwise allocate a new one, then
+ * add it to the set.  Checks that identical glyphs are shared and
+ * different ones aren't.  With --bench, also prints the time per glyph
+ * by glyph size, along with how much of that is the hash.
+ */
+
+#define NUM_GLYPHS 20000
+
+static GlyphPtr
+add_glyph(GlyphSetPtr glyphSet, Glyph id, xGlyphInfo * gi, CARD8 *bits,
+          unsigned long size)
+{
+    unsigned char sha1[20];
+    GlyphPtr glyph;
+
+    assert(HashGlyph(gi, bits, size, sha1) == Success);
+    glyph = FindGlyphByHash(sha1, gi, bits, size, glyphSet->fdepth);
+    if (!glyph || glyph == DeletedGlyph) {
+        glyph = AllocateGlyph(gi, bits, size, sha1, glyphSet->fdepth);
+        assert(glyph);
+    }
+    assert(ResizeGlyphSet(glyphSet, 1));
+    AddGlyph(glyphSet, glyph, id);
+    return glyph;
+}
+
+static void
+fill_glyph(xGlyphInfo * gi, CARD8 *bits, int width, int height, int seed)
+{
+    uint32_t x = seed * 2654435761U + 1;
+    int i;
+
+    memset(gi, 0, sizeof(*gi));
+    gi->width = width;
+    gi->height = height;
+    gi->xOff = width;
+    for (i = 0; i < width * height; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        bits[i] = x;
+    }
+}
+
+static void
+glyph_bench(int width, int height)
+{
+    GlyphSetPtr glyphSet = AllocateGlyphSet(0, NULL);
+    int size = width * height;
+    CARD8 *bits = malloc((size_t) size * NUM_GLYPHS);
+    xGlyphInfo gi;
+    unsigned char sha1[20];
+    uint64_t start, elapsed, hashed;
+    int i;
+
+    assert(glyphSet && bits);
+    for (i = 0; i < NUM_GLYPHS; i++)
+        fill_glyph(&gi, bits + (size_t) i * size, width, height, i);
+
+    start = now_ns();
+    for (i = 0; i < NUM_GLYPHS; i++)
+        HashGlyph(&gi, bits + (size_t) i * size, size, sha1);
+    hashed = now_ns() - start;
+
+    start = now_ns();
+    for (i = 0; i < NUM_GLYPHS; i++)
+        add_glyph(glyphSet, i + 1, &gi, bits + (size_t) i * size, size);
+    elapsed = now_ns() - start;
+    assert(glyphSet->hash.tableEntries == NUM_GLYPHS);
+
+    /* and once more, finding every one of them */
+    for (i = 0; i < NUM_GLYPHS; i++)
+        assert(add_glyph(glyphSet, NUM_GLYPHS + i + 1, &gi,
+                         bits + (size_t) i * size, size) ==
+               FindGlyph(glyphSet, i + 1));
+
+    printf("%3dx%-3d glyphs: %6.1f ns/glyph, %6.1f ns hashing\n",
+           width, height, (double) elapsed / NUM_GLYPHS,
+           (double) hashed / NUM_GLYPHS);
+
+    FreeGlyphSet(glyphSet, 0);
+    free(bits);
+}
+
+static void
+glyph_sharing(void)
+{
+    GlyphSetPtr a = AllocateGlyphSet(0, NULL);
+    GlyphSetPtr b = AllocateGlyphSet(0, NULL);
+    CARD8 bits[64];
+    xGlyphInfo gi;
+    GlyphPtr glyph, other;
+
+    assert(a && b);
+
+    /* The same glyph in two sets, or twice in one, is stored once */
+    fill_glyph(&gi, bits, 8, 8, 1);
+    glyph = add_glyph(a, 1, &gi, bits, sizeof(bits));
+    assert(add_glyph(b, 7, &gi, bits, sizeof(bits)) == glyph);
+    assert(add_glyph(a, 2, &gi, bits, sizeof(bits)) == glyph);
+    assert(glyph->refcnt == 3);
+
+    /* Anything different isn't */
+    bits[63] ^= 1;
+    other = add_glyph(a, 3, &gi, bits, sizeof(bits));
+    assert(other != glyph);
+    bits[63] ^= 1;
+    gi.xOff++;
+    assert(add_glyph(a, 4, &gi, bits, sizeof(bits)) != glyph);
+    gi.xOff--;
+
+#ifndef GLYPH_HASH_SHA1
+    /*
+     * Nor is a glyph that only hashes the same: give a new glyph the hash
+     * of an existing one and it must still not be found.
+     */
+    {
+        unsigned char sha1[20];
+
+        assert(HashGlyph(&gi, bits, sizeof(bits), sha1) == Success);
+        bits[0] ^= 0x80;
+        assert(FindGlyphByHash(sha1, &gi, bits, sizeof(bits), 0) == NULL);
+        bits[0] ^= 0x80;
+        assert(FindGlyphByHash(sha1, &gi, bits, sizeof(bits), 0) == glyph);
+        assert(memcmp(glyph->sha1, other->sha1, 20) != 0);
+    }
+#endif
+
+    /* Once every reference is gone, it goes too */
+    assert(DeleteGlyph(a, 1));
+    assert(DeleteGlyph(a, 2));
+    assert(FindGlyphByHash(glyph->sha1, &gi, bits, sizeof(bits), 0) == glyph);
+    FreeGlyphSet(b, 0);
+    {
+        unsigned char sha1[20];
+
+        assert(HashGlyph(&gi, bits, sizeof(bits), sha1) == Success);
+        assert(FindGlyphByHash(sha1, &gi, bits, sizeof(bits), 0) == NULL);
+    }
+    FreeGlyphSet(a, 0);
+}
+
+int
+main(int argc, char **argv)
+{
+    bench_init(argc, argv);
+    screenInfo.numScreens = 0;
+    dixResetPrivates();
+
+    glyph_sharing();
+    if (benchmarking) {
+        glyph_bench(8, 12);
+        glyph_bench(16, 24);
+        glyph_bench(48, 64);
+    }
+
+    return 0;
+}
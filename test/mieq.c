@@ -0,0 +1,189 @@
+/*
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#if INPUTTHREAD
+#include <pthread.h>
+#endif
+#include "misc.h"
+#include "inputstr.h"
+#include "eventstr.h"
+#include "mi.h"
+
+/*
+ * Several devices feeding the event queue at once, each from its own
+ * thread the way a threaded input driver would, while the main thread
+ * drains it.  Every device numbers its events; they must come out in
+ * order per device, and every event must be accounted for as delivered,
+ * coalesced into a later motion or dropped on overflow.
+ */
+
+#define NUM_DEVICES 4
+#define EVENTS_PER_DEVICE 200000
+#define BUTTON_EVERY 16
+
+static DeviceIntRec devices[NUM_DEVICES];
+static SpriteInfoRec spriteInfo[NUM_DEVICES];
+static SpriteRec sprite[NUM_DEVICES];
+
+static uint32_t lastSeen[NUM_DEVICES];
+static uint64_t delivered;
+static uint64_t buttonsDelivered;
+static int producersDone;
+
+static void
+mieq_handler(int screenNum, InternalEvent *ie, DeviceIntPtr dev)
+{
+    DeviceEvent *ev = &ie->device_event;
+    int i = dev - devices;
+
+    assert(i >= 0 && i < NUM_DEVICES);
+    assert(ev->type == ET_Motion || ev->type == ET_ButtonPress);
+    assert(ev->deviceid == dev->id);
+    assert(ev->flags > lastSeen[i]);
+    lastSeen[i] = ev->flags;
+
+    delivered++;
+    if (ev->type == ET_ButtonPress)
+        buttonsDelivered++;
+}
+
+static void *
+mieq_producer(void *arg)
+{
+    DeviceIntPtr dev = arg;
+    DeviceEvent ev;
+    uint32_t seq;
+
+    for (seq = 1; seq <= EVENTS_PER_DEVICE; seq++) {
+        memset(&ev, 0, sizeof(ev));
+        ev.header = ET_Internal;
+        ev.type = seq % BUTTON_EVERY ? ET_Motion : ET_ButtonPress;
+        ev.length = sizeof(ev);
+        ev.time = seq;
+        ev.deviceid = ev.sourceid = dev->id;
+        ev.detail.button = 1;
+        ev.flags = seq;
+
+        input_lock();
+        mieqEnqueue(dev, (InternalEvent *) &ev);
+        input_unlock();
+    }
+
+    input_lock();
+    producersDone++;
+    input_unlock();
+    return NULL;
+}
+
+static uint64_t
+mieq_statistic(const char *name)
+{
+    ServerStatisticsPtr stats = CollectServerStatistics();
+    uint64_t value = 0;
+    int i;
+
+    assert(stats);
+    for (i = 0; i < stats->num; i++)
+        if (strcmp(stats->stats[i].name, name) == 0)
+            value = stats->stats[i].value;
+    FreeServerStatistics(stats);
+    return value;
+}
+
+static void
+mieq_stress(void)
+{
+    uint64_t produced = (uint64_t) NUM_DEVICES * EVENTS_PER_DEVICE;
+    uint64_t coalesced, dropped;
+    int i;
+#if INPUTTHREAD
+    pthread_t threads[NUM_DEVICES];
+    Bool running = TRUE;
+#endif
+
+    mieqInit();
+    mieqSetHandler(ET_Motion, mieq_handler);
+    mieqSetHandler(ET_ButtonPress, mieq_handler);
+
+    for (i = 0; i < NUM_DEVICES; i++) {
+        devices[i].id = i + 2;
+        devices[i].type = SLAVE;
+        devices[i].enabled = TRUE;
+        devices[i].spriteInfo = &spriteInfo[i];
+        spriteInfo[i].sprite = &sprite[i];
+    }
+
+#if INPUTTHREAD
+    for (i = 0; i < NUM_DEVICES; i++)
+        assert(pthread_create(&threads[i], NULL, mieq_producer,
+                              &devices[i]) == 0);
+
+    /* Drain while they run; the pauses let the queue back up */
+    for (i = 0; running; i++) {
+        mieqProcessInputEvents();
+        if (i % 64 == 0)
+            usleep(200);
+        input_lock();
+        running = producersDone < NUM_DEVICES;
+        input_unlock();
+    }
+    for (i = 0; i < NUM_DEVICES; i++)
+        pthread_join(threads[i], NULL);
+#else
+    for (i = 0; i < NUM_DEVICES; i++)
+        mieq_producer(&devices[i]);
+#endif
+    mieqProcessInputEvents();
+
+    coalesced = mieq_statistic("mieq.events.coalesced");
+    dropped = mieq_statistic("mieq.events.dropped");
+    printf("%llu events: %llu delivered, %llu coalesced, %llu dropped\n",
+           (unsigned long long) produced, (unsigned long long) delivered,
+           (unsigned long long) coalesced, (unsigned long long) dropped);
+
+    assert(delivered == mieq_statistic("mieq.events.enqueued"));
+    assert(delivered + coalesced + dropped == produced);
+    assert(buttonsDelivered <= produced / BUTTON_EVERY);
+    if (!dropped)
+        assert(buttonsDelivered == produced / BUTTON_EVERY);
+
+    /* Each device ends on a button press, which is never coalesced */
+    for (i = 0; i < NUM_DEVICES && !dropped; i++)
+        assert(lastSeen[i] == EVENTS_PER_DEVICE);
+
+    mieqFini();
+}
+
+int
+main(int argc, char **argv)
+{
+    mieq_stress();
+
+    return 0;
+}
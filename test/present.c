@@ -0,0 +1,429 @@
+/*
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "misc.h"
+#include "scrnintstr.h"
+#include "pixmapstr.h"
+#include "windowstr.h"
+#include "gcstruct.h"
+#include "privates.h"
+#include "present_priv.h"
+#include "tests-common.h"
+
+/*
+ * Many clients presenting at once on the software vblank clock.  First
+ * the clock's queue on its own: it must stay in MSC order however
+ * vblanks are queued and aborted.  Then hundreds of PresentPixmap
+ * requests from many windows, which come due a frame's worth at a time:
+ * the copies for a frame must share one flush, every request must be
+ * flushed before it goes idle, and requests must complete in order.
+ * Last, a window asking for a NotifyMSC after each PresentPixmap for the
+ * same MSC: the notify must complete after the pixmap, as queued.
+ *
+ * The test driver has no CRTCs, so everything runs on the software
+ * clock; its GC ops record the copies and its flush records how many
+ * copies it covered.  A request going idle and completing drops its
+ * reference to the pixmap, which is where completions are recorded.
+ * Waiting for the clock only takes as long as the frames do.
+ */
+
+#define NUM_VBLANKS 600
+#define MAX_FRAMES 40
+#define NUM_WINDOWS 20
+#define NUM_FRAMES 30
+#define NUM_PRESENTS (NUM_WINDOWS * NUM_FRAMES)
+#define NUM_MIXED NUM_FRAMES
+#define MSC_SERIAL 0x10000      /* serials of the NotifyMSC requests */
+#define INTERVAL 16667          /* microseconds per frame */
+
+static ScreenRec screen;
+static present_screen_info_rec info;
+static WindowPtr windows[NUM_WINDOWS + 1];
+static PixmapRec pixmaps[NUM_PRESENTS + NUM_MIXED];
+
+static struct {
+    uint64_t target;
+    int window;
+    int copied;                 /* copy sequence number, from 1 */
+    Bool done;
+    Bool immediate;             /* executed without waiting */
+    int order;                  /* completion sequence number, from 1 */
+} presents[NUM_PRESENTS + NUM_MIXED];
+
+static struct {
+    Bool immediate;
+    int order;
+    uint64_t msc;
+} notifies[NUM_MIXED];
+
+static int copies;              /* copies made so far */
+static int flushed;             /* copies covered by the last flush */
+static int flushes;
+static int most_per_flush;
+static int completed;
+static int notified;            /* completion events */
+
+static void
+present_test_destroy_clip(GCPtr gc)
+{
+}
+
+static void
+present_test_change_clip(GCPtr gc, int type, void *value, int nrects)
+{
+    if (type == CT_REGION)
+        RegionDestroy(value);
+}
+
+static void
+present_test_validate_gc(GCPtr gc, unsigned long changes, DrawablePtr drawable)
+{
+}
+
+static void
+present_test_change_gc(GCPtr gc, unsigned long mask)
+{
+}
+
+static void
+present_test_destroy_gc(GCPtr gc)
+{
+}
+
+static const GCFuncs present_test_gc_funcs = {
+    .ValidateGC = present_test_validate_gc,
+    .ChangeGC = present_test_change_gc,
+    .DestroyGC = present_test_destroy_gc,
+    .ChangeClip = present_test_change_clip,
+    .DestroyClip = present_test_destroy_clip,
+};
+
+static RegionPtr
+present_test_copy_area(DrawablePtr src, DrawablePtr dst, GCPtr gc,
+                       int srcx, int srcy, int w, int h, int dstx, int dsty)
+{
+    int i = (PixmapPtr) src - pixmaps;
+
+    assert(i >= 0 && i < ARRAY_SIZE(presents));
+    assert(!presents[i].copied);
+    presents[i].copied = ++copies;
+    return NULL;
+}
+
+static const GCOps present_test_gc_ops = {
+    .CopyArea = present_test_copy_area,
+};
+
+static Bool
+present_test_create_gc(GCPtr gc)
+{
+    gc->funcs = &present_test_gc_funcs;
+    gc->ops = &present_test_gc_ops;
+    return TRUE;
+}
+
+static Bool
+present_test_destroy_pixmap(PixmapPtr pixmap)
+{
+    int i = pixmap - pixmaps, j;
+
+    assert(i >= 0 && i < ARRAY_SIZE(presents));
+    if (--pixmap->refcnt > 0) {
+        /* idle and complete: the copy must have been flushed */
+        assert(presents[i].copied && presents[i].copied <= flushed);
+        assert(!presents[i].done);
+        presents[i].done = TRUE;
+        completed++;
+
+        /* requests which waited for the clock complete in MSC order, and
+         * in the order queued for each window
+         */
+        for (j = 0; !presents[i].immediate && j < ARRAY_SIZE(presents); j++) {
+            if (!presents[j].done || presents[j].immediate)
+                continue;
+            assert(presents[j].target <= presents[i].target);
+            if (presents[j].window == presents[i].window)
+                assert(j <= i);
+        }
+    }
+    return TRUE;
+}
+
+static void
+present_test_complete(WindowPtr window, CARD8 kind, CARD8 mode, CARD32 serial,
+                      uint64_t ust, uint64_t msc)
+{
+    notified++;
+    if (serial >= MSC_SERIAL) {
+        assert(kind == PresentCompleteKindNotifyMSC);
+        notifies[serial - MSC_SERIAL].order = notified;
+        notifies[serial - MSC_SERIAL].msc = msc;
+    }
+    else {
+        assert(kind == PresentCompleteKindPixmap);
+        presents[serial].order = notified;
+    }
+}
+
+static RRCrtcPtr
+present_test_get_crtc(WindowPtr window)
+{
+    return NULL;
+}
+
+static void
+present_test_flush(WindowPtr window)
+{
+    flushes++;
+    most_per_flush = max(most_per_flush, copies - flushed);
+    flushed = copies;
+}
+
+static int
+present_fake_queued(present_screen_priv_ptr screen_priv)
+{
+    present_fake_vblank_ptr v;
+    uint64_t last = 0;
+    int n = 0;
+
+    xorg_list_for_each_entry(v, &screen_priv->fake_queue, list) {
+        assert(v->msc >= last);
+        last = v->msc;
+        n++;
+    }
+    return n;
+}
+
+static Bool
+present_fake_is_queued(present_screen_priv_ptr screen_priv, uint64_t event_id)
+{
+    present_fake_vblank_ptr v;
+
+    xorg_list_for_each_entry(v, &screen_priv->fake_queue, list)
+        if (v->event_id == event_id)
+            return TRUE;
+    return FALSE;
+}
+
+static void
+present_setup_screen(void)
+{
+    present_screen_priv_ptr screen_priv;
+
+    test_init_screen(&screen);
+    screen.CreateGC = present_test_create_gc;
+    screen.DestroyPixmap = present_test_destroy_pixmap;
+
+    info.version = PRESENT_SCREEN_INFO_VERSION;
+    info.get_crtc = present_test_get_crtc;
+    info.flush = present_test_flush;
+
+    TimerInit();
+    assert(dixRegisterPrivateKey(&present_screen_private_key,
+                                 PRIVATE_SCREEN, 0));
+    assert(dixRegisterPrivateKey(&present_window_private_key,
+                                 PRIVATE_WINDOW, 0));
+    test_init_screen_privates(&screen);
+    assert(present_init());
+    assert(present_screen_init(&screen, &info));
+    present_register_complete_notify(present_test_complete);
+
+    screen_priv = present_screen_priv(&screen);
+    screen_priv->fake_interval = INTERVAL;
+}
+
+/*
+ * The software clock's queue stays sorted as vblanks are queued and
+ * aborted
+ */
+static void
+present_fake_queue(void)
+{
+    present_screen_priv_ptr screen_priv = present_screen_priv(&screen);
+    uint64_t ust, msc;
+    uint64_t event_id;
+    int queued;
+
+    present_fake_get_ust_msc(&screen, &ust, &msc);
+    for (event_id = 1; event_id <= NUM_VBLANKS; event_id++)
+        assert(present_fake_queue_vblank(&screen, event_id,
+                                         msc + 2 + rand() % MAX_FRAMES) ==
+               Success);
+    queued = present_fake_queued(screen_priv);
+    assert(queued > 0 && queued <= NUM_VBLANKS);
+
+    /* aborting removes just that vblank */
+    for (event_id = 1; event_id <= NUM_VBLANKS; event_id += 5) {
+        int before = present_fake_queued(screen_priv);
+        Bool was_queued = present_fake_is_queued(screen_priv, event_id);
+
+        present_fake_abort_vblank(&screen, event_id, 0);
+        assert(present_fake_queued(screen_priv) == before - was_queued);
+    }
+
+    for (event_id = 1; event_id <= NUM_VBLANKS; event_id++)
+        present_fake_abort_vblank(&screen, event_id, 0);
+    assert(present_fake_queued(screen_priv) == 0);
+}
+
+static void
+present_make_window(int w)
+{
+    WindowPtr window = dixAllocateScreenObjectWithPrivates(&screen, WindowRec,
+                                                           PRIVATE_WINDOW);
+
+    assert(window);
+    window->drawable.type = DRAWABLE_WINDOW;
+    window->drawable.pScreen = &screen;
+    window->drawable.depth = 24;
+    window->drawable.id = 0x100 + w;
+    window->drawable.serialNumber = NEXT_SERIAL_NUMBER;
+    windows[w] = window;
+}
+
+static void
+present_destroy_window(int w)
+{
+    (*screen.DestroyWindow) (windows[w]);
+    dixFreeObjectWithPrivates(windows[w], PRIVATE_WINDOW);
+}
+
+/* Presents pixmaps[i] to its window at its target MSC */
+static void
+present_test_pixmap(int i)
+{
+    PixmapPtr pixmap = &pixmaps[i];
+    int before = completed;
+
+    pixmap->drawable.type = DRAWABLE_PIXMAP;
+    pixmap->drawable.pScreen = &screen;
+    pixmap->drawable.depth = 24;
+    pixmap->drawable.width = 16;
+    pixmap->drawable.height = 16;
+    pixmap->drawable.id = 0x1000 + i;
+    pixmap->refcnt = 1;
+
+    assert(present_pixmap(windows[presents[i].window], pixmap, i, NULL, NULL,
+                          0, 0, NULL, NULL, NULL, PresentOptionNone,
+                          presents[i].target, 0, 0, NULL, 0) == Success);
+    /* only when the clock got there before the request did */
+    if (completed != before)
+        presents[i].immediate = TRUE;
+}
+
+static void
+present_pixmaps(void)
+{
+    uint64_t ust, msc;
+    int w, f, i;
+
+    for (w = 0; w < NUM_WINDOWS; w++)
+        present_make_window(w);
+
+    /* a frame's worth of requests from every window for each MSC */
+    present_fake_get_ust_msc(&screen, &ust, &msc);
+    for (f = 0, i = 0; f < NUM_FRAMES; f++) {
+        for (w = 0; w < NUM_WINDOWS; w++, i++) {
+            presents[i].target = msc + 2 + f;
+            presents[i].window = w;
+            present_test_pixmap(i);
+        }
+    }
+
+    while (completed < NUM_PRESENTS) {
+        usleep(1000);
+        TimerCheck();
+    }
+
+    assert(copies == NUM_PRESENTS);
+    assert(flushed == copies);
+    assert(flushes < copies);
+    assert(most_per_flush > 1);
+    for (i = 0; i < NUM_PRESENTS; i++)
+        assert(pixmaps[i].refcnt == 1);
+
+    for (w = 0; w < NUM_WINDOWS; w++)
+        present_destroy_window(w);
+}
+
+/*
+ * Clients waiting for an MSC after swapping at it, as Mesa does to learn
+ * the swap count, must hear about the swap first
+ */
+static void
+present_mixed(void)
+{
+    uint64_t ust, msc;
+    int f, i, before;
+
+    present_make_window(NUM_WINDOWS);
+
+    present_fake_get_ust_msc(&screen, &ust, &msc);
+    for (f = 0; f < NUM_MIXED; f++) {
+        i = NUM_PRESENTS + f;
+        presents[i].target = msc + 2 + f / 2;
+        presents[i].window = NUM_WINDOWS;
+        present_test_pixmap(i);
+
+        before = notified;
+        assert(present_notify_msc(windows[NUM_WINDOWS], MSC_SERIAL + f,
+                                  presents[i].target, 0, 0) == Success);
+        if (notified != before)
+            notifies[f].immediate = TRUE;
+    }
+
+    while (completed < NUM_PRESENTS + NUM_MIXED ||
+           notified < NUM_PRESENTS + 2 * NUM_MIXED) {
+        usleep(1000);
+        TimerCheck();
+    }
+
+    for (f = 0; f < NUM_MIXED; f++) {
+        i = NUM_PRESENTS + f;
+        assert(notifies[f].msc >= presents[i].target);
+        if (!notifies[f].immediate)
+            assert(notifies[f].order > presents[i].order);
+    }
+
+    present_destroy_window(NUM_WINDOWS);
+}
+
+int
+main(int argc, char **argv)
+{
+    present_setup_screen();
+
+    present_fake_queue();
+    present_pixmaps();
+    present_mixed();
+
+    present_fake_screen_fini(&screen);
+    return 0;
+}
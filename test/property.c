@@ -0,0 +1,172 @@
+/*
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <X11/Xatom.h>
+#include "misc.h"
+#include "dix.h"
+#include "dixstruct.h"
+#include "windowstr.h"
+#include "propertyst.h"
+#include "tests-common.h"
+
+/*
+ * Property lookup on a window with a growing number of properties.
+ * Checks that every property stays reachable while the per-window index
+ * is built, grown and dropped again.  With --bench, also prints the
+ * average lookup time for each property count.
+ */
+
+#define MAX_PROPS 256
+#define LOOKUPS 200000
+
+static Atom
+prop_atom(int i)
+{
+    /* Spread the names out a little, real atoms are far from dense */
+    return XA_LAST_PREDEFINED + 1 + i * 7;
+}
+
+static void
+add_property(ClientPtr client, WindowPtr win, int i)
+{
+    CARD32 value = i;
+    int rc;
+
+    rc = dixChangeWindowProperty(client, win, prop_atom(i), XA_CARDINAL,
+                                 32, PropModeReplace, 1, &value, FALSE);
+    assert(rc == Success);
+}
+
+static void
+check_property(ClientPtr client, WindowPtr win, int i, Bool present)
+{
+    PropertyPtr prop;
+    int rc;
+
+    rc = dixLookupProperty(&prop, win, prop_atom(i), client, DixReadAccess);
+    if (present) {
+        assert(rc == Success);
+        assert(prop->propertyName == prop_atom(i));
+        assert(*(CARD32 *) prop->data == i);
+    }
+    else {
+        assert(rc == BadMatch);
+        assert(prop == NULL);
+    }
+}
+
+static int
+count_properties(WindowPtr win)
+{
+    PropertyPtr prop;
+    int n = 0;
+
+    for (prop = wUserProps(win); prop; prop = prop->next)
+        n++;
+    return n;
+}
+
+static void
+property_lookup_bench(ClientPtr client, WindowPtr win, int nprops)
+{
+    PropertyPtr prop;
+    uint64_t start, elapsed;
+    int i;
+
+    start = now_ns();
+    for (i = 0; i < LOOKUPS; i++)
+        dixLookupProperty(&prop, win, prop_atom(i % nprops), client,
+                          DixReadAccess);
+    elapsed = now_ns() - start;
+
+    printf("%4d properties: %6.1f ns/lookup\n", nprops,
+           (double) elapsed / LOOKUPS);
+}
+
+static void
+property_index(void)
+{
+    ClientRec client = { 0 };
+    WindowRec win = { 0 };
+    PropertyPtr prop;
+    Atom prev;
+    int i, rc;
+
+    win.optional = calloc(1, sizeof(WindowOptRec));
+    assert(win.optional);
+
+    for (i = 0; i < MAX_PROPS; i++) {
+        add_property(&client, &win, i);
+        check_property(&client, &win, 0, TRUE);
+        check_property(&client, &win, i, TRUE);
+        check_property(&client, &win, i + 1, FALSE);
+        if (benchmarking &&
+            (i + 1 == 4 || i + 1 == 16 || i + 1 == 64 || i + 1 == MAX_PROPS))
+            property_lookup_bench(&client, &win, i + 1);
+    }
+
+    /* Replacing a value must not duplicate the entry */
+    add_property(&client, &win, 5);
+    assert(count_properties(&win) == MAX_PROPS);
+
+    /* ListProperties order is still most-recently-created first */
+    prev = None;
+    for (prop = wUserProps(&win); prop; prop = prop->next) {
+        if (prev != None)
+            assert(prop->propertyName < prev);
+        prev = prop->propertyName;
+    }
+
+    /* Delete every other property, the rest must still be found */
+    for (i = 0; i < MAX_PROPS; i += 2) {
+        rc = DeleteProperty(&client, &win, prop_atom(i));
+        assert(rc == Success);
+    }
+    for (i = 0; i < MAX_PROPS; i++)
+        check_property(&client, &win, i, i & 1);
+
+    /* Shrink back below the index threshold and clear the window */
+    for (i = 1; i < MAX_PROPS - 4; i += 2)
+        DeleteProperty(&client, &win, prop_atom(i));
+    for (i = 0; i < MAX_PROPS; i++)
+        check_property(&client, &win, i, (i & 1) && i >= MAX_PROPS - 4);
+    assert(count_properties(&win) == 2);
+
+    DeleteAllWindowProperties(&win);
+    assert(wUserProps(&win) == NULL);
+    free(win.optional);
+}
+
+int
+main(int argc, char **argv)
+{
+    bench_init(argc, argv);
+
+    property_index();
+
+    return 0;
+}
@@ -0,0 +1,438 @@
+/*
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "misc.h"
+#include "regionstr.h"
+#include "tests-common.h"
+
+/*
+ * The fused region operations must give the same region as the steps
+ * they stand for, whatever aliases what, and scratch regions must behave
+ * like any other region while their storage goes round the pool.  With
+ * --bench, also prints the time taken by a few compositor-like
+ * workloads, done with plain temporaries and chained operations and then
+ * with scratch regions and the fused operations.
+ *
+ * Simplified regions must cover the exact region within the same extents
+ * and the box budget; the benchmark compares accumulating scattered
+ * damage exactly with accumulating it under a budget.
+ */
+
+#define AREA 512
+#define ROUNDS 20000
+#define BENCH_WINDOWS 64
+#define BENCH_FRAMES 2000
+#define BENCH_DAMAGE 32
+#define BENCH_CELLS 4096
+#define BENCH_BOXES 32
+
+static void
+region_random_box(BoxPtr box, int area, int size)
+{
+    box->x1 = rand() % area - area / 8;
+    box->y1 = rand() % area - area / 8;
+    box->x2 = box->x1 + 1 + rand() % size;
+    box->y2 = box->y1 + 1 + rand() % size;
+}
+
+/* A union of a few boxes, or sometimes one box or nothing at all */
+static void
+region_random(RegionPtr pReg)
+{
+    int n = rand() % 8;
+    BoxRec box;
+
+    RegionNull(pReg);
+    if (n == 0)
+        return;
+    while (n--) {
+        RegionRec r;
+
+        region_random_box(&box, AREA, AREA / 2);
+        RegionInit(&r, &box, 1);
+        RegionUnion(pReg, pReg, &r);
+        RegionUninit(&r);
+    }
+}
+
+static void
+region_check(RegionPtr got, RegionPtr want)
+{
+    assert(pixman_region_selfcheck(got));
+    assert(RegionEqual(got, want));
+}
+
+static void
+region_test_intersect_subtract(void)
+{
+    RegionRec a, b, c, want, got;
+    int alias = rand() % 4;
+
+    region_random(&a);
+    region_random(&b);
+    region_random(&c);
+    if (RegionNotEmpty(&a) && rand() % 4 == 0)
+        RegionReset(&b, RegionExtents(&a));
+
+    RegionNull(&want);
+    RegionIntersect(&want, &a, &b);
+    RegionSubtract(&want, &want, &c);
+
+    switch (alias) {
+    case 0:
+        region_random(&got);
+        RegionIntersectSubtract(&got, &a, &b, &c);
+        region_check(&got, &want);
+        RegionUninit(&got);
+        break;
+    case 1:
+        RegionIntersectSubtract(&a, &a, &b, &c);
+        region_check(&a, &want);
+        break;
+    case 2:
+        RegionIntersectSubtract(&b, &a, &b, &c);
+        region_check(&b, &want);
+        break;
+    case 3:
+        RegionIntersectSubtract(&c, &a, &b, &c);
+        region_check(&c, &want);
+        break;
+    }
+
+    RegionUninit(&a);
+    RegionUninit(&b);
+    RegionUninit(&c);
+    RegionUninit(&want);
+}
+
+static void
+region_test_translate_intersect(void)
+{
+    RegionRec a, b, orig, moved, want;
+    int dx = rand() % AREA - AREA / 2;
+    int dy = rand() % AREA - AREA / 2;
+
+    region_random(&a);
+    region_random(&b);
+
+    /* now and then push b off the edge of the coordinate space */
+    if (rand() % 8 == 0)
+        dx += rand() % 2 ? MAXSHORT : MINSHORT;
+
+    RegionNull(&orig);
+    RegionCopy(&orig, &b);
+    RegionNull(&moved);
+    RegionCopy(&moved, &b);
+    RegionTranslate(&moved, dx, dy);
+    RegionNull(&want);
+    RegionIntersect(&want, &a, &moved);
+
+    if (rand() % 2) {
+        RegionTranslateIntersect(&a, &a, &b, dx, dy);
+        region_check(&a, &want);
+        region_check(&b, &orig);
+    }
+    else {
+        RegionTranslateIntersect(&b, &a, &b, dx, dy);
+        region_check(&b, &want);
+    }
+
+    RegionUninit(&a);
+    RegionUninit(&b);
+    RegionUninit(&orig);
+    RegionUninit(&moved);
+    RegionUninit(&want);
+}
+
+static void
+region_test_simplify(void)
+{
+    RegionRec exact, simple, outside;
+    int maxBoxes = 1 + rand() % 16;
+    int n = rand() % 256, i;
+
+    /* lots of small scattered boxes, so the tile pass gets used too */
+    RegionNull(&exact);
+    for (i = 0; i < n; i++) {
+        RegionRec r;
+        BoxRec box;
+
+        region_random_box(&box, AREA * 4, 1 + rand() % 64);
+        RegionInit(&r, &box, 1);
+        RegionUnion(&exact, &exact, &r);
+        RegionUninit(&r);
+    }
+
+    RegionNull(&simple);
+    RegionCopy(&simple, &exact);
+    assert(RegionSimplify(&simple, maxBoxes));
+    assert(pixman_region_selfcheck(&simple));
+    assert(RegionNumRects(&simple) <= maxBoxes);
+    if (RegionNotEmpty(&exact))
+        assert(!memcmp(RegionExtents(&simple), RegionExtents(&exact),
+                       sizeof(BoxRec)));
+
+    RegionNull(&outside);
+    RegionSubtract(&outside, &exact, &simple);
+    assert(!RegionNotEmpty(&outside));
+
+    RegionUninit(&exact);
+    RegionUninit(&simple);
+    RegionUninit(&outside);
+}
+
+/* Nested scratch regions, as the recursion in miComputeClips uses them */
+static void
+region_test_scratch(int depth, RegionPtr universe)
+{
+    RegionRec scratch, plain, other;
+
+    region_random(&other);
+    RegionNullScratch(&scratch);
+    RegionNull(&plain);
+    assert(pixman_region_selfcheck(&scratch));
+    assert(!RegionNotEmpty(&scratch));
+
+    RegionIntersect(&scratch, universe, &other);
+    RegionIntersect(&plain, universe, &other);
+    region_check(&scratch, &plain);
+
+    if (depth)
+        region_test_scratch(depth - 1, &scratch);
+
+    RegionAppend(&scratch, &other);
+    RegionAppend(&plain, &other);
+    {
+        Bool overlap;
+
+        RegionValidate(&scratch, &overlap);
+        RegionValidate(&plain, &overlap);
+    }
+    region_check(&scratch, &plain);
+
+    RegionUninitScratch(&scratch);
+    RegionUninit(&plain);
+    RegionUninit(&other);
+}
+
+/*
+ * Compositor-like workloads: a stack of overlapping windows clipped
+ * against each other as miComputeClips does, and damage boxes moved into
+ * window coordinates and clipped there.
+ */
+
+static BoxRec windows[BENCH_WINDOWS];
+static RegionRec shapes[BENCH_WINDOWS];
+
+static void
+region_bench_setup(void)
+{
+    int i;
+
+    for (i = 0; i < BENCH_WINDOWS; i++) {
+        region_random_box(&windows[i], AREA * 2, AREA);
+        region_random(&shapes[i]);
+        if (i % 2)
+            RegionReset(&shapes[i], &windows[i]);
+    }
+}
+
+static double
+region_bench_clips(Bool scratch)
+{
+    BoxRec screen = { 0, 0, AREA * 2, AREA * 2 };
+    RegionRec universe, child, border;
+    uint64_t start = now_ns();
+    int frame, i;
+
+    for (frame = 0; frame < BENCH_FRAMES; frame++) {
+        RegionInit(&universe, &screen, 1);
+        for (i = 0; i < BENCH_WINDOWS; i++) {
+            if (scratch)
+                RegionNullScratch(&child);
+            else
+                RegionNull(&child);
+            RegionInit(&border, &windows[i], 1);
+            RegionIntersect(&child, &universe, &border);
+            RegionSubtract(&universe, &universe, &border);
+            if (scratch)
+                RegionUninitScratch(&child);
+            else
+                RegionUninit(&child);
+            RegionUninit(&border);
+        }
+        RegionUninit(&universe);
+        if (scratch)
+            RegionScratchReset();
+    }
+    return (double) (now_ns() - start) / BENCH_FRAMES / 1000;
+}
+
+static double
+region_bench_damage(Bool fused)
+{
+    RegionRec damage, exposed;
+    uint64_t start = now_ns();
+    int frame, i, w;
+    BoxRec box;
+
+    RegionNull(&exposed);
+    for (frame = 0; frame < BENCH_FRAMES; frame++) {
+        RegionNull(&damage);
+        for (i = 0; i < BENCH_DAMAGE; i++) {
+            RegionRec r;
+
+            region_random_box(&box, AREA * 2, AREA / 8);
+            RegionInit(&r, &box, 1);
+            RegionUnion(&damage, &damage, &r);
+            RegionUninit(&r);
+        }
+        for (w = 0; w < BENCH_WINDOWS; w++) {
+            int x = windows[w].x1, y = windows[w].y1;
+
+            if (fused) {
+                RegionTranslateIntersect(&exposed, &shapes[w], &damage,
+                                         -x, -y);
+                RegionIntersectSubtract(&exposed, &exposed, &shapes[w],
+                                        &shapes[(w + 1) % BENCH_WINDOWS]);
+            }
+            else {
+                RegionRec tmp;
+
+                RegionTranslate(&damage, -x, -y);
+                RegionIntersect(&exposed, &shapes[w], &damage);
+                RegionTranslate(&damage, x, y);
+                RegionNull(&tmp);
+                RegionIntersect(&tmp, &exposed, &shapes[w]);
+                RegionSubtract(&exposed, &tmp,
+                               &shapes[(w + 1) % BENCH_WINDOWS]);
+                RegionUninit(&tmp);
+            }
+        }
+        RegionUninit(&damage);
+        if (fused)
+            RegionScratchReset();
+    }
+    RegionUninit(&exposed);
+    return (double) (now_ns() - start) / BENCH_FRAMES / 1000;
+}
+
+/*
+ * Spreadsheet-like damage: single cells updated all over a large window,
+ * accumulated for a frame.  Prints the time and what's left to repaint.
+ */
+static double
+region_bench_accumulate(int maxBoxes, int *boxes, double *area)
+{
+    RegionRec damage;
+    uint64_t start = now_ns();
+    int64_t painted = 0;
+    int frame, i, nbox = 0;
+
+    for (frame = 0; frame < BENCH_FRAMES / 10; frame++) {
+        RegionNull(&damage);
+        for (i = 0; i < BENCH_CELLS; i++) {
+            RegionRec r;
+            BoxRec box;
+
+            box.x1 = rand() % 40 * 64 + 2;
+            box.y1 = rand() % 100 * 16 + 2;
+            box.x2 = box.x1 + 60;
+            box.y2 = box.y1 + 12;
+            RegionInit(&r, &box, 1);
+            RegionUnion(&damage, &damage, &r);
+            RegionUninit(&r);
+            if (maxBoxes && RegionNumRects(&damage) > maxBoxes)
+                RegionSimplify(&damage, maxBoxes);
+        }
+        nbox += RegionNumRects(&damage);
+        for (i = 0; i < RegionNumRects(&damage); i++) {
+            BoxPtr b = RegionRects(&damage) + i;
+
+            painted += (int64_t) (b->x2 - b->x1) * (b->y2 - b->y1);
+        }
+        RegionUninit(&damage);
+    }
+    *boxes = nbox / (BENCH_FRAMES / 10);
+    *area = (double) painted / (BENCH_FRAMES / 10) / (2560 * 1600);
+    return (double) (now_ns() - start) / (BENCH_FRAMES / 10) / 1000;
+}
+
+static void
+region_bench(void)
+{
+    int i, boxes;
+    double area, t;
+
+    region_bench_setup();
+    printf("window clips: plain %6.1f us scratch %6.1f us per frame\n",
+           region_bench_clips(FALSE), region_bench_clips(TRUE));
+    printf("damage clips: plain %6.1f us fused   %6.1f us per frame\n",
+           region_bench_damage(FALSE), region_bench_damage(TRUE));
+
+    t = region_bench_accumulate(0, &boxes, &area);
+    printf("cell damage:  exact   %6.1f us %5d boxes %3.0f%% of window\n",
+           t, boxes, area * 100);
+    t = region_bench_accumulate(BENCH_BOXES, &boxes, &area);
+    printf("cell damage:  budget  %6.1f us %5d boxes %3.0f%% of window\n",
+           t, boxes, area * 100);
+
+    for (i = 0; i < BENCH_WINDOWS; i++)
+        RegionUninit(&shapes[i]);
+}
+
+int
+main(int argc, char **argv)
+{
+    BoxRec all = { MINSHORT, MINSHORT, MAXSHORT, MAXSHORT };
+    RegionRec universe;
+    int i;
+
+    bench_init(argc, argv);
+    InitRegions();
+
+    for (i = 0; i < ROUNDS; i++) {
+        region_test_intersect_subtract();
+        region_test_translate_intersect();
+    }
+    for (i = 0; i < ROUNDS / 10; i++)
+        region_test_simplify();
+    RegionInit(&universe, &all, 1);
+    for (i = 0; i < ROUNDS / 10; i++) {
+        region_test_scratch(rand() % 8, &universe);
+        if (i % 3 == 0)
+            RegionScratchReset();
+    }
+    RegionUninit(&universe);
+
+    if (benchmarking)
+        region_bench();
+
+    return 0;
+}
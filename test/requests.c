@@ -0,0 +1,207 @@
+/*
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <X11/Xproto.h>
+#include <X11/extensions/bigreqsproto.h>
+#include "misc.h"
+#include "os.h"
+#include "osdep.h"
+#include "opaque.h"
+#include "dixstruct.h"
+#include "tests-common.h"
+
+/*
+ * Pipelined small requests, the way x11perf -rect1 or a chatty Xlib
+ * client sends them: a long run of PolyFillRectangle and ChangeGC
+ * requests sitting in the input buffer, with the occasional big request
+ * mixed in.  Checks that ReadRequestFromClient hands every request out
+ * intact.  With --bench, the stream is read many times over and the
+ * average time per request printed.
+ */
+
+#define NUM_REQUESTS 4096
+#define REPEAT 200
+
+/* Request i of the stream: its opcode and length in CARD32s */
+static void
+request_shape(int i, CARD8 *opcode, int *len, Bool *big)
+{
+    *big = FALSE;
+    if (i % 512 == 511) {
+        *opcode = X_PolyPoint;
+        *len = 300;
+        *big = TRUE;
+    }
+    else if (i % 4 == 3) {
+        *opcode = X_ChangeGC;
+        *len = 4;
+    }
+    else {
+        *opcode = X_PolyFillRectangle;
+        *len = 5;
+    }
+}
+
+static void
+put16(CARD8 *p, CARD16 v, Bool swapped)
+{
+    if (swapped)
+        v = lswaps(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static void
+put32(CARD8 *p, CARD32 v, Bool swapped)
+{
+    if (swapped)
+        v = lswapl(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static CARD8 *
+make_stream(Bool swapped, int *size)
+{
+    CARD8 *stream, *p;
+    CARD8 opcode;
+    int i, len, total = 0;
+    Bool big;
+
+    for (i = 0; i < NUM_REQUESTS; i++) {
+        request_shape(i, &opcode, &len, &big);
+        total += len << 2;
+    }
+
+    stream = p = calloc(1, total);
+    assert(stream);
+    for (i = 0; i < NUM_REQUESTS; i++) {
+        request_shape(i, &opcode, &len, &big);
+        p[0] = opcode;
+        p[1] = i & 0xff;
+        if (big) {
+            put16(p + 2, 0, swapped);
+            put32(p + 4, len, swapped);
+            put32(p + 8, i, swapped);
+        }
+        else {
+            put16(p + 2, len, swapped);
+            put32(p + 4, i, swapped);
+        }
+        p += len << 2;
+    }
+
+    *size = total;
+    return stream;
+}
+
+static void
+check_request(ClientPtr client, int i, int rc)
+{
+    xReq *req = client->requestBuffer;
+    CARD32 tag;
+    CARD8 opcode;
+    int len;
+    Bool big;
+
+    request_shape(i, &opcode, &len, &big);
+    assert(rc == len << 2);
+    assert(req->reqType == opcode);
+    assert(req->data == (i & 0xff));
+
+    /* Big requests come out with the extra length word squeezed out */
+    assert(client->req_len == (big ? len - 1 : len));
+
+    memcpy(&tag, (CARD8 *) req + sizeof(xReq), sizeof(tag));
+    if (client->swapped)
+        tag = lswapl(tag);
+    assert(tag == i);
+}
+
+static void
+request_stream(Bool swapped)
+{
+    ClientRec client = { 0 };
+    OsCommRec oc = { 0 };
+    struct xorg_list ready;
+    uint64_t start, elapsed = 0;
+    CARD8 *stream;
+    int i, n, rc, size, repeat = benchmarking ? REPEAT : 2;
+
+    /* Keep mark_client_ready() away from the dispatcher's ready list */
+    xorg_list_init(&ready);
+    xorg_list_append(&client.ready, &ready);
+
+    oc.fd = -1;
+    client.osPrivate = &oc;
+    client.swapped = swapped;
+    client.big_requests = TRUE;
+
+    stream = make_stream(swapped, &size);
+
+    for (n = 0; n < repeat; n++) {
+        rc = InsertFakeRequest(&client, (char *) stream, size);
+        assert(rc);
+
+        start = now_ns();
+        for (i = 0; i < NUM_REQUESTS; i++) {
+            rc = ReadRequestFromClient(&client);
+            check_request(&client, i, rc);
+
+            /* Going back to the current request must not confuse the
+             * requests already parsed behind it */
+            if (n == 0 && i % 100 == 50) {
+                ResetCurrentRequest(&client);
+                rc = ReadRequestFromClient(&client);
+                check_request(&client, i, rc);
+            }
+        }
+        elapsed += now_ns() - start;
+
+        /* All used up, and there is no connection to read more from */
+        rc = ReadRequestFromClient(&client);
+        assert(rc < 0);
+    }
+
+    if (benchmarking)
+        printf("%s client: %5.1f ns/request\n",
+               swapped ? "swapped" : "native ",
+               (double) elapsed / ((uint64_t) repeat * NUM_REQUESTS));
+
+    FreeOsBuffers(&oc);
+    free(stream);
+}
+
+int
+main(int argc, char **argv)
+{
+    bench_init(argc, argv);
+    maxBigRequestSize = (1 << 22) - 1;
+
+    request_stream(FALSE);
+    request_stream(TRUE);
+
+    return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include "misc.h"
+#include "resource.h"
+#include "dixstruct.h"
+#include "tests-common.h"
+
+/*
+ * A client creating a million resources, the way a long-running
+ * compositor or a browser piles up pixmaps, pictures and glyphsets.
+ * Checks that every resource can be found and freed again, by id, by
+ * type and with the client, including deletion functions that free other
+ * resources on the way.  With --bench, also prints the time per
+ * operation.
+ */
+
+#define NUM_IDS (1 << 20)
+#define SHARED_EVERY 10         /* ids also carrying a second type */
+
+static RESTYPE RT_BENCH, RT_SHARED, RT_CHAIN;
+static int freed[NUM_IDS + 2];
+static int deleted;
+
+static int
+bench_delete(void *value, XID id)
+{
+    freed[(intptr_t) value]++;
+    deleted++;
+    return Success;
+}
+
+/* Frees the next id's resources along with its own */
+static int
+chain_delete(void *value, XID id)
+{
+    deleted++;
+    FreeResource(id + 1, RT_NONE);
+    return Success;
+}
+
+static void
+count_resource(void *value, XID id, void *cdata)
+{
+    (*(int *) cdata)++;
+}
+
+static void
+free_next_shared(void *value, XID id, void *cdata)
+{
+    (*(int *) cdata)++;
+    /* free the next one on the list before it is reached */
+    FreeResourceByType(id - SHARED_EVERY, RT_SHARED, FALSE);
+}
+
+static void
+print_time(const char *what, uint64_t elapsed, int count)
+{
+    if (benchmarking)
+            printf("%-8s %6.1f ns/resource\n", what, (double) elapsed / count);
+}
+
+static void
+resource_churn(ClientPtr client)
+{
+    XID base = client->clientAsMask;
+    uint64_t start, t, worst = 0;
+    void *value;
+    int i, n, rc;
+
+    start = now_ns();
+    for (i = 1; i <= NUM_IDS; i++) {
+        t = now_ns();
+        assert(AddResource(base | i, RT_BENCH, (void *) (intptr_t) i));
+        t = now_ns() - t;
+        if (t > worst)
+            worst = t;
+    }
+    print_time("create", now_ns() - start, NUM_IDS);
+    if (benchmarking)
+        printf("slowest create: %.1f us\n", worst / 1000.0);
+
+    for (i = SHARED_EVERY; i <= NUM_IDS; i += SHARED_EVERY)
+        assert(AddResource(base | i, RT_SHARED, (void *) (intptr_t) i));
+
+    start = now_ns();
+    for (i = 1; i <= NUM_IDS; i++) {
+        rc = dixLookupResourceByType(&value, base | i, RT_BENCH, NULL,
+                                     DixReadAccess);
+        assert(rc == Success && value == (void *) (intptr_t) i);
+    }
+    print_time("lookup", now_ns() - start, NUM_IDS);
+
+    rc = dixLookupResourceByType(&value, base | (NUM_IDS + 1), RT_BENCH,
+                                 NULL, DixReadAccess);
+    assert(rc == BadValue);
+    rc = dixLookupResourceByType(&value, base | 1, RT_SHARED, NULL,
+                                 DixReadAccess);
+    assert(rc == BadValue);
+    rc = dixLookupResourceByClass(&value, base | SHARED_EVERY, RC_ANY,
+                                  NULL, DixReadAccess);
+    assert(rc == Success && value == (void *) (intptr_t) SHARED_EVERY);
+
+    /* Only the resources of one type are visited */
+    n = 0;
+    start = now_ns();
+    FindClientResourcesByType(client, RT_SHARED, count_resource, &n);
+    print_time("by type", now_ns() - start, NUM_IDS / SHARED_EVERY);
+    assert(n == NUM_IDS / SHARED_EVERY);
+
+    /* Resources freed while being walked are skipped */
+    n = 0;
+    FindClientResourcesByType(client, RT_SHARED, free_next_shared, &n);
+    assert(n == (NUM_IDS / SHARED_EVERY + 1) / 2);
+
+    /* Freeing an id frees every resource it has */
+    start = now_ns();
+    for (i = 1; i <= NUM_IDS; i += 2)
+        FreeResource(base | i, RT_NONE);
+    print_time("free", now_ns() - start, NUM_IDS / 2);
+    for (i = 1; i <= NUM_IDS; i++) {
+        rc = dixLookupResourceByType(&value, base | i, RT_BENCH, NULL,
+                                     DixReadAccess);
+        assert(rc == (i & 1 ? BadValue : Success));
+    }
+
+    /* Ids are reused after being freed */
+    for (i = 1; i <= NUM_IDS; i += 2)
+        assert(AddResource(base | i, RT_BENCH, (void *) (intptr_t) i));
+    assert(AddResource(base | (NUM_IDS + 1), RT_CHAIN, NULL));
+    assert(AddResource(base | (NUM_IDS + 2), RT_BENCH,
+                       (void *) (intptr_t) (NUM_IDS + 1)));
+
+    start = now_ns();
+    FreeClientResources(client);
+    print_time("client", now_ns() - start, NUM_IDS);
+
+    for (i = 1; i <= NUM_IDS; i++)
+        assert(freed[i] == (i % SHARED_EVERY ? 1 : 2) + (i & 1));
+    assert(freed[NUM_IDS + 1] == 1);
+    assert(deleted == NUM_IDS + NUM_IDS / 2 + NUM_IDS / SHARED_EVERY + 2);
+}
+
+int
+main(int argc, char **argv)
+{
+    ClientRec server_client, client;
+
+    bench_init(argc, argv);
+
+    serverClient = &server_client;
+    InitClient(serverClient, 0, (void *) NULL);
+    assert(InitClientResources(serverClient));
+
+    RT_BENCH = CreateNewResourceType(bench_delete, "Bench");
+    RT_SHARED = CreateNewResourceType(bench_delete, "Shared");
+    RT_CHAIN = CreateNewResourceType(chain_delete, "Chain");
+    assert(RT_BENCH && RT_SHARED && RT_CHAIN);
+
+    InitClient(&client, 1, (void *) NULL);
+    assert(InitClientResources(&client));
+    resource_churn(&client);
+
+    return 0;
+}
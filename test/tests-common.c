@@ -0,0 +1,172 @@
+/*
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "servermd.h"
+#include "privates.h"
+#include "fb.h"
+#include "tests-common.h"
+
+Bool benchmarking;
+
+void
+bench_init(int argc, char **argv)
+{
+    int i;
+
+    for (i = 1; i < argc; i++)
+        if (strcmp(argv[i], "--bench") == 0)
+            benchmarking = TRUE;
+}
+
+uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void
+test_init_screen(ScreenPtr pScreen)
+{
+    screenInfo.numScreens = 1;
+    screenInfo.screens[0] = pScreen;
+    pScreen->myNum = 0;
+
+    dixResetPrivates();
+}
+
+void
+test_init_screen_privates(ScreenPtr pScreen)
+{
+    dixInitScreenSpecificPrivates(pScreen);
+    assert(dixAllocatePrivates(&pScreen->devPrivates, PRIVATE_SCREEN));
+}
+
+void
+test_init_fb_screen(ScreenPtr pScreen)
+{
+    test_init_screen(pScreen);
+    pScreen->CreateGC = fbCreateGC;
+
+    PixmapWidthPaddingInfo[1].bitsPerPixel = 1;
+    PixmapWidthPaddingInfo[8].bitsPerPixel = 8;
+    PixmapWidthPaddingInfo[16].bitsPerPixel = 16;
+    PixmapWidthPaddingInfo[24].bitsPerPixel = 32;
+    PixmapWidthPaddingInfo[32].bitsPerPixel = 32;
+
+    test_init_screen_privates(pScreen);
+    assert(fbAllocatePrivates(pScreen));
+}
+
+PixmapPtr
+test_make_pixmap(ScreenPtr pScreen, int width, int height, int depth, int bpp)
+{
+    PixmapPtr pixmap = dixAllocateScreenObjectWithPrivates(pScreen, PixmapRec,
+                                                           PRIVATE_PIXMAP);
+    int stride = ((width * bpp + FB_MASK) >> FB_SHIFT) * sizeof(FbBits);
+
+    assert(pixmap);
+    pixmap->drawable.type = DRAWABLE_PIXMAP;
+    pixmap->drawable.depth = depth;
+    pixmap->drawable.bitsPerPixel = bpp;
+    pixmap->drawable.width = width;
+    pixmap->drawable.height = height;
+    pixmap->drawable.pScreen = pScreen;
+    pixmap->drawable.serialNumber = NEXT_SERIAL_NUMBER;
+    pixmap->refcnt = 1;
+    pixmap->devKind = stride;
+    pixmap->devPrivate.ptr = calloc(stride, height);
+    assert(pixmap->devPrivate.ptr);
+    return pixmap;
+}
+
+void
+test_free_pixmap(PixmapPtr pixmap)
+{
+    free(pixmap->devPrivate.ptr);
+    dixFreeObjectWithPrivates(pixmap, PRIVATE_PIXMAP);
+}
+
+void
+test_clear_pixmap(PixmapPtr pixmap)
+{
+    memset(pixmap->devPrivate.ptr, 0,
+           pixmap->devKind * pixmap->drawable.height);
+}
+
+void
+test_random_pixmap(PixmapPtr pixmap)
+{
+    CARD8 *bits = pixmap->devPrivate.ptr;
+    int i;
+
+    for (i = 0; i < pixmap->devKind * pixmap->drawable.height; i++)
+        bits[i] = rand();
+}
+
+void
+test_copy_pixmap(PixmapPtr dst, PixmapPtr src)
+{
+    memcpy(dst->devPrivate.ptr, src->devPrivate.ptr,
+           src->devKind * src->drawable.height);
+}
+
+Bool
+test_same_pixmap(PixmapPtr a, PixmapPtr b)
+{
+    return memcmp(a->devPrivate.ptr, b->devPrivate.ptr,
+                  a->devKind * a->drawable.height) == 0;
+}
+
+PicturePtr
+test_make_picture(PixmapPtr pixmap, PictFormatPtr format, int repeat)
+{
+    PicturePtr picture = calloc(1, sizeof(PictureRec));
+    /* a drawable moved away from the origin only has bits up to the edge */
+    BoxRec box = { pixmap->drawable.x, pixmap->drawable.y,
+                   pixmap->drawable.width, pixmap->drawable.height };
+
+    assert(picture);
+    picture->pDrawable = &pixmap->drawable;
+    picture->pFormat = format;
+    picture->format = format->format;
+    picture->repeat = repeat;
+    picture->repeatType = repeat;
+    picture->pCompositeClip = RegionCreate(&box, 1);
+    return picture;
+}
+
+void
+test_free_picture(PicturePtr picture)
+{
+    RegionDestroy(picture->pCompositeClip);
+    free(picture);
+}
@@ -0,0 +1,77 @@
+/*
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef TESTS_COMMON_H
+#define TESTS_COMMON_H
+
+#include <stdint.h>
+#include "misc.h"
+#include "scrnintstr.h"
+#include "pixmapstr.h"
+#include "picturestr.h"
+
+/*
+ * Some tests also time what they check.  The timings only mean something
+ * in an optimized build on a quiet machine and take a while, so they are
+ * left out of make check: a test runs them when started with --bench,
+ * which is what make bench does.
+ */
+extern Bool benchmarking;
+
+extern void bench_init(int argc, char **argv);
+
+/* Monotonic time in nanoseconds */
+extern uint64_t now_ns(void);
+
+/*
+ * A screen to test with, without a DDX.  test_init_screen makes it the
+ * only screen and starts the privates over; once the test has registered
+ * its own screen private keys, test_init_screen_privates allocates them.
+ * test_init_fb_screen does both for drawing with fb, through scratch GCs,
+ * to pixmaps from test_make_pixmap.
+ */
+extern void test_init_screen(ScreenPtr pScreen);
+
+extern void test_init_screen_privates(ScreenPtr pScreen);
+
+extern void test_init_fb_screen(ScreenPtr pScreen);
+
+/* A cleared pixmap laid out the way fb wants it */
+extern PixmapPtr test_make_pixmap(ScreenPtr pScreen, int width, int height,
+                                  int depth, int bpp);
+
+extern void test_free_pixmap(PixmapPtr pixmap);
+
+extern void test_clear_pixmap(PixmapPtr pixmap);
+
+extern void test_random_pixmap(PixmapPtr pixmap);
+
+extern void test_copy_pixmap(PixmapPtr dst, PixmapPtr src);
+
+extern Bool test_same_pixmap(PixmapPtr a, PixmapPtr b);
+
+/* A picture of pixmap, clipped to its bits */
+extern PicturePtr test_make_picture(PixmapPtr pixmap, PictFormatPtr format,
+                                    int repeat);
+
+extern void test_free_picture(PicturePtr picture);
+
+#endif /* TESTS_COMMON_H */
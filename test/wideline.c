@@ -0,0 +1,211 @@
+/*
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "misc.h"
+#include "scrnintstr.h"
+#include "pixmapstr.h"
+#include "gcstruct.h"
+#include "mi.h"
+#include "fb.h"
+#include "tests-common.h"
+
+/*
+ * Wide lines of three or more points drawn with a raster op that can't
+ * paint a pixel twice must cover exactly the pixels the same line covers
+ * with GXcopy, however the pieces of the line overlap.  Each line is
+ * drawn with GXcopy and with GXxor onto cleared pixmaps and the results
+ * compared.  With --bench, also prints the time per polyline for many
+ * thin polylines.
+ */
+
+#define WIDTH 301
+#define HEIGHT 257
+#define ROUNDS 300
+#define BENCH_LINES 20000
+#define BENCH_POINTS 10
+
+static ScreenRec screen;
+
+static void
+wl_random_gc(GCPtr gc, int lineStyle)
+{
+    ChangeGCVal vals[6];
+    unsigned char dashes[4];
+    int i, ndash = 1 + rand() % 4;
+
+    vals[0].val = 0x123456;
+    vals[1].val = 2 + rand() % 4;
+    vals[2].val = lineStyle;
+    vals[3].val = CapButt + rand() % 3;
+    vals[4].val = JoinMiter + rand() % 3;
+    vals[5].val = rand() % 10;
+    assert(ChangeGC(NullClient, gc, GCForeground | GCLineWidth |
+                    GCLineStyle | GCCapStyle | GCJoinStyle | GCDashOffset,
+                    vals) == Success);
+    for (i = 0; i < ndash; i++)
+        dashes[i] = 1 + rand() % 8;
+    assert(SetDashes(gc, gc->dashOffset, ndash, dashes) == Success);
+}
+
+static void
+wl_set_alu(PixmapPtr pixmap, GCPtr gc, int alu)
+{
+    ChangeGCVal val;
+
+    val.val = alu;
+    assert(ChangeGC(NullClient, gc, GCFunction, &val) == Success);
+    ValidateGC(&pixmap->drawable, gc);
+}
+
+static int
+wl_random_polyline(DDXPointPtr points, int max)
+{
+    int i, n = 3 + rand() % (max - 2);
+
+    for (i = 0; i < n; i++) {
+        if (i && rand() % 4 == 0) {
+            /* short segments, overlapping at the joins */
+            points[i].x = points[i - 1].x + rand() % 7 - 3;
+            points[i].y = points[i - 1].y + rand() % 7 - 3;
+        }
+        else {
+            points[i].x = rand() % (WIDTH + 40) - 20;
+            points[i].y = rand() % (HEIGHT + 40) - 20;
+        }
+    }
+    /* too spread out for the span bitmap */
+    if (rand() % 10 == 0)
+        points[rand() % n].x = 30000;
+    return n;
+}
+
+static void
+wl_conformance(int lineStyle)
+{
+    PixmapPtr copy = test_make_pixmap(&screen, WIDTH, HEIGHT, 24, 32);
+    PixmapPtr xor = test_make_pixmap(&screen, WIDTH, HEIGHT, 24, 32);
+    GCPtr gc = GetScratchGC(24, &screen);
+    DDXPointRec points[32];
+    int i, n;
+
+    assert(gc);
+    for (i = 0; i < ROUNDS; i++) {
+        n = wl_random_polyline(points, ARRAY_SIZE(points));
+        wl_random_gc(gc, lineStyle);
+
+        test_clear_pixmap(copy);
+        wl_set_alu(copy, gc, GXcopy);
+        miPolylines(&copy->drawable, gc, CoordModeOrigin, n, points);
+
+        test_clear_pixmap(xor);
+        wl_set_alu(xor, gc, GXxor);
+        miPolylines(&xor->drawable, gc, CoordModeOrigin, n, points);
+
+        assert(test_same_pixmap(copy, xor));
+    }
+    FreeScratchGC(gc);
+}
+
+/*
+ * Lines reaching the last coordinate a span can start at still end.
+ */
+static void
+wl_far_edge(void)
+{
+    PixmapPtr copy = test_make_pixmap(&screen, WIDTH, HEIGHT, 24, 32);
+    PixmapPtr xor = test_make_pixmap(&screen, WIDTH, HEIGHT, 24, 32);
+    GCPtr gc = GetScratchGC(24, &screen);
+    DDXPointRec points[3] = {
+        { MAXSHORT - 40, 10 }, { MAXSHORT, 10 }, { MAXSHORT, 30 }
+    };
+    ChangeGCVal vals[2];
+
+    assert(gc);
+    vals[0].val = 0x123456;
+    vals[1].val = 5;
+    assert(ChangeGC(NullClient, gc, GCForeground | GCLineWidth,
+                    vals) == Success);
+
+    wl_set_alu(copy, gc, GXcopy);
+    miPolylines(&copy->drawable, gc, CoordModeOrigin, 3, points);
+    wl_set_alu(xor, gc, GXxor);
+    miPolylines(&xor->drawable, gc, CoordModeOrigin, 3, points);
+    assert(test_same_pixmap(copy, xor));
+    FreeScratchGC(gc);
+}
+
+static void
+wl_bench(void)
+{
+    PixmapPtr pixmap = test_make_pixmap(&screen, WIDTH, HEIGHT, 24, 32);
+    GCPtr gc = GetScratchGC(24, &screen);
+    DDXPointRec points[BENCH_POINTS];
+    ChangeGCVal vals[2];
+    uint64_t start, elapsed;
+    int i, j, x, y;
+
+    assert(gc);
+    vals[0].val = 0x123456;
+    vals[1].val = 2;
+    assert(ChangeGC(NullClient, gc, GCForeground | GCLineWidth,
+                    vals) == Success);
+    wl_set_alu(pixmap, gc, GXxor);
+
+    start = now_ns();
+    for (i = 0; i < BENCH_LINES; i++) {
+        x = rand() % (WIDTH - 60);
+        y = rand() % (HEIGHT - 60);
+        for (j = 0; j < BENCH_POINTS; j++) {
+            points[j].x = x + rand() % 60;
+            points[j].y = y + rand() % 60;
+        }
+        miPolylines(&pixmap->drawable, gc, CoordModeOrigin,
+                    BENCH_POINTS, points);
+    }
+    elapsed = now_ns() - start;
+
+    printf("2px GXxor polylines of %d points: %.2f us/polyline\n",
+           BENCH_POINTS, (double) elapsed / BENCH_LINES / 1000);
+    FreeScratchGC(gc);
+}
+
+int
+main(int argc, char **argv)
+{
+    bench_init(argc, argv);
+    test_init_fb_screen(&screen);
+
+    wl_conformance(LineSolid);
+    wl_conformance(LineOnOffDash);
+    wl_far_edge();
+    if (benchmarking)
+        wl_bench();
+
+    return 0;
+}
@@ -0,0 +1,268 @@
+/*
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice (including the next
+ *  paragraph) shall be included in all copies or substantial portions of the
+ *  Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ *  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include "misc.h"
+#include "windowstr.h"
+#include "scrnintstr.h"
+#include "mi.h"
+#include "tests-common.h"
+
+/*
+ * Hit testing among many siblings, the way a large Java or Electron UI
+ * stacks override-redirect and child windows.  Checks that
+ * ChildWindowAtPoint finds the same window as walking the siblings while
+ * children are mapped, unmapped, moved and restacked underneath the
+ * index, including from inside mi's move and resize.  With --bench,
+ * also prints the average lookup time against the child count.
+ */
+
+#define PARENT_WIDTH 1920
+#define PARENT_HEIGHT 1080
+#define MAX_CHILDREN 2048
+#define LOOKUPS 200000
+#define POINTS 2000
+
+static ScreenRec screen;
+static WindowRec parent;
+static WindowOptRec parentOpt;
+static WindowRec children[MAX_CHILDREN];
+static int positioned;
+
+static void
+place_child(WindowPtr pWin)
+{
+    int bw = rand() % 3;
+
+    pWin->borderWidth = bw;
+    pWin->drawable.width = 1 + rand() % 300;
+    pWin->drawable.height = 1 + rand() % 200;
+    /* some stick out of the parent */
+    pWin->origin.x = rand() % (PARENT_WIDTH + 100) - 50 + bw;
+    pWin->origin.y = rand() % (PARENT_HEIGHT + 100) - 50 + bw;
+    pWin->drawable.x = parent.drawable.x + pWin->origin.x;
+    pWin->drawable.y = parent.drawable.y + pWin->origin.y;
+}
+
+static void
+append_child(WindowPtr pWin)
+{
+    pWin->parent = &parent;
+    pWin->prevSib = parent.lastChild;
+    pWin->nextSib = NULL;
+    if (parent.lastChild)
+        parent.lastChild->nextSib = pWin;
+    else
+        parent.firstChild = pWin;
+    parent.lastChild = pWin;
+}
+
+static void
+unlink_child(WindowPtr pWin)
+{
+    if (pWin->prevSib)
+        pWin->prevSib->nextSib = pWin->nextSib;
+    else
+        parent.firstChild = pWin->nextSib;
+    if (pWin->nextSib)
+        pWin->nextSib->prevSib = pWin->prevSib;
+    else
+        parent.lastChild = pWin->prevSib;
+}
+
+static void
+raise_child(WindowPtr pWin)
+{
+    unlink_child(pWin);
+    pWin->prevSib = NULL;
+    pWin->nextSib = parent.firstChild;
+    if (parent.firstChild)
+        parent.firstChild->prevSib = pWin;
+    else
+        parent.lastChild = pWin;
+    parent.firstChild = pWin;
+    WindowIndexInvalidate(&parent);
+}
+
+static WindowPtr
+walk_siblings(int x, int y)
+{
+    WindowPtr pWin;
+
+    for (pWin = parent.firstChild; pWin; pWin = pWin->nextSib) {
+        int bw = wBorderWidth(pWin);
+
+        if (pWin->mapped &&
+            x >= pWin->drawable.x - bw &&
+            x < pWin->drawable.x + (int) pWin->drawable.width + bw &&
+            y >= pWin->drawable.y - bw &&
+            y < pWin->drawable.y + (int) pWin->drawable.height + bw)
+            return pWin;
+    }
+    return NULL;
+}
+
+static void
+check_points(void)
+{
+    int i, x, y;
+
+    for (i = 0; i < POINTS; i++) {
+        x = parent.drawable.x + rand() % (PARENT_WIDTH + 40) - 20;
+        y = parent.drawable.y + rand() % (PARENT_HEIGHT + 40) - 20;
+        assert(ChildWindowAtPoint(&parent, x, y) == walk_siblings(x, y));
+    }
+}
+
+/*
+ * mi positions the window before the restructure looks up the pointer's
+ * window again, so the index has to be up to date by then.
+ */
+static Bool
+position_window(WindowPtr pWin, int x, int y)
+{
+    check_points();
+    positioned++;
+    return TRUE;
+}
+
+static void
+lookup_bench(int nchildren)
+{
+    uint64_t start, elapsed;
+    int i;
+
+    start = now_ns();
+    for (i = 0; i < LOOKUPS; i++)
+        ChildWindowAtPoint(&parent,
+                           parent.drawable.x + (i * 7919U) % PARENT_WIDTH,
+                           parent.drawable.y + (i * 104729U) % PARENT_HEIGHT);
+    elapsed = now_ns() - start;
+
+    printf("%4d children: %6.1f ns/lookup\n", nchildren,
+           (double) elapsed / LOOKUPS);
+}
+
+static void
+window_index(void)
+{
+    WindowPtr pWin;
+    int i, n;
+
+    screen.PositionWindow = position_window;
+    parent.drawable.pScreen = &screen;
+    parent.optional = &parentOpt;
+    parent.drawable.x = 100;
+    parent.drawable.y = 50;
+    parent.drawable.width = PARENT_WIDTH;
+    parent.drawable.height = PARENT_HEIGHT;
+
+    for (n = 0; n < MAX_CHILDREN; n++) {
+        pWin = &children[n];
+        pWin->drawable.pScreen = &screen;
+        place_child(pWin);
+        pWin->mapped = rand() % 4 != 0;
+        append_child(pWin);
+        WindowIndexInvalidate(&parent);
+
+        if (n + 1 == 8 || n + 1 == 64 || n + 1 == 512 ||
+            n + 1 == MAX_CHILDREN) {
+            check_points();
+            if (benchmarking)
+                lookup_bench(n + 1);
+        }
+    }
+    assert(parentOpt.childIndex != NULL);
+
+    /* Changes the index follows as they happen */
+    for (i = 0; i < 2000; i++) {
+        pWin = &children[rand() % MAX_CHILDREN];
+        switch (rand() % 3) {
+        case 0:
+            pWin->mapped = !pWin->mapped;
+            break;
+        default:
+            place_child(pWin);
+            break;
+        }
+        WindowIndexUpdate(pWin);
+        if (i % 100 == 0)
+            check_points();
+    }
+    check_points();
+
+    /* Moves and resizes through mi */
+    for (i = 0; i < 50; i++) {
+        pWin = &children[rand() % MAX_CHILDREN];
+        pWin->mapped = TRUE;
+        WindowIndexUpdate(pWin);
+        if (i % 2)
+            miMoveWindow(pWin, rand() % PARENT_WIDTH - 50,
+                         rand() % PARENT_HEIGHT - 50, pWin->nextSib, VTMove);
+        else
+            miResizeWindow(pWin, rand() % PARENT_WIDTH - 50,
+                           rand() % PARENT_HEIGHT - 50,
+                           1 + rand() % 300, 1 + rand() % 200, pWin->nextSib);
+        miChangeBorderWidth(pWin, rand() % 3);
+        check_points();
+    }
+    assert(positioned == 50);
+
+    /* Restacking only marks it stale */
+    for (i = 0; i < 50; i++) {
+        raise_child(&children[rand() % MAX_CHILDREN]);
+        check_points();
+    }
+
+    /* The parent moving doesn't matter, it growing rebuilds the grid */
+    parent.drawable.x = -300;
+    parent.drawable.y = 20;
+    for (pWin = parent.firstChild; pWin; pWin = pWin->nextSib) {
+        pWin->drawable.x = parent.drawable.x + pWin->origin.x;
+        pWin->drawable.y = parent.drawable.y + pWin->origin.y;
+    }
+    check_points();
+    parent.drawable.width = PARENT_WIDTH * 2;
+    check_points();
+
+    /* Down to a few children, the index goes away */
+    while (parent.firstChild != parent.lastChild) {
+        unlink_child(parent.lastChild);
+        WindowIndexInvalidate(&parent);
+    }
+    check_points();
+    assert(parentOpt.childIndex == NULL);
+}
+
+int
+main(int argc, char **argv)
+{
+    bench_init(argc, argv);
+
+    window_index();
+
+    return 0;
+}
@@ -391,9 +391,9 @@ ProcXFixesGetCursorImage(ClientPtr client)
         swapl(&rep->cursorSerial);
         SwapLongs(image, npixels);
     }
-    WriteToClient(client,
-                  sizeof(xXFixesGetCursorImageReply) + (npixels << 2), rep);
-    free(rep);
+    WriteToClientRef(client,
+                     sizeof(xXFixesGetCursorImageReply) + (npixels << 2), rep,
+                     free, rep);
     return Success;
 }
 
@@ -548,9 +548,8 @@ ProcXFixesGetCursorImageAndName(ClientPtr client)
         swaps(&rep->nbytes);
         SwapLongs(image, npixels);
     }
-    WriteToClient(client, sizeof(xXFixesGetCursorImageAndNameReply) +
-                  (npixels << 2) + nbytesRound, rep);
-    free(rep);
+    WriteToClientRef(client, sizeof(xXFixesGetCursorImageAndNameReply) +
+                     (npixels << 2) + nbytesRound, rep, free, rep);
     return Success;
 }
 